@@ -23,35 +23,191 @@
 #include <glib.h>
 #include <string.h>
 
-#include "git-reader.h"
+#include "git-blame-backend.h"
 #include "git-commit.h"
 #include "git-commit-bag.h"
 #include "git-common.h"
+#include "git-line-diff.h"
+#include "git-marshal.h"
+#include "git-object-db.h"
+#include "git-reader.h"
 
 static void git_annotated_source_dispose (GObject *object);
 static void git_annotated_source_finalize (GObject *object);
 
 static void
-git_annotated_source_on_reader_completed (GitReader *reader,
-                                          const GError *error,
-                                          GitAnnotatedSource *source);
-static gboolean
-git_annotated_source_on_line (GitReader *reader,
-                              guint length, const gchar *str,
+git_annotated_source_on_backend_completed (GitBlameBackend *backend,
+                                           const GError *error,
+                                           GitAnnotatedSource *source);
+static void
+git_annotated_source_on_hunk (GitBlameBackend *backend,
+                              const GitBlameHunk *hunk,
                               GitAnnotatedSource *source);
+static gboolean
+git_annotated_source_start_text (GitAnnotatedSource *source,
+                                 GFile *file,
+                                 const gchar *relative_file,
+                                 const gchar *revision,
+                                 GError **error);
+static void git_annotated_source_configure_pass (GitAnnotatedSource *source);
+static gboolean git_annotated_source_apply_hunk (GitAnnotatedSource *source,
+                                                 const GitBlameHunk *hunk);
+static void git_annotated_source_prefetch_commits (GitAnnotatedSource *source);
 
 typedef struct
 {
-  GitReader *reader;
+  GitBlameBackend *backend;
   guint completed_handler;
-  guint line_handler;
+  guint hunk_handler;
 
   GArray *lines;
-  GitAnnotatedSourceLine current_line;
+  gsize text_size;
+  /* Hash of the text of each line for mapping positions between
+     sources. This is made when it is first needed and is thrown away
+     whenever the text changes. */
+  guint64 *line_hashes;
+  guint n_line_hashes;
+  gboolean completed;
+  gboolean prefetch_commits;
+
+  /* The text is fetched before the blame is started because it only
+     takes a moment, so it can be shown while the blame is running and
+     the file can be checked to see if it is worth blaming at all */
+  GitReader *text_reader;
+  guint text_completed_handler;
+  guint text_line_handler;
+  GCancellable *text_cancellable;
+  GPtrArray *text_lines;
+  gboolean text_loaded;
+  /* Number of lines in the text that was loaded. Until the blame
+     completes only these lines are reported. */
+  guint n_text_lines;
+  /* Used while parsing the output of git cat-file --batch */
+  gboolean text_header_read;
+  guint64 text_bytes_left;
+  /* Number of bytes at the start of the file that have been checked
+     for a binary file */
+  gsize text_bytes_checked;
+
+  /* Files that are bigger than this or that look like they are binary
+     are not blamed unless the guard action says otherwise. A
+     max_size of zero means there’s no limit. */
+  guint64 max_size;
+  gboolean check_binary;
+  GitAnnotatedSourceGuardAction guard_action;
+  /* Whether the file was too big so the blame only looks at the
+     recent history */
+  gboolean shallow;
+
+  /* Number of lines covered by the hunks so far */
+  guint n_blamed_lines;
+  /* Number of lines that have a commit. The hunks can come in any
+     order so this can be less than n_blamed_lines. */
+  guint n_attributed_lines;
+  /* Monotonic time of the last progress signal */
+  gint64 last_progress_time;
+  /* Whether the blame disagreed with the text that was already
+     reported, which can happen if the working copy changes */
+  gboolean text_mismatch;
+
+  /* When the blame is progressive the first pass only looks at recent
+     history and then more passes are run with a deeper history until
+     no lines are on a boundary. After that there can be a pass to
+     detect copied lines. Each pass replaces the attribution of the
+     previous one. */
+  gboolean progressive;
+  gboolean detect_copies;
+  gboolean refining;
+  guint pass;
+  gboolean copies_pass;
+  /* The hunks of a refining pass are kept aside until the pass has
+     finished and covered every line. That way a pass that fails part
+     of the way through doesn’t leave a mix of old and new
+     attribution. */
+  GArray *pass_hunks;
+  guint8 *pass_covered;
+  guint n_pass_covered;
+  gboolean pass_mismatch;
+  gchar *relative_file;
+  gchar *revision;
+
+  /* For a source made by git_annotated_source_new_edited(), the blame
+     that the edits were compared with and how many lines differ from
+     it */
+  GitAnnotatedSource *edited_from;
+  guint n_edited_lines;
 
   GFile *repo;
 } GitAnnotatedSourcePrivate;
 
+/* Minimum number of microseconds between progress signals so that
+   they don’t slow down a fast blame */
+#define GIT_ANNOTATED_SOURCE_PROGRESS_INTERVAL (G_USEC_PER_SEC / 10)
+
+/* Default size limit before a file is considered too big to blame */
+#define GIT_ANNOTATED_SOURCE_DEFAULT_MAX_SIZE (8 * 1024 * 1024)
+
+/* Number of bytes at the start of a file to look in for a zero byte.
+   This is the same amount that git itself checks. */
+#define GIT_ANNOTATED_SOURCE_BINARY_CHECK_SIZE 8000
+
+/* Number of days of history that each pass of a progressive blame
+   looks at. Zero means the whole history. */
+static const guint
+git_annotated_source_pass_days[] = { 90, 365, 4 * 365, 0 };
+
+/* Gets the size limit and what to do with files that go over it
+   when nothing else has been asked for. These can be overridden by
+   setting BLAME_BROWSE_MAX_SIZE in the environment to a number of
+   bytes, where zero means no limit, and BLAME_BROWSE_LARGE_FILES to
+   ‘refuse’, ‘ask’ or ‘shallow’. */
+static void
+git_annotated_source_get_default_guard (guint64 *max_size_out,
+                                        GitAnnotatedSourceGuardAction *action_out)
+{
+  static guint64 max_size;
+  static GitAnnotatedSourceGuardAction action;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      const gchar *env = g_getenv ("BLAME_BROWSE_MAX_SIZE");
+
+      max_size = GIT_ANNOTATED_SOURCE_DEFAULT_MAX_SIZE;
+
+      if (env && *env)
+        {
+          guint64 value;
+
+          if (g_ascii_string_to_unsigned (env, 10, 0, G_MAXUINT64,
+                                          &value, NULL))
+            max_size = value;
+          else
+            g_warning ("Invalid maximum size “%s”", env);
+        }
+
+      env = g_getenv ("BLAME_BROWSE_LARGE_FILES");
+
+      action = GIT_ANNOTATED_SOURCE_GUARD_ASK;
+
+      if (env == NULL || *env == '\0')
+        ;
+      else if (!strcmp (env, "refuse"))
+        action = GIT_ANNOTATED_SOURCE_GUARD_REFUSE;
+      else if (!strcmp (env, "ask"))
+        action = GIT_ANNOTATED_SOURCE_GUARD_ASK;
+      else if (!strcmp (env, "shallow"))
+        action = GIT_ANNOTATED_SOURCE_GUARD_SHALLOW;
+      else
+        g_warning ("Unsupported action for large files “%s”", env);
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  *max_size_out = max_size;
+  *action_out = action;
+}
+
 G_DEFINE_TYPE_WITH_PRIVATE (GitAnnotatedSource,
                             git_annotated_source,
                             G_TYPE_OBJECT);
@@ -59,6 +215,10 @@ G_DEFINE_TYPE_WITH_PRIVATE (GitAnnotatedSource,
 enum
   {
     COMPLETED,
+    TEXT_CHANGED,
+    ATTRIBUTION_CHANGED,
+    REFINING_CHANGED,
+    PROGRESS,
 
     LAST_SIGNAL
   };
@@ -82,6 +242,54 @@ git_annotated_source_class_init (GitAnnotatedSourceClass *klass)
                     g_cclosure_marshal_VOID__POINTER,
                     G_TYPE_NONE, 1,
                     G_TYPE_POINTER);
+
+  /* Emitted when the text of the lines is first known, which is
+     usually long before the blame finishes, and again if the blame
+     ends up with different text */
+  client_signals[TEXT_CHANGED]
+    = g_signal_new ("text-changed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitAnnotatedSourceClass, text_changed),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__VOID,
+                    G_TYPE_NONE, 0);
+
+  /* Emitted when more of the lines have been blamed after the text
+     has been reported or when a later pass changes the attribution */
+  client_signals[ATTRIBUTION_CHANGED]
+    = g_signal_new ("attribution-changed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitAnnotatedSourceClass,
+                                     attribution_changed),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__VOID,
+                    G_TYPE_NONE, 0);
+
+  /* Emitted now and then while the first pass is running. See
+     git_annotated_source_get_progress. */
+  client_signals[PROGRESS]
+    = g_signal_new ("progress",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitAnnotatedSourceClass, progress),
+                    NULL, NULL,
+                    _git_marshal_VOID__UINT_UINT,
+                    G_TYPE_NONE, 2,
+                    G_TYPE_UINT,
+                    G_TYPE_UINT);
+
+  /* Emitted when git_annotated_source_get_refining changes */
+  client_signals[REFINING_CHANGED]
+    = g_signal_new ("refining-changed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitAnnotatedSourceClass,
+                                     refining_changed),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__VOID,
+                    G_TYPE_NONE, 0);
 }
 
 static void
@@ -90,53 +298,158 @@ git_annotated_source_init (GitAnnotatedSource *self)
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (self);
 
-  priv->reader = git_reader_new ();
+  priv->backend
+    = git_blame_backend_new (git_blame_backend_get_default_type ());
 
   priv->completed_handler
-    = g_signal_connect (priv->reader, "completed",
-                        G_CALLBACK (git_annotated_source_on_reader_completed),
+    = g_signal_connect (priv->backend, "completed",
+                        G_CALLBACK (git_annotated_source_on_backend_completed),
                         self);
 
-  priv->line_handler
-    = g_signal_connect (priv->reader, "line",
-                        G_CALLBACK (git_annotated_source_on_line),
+  priv->hunk_handler
+    = g_signal_connect (priv->backend, "hunk",
+                        G_CALLBACK (git_annotated_source_on_hunk),
                         self);
 
-  priv->lines = g_array_new (FALSE, FALSE, sizeof (GitAnnotatedSourceLine));
-  priv->current_line.commit = NULL;
-  priv->current_line.text = NULL;
+  /* Lines that haven’t been reached yet are cleared to zero */
+  priv->lines = g_array_new (FALSE, TRUE, sizeof (GitAnnotatedSourceLine));
+
+  git_annotated_source_get_default_guard (&priv->max_size,
+                                          &priv->guard_action);
+  priv->check_binary = TRUE;
 }
 
 static void
-git_annotated_source_clear_lines (GitAnnotatedSource *source)
+git_annotated_source_forget_line_hashes (GitAnnotatedSource *source)
 {
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (source);
-  int i;
 
-  for (i = 0; i < priv->lines->len; i++)
+  g_free (priv->line_hashes);
+  priv->line_hashes = NULL;
+  priv->n_line_hashes = 0;
+}
+
+static void
+git_annotated_source_clear_pass (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  guint i;
+
+  if (priv->pass_hunks)
+    {
+      for (i = 0; i < priv->pass_hunks->len; i++)
+        {
+          GitBlameHunk *hunk
+            = &g_array_index (priv->pass_hunks, GitBlameHunk, i);
+
+          g_object_unref (hunk->commit);
+          if (hunk->previous_commit)
+            g_object_unref (hunk->previous_commit);
+        }
+
+      g_array_free (priv->pass_hunks, TRUE);
+      priv->pass_hunks = NULL;
+    }
+
+  g_free (priv->pass_covered);
+  priv->pass_covered = NULL;
+  priv->n_pass_covered = 0;
+  priv->pass_mismatch = FALSE;
+}
+
+static void
+git_annotated_source_truncate_lines (GitAnnotatedSource *source,
+                                     guint n_lines)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  guint i;
+
+  git_annotated_source_forget_line_hashes (source);
+
+  for (i = n_lines; i < priv->lines->len; i++)
     {
       GitAnnotatedSourceLine *line
         = &g_array_index (priv->lines, GitAnnotatedSourceLine, i);
 
-      g_object_unref (line->commit);
-      g_free (line->text);
+      if (line->commit)
+        g_object_unref (line->commit);
+      if (line->previous_commit)
+        g_object_unref (line->previous_commit);
+      if (line->text)
+        {
+          priv->text_size -= strlen (line->text) + 1;
+          g_free (line->text);
+        }
     }
 
-  g_array_set_size (priv->lines, 0);
+  if (n_lines < priv->lines->len)
+    g_array_set_size (priv->lines, n_lines);
+}
+
+static void
+git_annotated_source_stop_text (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
 
-  if (priv->current_line.commit)
+  /* Destroying the reader kills the process */
+  if (priv->text_reader)
     {
-      g_object_unref (priv->current_line.commit);
-      priv->current_line.commit = NULL;
+      g_signal_handler_disconnect (priv->text_reader,
+                                   priv->text_completed_handler);
+      g_signal_handler_disconnect (priv->text_reader,
+                                   priv->text_line_handler);
+      g_object_unref (priv->text_reader);
+      priv->text_reader = NULL;
     }
-  if (priv->current_line.text)
+
+  if (priv->text_cancellable)
+    {
+      g_cancellable_cancel (priv->text_cancellable);
+      g_object_unref (priv->text_cancellable);
+      priv->text_cancellable = NULL;
+    }
+
+  if (priv->text_lines)
     {
-      g_free (priv->current_line.text);
-      priv->current_line.text = NULL;
+      g_ptr_array_free (priv->text_lines, TRUE);
+      priv->text_lines = NULL;
     }
 }
 
+static void
+git_annotated_source_clear_lines (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  git_annotated_source_stop_text (source);
+  git_annotated_source_truncate_lines (source, 0);
+
+  priv->text_size = 0;
+  priv->completed = FALSE;
+  priv->text_loaded = FALSE;
+  priv->n_text_lines = 0;
+  priv->text_header_read = FALSE;
+  priv->text_bytes_left = 0;
+  priv->text_bytes_checked = 0;
+  priv->shallow = FALSE;
+  priv->n_blamed_lines = 0;
+  priv->n_attributed_lines = 0;
+  priv->last_progress_time = 0;
+  priv->text_mismatch = FALSE;
+
+  git_annotated_source_clear_pass (source);
+  priv->refining = FALSE;
+  priv->pass = 0;
+  priv->copies_pass = FALSE;
+  g_clear_pointer (&priv->relative_file, g_free);
+  g_clear_pointer (&priv->revision, g_free);
+}
+
 static void
 git_annotated_source_dispose (GObject *object)
 {
@@ -144,14 +457,18 @@ git_annotated_source_dispose (GObject *object)
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (self);
 
-  if (priv->reader)
+  if (priv->backend)
     {
-      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
-      g_signal_handler_disconnect (priv->reader, priv->line_handler);
-      g_object_unref (priv->reader);
-      priv->reader = NULL;
+      g_signal_handler_disconnect (priv->backend, priv->completed_handler);
+      g_signal_handler_disconnect (priv->backend, priv->hunk_handler);
+      g_object_unref (priv->backend);
+      priv->backend = NULL;
     }
 
+  git_annotated_source_stop_text (self);
+
+  g_clear_object (&priv->edited_from);
+
   G_OBJECT_CLASS (git_annotated_source_parent_class)->dispose (object);
 }
 
@@ -179,6 +496,173 @@ git_annotated_source_new (void)
   return self;
 }
 
+/* Returns the commit that git-blame uses for uncommitted changes */
+static GitCommit *
+git_annotated_source_get_uncommitted_commit (GitAnnotatedSource *base)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (base);
+  GitCommitBag *bag = git_commit_bag_get_default ();
+  GitOid zero_oid;
+  gchar *time_str;
+
+  memset (&zero_oid, 0, sizeof zero_oid);
+  /* The id is all zeros in the hash format of the repo */
+  zero_oid.len
+    = git_object_db_get_hash_len (git_commit_bag_get_object_db (bag,
+                                                                priv->repo));
+
+  GitCommit *commit
+    = g_object_ref (git_commit_bag_get_oid (bag, &zero_oid, priv->repo));
+
+  /* These are the same properties that the blame backends give it */
+  git_commit_set_prop (commit, "author", "Not Committed Yet");
+  git_commit_set_prop (commit, "author-mail", "<not.committed.yet>");
+  time_str = g_strdup_printf ("%" G_GINT64_FORMAT,
+                              g_get_real_time () / G_USEC_PER_SEC);
+  git_commit_set_prop (commit, "author-time", time_str);
+  g_free (time_str);
+
+  return commit;
+}
+
+/* Creates a completed source for a new version of the working copy
+   without running git again. The lines that are the same as in the
+   base source keep its attribution and the rest are blamed on the
+   uncommitted changes. The base should be a blame of the working
+   copy. If it was itself made by this function then the new text is
+   compared with the blame that it came from instead so that
+   git_annotated_source_get_n_edited_lines() counts all of the edits
+   since then. */
+GitAnnotatedSource *
+git_annotated_source_new_edited (GitAnnotatedSource *base,
+                                 const gchar *contents,
+                                 gsize length)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (base), NULL);
+  g_return_val_if_fail (contents != NULL || length == 0, NULL);
+
+  GitAnnotatedSourcePrivate *base_priv =
+    git_annotated_source_get_instance_private (base);
+
+  if (base_priv->edited_from)
+    {
+      base = base_priv->edited_from;
+      base_priv = git_annotated_source_get_instance_private (base);
+    }
+
+  g_return_val_if_fail (base_priv->completed, NULL);
+  g_return_val_if_fail (base_priv->repo != NULL, NULL);
+
+  GitAnnotatedSource *self = git_annotated_source_new ();
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (self);
+  GitCommit *uncommitted = git_annotated_source_get_uncommitted_commit (base);
+  const gchar *p = contents, *end = contents + length;
+  GPtrArray *texts = g_ptr_array_new ();
+  const gchar **base_texts;
+  const GitAnnotatedSourceLine *base_line;
+  GitCommit *previous_commit = NULL;
+  const gchar *previous_path = NULL;
+  GitAnnotatedSourceLine line;
+  GArray *matches;
+  guint i, j, n_base_lines = base_priv->lines->len, n_matched_lines = 0;
+
+  /* The lines keep their newlines like the lines from a blame */
+  while (p < end)
+    {
+      const gchar *eol = memchr (p, '\n', end - p);
+      const gchar *next = eol ? eol + 1 : end;
+
+      g_ptr_array_add (texts, g_strndup (p, next - p));
+      p = next;
+    }
+
+  base_texts = g_new (const gchar *, MAX (n_base_lines, 1));
+  for (i = 0; i < n_base_lines; i++)
+    {
+      base_line = &g_array_index (base_priv->lines, GitAnnotatedSourceLine, i);
+      base_texts[i] = base_line->text;
+
+      /* New changes come before the same version as any uncommitted
+         changes that the base already had */
+      if (base_line->commit == uncommitted && base_line->previous_commit)
+        {
+          previous_commit = base_line->previous_commit;
+          previous_path = base_line->previous_path;
+        }
+    }
+
+  matches = git_line_diff_strings (base_texts, n_base_lines,
+                                   (const gchar * const *) texts->pdata,
+                                   texts->len,
+                                   0 /* max_cost */);
+
+  g_free (base_texts);
+
+  /* Start with everything uncommitted and then copy over the
+     attribution of the matching lines */
+  for (i = 0; i < texts->len; i++)
+    {
+      line.commit = g_object_ref (uncommitted);
+      line.orig_line = line.final_line = i + 1;
+      line.text = g_ptr_array_index (texts, i);
+      line.previous_commit = (previous_commit
+                              ? g_object_ref (previous_commit)
+                              : NULL);
+      line.previous_path = previous_path;
+      line.boundary = FALSE;
+      priv->text_size += strlen (line.text) + 1;
+      g_array_append_val (priv->lines, line);
+    }
+
+  for (i = 0; i < matches->len; i++)
+    {
+      const GitLineDiffMatch *match
+        = &g_array_index (matches, GitLineDiffMatch, i);
+
+      for (j = 0; j < match->n_lines; j++)
+        {
+          const GitAnnotatedSourceLine *from
+            = &g_array_index (base_priv->lines,
+                              GitAnnotatedSourceLine,
+                              match->a_line + j);
+          GitAnnotatedSourceLine *to
+            = &g_array_index (priv->lines,
+                              GitAnnotatedSourceLine,
+                              match->b_line + j);
+
+          g_object_unref (to->commit);
+          if (to->previous_commit)
+            g_object_unref (to->previous_commit);
+          to->commit = g_object_ref (from->commit);
+          to->orig_line = from->orig_line;
+          to->previous_commit = (from->previous_commit
+                                 ? g_object_ref (from->previous_commit)
+                                 : NULL);
+          to->previous_path = from->previous_path;
+          to->boundary = from->boundary;
+        }
+
+      n_matched_lines += match->n_lines;
+    }
+
+  /* Count both the added and the removed lines */
+  priv->n_edited_lines = (n_base_lines - n_matched_lines
+                          + texts->len - n_matched_lines);
+  priv->edited_from = g_object_ref (base);
+
+  g_array_free (matches, TRUE);
+  g_ptr_array_free (texts, TRUE);
+  g_object_unref (uncommitted);
+
+  priv->repo = g_object_ref (base_priv->repo);
+  priv->completed = TRUE;
+  priv->text_loaded = TRUE;
+
+  return self;
+}
+
 const GitAnnotatedSourceLine *
 git_annotated_source_get_line (GitAnnotatedSource *source,
                                gsize line_num)
@@ -201,42 +685,163 @@ git_annotated_source_get_n_lines (GitAnnotatedSource *source)
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (source);
 
-  return priv->lines->len;
+  if (priv->completed)
+    return priv->lines->len;
+  else
+    return MIN (priv->lines->len, priv->n_text_lines);
 }
 
 gboolean
-git_annotated_source_fetch (GitAnnotatedSource *source,
-                            GFile *file,
-                            const gchar *revision,
-                            GError **error)
+git_annotated_source_get_completed (GitAnnotatedSource *source)
 {
-  gboolean ret;
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), FALSE);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return priv->completed;
+}
 
+/* Returns whether the text of the lines is known. Some of the lines
+   might not have been blamed yet. */
+gboolean
+git_annotated_source_get_text_loaded (GitAnnotatedSource *source)
+{
   g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (source);
 
-  g_return_val_if_fail (priv->reader != NULL, FALSE);
-  g_return_val_if_fail (file != NULL, FALSE);
+  return priv->text_loaded;
+}
 
-  git_annotated_source_clear_lines (source);
+/* Gets how far the first pass of the blame has got. n_lines is zero
+   if the number of lines isn’t known yet, which is only until the
+   text has loaded. */
+void
+git_annotated_source_get_progress (GitAnnotatedSource *source,
+                                   guint *n_attributed_lines,
+                                   guint *n_lines)
+{
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
 
-  GFile *repo = git_find_repo (file);
+  if (n_attributed_lines)
+    *n_attributed_lines = priv->n_attributed_lines;
+  if (n_lines)
+    *n_lines = priv->text_loaded ? MAX (priv->n_text_lines,
+                                        priv->n_attributed_lines) : 0;
+}
 
-  if (repo == NULL)
+/* Returns a rough estimate of the number of bytes used by the source
+   so that caches can decide when to throw it away */
+gsize
+git_annotated_source_get_memory_usage (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), 0);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return (priv->text_size
+          + priv->lines->len * (sizeof (GitAnnotatedSourceLine)
+                                + 2 * sizeof (gpointer))
+          + priv->n_line_hashes * sizeof (guint64));
+}
+
+/* Returns the hash of the text of each of the lines reported by
+   git_annotated_source_get_n_lines(). The hashes are kept until the
+   text changes so that mapping positions from a source again doesn’t
+   need to read all of its text. */
+const guint64 *
+git_annotated_source_get_line_hashes (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), NULL);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  guint n_lines = git_annotated_source_get_n_lines (source);
+  guint i;
+
+  if (priv->line_hashes == NULL || priv->n_line_hashes != n_lines)
     {
-      char *parse_name = g_file_get_parse_name (file);
+      g_free (priv->line_hashes);
+      priv->line_hashes = g_new (guint64, MAX (n_lines, 1));
+      priv->n_line_hashes = n_lines;
 
-      g_set_error (error, GIT_ERROR, GIT_ERROR_NO_REPO,
-                   "No repo found for %s", parse_name);
+      for (i = 0; i < n_lines; i++)
+        {
+          const gchar *text
+            = g_array_index (priv->lines, GitAnnotatedSourceLine, i).text;
 
-      g_free (parse_name);
+          if (text == NULL)
+            text = "";
 
-      return FALSE;
+          priv->line_hashes[i] = git_line_diff_hash (text, strlen (text));
+        }
+    }
+
+  return priv->line_hashes;
+}
+
+/* Returns the number of lines that were added or removed by the
+   edits for a source made by git_annotated_source_new_edited(), or
+   zero for any other source */
+guint
+git_annotated_source_get_n_edited_lines (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), 0);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return priv->n_edited_lines;
+}
+
+/* Returns the top of the working tree that the source was fetched
+   from or NULL if it hasn’t been found yet */
+GFile *
+git_annotated_source_get_repo (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), NULL);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return priv->repo;
+}
+
+static void
+git_annotated_source_on_repo_found (GObject *object,
+                                    GAsyncResult *result,
+                                    gpointer user_data)
+{
+  GitAnnotatedSource *source = user_data;
+  GFile *file = G_FILE (object);
+  GError *error = NULL;
+  GFile *repo = git_find_repo_finish (file, result, &error);
+
+  if (repo == NULL)
+    {
+      /* The source might have been destroyed if it was cancelled */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          git_annotated_source_stop_text (source);
+          g_signal_emit (source, client_signals[COMPLETED], 0, error);
+        }
+
+      g_error_free (error);
+      return;
     }
 
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  /* Loading the text makes its own cancellable if it needs one */
+  g_clear_object (&priv->text_cancellable);
+
   if (priv->repo)
     g_object_unref (priv->repo);
   priv->repo = repo;
@@ -247,168 +852,1087 @@ git_annotated_source_fetch (GitAnnotatedSource *source,
     {
       char *parse_name = g_file_get_parse_name (file);
 
-      g_set_error (error,
+      g_set_error (&error,
                    G_FILE_ERROR,
                    G_FILE_ERROR_NOENT,
                    "Couldn’t convert %s to relative path",
                    parse_name);
 
       g_free (parse_name);
-
-      return FALSE;
     }
+  else
+    {
+      /* Remember what to blame for the later passes */
+      priv->relative_file = relative_file;
 
-  /* Revision can be NULL in which case it will terminate the argument
-     list early and git will include uncommitted changes */
-  ret = git_reader_start (priv->reader, repo, error, "blame", "-p",
-                          relative_file, revision, NULL);
-
-  g_free (relative_file);
+      /* The blame is started once the text has been checked */
+      git_annotated_source_start_text (source,
+                                       file, relative_file, priv->revision,
+                                       &error);
+    }
 
-  return ret;
+  if (error)
+    {
+      g_signal_emit (source, client_signals[COMPLETED], 0, error);
+      g_error_free (error);
+    }
 }
 
-static void
-git_annotated_source_parse_error (GitAnnotatedSource *source)
+/* Starts blaming the file. The repo is found and the file is loaded
+   in the background so errors are reported with the completed
+   signal. */
+gboolean
+git_annotated_source_fetch (GitAnnotatedSource *source,
+                            GFile *file,
+                            const gchar *revision,
+                            GError **error)
 {
-  GError *error = NULL;
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  g_set_error (&error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
-               "Invalid data from git-blame received");
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
 
-  g_signal_emit (source, client_signals[COMPLETED], 0, error);
+  g_return_val_if_fail (priv->backend != NULL, FALSE);
+  g_return_val_if_fail (file != NULL, FALSE);
 
-  g_error_free (error);
+  git_annotated_source_clear_lines (source);
+
+  priv->revision = g_strdup (revision);
+
+  /* This is cancelled along with loading the text */
+  priv->text_cancellable = g_cancellable_new ();
+
+  git_find_repo_async (file,
+                       priv->text_cancellable,
+                       git_annotated_source_on_repo_found,
+                       source);
+
+  return TRUE;
 }
 
-static void
-git_annotated_source_on_reader_completed (GitReader *reader,
-                                          const GError *error,
-                                          GitAnnotatedSource *source)
+/* Sets the size in bytes above which a file is not blamed without
+   following the guard action. Zero means there’s no limit. This needs
+   to be set before fetching. */
+void
+git_annotated_source_set_max_size (GitAnnotatedSource *source,
+                                   guint64 max_size)
 {
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (source);
 
-  /* If we've got a commit for the current line then we must be
-     missing the actual code for the line so the output is invalid */
-  if (priv->current_line.commit)
-    git_annotated_source_parse_error (source);
-  else
-    g_signal_emit (source, client_signals[COMPLETED], 0, error);
+  priv->max_size = max_size;
 }
 
-static gboolean
-git_annotated_source_on_line (GitReader *reader,
-                              guint length, const gchar *str,
-                              GitAnnotatedSource *source)
+/* Sets whether files with a zero byte near the start are treated as
+   binary files and not blamed without following the guard action.
+   This needs to be set before fetching. */
+void
+git_annotated_source_set_check_binary (GitAnnotatedSource *source,
+                                       gboolean check_binary)
 {
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
   GitAnnotatedSourcePrivate *priv =
     git_annotated_source_get_instance_private (source);
-  int i;
-  const gchar *p = str;
-  gboolean ret = TRUE;
 
-  /* If we haven't got a commit yet then we are expecting the first
-     line to be the commit hash followed by two or three numbers for
-     the lines */
-  if (priv->current_line.commit == NULL)
-    {
-      int nums[3];
+  priv->check_binary = check_binary;
+}
 
-      if (length < GIT_COMMIT_HASH_LENGTH)
-        {
-          git_annotated_source_parse_error (source);
-          ret = FALSE;
-        }
-      else
-        {
-          for (i = 0; i < GIT_COMMIT_HASH_LENGTH; i++, p++)
-            if ((*p < '0' || *p > '9') && (*p < 'a' || *p > 'f'))
-              break;
+void
+git_annotated_source_set_guard_action (GitAnnotatedSource *source,
+                                       GitAnnotatedSourceGuardAction action)
+{
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
 
-          length -= GIT_COMMIT_HASH_LENGTH;
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
 
-          if (i < GIT_COMMIT_HASH_LENGTH)
-            {
-              git_annotated_source_parse_error (source);
-              ret = FALSE;
-            }
-          else
-            {
-              for (i = 0; i < 3; i++)
-                {
-                  nums[i] = 0;
-                  if (length < 1 || *p != ' ')
-                    {
-                      git_annotated_source_parse_error (source);
-                      ret = FALSE;
-                      break;
-                    }
-                  length--;
-                  p++;
-                  while (length > 0 && *p >= '0' && *p <= '9')
-                    {
-                      nums[i] = nums[i] * 10 + *p - '0';
-                      length--;
-                      p++;
-                    }
-                  /* The last number is optional */
-                  if (i == 1 && length == 1 && *p == '\n')
-                    break;
-                }
+  priv->guard_action = action;
+}
 
-              if (ret)
-                {
-                  if (length != 1 || *p != '\n')
-                    {
-                      git_annotated_source_parse_error (source);
-                      ret = FALSE;
-                    }
-                  else
-                    {
-                      GitCommit *commit;
-                      GitCommitBag *commit_bag = git_commit_bag_get_default ();
-                      gchar *hash = g_strndup (str, GIT_COMMIT_HASH_LENGTH);
-
-                      commit = git_commit_bag_get (commit_bag, hash,
-                                                   priv->repo);
-                      g_free (hash);
-
-                      priv->current_line.commit = g_object_ref (commit);
-                      priv->current_line.orig_line = nums[0];
-                      priv->current_line.final_line = nums[1];
-                    }
-                }
-            }
+GitAnnotatedSourceGuardAction
+git_annotated_source_get_guard_action (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source),
+                        GIT_ANNOTATED_SOURCE_GUARD_REFUSE);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return priv->guard_action;
+}
+
+/* Sets whether the blame should first only look at recent history so
+   that the lines that changed recently are known quickly. Older lines
+   are marked as a boundary until later passes with a deeper history
+   find where they really came from. This only has an effect if the
+   blame backend can limit the history and it needs to be set before
+   fetching. */
+void
+git_annotated_source_set_progressive (GitAnnotatedSource *source,
+                                      gboolean progressive)
+{
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  priv->progressive = progressive;
+}
+
+/* Sets whether a final pass should be run once the blame has
+   completed to follow lines that were moved or copied from elsewhere.
+   Until then the lines are blamed on the commit that moved them. This
+   only has an effect if the blame backend supports it and it needs to
+   be set before fetching. */
+void
+git_annotated_source_set_detect_copies (GitAnnotatedSource *source,
+                                        gboolean detect_copies)
+{
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  priv->detect_copies = detect_copies;
+}
+
+/* Returns whether the blame has completed but more passes are still
+   running in the background to improve it */
+gboolean
+git_annotated_source_get_refining (GitAnnotatedSource *source)
+{
+  g_return_val_if_fail (GIT_IS_ANNOTATED_SOURCE (source), FALSE);
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  return priv->refining;
+}
+
+static void
+git_annotated_source_set_refining (GitAnnotatedSource *source,
+                                   gboolean refining)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (priv->refining == refining)
+    return;
+
+  priv->refining = refining;
+
+  g_signal_emit (source, client_signals[REFINING_CHANGED], 0);
+}
+
+/* Sets up the backend for the current pass */
+static void
+git_annotated_source_configure_pass (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (git_blame_backend_can_limit_history (priv->backend))
+    {
+      gint64 since = 0;
+
+      if (priv->shallow)
+        since = (g_get_real_time () / G_USEC_PER_SEC
+                 - git_annotated_source_pass_days[0] * (gint64) (24 * 60 * 60));
+      else if (priv->progressive && !priv->copies_pass)
+        {
+          guint days = git_annotated_source_pass_days[priv->pass];
+
+          if (days > 0)
+            since = (g_get_real_time () / G_USEC_PER_SEC
+                     - days * (gint64) (24 * 60 * 60));
         }
+
+      git_blame_backend_set_since (priv->backend, since);
     }
-  /* If this is the code of the line then it begins with a tab */
-  else if (length >= 1 && *str == '\t')
+
+  if (git_blame_backend_can_detect_copies (priv->backend))
+    git_blame_backend_set_detect_copies (priv->backend, priv->copies_pass);
+
+  /* Only the first pass is waited for */
+  git_blame_backend_set_priority (priv->backend,
+                                  priv->completed
+                                  ? G_PRIORITY_LOW
+                                  : G_PRIORITY_DEFAULT);
+}
+
+static gboolean
+git_annotated_source_has_boundary (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  guint i;
+
+  for (i = 0; i < priv->lines->len; i++)
     {
-      priv->current_line.text = g_strndup (str + 1, length - 1);
-      g_array_append_val (priv->lines, priv->current_line);
-      priv->current_line.commit = NULL;
-      priv->current_line.text = NULL;
+      if (g_array_index (priv->lines, GitAnnotatedSourceLine, i).boundary)
+        return TRUE;
     }
-  /* Otherwise it should be a key-value property pair */
+
+  return FALSE;
+}
+
+/* Starts the next pass in the background if there is one. Progressive
+   blames look further back in the history while there are lines on
+   the boundary and then the copies are detected over the whole
+   history. */
+static void
+git_annotated_source_refine (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  /* A shallow blame is all that is wanted for a file that is too big */
+  if (priv->backend == NULL || priv->copies_pass || priv->shallow)
+    goto done;
+
+  if (priv->progressive
+      && git_blame_backend_can_limit_history (priv->backend)
+      && priv->pass + 1 < G_N_ELEMENTS (git_annotated_source_pass_days)
+      && git_annotated_source_has_boundary (source))
+    priv->pass++;
+  else if (priv->detect_copies
+           && git_blame_backend_can_detect_copies (priv->backend))
+    priv->copies_pass = TRUE;
   else
+    goto done;
+
+  git_annotated_source_clear_pass (source);
+  priv->pass_hunks = g_array_new (FALSE, FALSE, sizeof (GitBlameHunk));
+  priv->pass_covered = g_new0 (guint8, MAX (priv->lines->len, 1));
+
+  git_annotated_source_configure_pass (source);
+
+  /* If it fails the blame that we already have is still usable */
+  if (!git_blame_backend_start (priv->backend,
+                                priv->repo,
+                                priv->relative_file,
+                                priv->revision,
+                                NULL /* error */))
+    goto done;
+
+  git_annotated_source_set_refining (source, TRUE);
+
+  return;
+
+ done:
+  git_annotated_source_clear_pass (source);
+  git_annotated_source_set_refining (source, FALSE);
+}
+
+static void
+git_annotated_source_refine_done (GitAnnotatedSource *source,
+                                  const GError *error)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  gboolean changed = FALSE;
+  guint i;
+
+  /* If this pass didn’t cover the same lines then the working copy
+     has probably changed so there’s no point in carrying on. The
+     attribution from the previous pass is kept as it was. */
+  if (error
+      || priv->pass_mismatch
+      || priv->n_pass_covered != priv->lines->len)
+    {
+      git_annotated_source_clear_pass (source);
+      git_annotated_source_set_refining (source, FALSE);
+      return;
+    }
+
+  for (i = 0; i < priv->pass_hunks->len; i++)
+    changed |= git_annotated_source_apply_hunk
+      (source, &g_array_index (priv->pass_hunks, GitBlameHunk, i));
+
+  git_annotated_source_clear_pass (source);
+
+  if (changed)
+    g_signal_emit (source, client_signals[ATTRIBUTION_CHANGED], 0);
+
+  if (priv->prefetch_commits)
+    git_annotated_source_prefetch_commits (source);
+
+  git_annotated_source_refine (source);
+}
+
+/* Sets whether the log data for all of the commits in the source
+   should be fetched in the background once the blame is complete.
+   That way the commit dialog can usually be shown without waiting. */
+void
+git_annotated_source_set_prefetch_commits (GitAnnotatedSource *source,
+                                           gboolean prefetch_commits)
+{
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  priv->prefetch_commits = prefetch_commits;
+}
+
+static void
+git_annotated_source_prefetch_commits (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GHashTable *seen = g_hash_table_new (NULL, NULL);
+  GPtrArray *commits = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < priv->lines->len; i++)
     {
-      const gchar *sep;
+      GitCommit *commit
+        = g_array_index (priv->lines, GitAnnotatedSourceLine, i).commit;
+
+      if (commit && g_hash_table_add (seen, commit))
+        g_ptr_array_add (commits, commit);
+    }
+
+  git_commit_fetch_log_data_batch (priv->repo,
+                                   (GitCommit * const *) commits->pdata,
+                                   commits->len,
+                                   G_PRIORITY_LOW);
+
+  g_ptr_array_free (commits, TRUE);
+  g_hash_table_destroy (seen);
+}
+
+static GitAnnotatedSourceLine *
+git_annotated_source_ensure_line (GitAnnotatedSource *source,
+                                  guint line_num)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (line_num >= priv->lines->len)
+    g_array_set_size (priv->lines, line_num + 1);
+
+  return &g_array_index (priv->lines, GitAnnotatedSourceLine, line_num);
+}
+
+static void
+git_annotated_source_finish (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GError *error = NULL;
+  guint i;
+
+  git_annotated_source_stop_text (source);
 
-      if (length > 1 && str[length - 1] == '\n')
-        length--;
+  /* The blame is what counts if the working copy changed after the
+     text was read */
+  git_annotated_source_truncate_lines (source, priv->n_blamed_lines);
 
-      if ((sep = memchr (str, ' ', length)))
+  if (priv->lines->len != priv->n_text_lines)
+    priv->text_mismatch = TRUE;
+
+  for (i = 0; i < priv->lines->len; i++)
+    {
+      const GitAnnotatedSourceLine *line
+        = &g_array_index (priv->lines, GitAnnotatedSourceLine, i);
+
+      if (line->commit == NULL || line->text == NULL)
+        break;
+    }
+
+  if (i < priv->lines->len)
+    {
+      g_set_error (&error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "The blame didn’t cover every line");
+
+      git_annotated_source_truncate_lines (source, 0);
+      g_signal_emit (source, client_signals[COMPLETED], 0, error);
+      g_error_free (error);
+
+      return;
+    }
+
+  gboolean text_changed = !priv->text_loaded || priv->text_mismatch;
+
+  priv->completed = TRUE;
+  priv->text_loaded = TRUE;
+  priv->n_text_lines = priv->lines->len;
+
+  if (text_changed)
+    g_signal_emit (source, client_signals[TEXT_CHANGED], 0);
+
+  if (priv->prefetch_commits)
+    git_annotated_source_prefetch_commits (source);
+
+  /* Start the next pass before reporting completion so that the
+     handlers can see that it is still refining */
+  git_annotated_source_refine (source);
+
+  g_signal_emit (source, client_signals[COMPLETED], 0, NULL);
+}
+
+/* Copies a line without its terminator and adds a newline in the same
+   way as the text from the blame so that they can be compared */
+static gchar *
+git_annotated_source_dup_line (const gchar *str, gsize length)
+{
+  gchar *text = g_malloc (length + 2);
+
+  memcpy (text, str, length);
+  text[length] = '\n';
+  text[length + 1] = '\0';
+
+  return text;
+}
+
+static void
+git_annotated_source_emit_progress (GitAnnotatedSource *source,
+                                    gboolean force)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  gint64 now = g_get_monotonic_time ();
+  guint n_attributed_lines, n_lines;
+
+  if (!force
+      && now - priv->last_progress_time
+      < GIT_ANNOTATED_SOURCE_PROGRESS_INTERVAL)
+    return;
+
+  priv->last_progress_time = now;
+
+  git_annotated_source_get_progress (source, &n_attributed_lines, &n_lines);
+
+  g_signal_emit (source, client_signals[PROGRESS], 0,
+                 n_attributed_lines, n_lines);
+}
+
+static void
+git_annotated_source_set_text (GitAnnotatedSource *source,
+                               GPtrArray *texts)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  guint i;
+
+  if (texts->len > 0)
+    git_annotated_source_ensure_line (source, texts->len - 1);
+
+  git_annotated_source_forget_line_hashes (source);
+
+  /* Lines that the blame has already given the text for are left
+     alone */
+  for (i = 0; i < texts->len; i++)
+    {
+      GitAnnotatedSourceLine *line
+        = &g_array_index (priv->lines, GitAnnotatedSourceLine, i);
+
+      if (line->text == NULL)
         {
-          gchar *key = g_strndup (str, sep - str);
-          gchar *value = g_strndup (sep + 1, str + length - sep - 1);
+          line->text = g_ptr_array_index (texts, i);
+          g_ptr_array_index (texts, i) = NULL;
+          priv->text_size += strlen (line->text) + 1;
+        }
+    }
+
+  priv->text_loaded = TRUE;
+  priv->n_text_lines = texts->len;
+
+  g_signal_emit (source, client_signals[TEXT_CHANGED], 0);
+
+  /* The total is known now */
+  git_annotated_source_emit_progress (source, TRUE);
+}
+
+/* Called when the file is too big or looks like a binary file.
+   Returns TRUE if it should be blamed anyway, otherwise it reports the
+   error and stops loading. */
+static gboolean
+git_annotated_source_guard (GitAnnotatedSource *source, GitError code)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GError *error = NULL;
+
+  /* A shallow blame doesn’t help with a binary file because it would
+     still look at every line */
+  if (code == GIT_ERROR_TOO_LARGE
+      && priv->guard_action == GIT_ANNOTATED_SOURCE_GUARD_SHALLOW
+      && git_blame_backend_can_limit_history (priv->backend))
+    {
+      priv->shallow = TRUE;
+      return TRUE;
+    }
+
+  git_annotated_source_stop_text (source);
+
+  if (code == GIT_ERROR_TOO_LARGE)
+    {
+      gchar *max_size = g_format_size (priv->max_size);
 
-          git_commit_set_prop (priv->current_line.commit, key, value);
+      g_set_error (&error, GIT_ERROR, code,
+                   "The file is bigger than the limit of %s", max_size);
 
-          g_free (key);
-          g_free (value);
+      g_free (max_size);
+    }
+  else
+    g_set_error (&error, GIT_ERROR, code,
+                 "The file looks like a binary file");
+
+  g_signal_emit (source, client_signals[COMPLETED], 0, error);
+  g_error_free (error);
+
+  return FALSE;
+}
+
+static gboolean
+git_annotated_source_check_size (GitAnnotatedSource *source, guint64 size)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (priv->max_size == 0 || size <= priv->max_size)
+    return TRUE;
+
+  return git_annotated_source_guard (source, GIT_ERROR_TOO_LARGE);
+}
+
+/* Looks for a zero byte in the next part of the start of the file in
+   the same way that git decides whether a file is binary. Returns
+   FALSE if it was found and the error has been reported. */
+static gboolean
+git_annotated_source_check_binary (GitAnnotatedSource *source,
+                                   const gchar *data,
+                                   gsize length)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (!priv->check_binary
+      || priv->text_bytes_checked >= GIT_ANNOTATED_SOURCE_BINARY_CHECK_SIZE)
+    return TRUE;
+
+  length = MIN (length,
+                GIT_ANNOTATED_SOURCE_BINARY_CHECK_SIZE
+                - priv->text_bytes_checked);
+  priv->text_bytes_checked += length;
+
+  if (memchr (data, '\0', length) == NULL)
+    return TRUE;
+
+  return git_annotated_source_guard (source, GIT_ERROR_BINARY);
+}
+
+static void
+git_annotated_source_start_blame (GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GError *error = NULL;
+
+  git_annotated_source_configure_pass (source);
+
+  if (!git_blame_backend_start (priv->backend,
+                                priv->repo,
+                                priv->relative_file,
+                                priv->revision,
+                                &error))
+    {
+      g_signal_emit (source, client_signals[COMPLETED], 0, error);
+      g_error_free (error);
+    }
+}
+
+static void
+git_annotated_source_text_done (GitAnnotatedSource *source,
+                                GPtrArray *texts,
+                                const GError *error)
+{
+  if (error)
+    {
+      g_signal_emit (source, client_signals[COMPLETED], 0, error);
+      return;
+    }
+
+  git_annotated_source_set_text (source, texts);
+  git_annotated_source_start_blame (source);
+}
+
+static void
+git_annotated_source_on_text_completed (GitReader *reader,
+                                        const GError *error,
+                                        GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GPtrArray *texts = priv->text_lines;
+  GError *header_error = NULL;
+
+  priv->text_lines = NULL;
+
+  if (error == NULL && !priv->text_header_read)
+    {
+      g_set_error (&header_error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Missing header from git cat-file");
+      error = header_error;
+    }
+
+  git_annotated_source_stop_text (source);
+  git_annotated_source_text_done (source, texts, error);
+
+  g_ptr_array_free (texts, TRUE);
+
+  if (header_error)
+    g_error_free (header_error);
+}
+
+/* Parses the line that git cat-file --batch writes before the object.
+   Returns FALSE if the object can’t be blamed and the error has been
+   reported. */
+static gboolean
+git_annotated_source_on_text_header (GitAnnotatedSource *source,
+                                     guint length, const gchar *str)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  gchar *header = g_strndup (str, length);
+  gchar **parts;
+  GError *error = NULL;
+  guint64 size;
+
+  g_strchomp (header);
+  parts = g_strsplit (header, " ", 0);
+
+  if (g_str_has_suffix (header, " missing") || g_strv_length (parts) != 3)
+    g_set_error (&error, GIT_ERROR, GIT_ERROR_NOT_FOUND,
+                 "%s doesn’t exist in %s",
+                 priv->relative_file, priv->revision);
+  else if (strcmp (parts[1], "blob"))
+    g_set_error (&error, GIT_ERROR, GIT_ERROR_NOT_FOUND,
+                 "%s isn’t a file in %s",
+                 priv->relative_file, priv->revision);
+  else if (!g_ascii_string_to_unsigned (parts[2], 10, 0, G_MAXUINT64,
+                                        &size, NULL))
+    g_set_error (&error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                 "Invalid header from git cat-file");
+
+  g_strfreev (parts);
+  g_free (header);
+
+  if (error)
+    {
+      git_annotated_source_stop_text (source);
+      g_signal_emit (source, client_signals[COMPLETED], 0, error);
+      g_error_free (error);
+
+      return FALSE;
+    }
+
+  priv->text_header_read = TRUE;
+  priv->text_bytes_left = size;
+
+  return git_annotated_source_check_size (source, size);
+}
+
+static gboolean
+git_annotated_source_on_text_line (GitReader *reader,
+                                   guint length, const gchar *str,
+                                   GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (!priv->text_header_read)
+    return git_annotated_source_on_text_header (source, length, str);
+
+  /* git adds a newline after the object. If the file doesn’t end with
+     a newline then this will be joined on to the last line. */
+  if (priv->text_bytes_left == 0)
+    return TRUE;
+  if (length > priv->text_bytes_left)
+    length = priv->text_bytes_left;
+  priv->text_bytes_left -= length;
+
+  if (!git_annotated_source_check_binary (source, str, length))
+    return FALSE;
+
+  if (length > 0 && str[length - 1] == '\n')
+    length--;
+
+  g_ptr_array_add (priv->text_lines,
+                   git_annotated_source_dup_line (str, length));
+
+  return TRUE;
+}
+
+static void
+git_annotated_source_on_contents_loaded (GObject *object,
+                                         GAsyncResult *result,
+                                         gpointer user_data)
+{
+  GitAnnotatedSource *source = user_data;
+  GError *error = NULL;
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_load_contents_finish (G_FILE (object), result,
+                                    &contents, &length,
+                                    NULL /* etag */,
+                                    &error))
+    {
+      /* The source might have been destroyed if it was cancelled */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          git_annotated_source_stop_text (source);
+          git_annotated_source_text_done (source, NULL, error);
         }
+
+      g_error_free (error);
+      return;
+    }
+
+  if (!git_annotated_source_check_binary (source, contents, length))
+    {
+      g_free (contents);
+      return;
     }
 
+  GPtrArray *texts = g_ptr_array_new_with_free_func (g_free);
+  const gchar *p = contents, *end = contents + length;
+
+  while (p < end)
+    {
+      const gchar *eol = memchr (p, '\n', end - p);
+      const gchar *next = eol ? eol + 1 : end;
+
+      g_ptr_array_add (texts,
+                       git_annotated_source_dup_line (p,
+                                                      (eol ? eol : end) - p));
+      p = next;
+    }
+
+  g_free (contents);
+
+  git_annotated_source_stop_text (source);
+  git_annotated_source_text_done (source, texts, NULL);
+
+  g_ptr_array_free (texts, TRUE);
+}
+
+static void
+git_annotated_source_on_info_queried (GObject *object,
+                                      GAsyncResult *result,
+                                      gpointer user_data)
+{
+  GitAnnotatedSource *source = user_data;
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GError *error = NULL;
+  GFileInfo *info;
+
+  info = g_file_query_info_finish (G_FILE (object), result, &error);
+
+  if (info == NULL)
+    {
+      /* The source might have been destroyed if it was cancelled */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          git_annotated_source_stop_text (source);
+          git_annotated_source_text_done (source, NULL, error);
+        }
+
+      g_error_free (error);
+      return;
+    }
+
+  /* Like git, a symlink is blamed as the path that it points to
+     rather than the contents of the file it points to */
+  if (g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK)
+    {
+      const gchar *target = g_file_info_get_symlink_target (info);
+      GPtrArray *texts = g_ptr_array_new_with_free_func (g_free);
+
+      if (target)
+        g_ptr_array_add (texts,
+                         git_annotated_source_dup_line (target,
+                                                        strlen (target)));
+
+      g_object_unref (info);
+
+      git_annotated_source_stop_text (source);
+      git_annotated_source_text_done (source, texts, NULL);
+
+      g_ptr_array_free (texts, TRUE);
+
+      return;
+    }
+
+  guint64 size = g_file_info_get_size (info);
+
+  g_object_unref (info);
+
+  if (!git_annotated_source_check_size (source, size))
+    return;
+
+  g_file_load_contents_async (G_FILE (object),
+                              priv->text_cancellable,
+                              git_annotated_source_on_contents_loaded,
+                              source);
+}
+
+/* Starts getting the text of the file either from the working copy or
+   from the object database. The size of the file is checked first so
+   that a huge file isn’t loaded just to find out it won’t be
+   blamed. */
+static gboolean
+git_annotated_source_start_text (GitAnnotatedSource *source,
+                                 GFile *file,
+                                 const gchar *relative_file,
+                                 const gchar *revision,
+                                 GError **error)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (revision == NULL)
+    {
+      priv->text_cancellable = g_cancellable_new ();
+      g_file_query_info_async (file,
+                               G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                               G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                               G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
+                               G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                               G_PRIORITY_DEFAULT,
+                               priv->text_cancellable,
+                               git_annotated_source_on_info_queried,
+                               source);
+      return TRUE;
+    }
+
+  priv->text_lines = g_ptr_array_new_with_free_func (g_free);
+  priv->text_reader = git_reader_new ();
+
+  priv->text_completed_handler
+    = g_signal_connect (priv->text_reader, "completed",
+                        G_CALLBACK (git_annotated_source_on_text_completed),
+                        source);
+  priv->text_line_handler
+    = g_signal_connect (priv->text_reader, "line",
+                        G_CALLBACK (git_annotated_source_on_text_line),
+                        source);
+
+  /* The batch mode reports the size of the object before its
+     contents */
+  gchar *object_name = g_strconcat (revision, ":", relative_file, "\n",
+                                    NULL);
+  GBytes *input = g_bytes_new_take (object_name, strlen (object_name));
+
+  git_reader_set_input (priv->text_reader, input);
+  g_bytes_unref (input);
+
+  gboolean ret = git_reader_start (priv->text_reader, priv->repo, error,
+                                   "cat-file", "--batch",
+                                   NULL);
+
+  if (!ret)
+    git_annotated_source_stop_text (source);
+
   return ret;
 }
+
+static void
+git_annotated_source_on_backend_completed (GitBlameBackend *backend,
+                                           const GError *error,
+                                           GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+
+  if (priv->completed)
+    git_annotated_source_refine_done (source, error);
+  /* The text has always been loaded before the blame is started */
+  else if (error)
+    g_signal_emit (source, client_signals[COMPLETED], 0, error);
+  else
+    git_annotated_source_finish (source);
+}
+
+/* Copies the attribution of the hunk to the lines. Returns whether
+   any of them changed. */
+static gboolean
+git_annotated_source_apply_hunk (GitAnnotatedSource *source,
+                                 const GitBlameHunk *hunk)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  gboolean changed = FALSE;
+  guint i;
+
+  /* Interning takes a global lock so only do it once for the hunk */
+  const gchar *previous_path = (hunk->previous_path
+                                ? g_intern_string (hunk->previous_path)
+                                : NULL);
+
+  for (i = 0; i < hunk->n_lines; i++)
+    {
+      GitAnnotatedSourceLine *line
+        = &g_array_index (priv->lines,
+                          GitAnnotatedSourceLine,
+                          hunk->final_line - 1 + i);
+
+      /* The later passes mostly agree with the earlier ones so only
+         the lines that they change are reported */
+      if (line->commit != hunk->commit
+          || line->orig_line != hunk->orig_line + i
+          || line->previous_commit != hunk->previous_commit
+          || line->previous_path != previous_path
+          || line->boundary != hunk->boundary)
+        {
+          if (line->commit)
+            g_object_unref (line->commit);
+          else
+            priv->n_attributed_lines++;
+          if (line->previous_commit)
+            g_object_unref (line->previous_commit);
+
+          line->commit = g_object_ref (hunk->commit);
+          line->orig_line = hunk->orig_line + i;
+          line->previous_commit = (hunk->previous_commit
+                                   ? g_object_ref (hunk->previous_commit)
+                                   : NULL);
+          line->previous_path = previous_path;
+          line->boundary = hunk->boundary;
+
+          changed = TRUE;
+        }
+
+      line->final_line = hunk->final_line + i;
+
+      if (hunk->lines)
+        {
+          /* The text of each line keeps its newline so that the lines
+             can simply be joined together */
+          gchar *text = g_strconcat (hunk->lines[i], "\n", NULL);
+
+          if (line->text && !strcmp (line->text, text))
+            g_free (text);
+          else
+            {
+              git_annotated_source_forget_line_hashes (source);
+
+              if (line->text)
+                {
+                  priv->text_size -= strlen (line->text) + 1;
+                  g_free (line->text);
+
+                  if (priv->text_loaded)
+                    priv->text_mismatch = TRUE;
+                }
+
+              line->text = text;
+              priv->text_size += strlen (text) + 1;
+            }
+        }
+    }
+
+  return changed;
+}
+
+/* Keeps a hunk from a refining pass until the whole pass is done. A
+   pass that doesn’t match the lines that are already there is thrown
+   away. */
+static void
+git_annotated_source_buffer_hunk (GitAnnotatedSource *source,
+                                  const GitBlameHunk *hunk)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  GitBlameHunk copy;
+  guint i;
+
+  if (priv->pass_mismatch)
+    return;
+
+  if (hunk->final_line - 1 + hunk->n_lines > priv->lines->len)
+    {
+      priv->pass_mismatch = TRUE;
+      return;
+    }
+
+  for (i = 0; i < hunk->n_lines; i++)
+    {
+      guint line_num = hunk->final_line - 1 + i;
+      const gchar *text
+        = g_array_index (priv->lines, GitAnnotatedSourceLine, line_num).text;
+
+      /* The text of each line has its newline but the hunk’s doesn’t */
+      if (hunk->lines
+          && (text == NULL
+              || !g_str_has_prefix (text, hunk->lines[i])
+              || strcmp (text + strlen (hunk->lines[i]), "\n")))
+        {
+          priv->pass_mismatch = TRUE;
+          return;
+        }
+
+      if (!priv->pass_covered[line_num])
+        {
+          priv->pass_covered[line_num] = TRUE;
+          priv->n_pass_covered++;
+        }
+    }
+
+  copy = *hunk;
+  copy.commit = g_object_ref (hunk->commit);
+  copy.lines = NULL;
+  copy.previous_commit = (hunk->previous_commit
+                          ? g_object_ref (hunk->previous_commit)
+                          : NULL);
+  copy.previous_path = (hunk->previous_path
+                        ? g_intern_string (hunk->previous_path)
+                        : NULL);
+  copy.orig_path = (hunk->orig_path
+                    ? g_intern_string (hunk->orig_path)
+                    : NULL);
+  g_array_append_val (priv->pass_hunks, copy);
+}
+
+static void
+git_annotated_source_on_hunk (GitBlameBackend *backend,
+                              const GitBlameHunk *hunk,
+                              GitAnnotatedSource *source)
+{
+  GitAnnotatedSourcePrivate *priv =
+    git_annotated_source_get_instance_private (source);
+  gboolean changed;
+
+  if (hunk->final_line < 1 || hunk->n_lines < 1)
+    return;
+
+  /* The later passes only refine the lines that are already there */
+  if (priv->completed)
+    {
+      if (priv->pass_hunks)
+        git_annotated_source_buffer_hunk (source, hunk);
+      return;
+    }
+
+  git_annotated_source_ensure_line (source,
+                                    hunk->final_line + hunk->n_lines - 2);
+
+  changed = git_annotated_source_apply_hunk (source, hunk);
+
+  priv->n_blamed_lines = MAX (priv->n_blamed_lines,
+                              hunk->final_line - 1 + hunk->n_lines);
+
+  if (changed && priv->text_loaded)
+    g_signal_emit (source, client_signals[ATTRIBUTION_CHANGED], 0);
+
+  if (!priv->completed)
+    git_annotated_source_emit_progress (source, FALSE);
+}
@@ -19,6 +19,7 @@
 #define __GIT_ANNOTATED_SOURCE_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include "git-commit.h"
 
 G_BEGIN_DECLS
@@ -36,22 +37,81 @@ struct _GitAnnotatedSourceClass
   GObjectClass parent_class;
 
   void (* completed) (GitAnnotatedSource *source, const GError *error);
+  void (* text_changed) (GitAnnotatedSource *source);
+  void (* attribution_changed) (GitAnnotatedSource *source);
+  void (* refining_changed) (GitAnnotatedSource *source);
+  void (* progress) (GitAnnotatedSource *source,
+                     guint n_attributed_lines,
+                     guint n_lines);
 };
 
+/* What to do with a file that is bigger than the size limit or that
+   looks like a binary file */
+typedef enum
+{
+  /* Fail with GIT_ERROR_TOO_LARGE or GIT_ERROR_BINARY */
+  GIT_ANNOTATED_SOURCE_GUARD_REFUSE,
+  /* Fail in the same way but the user can be asked whether to blame
+     it anyway */
+  GIT_ANNOTATED_SOURCE_GUARD_ASK,
+  /* Only blame the recent history of files that are too big. The
+     whole text is still loaded so this only saves the time spent
+     walking the history, not memory. Binary files are treated as
+     with ASK. */
+  GIT_ANNOTATED_SOURCE_GUARD_SHALLOW
+} GitAnnotatedSourceGuardAction;
+
+/* The commit is NULL until the blame has reached the line */
 typedef struct _GitAnnotatedSourceLine
 {
   GitCommit *commit;
   guint orig_line, final_line;
   gchar *text;
+  /* See GitBlameHunk. The path is an interned string. */
+  GitCommit *previous_commit;
+  const gchar *previous_path;
+  /* The line is older than the history that has been looked at so
+     far. The commit is the oldest one that was looked at. */
+  gboolean boundary;
 } GitAnnotatedSourceLine;
 
 GitAnnotatedSource *git_annotated_source_new (void);
+GitAnnotatedSource *git_annotated_source_new_edited (GitAnnotatedSource *base,
+                                                     const gchar *contents,
+                                                     gsize length);
 gboolean git_annotated_source_fetch (GitAnnotatedSource *source,
                                      GFile *file,
                                      const gchar *revision,
                                      GError **error);
 
+void git_annotated_source_set_prefetch_commits (GitAnnotatedSource *source,
+                                                gboolean prefetch_commits);
+void git_annotated_source_set_progressive (GitAnnotatedSource *source,
+                                           gboolean progressive);
+void git_annotated_source_set_detect_copies (GitAnnotatedSource *source,
+                                             gboolean detect_copies);
+void git_annotated_source_set_max_size (GitAnnotatedSource *source,
+                                        guint64 max_size);
+void git_annotated_source_set_check_binary (GitAnnotatedSource *source,
+                                            gboolean check_binary);
+void
+git_annotated_source_set_guard_action (GitAnnotatedSource *source,
+                                       GitAnnotatedSourceGuardAction action);
+GitAnnotatedSourceGuardAction
+git_annotated_source_get_guard_action (GitAnnotatedSource *source);
+
 gsize git_annotated_source_get_n_lines (GitAnnotatedSource *source);
+gboolean git_annotated_source_get_completed (GitAnnotatedSource *source);
+gboolean git_annotated_source_get_text_loaded (GitAnnotatedSource *source);
+gboolean git_annotated_source_get_refining (GitAnnotatedSource *source);
+void git_annotated_source_get_progress (GitAnnotatedSource *source,
+                                        guint *n_attributed_lines,
+                                        guint *n_lines);
+gsize git_annotated_source_get_memory_usage (GitAnnotatedSource *source);
+const guint64 *
+git_annotated_source_get_line_hashes (GitAnnotatedSource *source);
+guint git_annotated_source_get_n_edited_lines (GitAnnotatedSource *source);
+GFile *git_annotated_source_get_repo (GitAnnotatedSource *source);
 
 const GitAnnotatedSourceLine *
 git_annotated_source_get_line (GitAnnotatedSource *source, gsize line_num);
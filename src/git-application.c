@@ -21,12 +21,31 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "git-main-window.h"
+#include "git-source-cache.h"
+#include "git-commit-bag.h"
+#include "git-common.h"
+
+/* Time in milliseconds to keep the process alive after the last
+   window is closed when running with --resident */
+#define GIT_APPLICATION_RESIDENT_TIMEOUT (30 * 60 * 1000)
+/* Maximum number of bytes of annotated source and unreferenced
+   commits to keep while there are no windows open in resident mode */
+#define GIT_APPLICATION_IDLE_CACHE_SIZE (16 * 1024 * 1024)
+#define GIT_APPLICATION_IDLE_COMMIT_BAG_SIZE (4 * 1024 * 1024)
 
 struct _GitApplication
 {
   GtkApplication parent_object;
+
+  /* Annotated sources shared between all of the windows */
+  GitSourceCache *source_cache;
+
+  /* Whether to stay alive with warm caches after the last window is
+     closed so that the next invocation opens instantly */
+  gboolean resident;
 };
 
 G_DEFINE_TYPE (GitApplication,
@@ -36,51 +55,159 @@ G_DEFINE_TYPE (GitApplication,
 static void
 git_application_init (GitApplication *app)
 {
+  app->source_cache = git_source_cache_new ();
 }
 
-static gboolean
-git_application_local_command_line (GApplication *application,
-                                    char ***arguments,
-                                    int *exit_status)
+static void
+git_application_dispose (GObject *object)
 {
-  char **argv = *arguments;
+  GitApplication *app = (GitApplication *) object;
 
-  /* If there are two or more arguments then we’ll treat the first one
-     as a revision and the second one as the filename. Otherwise we’ll
-     let the default handler handle them. */
-  if (argv[0] && argv[1] && argv[2])
+  if (app->source_cache)
     {
-      if (argv[3])
-        {
-          g_printerr (_("usage: %s [revision] [filename]\n"), g_get_prgname ());
-          *exit_status = 1;
-          return TRUE;
-        }
+      g_object_unref (app->source_cache);
+      app->source_cache = NULL;
+    }
 
-      GError *error = NULL;
+  G_OBJECT_CLASS (git_application_parent_class)->dispose (object);
+}
+
+/* Removes the --resident option from the arguments and returns
+   whether it was found */
+static gboolean
+git_application_strip_resident_option (char **argv)
+{
+  gboolean found = FALSE;
+  int dst = 0;
 
-      if (!g_application_register (application, NULL, &error))
+  for (int src = 0; argv[src]; src++)
+    {
+      if (src > 0 && !strcmp (argv[src], "--resident"))
         {
-          g_printerr ("Failed to register: %s\n", error->message);
-          g_error_free (error);
-          *exit_status = 1;
-          return TRUE;
+          g_free (argv[src]);
+          found = TRUE;
         }
+      else
+        argv[dst++] = argv[src];
+    }
 
-      GFile *file = g_file_new_for_commandline_arg (argv[2]);
+  argv[dst] = NULL;
 
-      g_application_open (application, &file, 1, argv[1]);
+  return found;
+}
 
-      g_object_unref (file);
+static gboolean
+git_application_local_command_line (GApplication *application,
+                                    char ***arguments,
+                                    int *exit_status)
+{
+  GitApplication *app = (GitApplication *) application;
 
-      *exit_status = 0;
-      return TRUE;
-    }
+  /* This needs to be known before the application is registered in
+     case this becomes the primary instance. The option itself is
+     handled along with the rest of the command line, which might be
+     in another instance. */
+  app->resident = g_strv_contains ((const gchar * const *) *arguments + 1,
+                                   "--resident");
 
   return G_APPLICATION_CLASS (git_application_parent_class)
     ->local_command_line(application, arguments, exit_status);
 }
 
+/* Git finds the repository with GIT_DIR and GIT_WORK_TREE. These have
+   to be taken from the environment of the command line because with
+   --resident it might have been run from a different shell than this
+   process. */
+static void
+git_application_set_env_repo (GApplicationCommandLine *command_line)
+{
+  const gchar *env = g_application_command_line_getenv (command_line,
+                                                        "GIT_DIR");
+  GFile *git_dir, *work_tree;
+
+  if (env == NULL || *env == '\0')
+    return;
+
+  git_dir = g_application_command_line_create_file_for_arg (command_line,
+                                                            env);
+
+  env = g_application_command_line_getenv (command_line, "GIT_WORK_TREE");
+
+  /* Like git, the working tree is the current directory if it isn’t
+     given */
+  if (env == NULL || *env == '\0')
+    env = ".";
+
+  work_tree = g_application_command_line_create_file_for_arg (command_line,
+                                                              env);
+
+  git_set_env_repo (git_dir, work_tree);
+
+  g_object_unref (work_tree);
+  g_object_unref (git_dir);
+}
+
+static int
+git_application_command_line (GApplication *application,
+                              GApplicationCommandLine *command_line)
+{
+  int argc;
+  char **argv = g_application_command_line_get_arguments (command_line,
+                                                          &argc);
+  gboolean resident = git_application_strip_resident_option (argv);
+  int exit_status = 0;
+
+  argc = g_strv_length (argv);
+
+  git_application_set_env_repo (command_line);
+
+  /* Whether the process stays around is decided when the primary
+     instance starts, so the option can’t take effect from here */
+  if (resident && !((GitApplication *) application)->resident)
+    g_application_command_line_printerr (command_line,
+                                         _("%s is already running without "
+                                           "--resident so it will exit "
+                                           "when the last window is "
+                                           "closed\n"),
+                                         g_get_prgname ());
+
+  /* If there are two arguments then we’ll treat the first one as a
+     revision and the second one as the filename */
+  if (argc > 3)
+    {
+      g_application_command_line_printerr (command_line,
+                                           _("usage: %s [--resident] "
+                                             "[revision] [filename]\n"),
+                                           g_get_prgname ());
+      exit_status = 1;
+    }
+  else if (argc > 1)
+    {
+      GFile *file
+        = g_application_command_line_create_file_for_arg (command_line,
+                                                          argv[argc - 1]);
+
+      g_application_open (application, &file, 1, argc > 2 ? argv[1] : "");
+
+      g_object_unref (file);
+    }
+  else if (resident)
+    {
+      /* With no other arguments just start the resident instance
+         without opening a window. Holding and releasing the
+         application starts the inactivity timeout so that the main
+         loop keeps running. */
+      g_application_hold (application);
+      g_application_release (application);
+    }
+  else
+    g_application_activate (application);
+
+  g_strfreev (argv);
+
+  return exit_status;
+}
+
 static void
 git_application_open (GApplication *application,
                       GFile **files,
@@ -107,14 +234,91 @@ git_application_activate (GApplication *application)
   gtk_window_present (GTK_WINDOW (main_win));
 }
 
+static void
+git_application_startup (GApplication *application)
+{
+  GitApplication *app = (GitApplication *) application;
+
+  G_APPLICATION_CLASS (git_application_parent_class)->startup (application);
+
+  /* This only runs in the primary instance so it is the one that
+     will stay around */
+  if (app->resident)
+    g_application_set_inactivity_timeout (application,
+                                          GIT_APPLICATION_RESIDENT_TIMEOUT);
+}
+
+static void
+git_application_report_idle_memory (GitApplication *app)
+{
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  gchar *source_size
+    = g_format_size (git_source_cache_get_size (app->source_cache));
+  gchar *commit_size
+    = g_format_size (git_commit_bag_get_memory_usage (commit_bag));
+
+  g_debug ("No windows open, keeping %s of blame data and "
+             "%s of commit data cached",
+             source_size,
+             commit_size);
+
+  g_free (source_size);
+  g_free (commit_size);
+}
+
+static void
+git_application_window_added (GtkApplication *application,
+                              GtkWindow *window)
+{
+  GitApplication *app = (GitApplication *) application;
+
+  GTK_APPLICATION_CLASS (git_application_parent_class)
+    ->window_added (application, window);
+
+  git_source_cache_set_max_size (app->source_cache,
+                                 GIT_SOURCE_CACHE_DEFAULT_MAX_SIZE);
+  git_commit_bag_set_max_size (git_commit_bag_get_default (),
+                               GIT_COMMIT_BAG_DEFAULT_MAX_SIZE);
+}
+
+static void
+git_application_window_removed (GtkApplication *application,
+                                GtkWindow *window)
+{
+  GitApplication *app = (GitApplication *) application;
+
+  GTK_APPLICATION_CLASS (git_application_parent_class)
+    ->window_removed (application, window);
+
+  /* When the last window is closed in resident mode the process stays
+     alive, so limit how much memory it sits on while it is idle */
+  if (app->resident && gtk_application_get_windows (application) == NULL)
+    {
+      git_source_cache_set_max_size (app->source_cache,
+                                     GIT_APPLICATION_IDLE_CACHE_SIZE);
+      git_commit_bag_set_max_size (git_commit_bag_get_default (),
+                                   GIT_APPLICATION_IDLE_COMMIT_BAG_SIZE);
+      git_application_report_idle_memory (app);
+    }
+}
+
 static void
 git_application_class_init (GitApplicationClass *klass)
 {
+  GObjectClass *gobject_class = (GObjectClass *) klass;
   GApplicationClass *app_class = (GApplicationClass *) klass;
+  GtkApplicationClass *gtk_app_class = (GtkApplicationClass *) klass;
+
+  gobject_class->dispose = git_application_dispose;
 
   app_class->local_command_line = git_application_local_command_line;
+  app_class->command_line = git_application_command_line;
   app_class->open = git_application_open;
   app_class->activate = git_application_activate;
+  app_class->startup = git_application_startup;
+
+  gtk_app_class->window_added = git_application_window_added;
+  gtk_app_class->window_removed = git_application_window_removed;
 }
 
 GitApplication *
@@ -122,6 +326,15 @@ git_application_new (void)
 {
   return g_object_new (GIT_TYPE_APPLICATION,
                        "application-id", "uk.co.busydoingnothing.blame_browse",
-                       "flags", G_APPLICATION_HANDLES_OPEN,
+                       "flags", (G_APPLICATION_HANDLES_OPEN
+                                 | G_APPLICATION_HANDLES_COMMAND_LINE),
                        NULL);
 }
+
+GitSourceCache *
+git_application_get_source_cache (GitApplication *app)
+{
+  g_return_val_if_fail (GIT_IS_APPLICATION (app), NULL);
+
+  return app->source_cache;
+}
@@ -19,6 +19,7 @@
 #define __GIT_APPLICATION_H__
 
 #include <gtk/gtk.h>
+#include "git-source-cache.h"
 
 G_BEGIN_DECLS
 
@@ -32,6 +33,8 @@ G_DECLARE_FINAL_TYPE (GitApplication,
 
 GitApplication *git_application_new (void);
 
+GitSourceCache *git_application_get_source_cache (GitApplication *app);
+
 G_END_DECLS
 
 #endif /* __GIT_APPLICATION_H__ */
@@ -0,0 +1,280 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-backend.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "git-blame-native.h"
+#include "git-blame-process.h"
+#ifdef HAVE_LIBGIT2
+#include "git-blame-libgit2.h"
+#endif
+
+/* A way of getting the blame for a file. The implementations report
+   the blame as hunks, which can be in any order, and then emit the
+   completed signal once, either with an error or with NULL if all of
+   the lines have been reported. */
+
+G_DEFINE_ABSTRACT_TYPE (GitBlameBackend,
+                        git_blame_backend,
+                        G_TYPE_OBJECT);
+
+enum
+  {
+    HUNK,
+    PROGRESS,
+    COMPLETED,
+
+    LAST_SIGNAL
+  };
+
+static guint client_signals[LAST_SIGNAL];
+
+static void
+git_blame_backend_class_init (GitBlameBackendClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  client_signals[HUNK]
+    = g_signal_new ("hunk",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitBlameBackendClass, hunk),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_POINTER);
+
+  client_signals[PROGRESS]
+    = g_signal_new ("progress",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitBlameBackendClass, progress),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__UINT,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_UINT);
+
+  client_signals[COMPLETED]
+    = g_signal_new ("completed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitBlameBackendClass, completed),
+                    NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_POINTER);
+}
+
+static void
+git_blame_backend_init (GitBlameBackend *self)
+{
+}
+
+/* Returns the backend to use when nothing else has been asked for.
+   This can be overridden by setting BLAME_BROWSE_BACKEND in the
+   environment to ‘process’, ‘native’ or ‘libgit2’, which is useful
+   for comparing them. */
+GitBlameBackendType
+git_blame_backend_get_default_type (void)
+{
+  static GitBlameBackendType type;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      const gchar *env = g_getenv ("BLAME_BROWSE_BACKEND");
+
+#ifdef HAVE_LIBGIT2
+      type = GIT_BLAME_BACKEND_TYPE_LIBGIT2;
+#else
+      type = GIT_BLAME_BACKEND_TYPE_PROCESS;
+#endif
+
+      if (env == NULL || *env == '\0')
+        ;
+      else if (!strcmp (env, "process"))
+        type = GIT_BLAME_BACKEND_TYPE_PROCESS;
+      else if (!strcmp (env, "native"))
+        type = GIT_BLAME_BACKEND_TYPE_NATIVE;
+#ifdef HAVE_LIBGIT2
+      else if (!strcmp (env, "libgit2"))
+        type = GIT_BLAME_BACKEND_TYPE_LIBGIT2;
+#endif
+      else
+        g_warning ("Unsupported blame backend “%s”", env);
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return type;
+}
+
+GitBlameBackend *
+git_blame_backend_new (GitBlameBackendType type)
+{
+  switch (type)
+    {
+    case GIT_BLAME_BACKEND_TYPE_PROCESS:
+      return GIT_BLAME_BACKEND (git_blame_process_new ());
+
+    case GIT_BLAME_BACKEND_TYPE_NATIVE:
+      return GIT_BLAME_BACKEND (git_blame_native_new ());
+
+    case GIT_BLAME_BACKEND_TYPE_LIBGIT2:
+#ifdef HAVE_LIBGIT2
+      return GIT_BLAME_BACKEND (git_blame_libgit2_new ());
+#else
+      g_warning ("blame-browse was built without libgit2");
+      return GIT_BLAME_BACKEND (git_blame_process_new ());
+#endif
+    }
+
+  g_return_val_if_reached (NULL);
+}
+
+/* Starts getting the blame for path, which is relative to the top of
+   repo. If revision is NULL then uncommitted changes are included.
+   Anything that was already running is cancelled first. */
+gboolean
+git_blame_backend_start (GitBlameBackend *backend,
+                         GFile *repo,
+                         const gchar *path,
+                         const gchar *revision,
+                         GError **error)
+{
+  g_return_val_if_fail (GIT_IS_BLAME_BACKEND (backend), FALSE);
+  g_return_val_if_fail (G_IS_FILE (repo), FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  GitBlameBackendClass *klass = GIT_BLAME_BACKEND_GET_CLASS (backend);
+
+  git_blame_backend_cancel (backend);
+
+  return klass->start (backend, repo, path, revision, error);
+}
+
+/* Stops the current blame. No more signals will be emitted for it,
+   including the completed signal. */
+void
+git_blame_backend_cancel (GitBlameBackend *backend)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  GitBlameBackendClass *klass = GIT_BLAME_BACKEND_GET_CLASS (backend);
+
+  klass->cancel (backend);
+}
+
+/* Returns whether git_blame_backend_set_since does anything */
+gboolean
+git_blame_backend_can_limit_history (GitBlameBackend *backend)
+{
+  g_return_val_if_fail (GIT_IS_BLAME_BACKEND (backend), FALSE);
+
+  return GIT_BLAME_BACKEND_GET_CLASS (backend)->set_since != NULL;
+}
+
+/* Makes the following blames only look at commits made after since,
+   which is in seconds since the epoch. Lines that are older are
+   blamed on the oldest commit that was looked at and the hunk is
+   marked as a boundary. Zero removes the limit. */
+void
+git_blame_backend_set_since (GitBlameBackend *backend, gint64 since)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  GitBlameBackendClass *klass = GIT_BLAME_BACKEND_GET_CLASS (backend);
+
+  g_return_if_fail (klass->set_since != NULL);
+
+  klass->set_since (backend, since);
+}
+
+/* Returns whether git_blame_backend_set_detect_copies does anything */
+gboolean
+git_blame_backend_can_detect_copies (GitBlameBackend *backend)
+{
+  g_return_val_if_fail (GIT_IS_BLAME_BACKEND (backend), FALSE);
+
+  return GIT_BLAME_BACKEND_GET_CLASS (backend)->set_detect_copies != NULL;
+}
+
+/* Makes the following blames follow lines that were moved or copied
+   from elsewhere in the same commit, like git blame -C -M. This gives
+   a better attribution for code that was refactored but it is much
+   slower. */
+void
+git_blame_backend_set_detect_copies (GitBlameBackend *backend,
+                                     gboolean detect_copies)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  GitBlameBackendClass *klass = GIT_BLAME_BACKEND_GET_CLASS (backend);
+
+  g_return_if_fail (klass->set_detect_copies != NULL);
+
+  klass->set_detect_copies (backend, detect_copies);
+}
+
+/* Sets the main loop priority that the following blames are handled
+   at. Backends that don’t do their work in the main loop ignore
+   this. */
+void
+git_blame_backend_set_priority (GitBlameBackend *backend, gint priority)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  GitBlameBackendClass *klass = GIT_BLAME_BACKEND_GET_CLASS (backend);
+
+  if (klass->set_priority)
+    klass->set_priority (backend, priority);
+}
+
+void
+git_blame_backend_emit_hunk (GitBlameBackend *backend,
+                             const GitBlameHunk *hunk)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  g_signal_emit (backend, client_signals[HUNK], 0, hunk);
+}
+
+/* n_lines is the total number of lines that have been reported so
+   far */
+void
+git_blame_backend_emit_progress (GitBlameBackend *backend, guint n_lines)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  g_signal_emit (backend, client_signals[PROGRESS], 0, n_lines);
+}
+
+void
+git_blame_backend_emit_completed (GitBlameBackend *backend,
+                                  const GError *error)
+{
+  g_return_if_fail (GIT_IS_BLAME_BACKEND (backend));
+
+  g_signal_emit (backend, client_signals[COMPLETED], 0, error);
+}
@@ -0,0 +1,124 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_BACKEND_H__
+#define __GIT_BLAME_BACKEND_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-commit.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_BLAME_BACKEND git_blame_backend_get_type ()
+
+G_DECLARE_DERIVABLE_TYPE (GitBlameBackend,
+                          git_blame_backend,
+                          GIT,
+                          BLAME_BACKEND,
+                          GObject);
+
+typedef enum
+{
+  /* Runs git-blame and parses its incremental output */
+  GIT_BLAME_BACKEND_TYPE_PROCESS,
+  /* Walks the history itself using several threads */
+  GIT_BLAME_BACKEND_TYPE_NATIVE,
+  /* Uses libgit2 in a thread. Only available if blame-browse was
+     built with libgit2. */
+  GIT_BLAME_BACKEND_TYPE_LIBGIT2
+} GitBlameBackendType;
+
+/* A run of consecutive lines in the final file that all come from the
+   same commit. Line numbers count from 1. */
+typedef struct
+{
+  GitCommit *commit;
+  guint orig_line, final_line;
+  guint n_lines;
+  /* The text of each line without the newline, or NULL if the
+     backend doesn’t have it. GitAnnotatedSource gets the text itself
+     anyway so that it can be shown before the blame finishes. */
+  gchar **lines;
+  /* The path of the file in the commit, which can be different from
+     the blamed path if the commit is older than a rename, or NULL if
+     the backend doesn’t know. This belongs to the hunk rather than
+     the commit because the same commit can be reached through
+     different files. */
+  const gchar *orig_path;
+  /* The commit and path of the file that the commit changed to get
+     these lines, ie, the version to blame to see what was there
+     before. The path can be different from the blamed path if the
+     file was renamed. Both are NULL if the commit added the file or
+     the backend doesn’t know. */
+  GitCommit *previous_commit;
+  const gchar *previous_path;
+  /* The history was limited and the commit is the oldest one that was
+     looked at, so the lines might really be older */
+  gboolean boundary;
+} GitBlameHunk;
+
+struct _GitBlameBackendClass
+{
+  GObjectClass parent_class;
+
+  gboolean (* start) (GitBlameBackend *backend,
+                      GFile *repo,
+                      const gchar *path,
+                      const gchar *revision,
+                      GError **error);
+  void (* cancel) (GitBlameBackend *backend);
+  /* These can be NULL if the backend doesn’t support them */
+  void (* set_since) (GitBlameBackend *backend, gint64 since);
+  void (* set_detect_copies) (GitBlameBackend *backend,
+                              gboolean detect_copies);
+  void (* set_priority) (GitBlameBackend *backend, gint priority);
+
+  void (* hunk) (GitBlameBackend *backend, const GitBlameHunk *hunk);
+  void (* progress) (GitBlameBackend *backend, guint n_lines);
+  void (* completed) (GitBlameBackend *backend, const GError *error);
+};
+
+GitBlameBackendType git_blame_backend_get_default_type (void);
+
+GitBlameBackend *git_blame_backend_new (GitBlameBackendType type);
+
+gboolean git_blame_backend_start (GitBlameBackend *backend,
+                                  GFile *repo,
+                                  const gchar *path,
+                                  const gchar *revision,
+                                  GError **error);
+void git_blame_backend_cancel (GitBlameBackend *backend);
+
+gboolean git_blame_backend_can_limit_history (GitBlameBackend *backend);
+void git_blame_backend_set_since (GitBlameBackend *backend, gint64 since);
+gboolean git_blame_backend_can_detect_copies (GitBlameBackend *backend);
+void git_blame_backend_set_detect_copies (GitBlameBackend *backend,
+                                          gboolean detect_copies);
+void git_blame_backend_set_priority (GitBlameBackend *backend, gint priority);
+
+/* For use by the implementations */
+void git_blame_backend_emit_hunk (GitBlameBackend *backend,
+                                  const GitBlameHunk *hunk);
+void git_blame_backend_emit_progress (GitBlameBackend *backend,
+                                      guint n_lines);
+void git_blame_backend_emit_completed (GitBlameBackend *backend,
+                                       const GError *error);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_BACKEND_H__ */
@@ -0,0 +1,411 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-libgit2-worker.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <git2.h>
+
+/* None of blame-browse’s own headers can be included here because
+   their names would clash with libgit2’s, so the only error domain
+   available is GIO’s */
+
+static void
+git_blame_libgit2_worker_set_error (GError **error)
+{
+  const git_error *err = git_error_last ();
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+               "Error from libgit2: %s",
+               err && err->message ? err->message : "unknown error");
+}
+
+static void
+git_blame_libgit2_worker_split_lines (GitBlameLibgit2Result *result,
+                                      const gchar *text,
+                                      gsize length)
+{
+  GPtrArray *lines = g_ptr_array_new ();
+  const gchar *end = text + length;
+
+  while (text < end)
+    {
+      const gchar *nl = memchr (text, '\n', end - text);
+      const gchar *line_end = nl ? nl : end;
+
+      g_ptr_array_add (lines, g_strndup (text, line_end - text));
+
+      text = nl ? nl + 1 : end;
+    }
+
+  result->n_lines = lines->len;
+  g_ptr_array_add (lines, NULL);
+  result->lines = (gchar **) g_ptr_array_free (lines, FALSE);
+}
+
+/* Returns the number of bytes in the object ids of the repository.
+   libgit2 only knows about SHA-256 if it was built with it and older
+   versions only have GIT_OID_RAWSZ. */
+static gsize
+git_blame_libgit2_worker_oid_size (git_repository *repo)
+{
+#ifdef GIT_EXPERIMENTAL_SHA256
+  if (git_repository_oid_type (repo) == GIT_OID_SHA256)
+    return GIT_OID_SHA256_SIZE;
+#endif
+
+#ifdef GIT_OID_SHA1_SIZE
+  return GIT_OID_SHA1_SIZE;
+#else
+  return GIT_OID_RAWSZ;
+#endif
+}
+
+/* Reads the file either from the tree of the commit or from the
+   working directory if there is no commit. A symlink in the working
+   directory is read as the path it points to like git does. */
+static gboolean
+git_blame_libgit2_worker_read_text (git_repository *repo,
+                                    git_commit *commit,
+                                    const gchar *path,
+                                    gchar **contents,
+                                    gsize *length,
+                                    GError **error)
+{
+  git_tree *tree = NULL;
+  git_tree_entry *entry = NULL;
+  git_blob *blob = NULL;
+  gboolean ret = FALSE;
+
+  if (commit == NULL)
+    {
+      gchar *filename = g_build_filename (git_repository_workdir (repo),
+                                          path,
+                                          NULL);
+
+      if (g_file_test (filename, G_FILE_TEST_IS_SYMLINK))
+        {
+          *contents = g_file_read_link (filename, error);
+
+          if (*contents)
+            {
+              *length = strlen (*contents);
+              ret = TRUE;
+            }
+        }
+      else
+        ret = g_file_get_contents (filename, contents, length, error);
+
+      g_free (filename);
+
+      return ret;
+    }
+
+  if (git_commit_tree (&tree, commit)
+      || git_tree_entry_bypath (&entry, tree, path)
+      || git_blob_lookup (&blob, repo, git_tree_entry_id (entry)))
+    git_blame_libgit2_worker_set_error (error);
+  else
+    {
+      *length = git_blob_rawsize (blob);
+      *contents = g_memdup2 (git_blob_rawcontent (blob), *length);
+      ret = TRUE;
+    }
+
+  git_blob_free (blob);
+  git_tree_entry_free (entry);
+  git_tree_free (tree);
+
+  return ret;
+}
+
+/* Details of a commit that are looked up once for all of its hunks */
+typedef struct
+{
+  gchar *summary;
+  gboolean has_previous;
+  git_oid previous;
+  gchar *previous_path;
+} GitBlameLibgit2WorkerCommit;
+
+static void
+git_blame_libgit2_worker_free_commit (GitBlameLibgit2WorkerCommit *info)
+{
+  g_free (info->summary);
+  g_free (info->previous_path);
+  g_slice_free (GitBlameLibgit2WorkerCommit, info);
+}
+
+/* Sets the previous commit to the first parent if it has the file at
+   the same path. libgit2 doesn’t report renames so that is the best
+   that can be done. */
+static void
+git_blame_libgit2_worker_find_previous (git_repository *repo,
+                                        const git_oid *parent_id,
+                                        const gchar *path,
+                                        GitBlameLibgit2WorkerCommit *info)
+{
+  git_commit *parent = NULL;
+  git_tree *tree = NULL;
+  git_tree_entry *entry = NULL;
+
+  if (path
+      && git_commit_lookup (&parent, repo, parent_id) == 0
+      && git_commit_tree (&tree, parent) == 0
+      && git_tree_entry_bypath (&entry, tree, path) == 0)
+    {
+      info->has_previous = TRUE;
+      git_oid_cpy (&info->previous, parent_id);
+      info->previous_path = g_strdup (path);
+    }
+
+  git_tree_entry_free (entry);
+  git_tree_free (tree);
+  git_commit_free (parent);
+}
+
+static void
+git_blame_libgit2_worker_set_previous (GitBlameLibgit2Hunk *out,
+                                       const GitBlameLibgit2WorkerCommit *info,
+                                       gsize oid_size)
+{
+  if (info->has_previous)
+    {
+      out->previous_id_len = oid_size;
+      memcpy (out->previous_id, info->previous.id, oid_size);
+      out->previous_path = g_strdup (info->previous_path);
+    }
+}
+
+static void
+git_blame_libgit2_worker_add_hunks (git_repository *repo,
+                                    git_blame *blame,
+                                    const gchar *path,
+                                    GitBlameLibgit2Result *result)
+{
+  /* Map from the commit id to a GitBlameLibgit2WorkerCommit */
+  GHashTable *commits
+    = g_hash_table_new_full (g_bytes_hash,
+                             g_bytes_equal,
+                             (GDestroyNotify) g_bytes_unref,
+                             (GDestroyNotify)
+                             git_blame_libgit2_worker_free_commit);
+  GitBlameLibgit2WorkerCommit working_copy = { 0 };
+  gsize oid_size = git_blame_libgit2_worker_oid_size (repo);
+  git_oid head;
+  guint32 n_hunks = git_blame_get_hunk_count (blame);
+  guint32 i;
+
+  /* Uncommitted changes come before whatever HEAD has */
+  if (git_reference_name_to_id (&head, repo, "HEAD") == 0)
+    git_blame_libgit2_worker_find_previous (repo, &head, path, &working_copy);
+
+  for (i = 0; i < n_hunks; i++)
+    {
+      const git_blame_hunk *hunk = git_blame_get_hunk_byindex (blame, i);
+      GitBlameLibgit2Hunk out;
+      GitBlameLibgit2WorkerCommit *info;
+      GBytes *id;
+
+      memset (&out, 0, sizeof out);
+
+      out.id_len = oid_size;
+      memcpy (out.id, hunk->final_commit_id.id, oid_size);
+      out.orig_line = hunk->orig_start_line_number;
+      out.final_line = hunk->final_start_line_number;
+      out.n_lines = hunk->lines_in_hunk;
+      out.filename = g_strdup (hunk->orig_path);
+
+      if (git_oid_is_zero (&hunk->final_commit_id)
+          || hunk->final_signature == NULL)
+        {
+          /* The same as what git-blame reports for uncommitted
+             changes */
+          out.author = g_strdup ("Not Committed Yet");
+          out.author_mail = g_strdup ("<not.committed.yet>");
+          out.author_time = g_get_real_time () / G_USEC_PER_SEC;
+          git_blame_libgit2_worker_set_previous (&out,
+                                                 &working_copy,
+                                                 oid_size);
+          g_array_append_val (result->hunks, out);
+          continue;
+        }
+
+      out.author = g_strdup (hunk->final_signature->name);
+      out.author_mail = g_strdup_printf ("<%s>",
+                                         hunk->final_signature->email);
+      out.author_time = hunk->final_signature->when.time;
+
+      id = g_bytes_new (out.id, out.id_len);
+
+      if (!(info = g_hash_table_lookup (commits, id)))
+        {
+          git_commit *commit;
+
+          info = g_slice_new0 (GitBlameLibgit2WorkerCommit);
+
+          if (git_commit_lookup (&commit, repo, &hunk->final_commit_id) == 0)
+            {
+              info->summary = g_strdup (git_commit_summary (commit));
+
+              if (git_commit_parentcount (commit) > 0)
+                git_blame_libgit2_worker_find_previous
+                  (repo,
+                   git_commit_parent_id (commit, 0),
+                   hunk->orig_path,
+                   info);
+
+              git_commit_free (commit);
+            }
+
+          g_hash_table_insert (commits, g_bytes_ref (id), info);
+        }
+
+      out.summary = g_strdup (info->summary);
+      git_blame_libgit2_worker_set_previous (&out, info, oid_size);
+
+      g_bytes_unref (id);
+
+      g_array_append_val (result->hunks, out);
+    }
+
+  g_hash_table_destroy (commits);
+  g_free (working_copy.previous_path);
+}
+
+static void
+git_blame_libgit2_worker_init (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      git_libgit2_init ();
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+/* Runs the whole blame. This blocks so it is meant to be called from
+   a thread. */
+GitBlameLibgit2Result *
+git_blame_libgit2_worker_run (const gchar *repo_path,
+                              const gchar *git_dir_path,
+                              const gchar *path,
+                              const gchar *revision,
+                              GError **error)
+{
+  GitBlameLibgit2Result *result = NULL;
+  git_repository *repo = NULL;
+  git_object *object = NULL;
+  git_commit *commit = NULL;
+  git_blame *blame = NULL, *buffer_blame = NULL;
+  git_blame_options opts;
+  gchar *contents = NULL;
+  gsize length;
+
+  git_blame_libgit2_worker_init ();
+
+  /* Open the git directory that was found for the working tree
+     rather than letting libgit2 look for it. Then the environment of
+     this process isn’t used and a repo given with GIT_DIR works. */
+  if (git_repository_open_ext (&repo,
+                               git_dir_path ? git_dir_path : repo_path,
+                               GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)
+      || (git_dir_path && git_repository_set_workdir (repo, repo_path, 0))
+      || git_blame_options_init (&opts, GIT_BLAME_OPTIONS_VERSION))
+    {
+      git_blame_libgit2_worker_set_error (error);
+      goto done;
+    }
+
+  if (revision)
+    {
+      if (git_revparse_single (&object, repo, revision)
+          || git_object_peel ((git_object **) &commit,
+                              object,
+                              GIT_OBJECT_COMMIT))
+        {
+          git_blame_libgit2_worker_set_error (error);
+          goto done;
+        }
+
+      opts.newest_commit = *git_commit_id (commit);
+    }
+
+  if (git_blame_file (&blame, repo, path, &opts))
+    {
+      git_blame_libgit2_worker_set_error (error);
+      goto done;
+    }
+
+  if (!git_blame_libgit2_worker_read_text (repo, commit, path,
+                                           &contents, &length, error))
+    goto done;
+
+  /* Without a revision the working copy is blamed like git-blame
+     does, so the committed blame is adjusted for local changes */
+  if (commit == NULL
+      && git_blame_buffer (&buffer_blame, blame, contents, length))
+    {
+      git_blame_libgit2_worker_set_error (error);
+      goto done;
+    }
+
+  result = g_slice_new (GitBlameLibgit2Result);
+  result->hunks = g_array_new (FALSE, FALSE, sizeof (GitBlameLibgit2Hunk));
+  git_blame_libgit2_worker_split_lines (result, contents, length);
+  git_blame_libgit2_worker_add_hunks (repo,
+                                      buffer_blame ? buffer_blame : blame,
+                                      path,
+                                      result);
+
+ done:
+  g_free (contents);
+  git_blame_free (buffer_blame);
+  git_blame_free (blame);
+  git_commit_free (commit);
+  git_object_free (object);
+  git_repository_free (repo);
+
+  return result;
+}
+
+void
+git_blame_libgit2_worker_free_result (GitBlameLibgit2Result *result)
+{
+  guint i;
+
+  for (i = 0; i < result->hunks->len; i++)
+    {
+      GitBlameLibgit2Hunk *hunk
+        = &g_array_index (result->hunks, GitBlameLibgit2Hunk, i);
+
+      g_free (hunk->author);
+      g_free (hunk->author_mail);
+      g_free (hunk->summary);
+      g_free (hunk->filename);
+      g_free (hunk->previous_path);
+    }
+
+  g_array_free (result->hunks, TRUE);
+  g_strfreev (result->lines);
+  g_slice_free (GitBlameLibgit2Result, result);
+}
@@ -0,0 +1,69 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_LIBGIT2_WORKER_H__
+#define __GIT_BLAME_LIBGIT2_WORKER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* This is kept separate from the rest of the libgit2 backend because
+   a lot of libgit2’s names clash with ours. Only glib types are used
+   in the interface. */
+
+typedef struct
+{
+  guint8 id_len;
+  guint8 id[32];
+
+  guint orig_line, final_line, n_lines;
+
+  gchar *author;
+  gchar *author_mail;
+  gint64 author_time;
+  gchar *summary;
+  gchar *filename;
+
+  /* The first parent of the commit if it has the file. previous_id_len
+     is zero and previous_path is NULL otherwise. */
+  guint8 previous_id_len;
+  guint8 previous_id[32];
+  gchar *previous_path;
+} GitBlameLibgit2Hunk;
+
+typedef struct
+{
+  /* Array of GitBlameLibgit2Hunk */
+  GArray *hunks;
+  /* The text of each line of the file without the newline */
+  gchar **lines;
+  guint n_lines;
+} GitBlameLibgit2Result;
+
+GitBlameLibgit2Result *
+git_blame_libgit2_worker_run (const gchar *repo_path,
+                              const gchar *git_dir_path,
+                              const gchar *path,
+                              const gchar *revision,
+                              GError **error);
+
+void git_blame_libgit2_worker_free_result (GitBlameLibgit2Result *result);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_LIBGIT2_WORKER_H__ */
@@ -0,0 +1,321 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-libgit2.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "git-blame-libgit2-worker.h"
+#include "git-commit.h"
+#include "git-commit-bag.h"
+#include "git-common.h"
+#include "git-oid.h"
+
+/* Blame backend that runs libgit2’s blame in a thread. The whole
+   blame is reported in one go once the thread has finished. */
+
+static void git_blame_libgit2_dispose (GObject *object);
+
+static gboolean git_blame_libgit2_start (GitBlameBackend *backend,
+                                         GFile *repo,
+                                         const gchar *path,
+                                         const gchar *revision,
+                                         GError **error);
+static void git_blame_libgit2_cancel (GitBlameBackend *backend);
+
+struct _GitBlameLibgit2
+{
+  GitBlameBackend parent;
+};
+
+typedef struct
+{
+  /* The cancellable of the task that is currently running */
+  GCancellable *cancellable;
+  GFile *repo;
+} GitBlameLibgit2Private;
+
+typedef struct
+{
+  gchar *repo_path;
+  gchar *git_dir_path;
+  gchar *path;
+  gchar *revision;
+} GitBlameLibgit2TaskData;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitBlameLibgit2,
+                                  git_blame_libgit2,
+                                  GIT_TYPE_BLAME_BACKEND);
+
+static void
+git_blame_libgit2_class_init (GitBlameLibgit2Class *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GitBlameBackendClass *backend_class = (GitBlameBackendClass *) klass;
+
+  gobject_class->dispose = git_blame_libgit2_dispose;
+
+  backend_class->start = git_blame_libgit2_start;
+  backend_class->cancel = git_blame_libgit2_cancel;
+}
+
+static void
+git_blame_libgit2_init (GitBlameLibgit2 *self)
+{
+}
+
+static void
+git_blame_libgit2_cancel (GitBlameBackend *backend)
+{
+  GitBlameLibgit2 *self = (GitBlameLibgit2 *) backend;
+  GitBlameLibgit2Private *priv = git_blame_libgit2_get_instance_private (self);
+
+  /* libgit2 can’t be interrupted so the thread will carry on but its
+     result will be thrown away */
+  if (priv->cancellable)
+    {
+      g_cancellable_cancel (priv->cancellable);
+      g_object_unref (priv->cancellable);
+      priv->cancellable = NULL;
+    }
+
+  if (priv->repo)
+    {
+      g_object_unref (priv->repo);
+      priv->repo = NULL;
+    }
+}
+
+static void
+git_blame_libgit2_dispose (GObject *object)
+{
+  git_blame_libgit2_cancel ((GitBlameBackend *) object);
+
+  G_OBJECT_CLASS (git_blame_libgit2_parent_class)->dispose (object);
+}
+
+GitBlameLibgit2 *
+git_blame_libgit2_new (void)
+{
+  GitBlameLibgit2 *self = g_object_new (GIT_TYPE_BLAME_LIBGIT2, NULL);
+
+  return self;
+}
+
+static void
+git_blame_libgit2_free_task_data (GitBlameLibgit2TaskData *data)
+{
+  g_free (data->repo_path);
+  g_free (data->git_dir_path);
+  g_free (data->path);
+  g_free (data->revision);
+  g_slice_free (GitBlameLibgit2TaskData, data);
+}
+
+static void
+git_blame_libgit2_thread (GTask *task,
+                          gpointer source_object,
+                          gpointer task_data,
+                          GCancellable *cancellable)
+{
+  GitBlameLibgit2TaskData *data = task_data;
+  GError *error = NULL;
+  GitBlameLibgit2Result *result
+    = git_blame_libgit2_worker_run (data->repo_path,
+                                    data->git_dir_path,
+                                    data->path,
+                                    data->revision,
+                                    &error);
+
+  if (result)
+    g_task_return_pointer (task,
+                           result,
+                           (GDestroyNotify)
+                           git_blame_libgit2_worker_free_result);
+  else
+    g_task_return_error (task, error);
+}
+
+static void
+git_blame_libgit2_set_props (GitCommit *commit,
+                             const GitBlameLibgit2Hunk *hunk)
+{
+  gchar *time_str;
+
+  /* These are the same properties that git-blame reports */
+  git_commit_set_prop (commit, "author", hunk->author);
+  git_commit_set_prop (commit, "author-mail", hunk->author_mail);
+
+  time_str = g_strdup_printf ("%" G_GINT64_FORMAT, hunk->author_time);
+  git_commit_set_prop (commit, "author-time", time_str);
+  g_free (time_str);
+
+  if (hunk->summary)
+    git_commit_set_prop (commit, "summary", hunk->summary);
+}
+
+static void
+git_blame_libgit2_on_task_done (GObject *source_object,
+                                GAsyncResult *res,
+                                gpointer user_data)
+{
+  GitBlameLibgit2 *self = (GitBlameLibgit2 *) source_object;
+  GitBlameLibgit2Private *priv = git_blame_libgit2_get_instance_private (self);
+  GitBlameBackend *backend = (GitBlameBackend *) self;
+  GCancellable *cancellable = g_task_get_cancellable (G_TASK (res));
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  GitBlameLibgit2Result *result;
+  GError *error = NULL;
+  guint i;
+
+  /* Ignore tasks that have been cancelled or replaced */
+  if (cancellable != priv->cancellable)
+    return;
+
+  result = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (result == NULL)
+    {
+      git_blame_libgit2_cancel (backend);
+      git_blame_backend_emit_completed (backend, error);
+      g_error_free (error);
+      return;
+    }
+
+  for (i = 0; i < result->hunks->len; i++)
+    {
+      const GitBlameLibgit2Hunk *lg_hunk
+        = &g_array_index (result->hunks, GitBlameLibgit2Hunk, i);
+      GitBlameHunk hunk;
+      GitOid oid;
+
+      /* Don’t trust the line numbers to match the text */
+      if (lg_hunk->final_line < 1
+          || lg_hunk->final_line - 1 > result->n_lines
+          || lg_hunk->n_lines > result->n_lines - (lg_hunk->final_line - 1))
+        continue;
+
+      oid.len = lg_hunk->id_len;
+      memcpy (oid.id, lg_hunk->id, lg_hunk->id_len);
+
+      hunk.commit = g_object_ref (git_commit_bag_get_oid (commit_bag,
+                                                          &oid,
+                                                          priv->repo));
+      hunk.orig_line = lg_hunk->orig_line;
+      hunk.final_line = lg_hunk->final_line;
+      hunk.n_lines = lg_hunk->n_lines;
+      hunk.lines = result->lines + lg_hunk->final_line - 1;
+      hunk.orig_path = lg_hunk->filename;
+      hunk.previous_commit = NULL;
+      hunk.previous_path = NULL;
+      hunk.boundary = FALSE;
+
+      if (lg_hunk->previous_id_len > 0)
+        {
+          oid.len = lg_hunk->previous_id_len;
+          memcpy (oid.id, lg_hunk->previous_id, lg_hunk->previous_id_len);
+          hunk.previous_commit
+            = g_object_ref (git_commit_bag_get_oid (commit_bag,
+                                                    &oid,
+                                                    priv->repo));
+          hunk.previous_path = lg_hunk->previous_path;
+        }
+
+      git_blame_libgit2_set_props (hunk.commit, lg_hunk);
+
+      git_blame_backend_emit_hunk (backend, &hunk);
+      g_object_unref (hunk.commit);
+      if (hunk.previous_commit)
+        g_object_unref (hunk.previous_commit);
+
+      /* The handler might have cancelled the blame */
+      if (cancellable != priv->cancellable)
+        {
+          git_blame_libgit2_worker_free_result (result);
+          return;
+        }
+    }
+
+  git_blame_backend_emit_progress (backend, result->n_lines);
+
+  git_blame_libgit2_worker_free_result (result);
+
+  if (cancellable == priv->cancellable)
+    {
+      git_blame_libgit2_cancel (backend);
+      git_blame_backend_emit_completed (backend, NULL);
+    }
+}
+
+static gboolean
+git_blame_libgit2_start (GitBlameBackend *backend,
+                         GFile *repo,
+                         const gchar *path,
+                         const gchar *revision,
+                         GError **error)
+{
+  GitBlameLibgit2 *self = (GitBlameLibgit2 *) backend;
+  GitBlameLibgit2Private *priv = git_blame_libgit2_get_instance_private (self);
+  GitBlameLibgit2TaskData *data;
+  gchar *repo_path = g_file_get_path (repo);
+  GTask *task;
+
+  if (repo_path == NULL)
+    {
+      gchar *parse_name = g_file_get_parse_name (repo);
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   G_FILE_ERROR_NOENT,
+                   "%s does not exist",
+                   parse_name);
+
+      g_free (parse_name);
+
+      return FALSE;
+    }
+
+  /* The git directory isn’t necessarily in the working tree, such as
+     when it was given with GIT_DIR */
+  GFile *git_dir = git_find_git_dir (repo);
+
+  data = g_slice_new (GitBlameLibgit2TaskData);
+  data->repo_path = repo_path;
+  data->git_dir_path = g_file_get_path (git_dir);
+  data->path = g_strdup (path);
+  data->revision = g_strdup (revision);
+
+  g_object_unref (git_dir);
+
+  priv->repo = g_object_ref (repo);
+  priv->cancellable = g_cancellable_new ();
+
+  task = g_task_new (self, priv->cancellable,
+                     git_blame_libgit2_on_task_done,
+                     NULL);
+  g_task_set_task_data (task,
+                        data,
+                        (GDestroyNotify) git_blame_libgit2_free_task_data);
+  g_task_run_in_thread (task, git_blame_libgit2_thread);
+  g_object_unref (task);
+
+  return TRUE;
+}
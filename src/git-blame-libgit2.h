@@ -0,0 +1,38 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_LIBGIT2_H__
+#define __GIT_BLAME_LIBGIT2_H__
+
+#include <glib-object.h>
+#include "git-blame-backend.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_BLAME_LIBGIT2 git_blame_libgit2_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitBlameLibgit2,
+                      git_blame_libgit2,
+                      GIT,
+                      BLAME_LIBGIT2,
+                      GitBlameBackend);
+
+GitBlameLibgit2 *git_blame_libgit2_new (void);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_LIBGIT2_H__ */
@@ -0,0 +1,1637 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-native.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "git-commit.h"
+#include "git-commit-bag.h"
+#include "git-common.h"
+#include "git-line-diff.h"
+#include "git-object-db.h"
+#include "git-oid.h"
+#include "git-reader.h"
+
+/* Blame backend that walks the history of the file itself using the
+   object database. The walk happens in a thread in the same order as
+   git-blame, newest commit first. The diffs between each version of
+   the file and its parents don’t depend on which lines are still
+   being looked for so they are started in a pool of worker threads as
+   soon as the commits are found, ahead of the walk. On long histories
+   the walk then mostly just has to pick up results that are already
+   there.
+
+   Only the path of the file is followed. Moved or copied lines aren’t
+   detected, just like plain git-blame. */
+
+/* Don’t look further ahead than this many commits */
+#define GIT_BLAME_NATIVE_MAX_PREPARED 1024
+
+typedef struct _GitBlameNativeRun GitBlameNativeRun;
+typedef struct _GitBlameNativeOrigin GitBlameNativeOrigin;
+
+/* One version of the file split into lines. The blob is shared between
+   the walk and the diff jobs and is loaded by whichever gets to it
+   first. */
+typedef struct
+{
+  gint ref_count;
+  GitOid oid;
+
+  GMutex mutex;
+  gboolean loaded;
+  GBytes *data;
+  guint *line_starts;
+  guint n_lines;
+} GitBlameNativeBlob;
+
+typedef struct
+{
+  GitBlameNativeRun *run;
+  GitBlameNativeBlob *parent, *child;
+
+  /* Set by the worker with the run’s mutex locked */
+  gboolean done;
+  GArray *matches;
+  GError *error;
+} GitBlameNativeJob;
+
+/* Lines of the final file that are currently thought to come from a
+   commit. Line numbers count from 0. */
+typedef struct
+{
+  guint final_line;
+  guint suspect_line;
+  guint n_lines;
+} GitBlameNativeEntry;
+
+struct _GitBlameNativeOrigin
+{
+  GitOid commit;
+  GitOid blob_oid;
+  GitBlameNativeBlob *blob;
+
+  gboolean loaded;
+  gboolean prepared;
+  gboolean queued;
+  gboolean props_sent;
+
+  gint64 commit_time;
+  GArray *parent_oids;
+
+  gchar *author;
+  gchar *author_mail;
+  gint64 author_time;
+  gchar *summary;
+
+  /* Parents that have the file */
+  GPtrArray *parents;
+  /* A parent with exactly the same version of the file. If there is
+     one then it gets all of the blame. */
+  GitBlameNativeOrigin *same_parent;
+  /* One job for each of the parents */
+  GPtrArray *jobs;
+
+  GArray *entries;
+};
+
+typedef struct
+{
+  GitOid commit;
+  guint orig_line, final_line, n_lines;
+  /* The first parent that has the file, like git-blame’s ‘previous’
+     header. Only the path is followed so it has the same path. */
+  gboolean has_previous;
+  GitOid previous;
+
+  /* Only set the first time a commit is reported */
+  gchar *author;
+  gchar *author_mail;
+  gint64 author_time;
+  gchar *summary;
+} GitBlameNativeHunk;
+
+/* Sent from the walk to the main thread */
+typedef struct
+{
+  GitBlameNative *backend;
+  GCancellable *cancellable;
+
+  /* The final version of the file, only in the first update */
+  GitBlameNativeBlob *final_blob;
+
+  GArray *hunks;
+  guint n_resolved;
+
+  gboolean finished;
+  GError *error;
+} GitBlameNativeUpdate;
+
+struct _GitBlameNativeRun
+{
+  GitBlameNative *backend;
+  GCancellable *cancellable;
+  GitObjectDb *object_db;
+  gchar *path;
+  GitOid start;
+  /* The contents of the working copy if uncommitted changes should be
+     included */
+  GBytes *working_copy;
+
+  /* Map from a commit id to its origin */
+  GHashTable *origins;
+  /* Origins that have lines to blame ordered by commit time, newest
+     first */
+  GQueue queue;
+  /* Origins that have been found but not prepared yet */
+  GQueue prepare_queue;
+  guint n_prepared;
+  guint max_jobs;
+
+  GThreadPool *pool;
+  /* Set when the walk has stopped so that queued jobs can be
+     skipped */
+  gint stopping;
+
+  /* Protects the results of the jobs and n_running_jobs */
+  GMutex mutex;
+  GCond cond;
+  guint n_running_jobs;
+
+  /* The origin and line that each line of the final file is blamed on
+     once it is known */
+  GitBlameNativeOrigin **resolved_origins;
+  guint *resolved_lines;
+  guint n_final_lines;
+  guint n_resolved;
+  /* Lines before this have been reported */
+  guint next_report;
+
+  GitBlameNativeBlob *final_blob;
+  gboolean sent_final_blob;
+};
+
+struct _GitBlameNative
+{
+  GitBlameBackend parent;
+};
+
+typedef struct
+{
+  /* Used to find the commit to start from */
+  GitReader *reader;
+  guint line_handler;
+  guint completed_handler;
+  GitOid start;
+  gboolean got_start;
+
+  GFile *repo;
+  gchar *path;
+  gboolean working_copy;
+
+  /* The working copy as it was read from the file and the id that git
+     gives it after running it through the clean filters */
+  GBytes *working_copy_data;
+  GitOid clean_oid;
+  gboolean got_clean_oid;
+
+  /* If the filters change the working copy then git-blame is used
+     instead because it can apply them */
+  GitBlameBackend *fallback;
+  guint fallback_hunk_handler;
+  guint fallback_progress_handler;
+  guint fallback_completed_handler;
+
+  /* The cancellable of the walk that is currently running */
+  GCancellable *cancellable;
+
+  /* The lines of the final version of the file */
+  gchar **lines;
+} GitBlameNativePrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitBlameNative,
+                                  git_blame_native,
+                                  GIT_TYPE_BLAME_BACKEND);
+
+static void git_blame_native_dispose (GObject *object);
+
+static gboolean git_blame_native_start (GitBlameBackend *backend,
+                                        GFile *repo,
+                                        const gchar *path,
+                                        const gchar *revision,
+                                        GError **error);
+static void git_blame_native_cancel (GitBlameBackend *backend);
+
+static void
+git_blame_native_class_init (GitBlameNativeClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GitBlameBackendClass *backend_class = (GitBlameBackendClass *) klass;
+
+  gobject_class->dispose = git_blame_native_dispose;
+
+  backend_class->start = git_blame_native_start;
+  backend_class->cancel = git_blame_native_cancel;
+}
+
+static void
+git_blame_native_init (GitBlameNative *self)
+{
+}
+
+GitBlameNative *
+git_blame_native_new (void)
+{
+  GitBlameNative *self = g_object_new (GIT_TYPE_BLAME_NATIVE, NULL);
+
+  return self;
+}
+
+static GitBlameNativeBlob *
+git_blame_native_blob_new (const GitOid *oid)
+{
+  GitBlameNativeBlob *blob = g_slice_new0 (GitBlameNativeBlob);
+
+  blob->ref_count = 1;
+  blob->oid = *oid;
+  g_mutex_init (&blob->mutex);
+
+  return blob;
+}
+
+static GitBlameNativeBlob *
+git_blame_native_blob_ref (GitBlameNativeBlob *blob)
+{
+  g_atomic_int_inc (&blob->ref_count);
+
+  return blob;
+}
+
+static void
+git_blame_native_blob_unref (GitBlameNativeBlob *blob)
+{
+  if (!g_atomic_int_dec_and_test (&blob->ref_count))
+    return;
+
+  if (blob->data)
+    g_bytes_unref (blob->data);
+  g_free (blob->line_starts);
+  g_mutex_clear (&blob->mutex);
+  g_slice_free (GitBlameNativeBlob, blob);
+}
+
+static void
+git_blame_native_blob_set_data (GitBlameNativeBlob *blob, GBytes *data)
+{
+  gsize length;
+  const gchar *text = g_bytes_get_data (data, &length);
+
+  blob->data = data;
+  blob->line_starts = git_line_diff_split (text, length, &blob->n_lines);
+  blob->loaded = TRUE;
+}
+
+/* Can be called from any thread */
+static gboolean
+git_blame_native_blob_load (GitBlameNativeBlob *blob,
+                            GitObjectDb *object_db,
+                            GError **error)
+{
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&blob->mutex);
+
+  if (!blob->loaded)
+    {
+      GBytes *data = git_object_db_read_blob (object_db, &blob->oid, error);
+
+      if (data)
+        git_blame_native_blob_set_data (blob, data);
+      else
+        ret = FALSE;
+    }
+
+  g_mutex_unlock (&blob->mutex);
+
+  return ret;
+}
+
+static void
+git_blame_native_free_job (GitBlameNativeJob *job)
+{
+  if (job->parent)
+    git_blame_native_blob_unref (job->parent);
+  if (job->child)
+    git_blame_native_blob_unref (job->child);
+  if (job->matches)
+    g_array_free (job->matches, TRUE);
+  if (job->error)
+    g_error_free (job->error);
+  g_slice_free (GitBlameNativeJob, job);
+}
+
+static void
+git_blame_native_free_origin (GitBlameNativeOrigin *origin)
+{
+  if (origin->blob)
+    git_blame_native_blob_unref (origin->blob);
+  if (origin->parent_oids)
+    g_array_free (origin->parent_oids, TRUE);
+  if (origin->parents)
+    g_ptr_array_free (origin->parents, TRUE);
+  if (origin->jobs)
+    g_ptr_array_free (origin->jobs, TRUE);
+  g_array_free (origin->entries, TRUE);
+  g_free (origin->author);
+  g_free (origin->author_mail);
+  g_free (origin->summary);
+  g_slice_free (GitBlameNativeOrigin, origin);
+}
+
+static guint
+git_blame_native_hash_oid (gconstpointer key)
+{
+  return git_oid_hash (key);
+}
+
+static gboolean
+git_blame_native_equal_oid (gconstpointer a, gconstpointer b)
+{
+  return git_oid_equal (a, b);
+}
+
+/* Runs in one of the worker threads */
+static void
+git_blame_native_run_job (gpointer data, gpointer user_data)
+{
+  GitBlameNativeJob *job = data;
+  GitBlameNativeRun *run = job->run;
+  GArray *matches = NULL;
+  GError *error = NULL;
+
+  if (g_atomic_int_get (&run->stopping)
+      || g_cancellable_is_cancelled (run->cancellable))
+    ;
+  else if (git_blame_native_blob_load (job->parent, run->object_db, &error)
+           && git_blame_native_blob_load (job->child, run->object_db, &error))
+    {
+      matches = git_line_diff (g_bytes_get_data (job->parent->data, NULL),
+                               job->parent->line_starts,
+                               job->parent->n_lines,
+                               g_bytes_get_data (job->child->data, NULL),
+                               job->child->line_starts,
+                               job->child->n_lines);
+    }
+
+  g_mutex_lock (&run->mutex);
+
+  job->matches = matches;
+  job->error = error;
+  job->done = TRUE;
+  run->n_running_jobs--;
+
+  /* The blobs are only needed for the diff */
+  git_blame_native_blob_unref (job->parent);
+  git_blame_native_blob_unref (job->child);
+  job->parent = job->child = NULL;
+
+  g_cond_broadcast (&run->cond);
+  g_mutex_unlock (&run->mutex);
+}
+
+static GitBlameNativeBlob *
+git_blame_native_get_blob (GitBlameNativeOrigin *origin)
+{
+  if (origin->blob == NULL)
+    origin->blob = git_blame_native_blob_new (&origin->blob_oid);
+
+  return origin->blob;
+}
+
+static GitBlameNativeJob *
+git_blame_native_submit_job (GitBlameNativeRun *run,
+                             GitBlameNativeOrigin *parent,
+                             GitBlameNativeOrigin *child)
+{
+  GitBlameNativeJob *job = g_slice_new0 (GitBlameNativeJob);
+
+  job->run = run;
+  job->parent = git_blame_native_blob_ref (git_blame_native_get_blob (parent));
+  job->child = git_blame_native_blob_ref (git_blame_native_get_blob (child));
+
+  g_mutex_lock (&run->mutex);
+  run->n_running_jobs++;
+  g_mutex_unlock (&run->mutex);
+
+  g_thread_pool_push (run->pool, job, NULL);
+
+  return job;
+}
+
+/* Waits for the job to finish and returns its matches or NULL if it
+   failed */
+static GArray *
+git_blame_native_wait_job (GitBlameNativeRun *run,
+                           GitBlameNativeJob *job,
+                           GError **error)
+{
+  g_mutex_lock (&run->mutex);
+
+  while (!job->done)
+    g_cond_wait (&run->cond, &run->mutex);
+
+  g_mutex_unlock (&run->mutex);
+
+  if (job->matches == NULL)
+    {
+      if (job->error)
+        g_propagate_error (error, g_error_copy (job->error));
+      else
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                     "The blame was cancelled");
+    }
+
+  return job->matches;
+}
+
+static void
+git_blame_native_parse_author (GitBlameNativeOrigin *origin,
+                               const gchar *line,
+                               gsize length)
+{
+  const gchar *mail_start = memchr (line, '<', length);
+  const gchar *mail_end = g_strrstr_len (line, length, ">");
+
+  if (mail_start == NULL || mail_end == NULL || mail_end < mail_start)
+    return;
+
+  origin->author = g_strndup (line,
+                              mail_start > line && mail_start[-1] == ' '
+                              ? mail_start - 1 - line
+                              : mail_start - line);
+  origin->author_mail = g_strndup (mail_start, mail_end + 1 - mail_start);
+  origin->author_time = g_ascii_strtoll (mail_end + 1, NULL, 10);
+}
+
+/* Reads the commit of an origin and finds which version of the file it
+   has. Returns FALSE if the commit doesn’t have the file. */
+static gboolean
+git_blame_native_load_origin (GitBlameNativeRun *run,
+                              GitBlameNativeOrigin *origin,
+                              GError **error)
+{
+  GError *find_error = NULL;
+  const gchar *p, *end;
+  GBytes *raw;
+  GitObjectType type;
+
+  origin->loaded = TRUE;
+
+  raw = git_object_db_read (run->object_db, &origin->commit, &type, error);
+
+  if (raw == NULL)
+    return FALSE;
+
+  if (type != GIT_OBJECT_TYPE_COMMIT)
+    {
+      g_bytes_unref (raw);
+      g_set_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Object is not a commit");
+      return FALSE;
+    }
+
+  origin->parent_oids = g_array_new (FALSE, FALSE, sizeof (GitOid));
+
+  p = g_bytes_get_data (raw, NULL);
+  end = p + g_bytes_get_size (raw);
+
+  while (p < end && *p != '\n')
+    {
+      const gchar *eol = memchr (p, '\n', end - p);
+      GitOid oid;
+
+      if (eol == NULL)
+        eol = end;
+
+      if (g_str_has_prefix (p, "parent ")
+          && git_oid_parse_hex (&oid, p + 7, eol - (p + 7)))
+        g_array_append_val (origin->parent_oids, oid);
+      else if (g_str_has_prefix (p, "author "))
+        git_blame_native_parse_author (origin, p + 7, eol - (p + 7));
+      else if (g_str_has_prefix (p, "committer "))
+        {
+          const gchar *mail_end = g_strrstr_len (p, eol - p, ">");
+
+          if (mail_end)
+            origin->commit_time = g_ascii_strtoll (mail_end + 1, NULL, 10);
+        }
+
+      p = eol + 1;
+    }
+
+  /* The summary is the first line of the message */
+  if (p < end)
+    {
+      const gchar *eol;
+
+      p++;
+      eol = memchr (p, '\n', end - p);
+      origin->summary = g_strndup (p, (eol ? eol : end) - p);
+    }
+
+  g_bytes_unref (raw);
+
+  if (git_object_db_find_blob_at_path (run->object_db,
+                                       &origin->commit,
+                                       run->path,
+                                       &origin->blob_oid,
+                                       &find_error))
+    return TRUE;
+
+  if (g_error_matches (find_error, GIT_ERROR, GIT_ERROR_NOT_FOUND))
+    g_error_free (find_error);
+  else
+    g_propagate_error (error, find_error);
+
+  return FALSE;
+}
+
+static GitBlameNativeOrigin *
+git_blame_native_new_origin (GitBlameNativeRun *run, const GitOid *commit)
+{
+  GitBlameNativeOrigin *origin = g_slice_new0 (GitBlameNativeOrigin);
+
+  origin->commit = *commit;
+  origin->entries = g_array_new (FALSE, FALSE, sizeof (GitBlameNativeEntry));
+
+  g_hash_table_insert (run->origins, &origin->commit, origin);
+
+  return origin;
+}
+
+static gint
+git_blame_native_compare_time (gconstpointer a,
+                               gconstpointer b,
+                               gpointer user_data)
+{
+  const GitBlameNativeOrigin *origin_a = a, *origin_b = b;
+
+  if (origin_a->commit_time > origin_b->commit_time)
+    return -1;
+  else if (origin_a->commit_time < origin_b->commit_time)
+    return 1;
+  else
+    return 0;
+}
+
+/* Finds the parents of the origin that have the file and starts
+   diffing against them */
+static gboolean
+git_blame_native_prepare_origin (GitBlameNativeRun *run,
+                                 GitBlameNativeOrigin *origin,
+                                 GError **error)
+{
+  guint i;
+
+  if (origin->prepared)
+    return TRUE;
+
+  origin->prepared = TRUE;
+  run->n_prepared++;
+  origin->parents = g_ptr_array_new ();
+  origin->jobs
+    = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                      git_blame_native_free_job);
+
+  for (i = 0; i < origin->parent_oids->len; i++)
+    {
+      const GitOid *oid = &g_array_index (origin->parent_oids, GitOid, i);
+      GitBlameNativeOrigin *parent = g_hash_table_lookup (run->origins, oid);
+      GError *load_error = NULL;
+
+      if (parent == NULL)
+        {
+          parent = git_blame_native_new_origin (run, oid);
+
+          if (!git_blame_native_load_origin (run, parent, &load_error)
+              && load_error)
+            {
+              g_propagate_error (error, load_error);
+              return FALSE;
+            }
+        }
+
+      /* The parent doesn’t have the file */
+      if (parent->parent_oids == NULL || parent->blob_oid.len == 0)
+        continue;
+
+      if (git_oid_equal (&parent->blob_oid, &origin->blob_oid))
+        {
+          origin->same_parent = parent;
+          g_ptr_array_set_size (origin->parents, 0);
+          g_ptr_array_add (origin->parents, parent);
+          break;
+        }
+
+      g_ptr_array_add (origin->parents, parent);
+    }
+
+  for (i = 0; i < origin->parents->len; i++)
+    {
+      GitBlameNativeOrigin *parent = g_ptr_array_index (origin->parents, i);
+
+      g_ptr_array_add (origin->jobs,
+                       origin->same_parent
+                       ? NULL
+                       : git_blame_native_submit_job (run, parent, origin));
+
+      if (!parent->prepared)
+        g_queue_insert_sorted (&run->prepare_queue,
+                               parent,
+                               git_blame_native_compare_time,
+                               NULL);
+    }
+
+  return TRUE;
+}
+
+/* Prepares origins ahead of the walk so that the worker threads have
+   something to do */
+static gboolean
+git_blame_native_prepare_ahead (GitBlameNativeRun *run, GError **error)
+{
+  while (run->n_prepared < GIT_BLAME_NATIVE_MAX_PREPARED)
+    {
+      GitBlameNativeOrigin *origin;
+      guint n_running_jobs;
+
+      g_mutex_lock (&run->mutex);
+      n_running_jobs = run->n_running_jobs;
+      g_mutex_unlock (&run->mutex);
+
+      if (n_running_jobs >= run->max_jobs)
+        break;
+
+      origin = g_queue_pop_head (&run->prepare_queue);
+
+      if (origin == NULL)
+        break;
+
+      if (!git_blame_native_prepare_origin (run, origin, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+git_blame_native_queue_origin (GitBlameNativeRun *run,
+                               GitBlameNativeOrigin *origin)
+{
+  if (origin->queued)
+    return;
+
+  origin->queued = TRUE;
+  g_queue_insert_sorted (&run->queue,
+                         origin,
+                         git_blame_native_compare_time,
+                         NULL);
+}
+
+static void
+git_blame_native_add_entry (GArray *entries,
+                            guint final_line,
+                            guint suspect_line,
+                            guint n_lines)
+{
+  GitBlameNativeEntry entry = { final_line, suspect_line, n_lines };
+
+  g_array_append_val (entries, entry);
+}
+
+/* Gives the parts of the entries that are the same in the parent to
+   the parent and returns the rest */
+static GArray *
+git_blame_native_pass_blame (GArray *entries,
+                             GArray *matches,
+                             GitBlameNativeOrigin *parent)
+{
+  GArray *remaining = g_array_new (FALSE, FALSE,
+                                   sizeof (GitBlameNativeEntry));
+  guint i;
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const GitBlameNativeEntry *entry
+        = &g_array_index (entries, GitBlameNativeEntry, i);
+      guint pos = entry->suspect_line;
+      guint end = pos + entry->n_lines;
+      guint lo = 0, hi = matches->len;
+
+      /* Find the first match that ends after the start of the entry */
+      while (lo < hi)
+        {
+          guint mid = (lo + hi) / 2;
+          const GitLineDiffMatch *match
+            = &g_array_index (matches, GitLineDiffMatch, mid);
+
+          if (match->b_line + match->n_lines <= pos)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+
+      while (pos < end)
+        {
+          const GitLineDiffMatch *match;
+          guint take;
+
+          if (lo >= matches->len
+              || (match = &g_array_index (matches,
+                                          GitLineDiffMatch,
+                                          lo))->b_line >= end)
+            {
+              git_blame_native_add_entry (remaining,
+                                          entry->final_line
+                                          + pos - entry->suspect_line,
+                                          pos,
+                                          end - pos);
+              break;
+            }
+
+          if (match->b_line > pos)
+            {
+              git_blame_native_add_entry (remaining,
+                                          entry->final_line
+                                          + pos - entry->suspect_line,
+                                          pos,
+                                          match->b_line - pos);
+              pos = match->b_line;
+            }
+
+          take = MIN (end, match->b_line + match->n_lines) - pos;
+
+          git_blame_native_add_entry (parent->entries,
+                                      entry->final_line
+                                      + pos - entry->suspect_line,
+                                      match->a_line + pos - match->b_line,
+                                      take);
+
+          pos += take;
+          lo++;
+        }
+    }
+
+  return remaining;
+}
+
+static gboolean
+git_blame_native_process_origin (GitBlameNativeRun *run,
+                                 GitBlameNativeOrigin *origin,
+                                 GError **error)
+{
+  GArray *entries = origin->entries;
+  guint i, j;
+
+  origin->queued = FALSE;
+  origin->entries = g_array_new (FALSE, FALSE, sizeof (GitBlameNativeEntry));
+
+  if (!git_blame_native_prepare_origin (run, origin, error))
+    {
+      g_array_free (entries, TRUE);
+      return FALSE;
+    }
+
+  if (origin->same_parent)
+    {
+      /* Nothing changed in this commit so the parent gets everything */
+      g_array_append_vals (origin->same_parent->entries,
+                           entries->data,
+                           entries->len);
+      g_array_set_size (entries, 0);
+      git_blame_native_queue_origin (run, origin->same_parent);
+    }
+  else
+    {
+      for (i = 0; i < origin->parents->len && entries->len > 0; i++)
+        {
+          GitBlameNativeOrigin *parent
+            = g_ptr_array_index (origin->parents, i);
+          GitBlameNativeJob *job = g_ptr_array_index (origin->jobs, i);
+          GArray *matches = git_blame_native_wait_job (run, job, error);
+          GArray *remaining;
+          guint old_len = parent->entries->len;
+
+          if (matches == NULL)
+            {
+              g_array_free (entries, TRUE);
+              return FALSE;
+            }
+
+          remaining = git_blame_native_pass_blame (entries, matches, parent);
+          g_array_free (entries, TRUE);
+          entries = remaining;
+
+          if (parent->entries->len > old_len)
+            git_blame_native_queue_origin (run, parent);
+        }
+    }
+
+  /* Whatever is left was changed by this commit */
+  for (i = 0; i < entries->len; i++)
+    {
+      const GitBlameNativeEntry *entry
+        = &g_array_index (entries, GitBlameNativeEntry, i);
+
+      for (j = 0; j < entry->n_lines; j++)
+        {
+          run->resolved_origins[entry->final_line + j] = origin;
+          run->resolved_lines[entry->final_line + j] = entry->suspect_line + j;
+        }
+
+      run->n_resolved += entry->n_lines;
+    }
+
+  g_array_free (entries, TRUE);
+
+  /* The contents of this version won’t be needed again unless another
+     child passes blame to it later */
+  if (origin->blob)
+    {
+      git_blame_native_blob_unref (origin->blob);
+      origin->blob = NULL;
+    }
+
+  return TRUE;
+}
+
+static void
+git_blame_native_free_update (GitBlameNativeUpdate *update)
+{
+  guint i;
+
+  for (i = 0; i < update->hunks->len; i++)
+    {
+      GitBlameNativeHunk *hunk
+        = &g_array_index (update->hunks, GitBlameNativeHunk, i);
+
+      g_free (hunk->author);
+      g_free (hunk->author_mail);
+      g_free (hunk->summary);
+    }
+
+  g_array_free (update->hunks, TRUE);
+
+  if (update->final_blob)
+    git_blame_native_blob_unref (update->final_blob);
+  if (update->error)
+    g_error_free (update->error);
+
+  g_object_unref (update->cancellable);
+  g_object_unref (update->backend);
+  g_slice_free (GitBlameNativeUpdate, update);
+}
+
+static gboolean git_blame_native_on_update (gpointer user_data);
+
+/* Sends the lines at the start of the file that have been resolved
+   since the last update to the main thread. Hunks are always reported
+   in order. */
+static void
+git_blame_native_send_update (GitBlameNativeRun *run,
+                              gboolean finished,
+                              GError *error)
+{
+  GitBlameNativeUpdate *update = g_slice_new0 (GitBlameNativeUpdate);
+
+  update->backend = g_object_ref (run->backend);
+  update->cancellable = g_object_ref (run->cancellable);
+  update->hunks = g_array_new (FALSE, FALSE, sizeof (GitBlameNativeHunk));
+  update->finished = finished;
+  update->error = error;
+
+  if (!run->sent_final_blob && run->final_blob)
+    {
+      update->final_blob = git_blame_native_blob_ref (run->final_blob);
+      run->sent_final_blob = TRUE;
+    }
+
+  while (run->next_report < run->n_final_lines
+         && run->resolved_origins[run->next_report])
+    {
+      GitBlameNativeOrigin *origin = run->resolved_origins[run->next_report];
+      GitBlameNativeHunk hunk = { 0 };
+      guint end = run->next_report + 1;
+
+      while (end < run->n_final_lines
+             && run->resolved_origins[end] == origin
+             && (run->resolved_lines[end]
+                 == run->resolved_lines[end - 1] + 1))
+        end++;
+
+      hunk.commit = origin->commit;
+      hunk.orig_line = run->resolved_lines[run->next_report] + 1;
+      hunk.final_line = run->next_report + 1;
+      hunk.n_lines = end - run->next_report;
+
+      if (origin->parents && origin->parents->len > 0)
+        {
+          GitBlameNativeOrigin *parent = g_ptr_array_index (origin->parents, 0);
+
+          hunk.has_previous = TRUE;
+          hunk.previous = parent->commit;
+        }
+
+      if (!origin->props_sent)
+        {
+          hunk.author = g_strdup (origin->author);
+          hunk.author_mail = g_strdup (origin->author_mail);
+          hunk.author_time = origin->author_time;
+          hunk.summary = g_strdup (origin->summary);
+          origin->props_sent = TRUE;
+        }
+
+      g_array_append_val (update->hunks, hunk);
+      run->next_report = end;
+    }
+
+  update->n_resolved = run->n_resolved;
+
+  if (update->hunks->len == 0 && !finished && update->final_blob == NULL)
+    {
+      git_blame_native_free_update (update);
+      return;
+    }
+
+  g_main_context_invoke (NULL, git_blame_native_on_update, update);
+}
+
+static gboolean
+git_blame_native_walk (GitBlameNativeRun *run, GError **error)
+{
+  GitBlameNativeOrigin *start, *origin;
+  GitOid zero_oid;
+
+  start = git_blame_native_new_origin (run, &run->start);
+
+  if (!git_blame_native_load_origin (run, start, error))
+    {
+      if (*error)
+        return FALSE;
+
+      /* A new file that hasn’t been committed yet is all blamed on the
+         working copy */
+      if (!run->working_copy)
+        {
+          g_set_error (error, GIT_ERROR, GIT_ERROR_NOT_FOUND,
+                       "%s does not exist in the revision", run->path);
+          return FALSE;
+        }
+    }
+
+  if (run->working_copy)
+    {
+      /* The uncommitted changes are blamed on the zero commit id whose
+         only parent is HEAD */
+      GitBlameNativeOrigin *head = start;
+
+      memset (&zero_oid, 0, sizeof zero_oid);
+      zero_oid.len = head->commit.len;
+
+      start = git_blame_native_new_origin (run, &zero_oid);
+      start->loaded = TRUE;
+      start->commit_time = G_MAXINT64;
+      start->parent_oids = g_array_new (FALSE, FALSE, sizeof (GitOid));
+      g_array_append_val (start->parent_oids, head->commit);
+      start->blob_oid = zero_oid;
+      start->blob = git_blame_native_blob_new (&zero_oid);
+      git_blame_native_blob_set_data (start->blob,
+                                      g_bytes_ref (run->working_copy));
+      start->author = g_strdup ("Not Committed Yet");
+      start->author_mail = g_strdup ("<not.committed.yet>");
+      start->author_time = g_get_real_time () / G_USEC_PER_SEC;
+      start->summary = g_strdup_printf ("Version of %s from %s",
+                                        run->path, run->path);
+    }
+
+  run->final_blob = git_blame_native_blob_ref (git_blame_native_get_blob (start));
+
+  if (!git_blame_native_blob_load (run->final_blob, run->object_db, error))
+    return FALSE;
+
+  run->n_final_lines = run->final_blob->n_lines;
+  run->resolved_origins = g_new0 (GitBlameNativeOrigin *, run->n_final_lines);
+  run->resolved_lines = g_new0 (guint, run->n_final_lines);
+
+  if (run->n_final_lines > 0)
+    git_blame_native_add_entry (start->entries, 0, 0, run->n_final_lines);
+
+  git_blame_native_send_update (run, FALSE, NULL);
+
+  git_blame_native_queue_origin (run, start);
+
+  if (!git_blame_native_prepare_origin (run, start, error))
+    return FALSE;
+
+  while ((origin = g_queue_pop_head (&run->queue)))
+    {
+      if (g_cancellable_set_error_if_cancelled (run->cancellable, error))
+        return FALSE;
+
+      if (!git_blame_native_prepare_ahead (run, error)
+          || !git_blame_native_process_origin (run, origin, error))
+        return FALSE;
+
+      git_blame_native_send_update (run, FALSE, NULL);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+git_blame_native_unref_idle (gpointer user_data)
+{
+  g_object_unref (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+git_blame_native_free_run (GitBlameNativeRun *run)
+{
+  /* Let the jobs that are still queued notice that the walk has
+     stopped and wait for them to finish */
+  g_atomic_int_set (&run->stopping, TRUE);
+  g_thread_pool_free (run->pool, FALSE, TRUE);
+
+  g_hash_table_destroy (run->origins);
+  g_queue_clear (&run->queue);
+  g_queue_clear (&run->prepare_queue);
+  g_mutex_clear (&run->mutex);
+  g_cond_clear (&run->cond);
+
+  if (run->final_blob)
+    git_blame_native_blob_unref (run->final_blob);
+  if (run->working_copy)
+    g_bytes_unref (run->working_copy);
+  g_free (run->resolved_origins);
+  g_free (run->resolved_lines);
+  g_free (run->path);
+  g_object_unref (run->object_db);
+  g_object_unref (run->cancellable);
+
+  /* The backend might not have any other references and it should
+     only be destroyed in the main thread */
+  g_idle_add (git_blame_native_unref_idle, run->backend);
+
+  g_slice_free (GitBlameNativeRun, run);
+}
+
+static gpointer
+git_blame_native_thread (gpointer data)
+{
+  GitBlameNativeRun *run = data;
+  GError *error = NULL;
+
+  if (git_blame_native_walk (run, &error))
+    git_blame_native_send_update (run, TRUE, NULL);
+  else
+    git_blame_native_send_update (run, TRUE, error);
+
+  git_blame_native_free_run (run);
+
+  return NULL;
+}
+
+static void
+git_blame_native_split_final_lines (GitBlameNative *self,
+                                    GitBlameNativeBlob *blob)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  const gchar *text = g_bytes_get_data (blob->data, NULL);
+  guint i;
+
+  g_strfreev (priv->lines);
+  priv->lines = g_new (gchar *, blob->n_lines + 1);
+
+  for (i = 0; i < blob->n_lines; i++)
+    {
+      guint start = blob->line_starts[i], end = blob->line_starts[i + 1];
+
+      if (end > start && text[end - 1] == '\n')
+        end--;
+
+      priv->lines[i] = g_strndup (text + start, end - start);
+    }
+
+  priv->lines[blob->n_lines] = NULL;
+}
+
+static void
+git_blame_native_set_props (GitCommit *commit, const GitBlameNativeHunk *hunk)
+{
+  gchar *time_str;
+
+  /* These are the same properties that git-blame reports */
+  if (hunk->author)
+    git_commit_set_prop (commit, "author", hunk->author);
+  if (hunk->author_mail)
+    git_commit_set_prop (commit, "author-mail", hunk->author_mail);
+
+  time_str = g_strdup_printf ("%" G_GINT64_FORMAT, hunk->author_time);
+  git_commit_set_prop (commit, "author-time", time_str);
+  g_free (time_str);
+
+  if (hunk->summary)
+    git_commit_set_prop (commit, "summary", hunk->summary);
+}
+
+/* Runs in the main thread */
+static gboolean
+git_blame_native_on_update (gpointer user_data)
+{
+  GitBlameNativeUpdate *update = user_data;
+  GitBlameNative *self = update->backend;
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  GitBlameBackend *backend = (GitBlameBackend *) self;
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  guint i;
+
+  /* Ignore updates from walks that have been cancelled or replaced */
+  if (update->cancellable != priv->cancellable)
+    goto done;
+
+  if (update->final_blob)
+    git_blame_native_split_final_lines (self, update->final_blob);
+
+  for (i = 0; i < update->hunks->len; i++)
+    {
+      const GitBlameNativeHunk *native_hunk
+        = &g_array_index (update->hunks, GitBlameNativeHunk, i);
+      GitBlameHunk hunk;
+
+      hunk.commit = g_object_ref (git_commit_bag_get_oid (commit_bag,
+                                                          &native_hunk->commit,
+                                                          priv->repo));
+      hunk.orig_line = native_hunk->orig_line;
+      hunk.final_line = native_hunk->final_line;
+      hunk.n_lines = native_hunk->n_lines;
+      hunk.lines = priv->lines + native_hunk->final_line - 1;
+      hunk.orig_path = priv->path;
+
+      if (native_hunk->has_previous)
+        {
+          hunk.previous_commit = git_commit_bag_get_oid (commit_bag,
+                                                         &native_hunk->previous,
+                                                         priv->repo);
+          hunk.previous_path = priv->path;
+        }
+      else
+        {
+          hunk.previous_commit = NULL;
+          hunk.previous_path = NULL;
+        }
+
+      hunk.boundary = FALSE;
+
+      if (native_hunk->author)
+        git_blame_native_set_props (hunk.commit, native_hunk);
+
+      git_blame_backend_emit_hunk (backend, &hunk);
+      g_object_unref (hunk.commit);
+
+      /* The handler might have cancelled the blame */
+      if (update->cancellable != priv->cancellable)
+        goto done;
+    }
+
+  git_blame_backend_emit_progress (backend, update->n_resolved);
+
+  if (update->finished && update->cancellable == priv->cancellable)
+    {
+      g_object_ref (self);
+      git_blame_native_cancel (backend);
+      git_blame_backend_emit_completed (backend, update->error);
+      g_object_unref (self);
+    }
+
+ done:
+  git_blame_native_free_update (update);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+git_blame_native_start_walk (GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  GitBlameNativeRun *run = g_slice_new0 (GitBlameNativeRun);
+  guint n_threads = g_get_num_processors ();
+
+  run->backend = g_object_ref (self);
+  run->cancellable = g_object_ref (priv->cancellable);
+  run->object_db
+    = g_object_ref (git_commit_bag_get_object_db (git_commit_bag_get_default (),
+                                                  priv->repo));
+  run->path = g_strdup (priv->path);
+  run->start = priv->start;
+  run->origins
+    = g_hash_table_new_full (git_blame_native_hash_oid,
+                             git_blame_native_equal_oid,
+                             NULL,
+                             (GDestroyNotify) git_blame_native_free_origin);
+  g_queue_init (&run->queue);
+  g_queue_init (&run->prepare_queue);
+  g_mutex_init (&run->mutex);
+  g_cond_init (&run->cond);
+  run->max_jobs = n_threads * GIT_BLAME_NATIVE_DIFFS_PER_THREAD;
+  run->pool = g_thread_pool_new (git_blame_native_run_job,
+                                 NULL,
+                                 n_threads,
+                                 FALSE,
+                                 NULL);
+
+  if (priv->working_copy_data)
+    run->working_copy = g_bytes_ref (priv->working_copy_data);
+
+  g_thread_unref (g_thread_new ("blame", git_blame_native_thread, run));
+}
+
+static void
+git_blame_native_unref_reader (GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+
+  if (priv->reader)
+    {
+      g_signal_handler_disconnect (priv->reader, priv->line_handler);
+      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
+      g_object_unref (priv->reader);
+      priv->reader = NULL;
+    }
+}
+
+static gboolean
+git_blame_native_on_line (GitReader *reader,
+                          guint length, const gchar *line,
+                          GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+
+  if (!priv->got_start
+      && length > 0
+      && git_oid_parse_hex (&priv->start, line, length) == length - 1
+      && line[length - 1] == '\n')
+    priv->got_start = TRUE;
+
+  return TRUE;
+}
+
+/* Stops everything and reports that the blame has finished */
+static void
+git_blame_native_finish (GitBlameNative *self, const GError *error)
+{
+  g_object_ref (self);
+  git_blame_native_cancel ((GitBlameBackend *) self);
+  git_blame_backend_emit_completed ((GitBlameBackend *) self, error);
+  g_object_unref (self);
+}
+
+static void
+git_blame_native_on_fallback_hunk (GitBlameBackend *fallback,
+                                   const GitBlameHunk *hunk,
+                                   GitBlameNative *self)
+{
+  git_blame_backend_emit_hunk ((GitBlameBackend *) self, hunk);
+}
+
+static void
+git_blame_native_on_fallback_progress (GitBlameBackend *fallback,
+                                       guint n_lines,
+                                       GitBlameNative *self)
+{
+  git_blame_backend_emit_progress ((GitBlameBackend *) self, n_lines);
+}
+
+static void
+git_blame_native_on_fallback_completed (GitBlameBackend *fallback,
+                                        const GError *error,
+                                        GitBlameNative *self)
+{
+  git_blame_native_finish (self, error);
+}
+
+static void
+git_blame_native_start_fallback (GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  GError *error = NULL;
+
+  priv->fallback = git_blame_backend_new (GIT_BLAME_BACKEND_TYPE_PROCESS);
+  priv->fallback_hunk_handler
+    = g_signal_connect (priv->fallback, "hunk",
+                        G_CALLBACK (git_blame_native_on_fallback_hunk),
+                        self);
+  priv->fallback_progress_handler
+    = g_signal_connect (priv->fallback, "progress",
+                        G_CALLBACK (git_blame_native_on_fallback_progress),
+                        self);
+  priv->fallback_completed_handler
+    = g_signal_connect (priv->fallback, "completed",
+                        G_CALLBACK (git_blame_native_on_fallback_completed),
+                        self);
+
+  if (!git_blame_backend_start (priv->fallback,
+                                priv->repo,
+                                priv->path,
+                                NULL, /* revision */
+                                &error))
+    {
+      git_blame_native_finish (self, error);
+      g_error_free (error);
+    }
+}
+
+/* Works out the id of the data as a blob in the same way that git
+   does. Returns FALSE if the hash isn’t known. */
+static gboolean
+git_blame_native_hash_blob (GBytes *data, guint hash_len, GitOid *oid)
+{
+  GChecksumType type;
+  GChecksum *checksum;
+  gchar *header;
+  gsize digest_len = hash_len;
+
+  if (hash_len == GIT_OID_SHA1_LENGTH)
+    type = G_CHECKSUM_SHA1;
+  else if (hash_len == GIT_OID_SHA256_LENGTH)
+    type = G_CHECKSUM_SHA256;
+  else
+    return FALSE;
+
+  checksum = g_checksum_new (type);
+
+  /* The header includes the terminating nul */
+  header = g_strdup_printf ("blob %" G_GSIZE_FORMAT, g_bytes_get_size (data));
+  g_checksum_update (checksum, (const guchar *) header, strlen (header) + 1);
+  g_free (header);
+
+  g_checksum_update (checksum,
+                     g_bytes_get_data (data, NULL),
+                     g_bytes_get_size (data));
+
+  oid->len = hash_len;
+  g_checksum_get_digest (checksum, oid->id, &digest_len);
+
+  g_checksum_free (checksum);
+
+  return TRUE;
+}
+
+static gboolean
+git_blame_native_on_hash_line (GitReader *reader,
+                               guint length, const gchar *line,
+                               GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+
+  if (!priv->got_clean_oid
+      && length > 0
+      && git_oid_parse_hex (&priv->clean_oid, line, length) == length - 1
+      && line[length - 1] == '\n')
+    priv->got_clean_oid = TRUE;
+
+  return TRUE;
+}
+
+static void
+git_blame_native_on_hash_completed (GitReader *reader,
+                                    const GError *error,
+                                    GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  GError *parse_error = NULL;
+  GitOid oid;
+
+  git_blame_native_unref_reader (self);
+
+  if (error == NULL && !priv->got_clean_oid)
+    {
+      g_set_error (&parse_error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Invalid output from git-hash-object");
+      error = parse_error;
+    }
+
+  if (error)
+    git_blame_native_finish (self, error);
+  else if (git_blame_native_hash_blob (priv->working_copy_data,
+                                       priv->clean_oid.len,
+                                       &oid)
+           && git_oid_equal (&oid, &priv->clean_oid))
+    git_blame_native_start_walk (self);
+  else
+    git_blame_native_start_fallback (self);
+
+  g_clear_error (&parse_error);
+}
+
+/* The blame is of the working copy as git would commit it, ie, after
+   the clean filters and any line ending conversion. Rather than
+   trying to apply those, the file is read as it is and git
+   hash-object is used to check whether they change anything. If they
+   do then git-blame is used instead. */
+static void
+git_blame_native_check_filters (GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  gchar *repo_path = g_file_get_path (priv->repo);
+  gchar *filename = g_build_filename (repo_path, priv->path, NULL);
+  GError *error = NULL;
+  gchar *contents;
+  gsize length;
+
+  /* Like git, a symlink is blamed as the path that it points to.
+     Filters never apply to those so there is nothing to check. */
+  if (g_file_test (filename, G_FILE_TEST_IS_SYMLINK))
+    {
+      contents = g_file_read_link (filename, &error);
+
+      if (contents)
+        {
+          priv->working_copy_data = g_bytes_new_take (contents,
+                                                      strlen (contents));
+          git_blame_native_start_walk (self);
+        }
+    }
+  else if (g_file_get_contents (filename, &contents, &length, &error))
+    {
+      priv->working_copy_data = g_bytes_new_take (contents, length);
+      priv->got_clean_oid = FALSE;
+
+      priv->reader = git_reader_new ();
+      priv->line_handler
+        = g_signal_connect (priv->reader, "line",
+                            G_CALLBACK (git_blame_native_on_hash_line),
+                            self);
+      priv->completed_handler
+        = g_signal_connect (priv->reader, "completed",
+                            G_CALLBACK (git_blame_native_on_hash_completed),
+                            self);
+
+      git_reader_start (priv->reader, priv->repo, &error,
+                        "hash-object", "--", priv->path, NULL);
+    }
+
+  g_free (filename);
+  g_free (repo_path);
+
+  if (error)
+    {
+      git_blame_native_finish (self, error);
+      g_error_free (error);
+    }
+}
+
+static void
+git_blame_native_on_completed (GitReader *reader,
+                               const GError *error,
+                               GitBlameNative *self)
+{
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  GError *parse_error = NULL;
+
+  git_blame_native_unref_reader (self);
+
+  if (error == NULL && !priv->got_start)
+    {
+      g_set_error (&parse_error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Invalid output from git-rev-parse");
+      error = parse_error;
+    }
+
+  if (error)
+    git_blame_native_finish (self, error);
+  else if (priv->working_copy)
+    git_blame_native_check_filters (self);
+  else
+    git_blame_native_start_walk (self);
+
+  g_clear_error (&parse_error);
+}
+
+static void
+git_blame_native_cancel (GitBlameBackend *backend)
+{
+  GitBlameNative *self = (GitBlameNative *) backend;
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+
+  git_blame_native_unref_reader (self);
+
+  if (priv->fallback)
+    {
+      g_signal_handler_disconnect (priv->fallback,
+                                   priv->fallback_hunk_handler);
+      g_signal_handler_disconnect (priv->fallback,
+                                   priv->fallback_progress_handler);
+      g_signal_handler_disconnect (priv->fallback,
+                                   priv->fallback_completed_handler);
+      git_blame_backend_cancel (priv->fallback);
+      g_object_unref (priv->fallback);
+      priv->fallback = NULL;
+    }
+
+  if (priv->working_copy_data)
+    {
+      g_bytes_unref (priv->working_copy_data);
+      priv->working_copy_data = NULL;
+    }
+
+  /* The thread notices this when it next looks and any updates that it
+     has already sent will be ignored */
+  if (priv->cancellable)
+    {
+      g_cancellable_cancel (priv->cancellable);
+      g_object_unref (priv->cancellable);
+      priv->cancellable = NULL;
+    }
+
+  if (priv->repo)
+    {
+      g_object_unref (priv->repo);
+      priv->repo = NULL;
+    }
+
+  g_free (priv->path);
+  priv->path = NULL;
+
+  g_strfreev (priv->lines);
+  priv->lines = NULL;
+}
+
+static void
+git_blame_native_dispose (GObject *object)
+{
+  git_blame_native_cancel ((GitBlameBackend *) object);
+
+  G_OBJECT_CLASS (git_blame_native_parent_class)->dispose (object);
+}
+
+static gboolean
+git_blame_native_start (GitBlameBackend *backend,
+                        GFile *repo,
+                        const gchar *path,
+                        const gchar *revision,
+                        GError **error)
+{
+  GitBlameNative *self = (GitBlameNative *) backend;
+  GitBlameNativePrivate *priv = git_blame_native_get_instance_private (self);
+  gchar *rev_arg;
+  gboolean ret;
+
+  priv->repo = g_object_ref (repo);
+  priv->path = g_strdup (path);
+  priv->working_copy = revision == NULL;
+  priv->got_start = FALSE;
+  priv->cancellable = g_cancellable_new ();
+
+  /* Find the commit to start from first. Without a revision the walk
+     starts from HEAD with the working copy on top of it. */
+  priv->reader = git_reader_new ();
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_blame_native_on_line),
+                        self);
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_blame_native_on_completed),
+                        self);
+
+  rev_arg = g_strconcat (revision ? revision : "HEAD", "^{commit}", NULL);
+  ret = git_reader_start (priv->reader, repo, error,
+                          "rev-parse", "--verify", rev_arg, NULL);
+  g_free (rev_arg);
+
+  if (!ret)
+    git_blame_native_cancel (backend);
+
+  return ret;
+}
@@ -0,0 +1,41 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_NATIVE_H__
+#define __GIT_BLAME_NATIVE_H__
+
+#include <glib-object.h>
+#include "git-blame-backend.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_BLAME_NATIVE git_blame_native_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitBlameNative,
+                      git_blame_native,
+                      GIT,
+                      BLAME_NATIVE,
+                      GitBlameBackend);
+
+/* Maximum number of diffs to run ahead of the commit being blamed */
+#define GIT_BLAME_NATIVE_DIFFS_PER_THREAD 2
+
+GitBlameNative *git_blame_native_new (void);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_NATIVE_H__ */
@@ -0,0 +1,461 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-prefetcher.h"
+
+#include <glib-object.h>
+
+#include "git-annotated-source.h"
+
+static void git_blame_prefetcher_dispose (GObject *object);
+static void git_blame_prefetcher_finalize (GObject *object);
+
+typedef struct _GitBlamePrefetcherJob GitBlamePrefetcherJob;
+typedef struct _GitBlamePrefetcherEntry GitBlamePrefetcherEntry;
+
+struct _GitBlamePrefetcher
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  GitSourceCache *cache;
+  GitFileRevisions *revisions;
+  guint position;
+  /* Whether the blames are refined like the ones in the source view so
+     that they end up under the same key in the cache */
+  gboolean refine;
+
+  /* Blames that are currently running */
+  GQueue jobs;
+  guint max_jobs;
+
+  /* Blames that have finished and were put in the cache, to count
+     towards the budget until the cache throws them away */
+  GQueue entries;
+  /* Size of the most recent blame to finish, used to guess how much
+     the running ones will take up */
+  gsize last_size;
+
+  /* Revisions of the current file that failed to blame so that they
+     aren’t tried again */
+  GHashTable *failed;
+
+  guint fill_idle;
+} GitBlamePrefetcherPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitBlamePrefetcher,
+                                  git_blame_prefetcher,
+                                  G_TYPE_OBJECT);
+
+struct _GitBlamePrefetcherJob
+{
+  GitBlamePrefetcher *prefetcher;
+  /* The list of revisions that was current when the job started */
+  GitFileRevisions *revisions;
+  gchar *revision;
+  gboolean refine;
+  GitAnnotatedSource *source;
+  guint completed_handler;
+  GList link;
+};
+
+struct _GitBlamePrefetcherEntry
+{
+  GFile *file;
+  gchar *revision;
+  gboolean refine;
+  gsize size;
+};
+
+static void
+git_blame_prefetcher_class_init (GitBlamePrefetcherClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_blame_prefetcher_dispose;
+  gobject_class->finalize = git_blame_prefetcher_finalize;
+}
+
+static void
+git_blame_prefetcher_init (GitBlamePrefetcher *self)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (self);
+
+  g_queue_init (&priv->jobs);
+  g_queue_init (&priv->entries);
+  priv->failed = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, NULL);
+
+  /* Each blame can already use more than one thread or process so
+     only use about half of the processors for the pool */
+  priv->max_jobs = CLAMP (g_get_num_processors () / 2, 1, 4);
+}
+
+static void
+git_blame_prefetcher_free_job (GitBlamePrefetcherJob *job)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (job->prefetcher);
+
+  g_queue_unlink (&priv->jobs, &job->link);
+
+  /* The cache keeps its own reference so the blame carries on if it
+     hasn’t finished yet */
+  g_signal_handler_disconnect (job->source, job->completed_handler);
+  g_object_unref (job->source);
+  g_object_unref (job->revisions);
+  g_free (job->revision);
+
+  g_slice_free (GitBlamePrefetcherJob, job);
+}
+
+static void
+git_blame_prefetcher_free_entry (GitBlamePrefetcherEntry *entry)
+{
+  g_object_unref (entry->file);
+  g_free (entry->revision);
+  g_slice_free (GitBlamePrefetcherEntry, entry);
+}
+
+static void
+git_blame_prefetcher_dispose (GObject *object)
+{
+  GitBlamePrefetcher *self = (GitBlamePrefetcher *) object;
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (self);
+
+  while (priv->jobs.head)
+    git_blame_prefetcher_free_job (priv->jobs.head->data);
+
+  g_queue_clear_full (&priv->entries,
+                      (GDestroyNotify) git_blame_prefetcher_free_entry);
+
+  if (priv->fill_idle)
+    {
+      g_source_remove (priv->fill_idle);
+      priv->fill_idle = 0;
+    }
+
+  if (priv->revisions)
+    {
+      g_object_unref (priv->revisions);
+      priv->revisions = NULL;
+    }
+
+  if (priv->cache)
+    {
+      g_object_unref (priv->cache);
+      priv->cache = NULL;
+    }
+
+  G_OBJECT_CLASS (git_blame_prefetcher_parent_class)->dispose (object);
+}
+
+static void
+git_blame_prefetcher_finalize (GObject *object)
+{
+  GitBlamePrefetcher *self = (GitBlamePrefetcher *) object;
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (self);
+
+  g_hash_table_destroy (priv->failed);
+
+  G_OBJECT_CLASS (git_blame_prefetcher_parent_class)->finalize (object);
+}
+
+GitBlamePrefetcher *
+git_blame_prefetcher_new (GitSourceCache *cache)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), NULL);
+
+  GitBlamePrefetcher *self = g_object_new (GIT_TYPE_BLAME_PREFETCHER, NULL);
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (self);
+
+  priv->cache = g_object_ref (cache);
+
+  return self;
+}
+
+static void git_blame_prefetcher_queue_fill (GitBlamePrefetcher *prefetcher);
+
+static void
+git_blame_prefetcher_on_completed (GitAnnotatedSource *source,
+                                   const GError *error,
+                                   GitBlamePrefetcherJob *job)
+{
+  GitBlamePrefetcher *prefetcher = job->prefetcher;
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+
+  if (error)
+    {
+      if (job->revisions == priv->revisions)
+        g_hash_table_add (priv->failed, g_strdup (job->revision));
+    }
+  else
+    {
+      GitBlamePrefetcherEntry *entry = g_slice_new (GitBlamePrefetcherEntry);
+      GFile *file = git_file_revisions_get_file (job->revisions);
+
+      entry->file = g_object_ref (file);
+      entry->revision = g_strdup (job->revision);
+      entry->refine = job->refine;
+      entry->size = git_annotated_source_get_memory_usage (source);
+      g_queue_push_tail (&priv->entries, entry);
+
+      priv->last_size = entry->size;
+    }
+
+  git_blame_prefetcher_free_job (job);
+
+  git_blame_prefetcher_queue_fill (prefetcher);
+}
+
+static gboolean
+git_blame_prefetcher_start_job (GitBlamePrefetcher *prefetcher,
+                                const gchar *revision)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+  GFile *file = git_file_revisions_get_file (priv->revisions);
+  GitAnnotatedSource *source = git_annotated_source_new ();
+
+  git_annotated_source_set_progressive (source, priv->refine);
+  git_annotated_source_set_detect_copies (source, priv->refine);
+
+  if (!git_annotated_source_fetch (source, file, revision, NULL))
+    {
+      g_hash_table_add (priv->failed, g_strdup (revision));
+      g_object_unref (source);
+      return FALSE;
+    }
+
+  git_source_cache_add (priv->cache, file, revision, priv->refine, source);
+
+  GitBlamePrefetcherJob *job = g_slice_new (GitBlamePrefetcherJob);
+
+  job->prefetcher = prefetcher;
+  job->revisions = g_object_ref (priv->revisions);
+  job->revision = g_strdup (revision);
+  job->refine = priv->refine;
+  job->source = source;
+  job->link.data = job;
+  job->link.prev = job->link.next = NULL;
+  job->completed_handler
+    = g_signal_connect (source, "completed",
+                        G_CALLBACK (git_blame_prefetcher_on_completed),
+                        job);
+
+  g_queue_push_tail_link (&priv->jobs, &job->link);
+
+  return TRUE;
+}
+
+/* Returns the closest revision to the current position that hasn’t
+   been blamed yet or NULL if there aren’t any left within range */
+static const gchar *
+git_blame_prefetcher_next_revision (GitBlamePrefetcher *prefetcher)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+  GFile *file = git_file_revisions_get_file (priv->revisions);
+  guint n_revisions = git_file_revisions_get_n_revisions (priv->revisions);
+  guint distance;
+  int side;
+
+  for (distance = 1;
+       distance <= GIT_BLAME_PREFETCHER_MAX_DISTANCE;
+       distance++)
+    {
+      /* Try the older revision first because that is the direction
+         people usually go when looking for where a line came from */
+      for (side = -1; side <= 1; side += 2)
+        {
+          gint64 index = (gint64) priv->position + side * (gint64) distance;
+
+          if (index < 0 || index >= n_revisions)
+            continue;
+
+          const gchar *revision
+            = git_file_revisions_get_revision (priv->revisions, index);
+
+          if (!g_hash_table_contains (priv->failed, revision)
+              && !git_source_cache_contains (priv->cache, file, revision,
+                                             priv->refine))
+            return revision;
+        }
+    }
+
+  return NULL;
+}
+
+/* Returns how much of the cache is taken up by blames that the
+   prefetcher started, including a guess for the ones that are still
+   running. Blames that the cache has thrown away are forgotten. */
+static gsize
+git_blame_prefetcher_get_size (GitBlamePrefetcher *prefetcher)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+  GList *node, *next;
+  gsize size = 0;
+
+  for (node = priv->entries.head; node; node = next)
+    {
+      GitBlamePrefetcherEntry *entry = node->data;
+
+      next = node->next;
+
+      if (git_source_cache_contains (priv->cache,
+                                     entry->file,
+                                     entry->revision,
+                                     entry->refine))
+        size += entry->size;
+      else
+        {
+          git_blame_prefetcher_free_entry (entry);
+          g_queue_delete_link (&priv->entries, node);
+        }
+    }
+
+  for (node = priv->jobs.head; node; node = node->next)
+    {
+      GitBlamePrefetcherJob *job = node->data;
+
+      size += MAX (git_annotated_source_get_memory_usage (job->source),
+                   priv->last_size);
+    }
+
+  return size;
+}
+
+static gboolean
+git_blame_prefetcher_fill_cb (gpointer user_data)
+{
+  GitBlamePrefetcher *prefetcher = user_data;
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+  gsize budget = (git_source_cache_get_max_size (priv->cache)
+                  * GIT_BLAME_PREFETCHER_BUDGET_PERCENT / 100);
+
+  priv->fill_idle = 0;
+
+  if (priv->revisions == NULL
+      || !git_file_revisions_get_completed (priv->revisions))
+    return G_SOURCE_REMOVE;
+
+  /* The cache makes room for these by throwing away whatever was
+     used least recently */
+  while (priv->jobs.length < priv->max_jobs
+         && git_blame_prefetcher_get_size (prefetcher) < budget)
+    {
+      const gchar *revision = git_blame_prefetcher_next_revision (prefetcher);
+
+      if (revision == NULL)
+        break;
+
+      git_blame_prefetcher_start_job (prefetcher, revision);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+git_blame_prefetcher_queue_fill (GitBlamePrefetcher *prefetcher)
+{
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+
+  /* Wait until everything else is done so that starting the blames
+     doesn’t hold up the one being shown */
+  if (priv->fill_idle == 0)
+    priv->fill_idle = g_idle_add_full (G_PRIORITY_LOW,
+                                       git_blame_prefetcher_fill_cb,
+                                       prefetcher,
+                                       NULL);
+}
+
+/* Sets the list of revisions to blame. It must have already been
+   fetched. The blames that are already running for a previous list
+   are left to finish in the cache. */
+void
+git_blame_prefetcher_set_revisions (GitBlamePrefetcher *prefetcher,
+                                    GitFileRevisions *revisions)
+{
+  g_return_if_fail (GIT_IS_BLAME_PREFETCHER (prefetcher));
+  g_return_if_fail (revisions == NULL || GIT_IS_FILE_REVISIONS (revisions));
+
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+
+  if (revisions)
+    g_object_ref (revisions);
+  if (priv->revisions)
+    g_object_unref (priv->revisions);
+  priv->revisions = revisions;
+
+  g_hash_table_remove_all (priv->failed);
+  priv->position = 0;
+
+  git_blame_prefetcher_queue_fill (prefetcher);
+}
+
+/* Sets whether the blames are run with the same refining passes as
+   git_source_view_set_refine(). The blames that are already running
+   are left to finish in the cache. */
+void
+git_blame_prefetcher_set_refine (GitBlamePrefetcher *prefetcher,
+                                 gboolean refine)
+{
+  g_return_if_fail (GIT_IS_BLAME_PREFETCHER (prefetcher));
+
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+
+  refine = !!refine;
+
+  if (priv->refine == refine)
+    return;
+
+  priv->refine = refine;
+
+  g_hash_table_remove_all (priv->failed);
+
+  git_blame_prefetcher_queue_fill (prefetcher);
+}
+
+/* Sets the index of the revision being shown. The revisions nearest
+   to it will be blamed next. */
+void
+git_blame_prefetcher_set_position (GitBlamePrefetcher *prefetcher,
+                                   guint position)
+{
+  g_return_if_fail (GIT_IS_BLAME_PREFETCHER (prefetcher));
+
+  GitBlamePrefetcherPrivate *priv =
+    git_blame_prefetcher_get_instance_private (prefetcher);
+
+  priv->position = position;
+
+  git_blame_prefetcher_queue_fill (prefetcher);
+}
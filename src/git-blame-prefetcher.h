@@ -0,0 +1,61 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_PREFETCHER_H__
+#define __GIT_BLAME_PREFETCHER_H__
+
+#include <glib-object.h>
+#include "git-file-revisions.h"
+#include "git-source-cache.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_BLAME_PREFETCHER git_blame_prefetcher_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitBlamePrefetcher,
+                      git_blame_prefetcher,
+                      GIT,
+                      BLAME_PREFETCHER,
+                      GObject);
+
+/* Blames the revisions of a file in the background and puts the
+   results in a source cache so that moving between revisions doesn’t
+   have to wait. Only a few blames are run at once and the revisions
+   closest to the current position are done first. The blames that it
+   started only take up part of the cache so that they don’t push out
+   all of the sources that were actually looked at. */
+
+/* Number of revisions either side of the current position to
+   consider */
+#define GIT_BLAME_PREFETCHER_MAX_DISTANCE 32
+
+/* Percentage of the size of the cache that the prefetched blames can
+   use, counting the ones that are still running */
+#define GIT_BLAME_PREFETCHER_BUDGET_PERCENT 50
+
+GitBlamePrefetcher *git_blame_prefetcher_new (GitSourceCache *cache);
+
+void git_blame_prefetcher_set_revisions (GitBlamePrefetcher *prefetcher,
+                                         GitFileRevisions *revisions);
+void git_blame_prefetcher_set_position (GitBlamePrefetcher *prefetcher,
+                                        guint position);
+void git_blame_prefetcher_set_refine (GitBlamePrefetcher *prefetcher,
+                                      gboolean refine);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_PREFETCHER_H__ */
@@ -0,0 +1,514 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-blame-process.h"
+
+#include <glib-object.h>
+#include <string.h>
+
+#include "git-reader.h"
+#include "git-commit.h"
+#include "git-commit-bag.h"
+#include "git-common.h"
+#include "git-oid.h"
+
+/* Blame backend that runs git-blame and parses its incremental
+   output. This reports each hunk as soon as git has found where it
+   came from rather than waiting for the whole file like the porcelain
+   format. The hunks aren’t in order and they don’t include the text of
+   the lines. */
+
+static void git_blame_process_dispose (GObject *object);
+static void git_blame_process_finalize (GObject *object);
+
+static gboolean git_blame_process_start (GitBlameBackend *backend,
+                                         GFile *repo,
+                                         const gchar *path,
+                                         const gchar *revision,
+                                         GError **error);
+static void git_blame_process_cancel (GitBlameBackend *backend);
+static void git_blame_process_set_since (GitBlameBackend *backend,
+                                         gint64 since);
+static void git_blame_process_set_detect_copies (GitBlameBackend *backend,
+                                                 gboolean detect_copies);
+static void git_blame_process_set_priority (GitBlameBackend *backend,
+                                            gint priority);
+
+struct _GitBlameProcess
+{
+  GitBlameBackend parent;
+};
+
+typedef struct
+{
+  GitReader *reader;
+  guint completed_handler;
+  guint line_handler;
+
+  GFile *repo;
+
+  /* The header of the hunk that we are waiting for the filename of,
+     which is always its last property */
+  GitCommit *current_commit;
+  guint current_orig_line, current_final_line, current_n_lines;
+
+  /* Map from a GitCommit to the GitBlameProcessPrevious from its
+     ‘previous’ header. git only sends the header the first time a
+     commit is seen so it needs to be remembered for the later
+     lines. */
+  GHashTable *previous;
+
+  /* Set of the commits that git marked as a boundary. This is also
+     only sent the first time. */
+  GHashTable *boundaries;
+
+  /* Only commits after this time are looked at, or zero to look at
+     the whole history */
+  gint64 since;
+  /* Whether to pass -C -M so that lines that were moved or copied
+     from elsewhere are followed. This is much slower. */
+  gboolean detect_copies;
+  gint priority;
+
+  guint n_lines;
+} GitBlameProcessPrivate;
+
+typedef struct
+{
+  GitCommit *commit;
+  gchar *path;
+} GitBlameProcessPrevious;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitBlameProcess,
+                                  git_blame_process,
+                                  GIT_TYPE_BLAME_BACKEND);
+
+static void
+git_blame_process_class_init (GitBlameProcessClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GitBlameBackendClass *backend_class = (GitBlameBackendClass *) klass;
+
+  gobject_class->dispose = git_blame_process_dispose;
+  gobject_class->finalize = git_blame_process_finalize;
+
+  backend_class->start = git_blame_process_start;
+  backend_class->cancel = git_blame_process_cancel;
+  backend_class->set_since = git_blame_process_set_since;
+  backend_class->set_detect_copies = git_blame_process_set_detect_copies;
+  backend_class->set_priority = git_blame_process_set_priority;
+}
+
+static void
+git_blame_process_free_previous (GitBlameProcessPrevious *previous)
+{
+  g_object_unref (previous->commit);
+  g_free (previous->path);
+  g_slice_free (GitBlameProcessPrevious, previous);
+}
+
+static void
+git_blame_process_init (GitBlameProcess *self)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  priv->previous
+    = g_hash_table_new_full (NULL, NULL,
+                             g_object_unref,
+                             (GDestroyNotify) git_blame_process_free_previous);
+  priv->priority = G_PRIORITY_DEFAULT;
+  priv->boundaries = g_hash_table_new_full (NULL, NULL,
+                                            g_object_unref,
+                                            NULL);
+}
+
+static void
+git_blame_process_cancel (GitBlameBackend *backend)
+{
+  GitBlameProcess *self = (GitBlameProcess *) backend;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  /* Destroying the reader kills the process */
+  if (priv->reader)
+    {
+      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
+      g_signal_handler_disconnect (priv->reader, priv->line_handler);
+      g_object_unref (priv->reader);
+      priv->reader = NULL;
+    }
+
+  if (priv->current_commit)
+    {
+      g_object_unref (priv->current_commit);
+      priv->current_commit = NULL;
+    }
+
+  g_hash_table_remove_all (priv->previous);
+  g_hash_table_remove_all (priv->boundaries);
+
+  if (priv->repo)
+    {
+      g_object_unref (priv->repo);
+      priv->repo = NULL;
+    }
+
+  priv->n_lines = 0;
+}
+
+static void
+git_blame_process_dispose (GObject *object)
+{
+  git_blame_process_cancel ((GitBlameBackend *) object);
+
+  G_OBJECT_CLASS (git_blame_process_parent_class)->dispose (object);
+}
+
+static void
+git_blame_process_finalize (GObject *object)
+{
+  GitBlameProcess *self = (GitBlameProcess *) object;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  g_hash_table_destroy (priv->previous);
+  g_hash_table_destroy (priv->boundaries);
+
+  G_OBJECT_CLASS (git_blame_process_parent_class)->finalize (object);
+}
+
+GitBlameProcess *
+git_blame_process_new (void)
+{
+  GitBlameProcess *self = g_object_new (GIT_TYPE_BLAME_PROCESS, NULL);
+
+  return self;
+}
+
+static void
+git_blame_process_complete (GitBlameProcess *self, const GError *error)
+{
+  /* Keep the object alive in case a handler drops the last reference */
+  g_object_ref (self);
+  git_blame_process_cancel ((GitBlameBackend *) self);
+  git_blame_backend_emit_completed ((GitBlameBackend *) self, error);
+  g_object_unref (self);
+}
+
+static void
+git_blame_process_parse_error (GitBlameProcess *self)
+{
+  GError *error = NULL;
+
+  g_set_error (&error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+               "Invalid data from git-blame received");
+
+  git_blame_process_complete (self, error);
+
+  g_error_free (error);
+}
+
+static void
+git_blame_process_on_completed (GitReader *reader,
+                                const GError *error,
+                                GitBlameProcess *self)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  /* If we've got a commit for the current hunk then we must be
+     missing the rest of its properties so the output is invalid */
+  if (priv->current_commit)
+    git_blame_process_parse_error (self);
+  else
+    git_blame_process_complete (self, error);
+}
+
+static gboolean
+git_blame_process_parse_header (GitBlameProcess *self,
+                                guint length, const gchar *p)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  GitOid oid;
+  gsize hash_length = git_oid_parse_hex (&oid, p, length);
+  guint nums[3];
+  int i;
+
+  if (hash_length == 0)
+    return FALSE;
+
+  p += hash_length;
+  length -= hash_length;
+
+  /* The original line, the final line and the number of lines */
+  for (i = 0; i < 3; i++)
+    {
+      nums[i] = 0;
+      if (length < 1 || *p != ' ')
+        return FALSE;
+      length--;
+      p++;
+      while (length > 0 && *p >= '0' && *p <= '9')
+        {
+          nums[i] = nums[i] * 10 + *p - '0';
+          length--;
+          p++;
+        }
+    }
+
+  if (length != 1 || *p != '\n' || nums[1] < 1 || nums[2] < 1)
+    return FALSE;
+
+  priv->current_commit
+    = g_object_ref (git_commit_bag_get_oid (commit_bag, &oid, priv->repo));
+  priv->current_orig_line = nums[0];
+  priv->current_final_line = nums[1];
+  priv->current_n_lines = nums[2];
+
+  return TRUE;
+}
+
+/* Paths are quoted like C strings if they have unusual characters */
+static gchar *
+git_blame_process_unquote_path (const gchar *path)
+{
+  gsize length = strlen (path);
+
+  if (length >= 2 && path[0] == '"' && path[length - 1] == '"')
+    {
+      gchar *inner = g_strndup (path + 1, length - 2);
+      gchar *ret = g_strcompress (inner);
+
+      g_free (inner);
+
+      return ret;
+    }
+
+  return g_strdup (path);
+}
+
+/* The value is the hash of the parent commit followed by the path of
+   the file in that commit */
+static void
+git_blame_process_parse_previous (GitBlameProcess *self, const gchar *value)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+  GitBlameProcessPrevious *previous;
+  GitOid oid;
+  gsize hash_length = git_oid_parse_hex (&oid, value, strlen (value));
+
+  if (hash_length == 0 || value[hash_length] != ' ')
+    return;
+
+  previous = g_slice_new (GitBlameProcessPrevious);
+  previous->commit
+    = g_object_ref (git_commit_bag_get_oid (git_commit_bag_get_default (),
+                                            &oid,
+                                            priv->repo));
+  previous->path = git_blame_process_unquote_path (value + hash_length + 1);
+
+  g_hash_table_replace (priv->previous,
+                        g_object_ref (priv->current_commit),
+                        previous);
+}
+
+static void
+git_blame_process_emit_hunk (GitBlameProcess *self, const gchar *filename)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+  GitBlameHunk hunk;
+
+  hunk.commit = priv->current_commit;
+  hunk.orig_line = priv->current_orig_line;
+  hunk.final_line = priv->current_final_line;
+  hunk.n_lines = priv->current_n_lines;
+  hunk.lines = NULL;
+  hunk.orig_path = filename;
+
+  GitBlameProcessPrevious *previous
+    = g_hash_table_lookup (priv->previous, hunk.commit);
+
+  hunk.previous_commit = previous ? previous->commit : NULL;
+  hunk.previous_path = previous ? previous->path : NULL;
+  hunk.boundary = g_hash_table_contains (priv->boundaries, hunk.commit);
+
+  priv->current_commit = NULL;
+  priv->n_lines += hunk.n_lines;
+
+  git_blame_backend_emit_hunk ((GitBlameBackend *) self, &hunk);
+  g_object_unref (hunk.commit);
+
+  /* The handler might have cancelled the blame */
+  if (priv->reader)
+    git_blame_backend_emit_progress ((GitBlameBackend *) self,
+                                     priv->n_lines);
+}
+
+static gboolean
+git_blame_process_on_line (GitReader *reader,
+                           guint length, const gchar *str,
+                           GitBlameProcess *self)
+{
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  /* If we haven't got a commit yet then we are expecting the first
+     line to be the commit hash followed by three numbers for the
+     lines */
+  if (priv->current_commit == NULL)
+    {
+      if (!git_blame_process_parse_header (self, length, str))
+        {
+          git_blame_process_parse_error (self);
+          return FALSE;
+        }
+    }
+  /* Otherwise it should be a key-value property pair */
+  else
+    {
+      const gchar *sep;
+
+      if (length > 1 && str[length - 1] == '\n')
+        length--;
+
+      if ((sep = memchr (str, ' ', length)))
+        {
+          gchar *key = g_strndup (str, sep - str);
+          gchar *value = g_strndup (sep + 1, str + length - sep - 1);
+
+          if (!strcmp (key, "filename"))
+            /* This is the last property of every hunk */
+            git_blame_process_emit_hunk (self, value);
+          else
+            {
+              git_commit_set_prop (priv->current_commit, key, value);
+
+              if (!strcmp (key, "previous"))
+                git_blame_process_parse_previous (self, value);
+            }
+
+          g_free (key);
+          g_free (value);
+
+          /* The handler might have cancelled the blame */
+          if (priv->reader != reader)
+            return FALSE;
+        }
+      /* The only property without a value */
+      else if (length == 8 && !memcmp (str, "boundary", 8))
+        g_hash_table_add (priv->boundaries,
+                          g_object_ref (priv->current_commit));
+    }
+
+  return TRUE;
+}
+
+static void
+git_blame_process_set_since (GitBlameBackend *backend, gint64 since)
+{
+  GitBlameProcess *self = (GitBlameProcess *) backend;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  priv->since = since;
+}
+
+static void
+git_blame_process_set_detect_copies (GitBlameBackend *backend,
+                                     gboolean detect_copies)
+{
+  GitBlameProcess *self = (GitBlameProcess *) backend;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  priv->detect_copies = detect_copies;
+}
+
+static void
+git_blame_process_set_priority (GitBlameBackend *backend, gint priority)
+{
+  GitBlameProcess *self = (GitBlameProcess *) backend;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  priv->priority = priority;
+}
+
+static gboolean
+git_blame_process_start (GitBlameBackend *backend,
+                         GFile *repo,
+                         const gchar *path,
+                         const gchar *revision,
+                         GError **error)
+{
+  GitBlameProcess *self = (GitBlameProcess *) backend;
+  GitBlameProcessPrivate *priv = git_blame_process_get_instance_private (self);
+
+  priv->repo = g_object_ref (repo);
+  priv->reader = git_reader_new ();
+
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_blame_process_on_completed),
+                        self);
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_blame_process_on_line),
+                        self);
+
+  GPtrArray *args = g_ptr_array_new_with_free_func (g_free);
+  gboolean ret;
+
+  git_reader_set_priority (priv->reader, priv->priority);
+
+  g_ptr_array_add (args, g_strdup ("blame"));
+  g_ptr_array_add (args, g_strdup ("--incremental"));
+
+  if (priv->detect_copies)
+    {
+      g_ptr_array_add (args, g_strdup ("-C"));
+      g_ptr_array_add (args, g_strdup ("-M"));
+    }
+
+  if (priv->since > 0)
+    {
+      GDateTime *since = g_date_time_new_from_unix_utc (priv->since);
+
+      g_ptr_array_add (args,
+                       g_date_time_format (since,
+                                           "--since=%Y-%m-%dT%H:%M:%SZ"));
+      g_date_time_unref (since);
+    }
+
+  g_ptr_array_add (args, g_strdup (path));
+
+  /* Without a revision git will include uncommitted changes */
+  if (revision)
+    g_ptr_array_add (args, g_strdup (revision));
+
+  g_ptr_array_add (args, NULL);
+
+  ret = git_reader_startv (priv->reader, repo,
+                           (const gchar * const *) args->pdata,
+                           error);
+
+  g_ptr_array_free (args, TRUE);
+
+  if (!ret)
+    {
+      git_blame_process_cancel (backend);
+      return FALSE;
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,38 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_BLAME_PROCESS_H__
+#define __GIT_BLAME_PROCESS_H__
+
+#include <glib-object.h>
+#include "git-blame-backend.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_BLAME_PROCESS git_blame_process_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitBlameProcess,
+                      git_blame_process,
+                      GIT,
+                      BLAME_PROCESS,
+                      GitBlameBackend);
+
+GitBlameProcess *git_blame_process_new (void);
+
+G_END_DECLS
+
+#endif /* __GIT_BLAME_PROCESS_H__ */
@@ -20,26 +20,107 @@
 #include "git-commit-bag.h"
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "git-commit.h"
+#include "git-commit-graph.h"
+#include "git-commit-store.h"
+#include "git-object-db.h"
+#include "git-common.h"
+#include "git-oid.h"
 
 static void git_commit_bag_dispose (GObject *object);
 static void git_commit_bag_finalize (GObject *object);
 
+typedef struct _GitCommitBagEntry GitCommitBagEntry;
+typedef struct _GitCommitBagSlot GitCommitBagSlot;
+typedef struct _GitCommitBagPartition GitCommitBagPartition;
+
 struct _GitCommitBag
 {
   GObject parent;
 };
 
+/* Commits are stored in an open-addressing table with linear
+   probing. The hash of the object id is kept in the slot so that most
+   probes that don’t match can be rejected without touching the
+   entry. */
+struct _GitCommitBagSlot
+{
+  guint hash;
+  GitCommitBagEntry *entry;
+};
+
+/* Each object database gets its own table so that commits from one
+   repository can’t push out the commits of another. Worktrees of the
+   same repository share a partition. */
+struct _GitCommitBagPartition
+{
+  GitCommitBag *commit_bag;
+
+  /* The common git directory of the repository */
+  GFile *common_dir;
+
+  /* Commit data saved on disk from previous sessions */
+  GitCommitStore *store;
+  /* Git’s own commit-graph for the object database */
+  GitCommitGraph *graph;
+  /* For reading objects without running git */
+  GitObjectDb *object_db;
+
+  /* The number of slots is always a power of two and at most half of
+     them are used */
+  GitCommitBagSlot *slots;
+  guint n_slots;
+  guint n_entries;
+
+  /* Commits that are only referenced by the bag, ordered from the
+     most recently released to the least */
+  GQueue unpinned;
+  /* The total of the sizes of the unpinned entries */
+  gsize unpinned_size;
+};
+
 typedef struct
 {
-  GHashTable *hash_table;
+  /* Map from a common git directory to its partition */
+  GHashTable *partitions;
+  /* Map from each repo that has been seen to its partition so that
+     the common directory only has to be found once */
+  GHashTable *repos;
+
+  /* The last repo that was looked up. Usually all of the commits in a
+     row come from the same repo so this avoids hashing its path. */
+  GFile *last_repo;
+  GitCommitBagPartition *last_partition;
+
+  gsize max_size;
+  guint trim_source;
 } GitCommitBagPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitCommitBag,
                                   git_commit_bag,
                                   G_TYPE_OBJECT);
 
+#define GIT_COMMIT_BAG_INITIAL_SLOTS 256
+
+/* The bag holds a toggle reference on each commit so that it can
+   tell when nothing else is using it. Commits that are referenced by
+   something else, such as a line in an annotated source or the commit
+   dialog, are pinned and never evicted. The rest are kept in an LRU
+   list and are thrown away when they use too much memory. */
+struct _GitCommitBagEntry
+{
+  GitCommitBagPartition *partition;
+  GitCommit *commit;
+  gboolean pinned;
+  /* The memory used by the commit when it was unpinned. It can grow
+     afterwards if the commit was still fetching its log data so it is
+     measured again whenever the trim looks at it. */
+  gsize size;
+  GList link;
+};
+
 static void
 git_commit_bag_class_init (GitCommitBagClass *klass)
 {
@@ -49,13 +130,159 @@ git_commit_bag_class_init (GitCommitBagClass *klass)
   gobject_class->finalize = git_commit_bag_finalize;
 }
 
+static void git_commit_bag_toggle_notify (gpointer data,
+                                          GObject *object,
+                                          gboolean is_last_ref);
+
+static void git_commit_bag_free_partition (GitCommitBagPartition *partition);
+
 static void
 git_commit_bag_init (GitCommitBag *self)
 {
   GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (self);
 
-  priv->hash_table = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                            g_free, g_object_unref);
+  priv->partitions
+    = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                             NULL,
+                             (GDestroyNotify) git_commit_bag_free_partition);
+  priv->repos
+    = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                             g_object_unref, NULL);
+  priv->max_size = GIT_COMMIT_BAG_DEFAULT_MAX_SIZE;
+}
+
+static GitCommitBagPartition *
+git_commit_bag_partition_new (GitCommitBag *commit_bag, GFile *common_dir)
+{
+  GitCommitBagPartition *partition = g_slice_new (GitCommitBagPartition);
+
+  partition->commit_bag = commit_bag;
+  partition->common_dir = g_object_ref (common_dir);
+  partition->store = git_commit_store_new (common_dir);
+  partition->graph = git_commit_graph_new (common_dir);
+  partition->object_db = git_object_db_new (common_dir);
+  partition->n_slots = GIT_COMMIT_BAG_INITIAL_SLOTS;
+  partition->slots = g_new0 (GitCommitBagSlot, partition->n_slots);
+  partition->n_entries = 0;
+  g_queue_init (&partition->unpinned);
+  partition->unpinned_size = 0;
+
+  return partition;
+}
+
+static void
+git_commit_bag_partition_grow (GitCommitBagPartition *partition)
+{
+  GitCommitBagSlot *old_slots = partition->slots;
+  guint old_n_slots = partition->n_slots;
+  guint mask, i, pos;
+
+  partition->n_slots *= 2;
+  partition->slots = g_new0 (GitCommitBagSlot, partition->n_slots);
+  mask = partition->n_slots - 1;
+
+  for (i = 0; i < old_n_slots; i++)
+    {
+      if (old_slots[i].entry == NULL)
+        continue;
+
+      for (pos = old_slots[i].hash & mask;
+           partition->slots[pos].entry;
+           pos = (pos + 1) & mask);
+
+      partition->slots[pos] = old_slots[i];
+    }
+
+  g_free (old_slots);
+}
+
+static void
+git_commit_bag_partition_remove_slot (GitCommitBagPartition *partition,
+                                      guint pos)
+{
+  guint mask = partition->n_slots - 1;
+  guint next, ideal;
+
+  /* Move any following entries in the same cluster back so that there
+     are no holes in their probe sequences. This avoids needing
+     tombstones. */
+  for (next = (pos + 1) & mask;
+       partition->slots[next].entry;
+       next = (next + 1) & mask)
+    {
+      ideal = partition->slots[next].hash & mask;
+
+      /* The entry can only be moved into the gap if the gap lies
+         cyclically between its ideal position and where it is now */
+      if (((next - ideal) & mask) >= ((next - pos) & mask))
+        {
+          partition->slots[pos] = partition->slots[next];
+          pos = next;
+        }
+    }
+
+  partition->slots[pos].entry = NULL;
+  partition->n_entries--;
+}
+
+static void
+git_commit_bag_remove_entry (GitCommitBagEntry *entry)
+{
+  GitCommitBagPartition *partition = entry->partition;
+  GitCommit *commit = entry->commit;
+  guint mask = partition->n_slots - 1;
+  guint pos;
+
+  if (!entry->pinned)
+    {
+      g_queue_unlink (&partition->unpinned, &entry->link);
+      partition->unpinned_size -= entry->size;
+    }
+
+  for (pos = git_oid_hash (git_commit_get_oid (commit)) & mask;
+       partition->slots[pos].entry != entry;
+       pos = (pos + 1) & mask)
+    g_return_if_fail (partition->slots[pos].entry != NULL);
+
+  git_commit_bag_partition_remove_slot (partition, pos);
+
+  g_object_remove_toggle_ref (G_OBJECT (commit),
+                              git_commit_bag_toggle_notify,
+                              entry);
+
+  g_slice_free (GitCommitBagEntry, entry);
+}
+
+static void
+git_commit_bag_partition_clear (GitCommitBagPartition *partition)
+{
+  guint i;
+
+  /* Releasing a commit can release its parents and make them toggle
+     so the table can change while we are removing entries. Removing
+     an entry can also shift another one into its slot so only move
+     on when the slot is empty. */
+  for (i = 0; partition->n_entries > 0;)
+    {
+      if (partition->slots[i].entry)
+        git_commit_bag_remove_entry (partition->slots[i].entry);
+      else
+        i = (i + 1) & (partition->n_slots - 1);
+    }
+}
+
+static void
+git_commit_bag_free_partition (GitCommitBagPartition *partition)
+{
+  git_commit_bag_partition_clear (partition);
+
+  g_free (partition->slots);
+  g_object_unref (partition->object_db);
+  g_object_unref (partition->graph);
+  g_object_unref (partition->store);
+  g_object_unref (partition->common_dir);
+
+  g_slice_free (GitCommitBagPartition, partition);
 }
 
 static void
@@ -63,8 +290,26 @@ git_commit_bag_dispose (GObject *object)
 {
   GitCommitBag *self = (GitCommitBag *) object;
   GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (self);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_remove_all (priv->repos);
+  g_clear_object (&priv->last_repo);
+  priv->last_partition = NULL;
 
-  g_hash_table_remove_all (priv->hash_table);
+  /* Clear the partitions before freeing them because the parents of a
+     commit can be in another partition */
+  g_hash_table_iter_init (&iter, priv->partitions);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    git_commit_bag_partition_clear (value);
+
+  g_hash_table_remove_all (priv->partitions);
+
+  if (priv->trim_source)
+    {
+      g_source_remove (priv->trim_source);
+      priv->trim_source = 0;
+    }
 
   G_OBJECT_CLASS (git_commit_bag_parent_class)->dispose (object);
 }
@@ -75,7 +320,8 @@ git_commit_bag_finalize (GObject *object)
   GitCommitBag *self = (GitCommitBag *) object;
   GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (self);
 
-  g_hash_table_destroy (priv->hash_table);
+  g_hash_table_destroy (priv->repos);
+  g_hash_table_destroy (priv->partitions);
 
   G_OBJECT_CLASS (git_commit_bag_parent_class)->finalize (object);
 }
@@ -91,24 +337,323 @@ git_commit_bag_get_default (void)
   return default_bag;
 }
 
+static GitCommitBagPartition *
+git_commit_bag_get_partition (GitCommitBag *commit_bag, GFile *repo)
+{
+  GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
+  GitCommitBagPartition *partition;
+
+  if (repo == priv->last_repo)
+    return priv->last_partition;
+
+  partition = g_hash_table_lookup (priv->repos, repo);
+
+  if (partition == NULL)
+    {
+      GFile *common_dir = git_find_common_dir (repo);
+
+      partition = g_hash_table_lookup (priv->partitions, common_dir);
+
+      if (partition == NULL)
+        {
+          partition = git_commit_bag_partition_new (commit_bag, common_dir);
+          g_hash_table_insert (priv->partitions,
+                               partition->common_dir,
+                               partition);
+        }
+
+      g_object_unref (common_dir);
+
+      g_hash_table_insert (priv->repos, g_object_ref (repo), partition);
+    }
+
+  g_object_ref (repo);
+  if (priv->last_repo)
+    g_object_unref (priv->last_repo);
+  priv->last_repo = repo;
+  priv->last_partition = partition;
+
+  return partition;
+}
+
+static void
+git_commit_bag_update_entry_size (GitCommitBagEntry *entry)
+{
+  GitCommitBagPartition *partition = entry->partition;
+  gsize size = git_commit_get_memory_usage (entry->commit);
+
+  partition->unpinned_size = partition->unpinned_size - entry->size + size;
+  entry->size = size;
+}
+
+static void
+git_commit_bag_trim_partition (GitCommitBagPartition *partition,
+                               gsize max_size)
+{
+  GList *node, *prev;
+
+  /* First try to get under the limit by just throwing away the log
+     data, which is the biggest part of a commit and can be fetched
+     again. Any parents that this releases are added to the total by
+     the toggle notify. */
+  for (node = partition->unpinned.tail;
+       node && partition->unpinned_size > max_size;
+       node = prev)
+    {
+      GitCommitBagEntry *entry = node->data;
+
+      prev = node->prev;
+
+      git_commit_drop_log_data (entry->commit);
+      git_commit_bag_update_entry_size (entry);
+    }
+
+  /* Otherwise forget about the commits entirely */
+  while (partition->unpinned_size > max_size && partition->unpinned.tail)
+    git_commit_bag_remove_entry (partition->unpinned.tail->data);
+}
+
+static void
+git_commit_bag_trim (GitCommitBag *commit_bag)
+{
+  GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
+  GHashTableIter iter;
+  gpointer value;
+
+  /* Each repository gets its own budget */
+  g_hash_table_iter_init (&iter, priv->partitions);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    git_commit_bag_trim_partition (value, priv->max_size);
+}
+
+static gboolean
+git_commit_bag_trim_cb (gpointer user_data)
+{
+  GitCommitBag *commit_bag = user_data;
+  GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
+
+  priv->trim_source = 0;
+
+  git_commit_bag_trim (commit_bag);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+git_commit_bag_toggle_notify (gpointer data,
+                              GObject *object,
+                              gboolean is_last_ref)
+{
+  GitCommitBagEntry *entry = data;
+  GitCommitBagPartition *partition = entry->partition;
+  GitCommitBag *commit_bag = partition->commit_bag;
+  GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
+
+  if (is_last_ref)
+    {
+      entry->pinned = FALSE;
+      entry->size = git_commit_get_memory_usage (entry->commit);
+      partition->unpinned_size += entry->size;
+      g_queue_push_head_link (&partition->unpinned, &entry->link);
+
+      /* Trim later so that a commit that was just returned from
+         git_commit_bag_get has a chance to be referenced */
+      if (priv->trim_source == 0)
+        priv->trim_source = g_idle_add (git_commit_bag_trim_cb, commit_bag);
+    }
+  else
+    {
+      g_queue_unlink (&partition->unpinned, &entry->link);
+      partition->unpinned_size -= entry->size;
+      entry->pinned = TRUE;
+    }
+}
+
+/* Returns the slot holding the commit or the empty slot where it
+   would go */
+static guint
+git_commit_bag_partition_find (GitCommitBagPartition *partition,
+                               const GitOid *oid,
+                               guint hash)
+{
+  guint mask = partition->n_slots - 1;
+  GitCommitBagEntry *entry;
+  guint pos;
+
+  for (pos = hash & mask; partition->slots[pos].entry; pos = (pos + 1) & mask)
+    {
+      entry = partition->slots[pos].entry;
+
+      if (partition->slots[pos].hash == hash
+          && git_oid_equal (git_commit_get_oid (entry->commit), oid))
+        break;
+    }
+
+  return pos;
+}
+
+/* Looks up a commit from its binary object id. This doesn’t allocate
+   anything if the commit is already in the bag. The returned commit
+   isn’t referenced so the caller should take a reference if it wants
+   to keep it. */
+GitCommit *
+git_commit_bag_get_oid (GitCommitBag *commit_bag, const GitOid *oid,
+                        GFile *repo)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
+  g_return_val_if_fail (oid != NULL, NULL);
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  GitCommitBagPartition *partition
+    = git_commit_bag_get_partition (commit_bag, repo);
+  guint hash = git_oid_hash (oid);
+  guint pos = git_commit_bag_partition_find (partition, oid, hash);
+  GitCommitBagEntry *entry = partition->slots[pos].entry;
+  gchar hex[GIT_OID_MAX_HEX_LENGTH + 1];
+
+  if (entry)
+    return entry->commit;
+
+  git_oid_to_hex (oid, hex);
+
+  entry = g_slice_new (GitCommitBagEntry);
+  entry->partition = partition;
+  entry->commit = git_commit_new (hex, repo);
+  entry->pinned = TRUE;
+  entry->size = 0;
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+
+  partition->slots[pos].hash = hash;
+  partition->slots[pos].entry = entry;
+
+  if (++partition->n_entries > partition->n_slots / 2)
+    git_commit_bag_partition_grow (partition);
+
+  /* Swap our normal reference for a toggle reference. This will
+     immediately put the commit in the unpinned list until the caller
+     takes a reference. */
+  g_object_add_toggle_ref (G_OBJECT (entry->commit),
+                           git_commit_bag_toggle_notify,
+                           entry);
+  g_object_unref (entry->commit);
+
+  return entry->commit;
+}
+
+/* Like git_commit_bag_get_oid but returns NULL instead of adding the
+   commit if it isn’t already in the bag */
+GitCommit *
+git_commit_bag_lookup_oid (GitCommitBag *commit_bag, const GitOid *oid,
+                           GFile *repo)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
+  g_return_val_if_fail (oid != NULL, NULL);
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  GitCommitBagPartition *partition
+    = git_commit_bag_get_partition (commit_bag, repo);
+  guint pos = git_commit_bag_partition_find (partition, oid,
+                                             git_oid_hash (oid));
+  GitCommitBagEntry *entry = partition->slots[pos].entry;
+
+  return entry ? entry->commit : NULL;
+}
+
 GitCommit *
 git_commit_bag_get (GitCommitBag *commit_bag, const gchar *hash,
                     GFile *repo)
 {
   g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
 
+  GitOid oid;
+
+  if (!git_oid_from_hex (&oid, hash))
+    {
+      g_warning ("Invalid commit hash “%s”", hash);
+      return NULL;
+    }
+
+  return git_commit_bag_get_oid (commit_bag, &oid, repo);
+}
+
+/* Returns the on-disk store for the object database used by repo. The
+   store is owned by the bag. */
+GitCommitStore *
+git_commit_bag_get_store (GitCommitBag *commit_bag, GFile *repo)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  return git_commit_bag_get_partition (commit_bag, repo)->store;
+}
+
+/* Returns the commit-graph for the object database used by repo. The
+   graph is owned by the bag. */
+GitCommitGraph *
+git_commit_bag_get_graph (GitCommitBag *commit_bag, GFile *repo)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  return git_commit_bag_get_partition (commit_bag, repo)->graph;
+}
+
+/* Returns the object database used by repo. The database is owned by
+   the bag. */
+GitObjectDb *
+git_commit_bag_get_object_db (GitCommitBag *commit_bag, GFile *repo)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), NULL);
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  return git_commit_bag_get_partition (commit_bag, repo)->object_db;
+}
+
+/* Sets the number of bytes of unreferenced commits to keep for each
+   repository */
+void
+git_commit_bag_set_max_size (GitCommitBag *commit_bag, gsize max_size)
+{
+  g_return_if_fail (GIT_IS_COMMIT_BAG (commit_bag));
+
   GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
-  gchar *hash_copy = g_strdup (hash);
 
-  GitCommit *commit;
+  priv->max_size = max_size;
 
-  if ((commit = g_hash_table_lookup (priv->hash_table, hash_copy)))
-    g_free (hash_copy);
-  else
+  git_commit_bag_trim (commit_bag);
+}
+
+static gsize
+git_commit_bag_get_partition_memory_usage (GitCommitBagPartition *partition)
+{
+  gsize size = 0;
+  guint i;
+
+  for (i = 0; i < partition->n_slots; i++)
     {
-      commit = git_commit_new (hash_copy, repo);
-      g_hash_table_insert (priv->hash_table, hash_copy, commit);
+      if (partition->slots[i].entry)
+        size += git_commit_get_memory_usage (partition->slots[i].entry->commit);
     }
 
-  return commit;
+  return size;
+}
+
+/* Returns an estimate of the memory used by all of the commits in the
+   bag, including the ones that are pinned by something else */
+gsize
+git_commit_bag_get_memory_usage (GitCommitBag *commit_bag)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_BAG (commit_bag), 0);
+
+  GitCommitBagPrivate *priv = git_commit_bag_get_instance_private (commit_bag);
+  GHashTableIter iter;
+  gpointer value;
+  gsize size = 0;
+
+  g_hash_table_iter_init (&iter, priv->partitions);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    size += git_commit_bag_get_partition_memory_usage (value);
+
+  return size;
 }
@@ -20,6 +20,10 @@
 
 #include <glib-object.h>
 #include "git-commit.h"
+#include "git-commit-graph.h"
+#include "git-commit-store.h"
+#include "git-object-db.h"
+#include "git-oid.h"
 
 G_BEGIN_DECLS
 
@@ -31,10 +35,30 @@ G_DECLARE_FINAL_TYPE (GitCommitBag,
                       COMMIT_BAG,
                       GObject);
 
+/* Default number of bytes to keep for commits that aren’t referenced
+   by anything else in each repository */
+#define GIT_COMMIT_BAG_DEFAULT_MAX_SIZE (8 * 1024 * 1024)
+
 GitCommitBag *git_commit_bag_get_default (void);
 
 GitCommit *git_commit_bag_get (GitCommitBag *commit_bag,
                                const gchar *hash, GFile *repo);
+GitCommit *git_commit_bag_get_oid (GitCommitBag *commit_bag,
+                                   const GitOid *oid, GFile *repo);
+GitCommit *git_commit_bag_lookup_oid (GitCommitBag *commit_bag,
+                                      const GitOid *oid, GFile *repo);
+
+GitCommitStore *git_commit_bag_get_store (GitCommitBag *commit_bag,
+                                          GFile *repo);
+
+GitCommitGraph *git_commit_bag_get_graph (GitCommitBag *commit_bag,
+                                          GFile *repo);
+
+GitObjectDb *git_commit_bag_get_object_db (GitCommitBag *commit_bag,
+                                           GFile *repo);
+
+void git_commit_bag_set_max_size (GitCommitBag *commit_bag, gsize max_size);
+gsize git_commit_bag_get_memory_usage (GitCommitBag *commit_bag);
 
 G_END_DECLS
 
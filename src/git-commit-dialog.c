@@ -21,6 +21,7 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "git-commit-link-button.h"
 #include "git-marshal.h"
@@ -55,6 +56,15 @@ typedef struct
 {
   GitCommit *commit;
   guint has_log_data_handler;
+  guint has_parents_handler;
+  guint stat_data_handler;
+  /* Whether we have asked the commit for its diffstat */
+  gboolean stat_requested;
+  /* The number of bytes of the stat that are in the text buffer */
+  gsize stat_shown;
+  /* Whether the stat shown has been checked against the complete
+     stat */
+  gboolean stat_checked;
   GitCommitDialogButtonData *buttons;
 
   GtkWidget *grid, *commit_label, *copy_button, *log_view;
@@ -188,6 +198,17 @@ git_commit_dialog_unref_commit (GitCommitDialog *cdiag)
     {
       g_signal_handler_disconnect (priv->commit,
                                    priv->has_log_data_handler);
+      g_signal_handler_disconnect (priv->commit,
+                                   priv->has_parents_handler);
+      g_signal_handler_disconnect (priv->commit,
+                                   priv->stat_data_handler);
+
+      if (priv->stat_requested)
+        {
+          git_commit_cancel_stat_data (priv->commit);
+          priv->stat_requested = FALSE;
+        }
+
       g_object_unref (priv->commit);
       priv->commit = NULL;
     }
@@ -289,6 +310,80 @@ git_commit_dialog_add_commit_button (GitCommitDialog *cdiag,
   priv->buttons = bdata;
 }
 
+/* Returns whether the end of the log view is the start of the stat */
+static gboolean
+git_commit_dialog_stat_shown_matches (GitCommitDialog *cdiag,
+                                      const gchar *stat)
+{
+  GitCommitDialogPrivate *priv = git_commit_dialog_get_instance_private (cdiag);
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+  GtkTextIter start, end;
+  gchar *shown;
+  gboolean ret;
+
+  gtk_text_buffer_get_end_iter (buffer, &end);
+  start = end;
+  gtk_text_iter_backward_chars (&start,
+                                g_utf8_strlen (stat, priv->stat_shown));
+
+  shown = gtk_text_buffer_get_text (buffer, &start, &end, FALSE);
+  ret = (strlen (shown) == priv->stat_shown
+         && !memcmp (shown, stat, priv->stat_shown));
+  g_free (shown);
+
+  return ret;
+}
+
+/* Appends any part of the diffstat that isn’t in the log view yet.
+   This is called whenever more of the stat arrives so it only ever
+   adds the new text. */
+static void
+git_commit_dialog_update_stat (GitCommitDialog *cdiag)
+{
+  GitCommitDialogPrivate *priv = git_commit_dialog_get_instance_private (cdiag);
+
+  if (priv->log_view == NULL
+      || priv->commit == NULL
+      || !git_commit_get_has_log_data (priv->commit))
+    return;
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+  const gchar *stat = git_commit_get_stat_data (priv->commit);
+  gsize stat_length = stat ? strlen (stat) : 0;
+  GtkTextIter iter;
+
+  /* If the stat was replaced with an error message then start
+     again. The message can be longer than what was shown so the text
+     is compared once when the stat is complete. */
+  if (stat_length < priv->stat_shown
+      || (!priv->stat_checked
+          && priv->stat_shown > 0
+          && git_commit_get_has_stat_data (priv->commit)
+          && !git_commit_dialog_stat_shown_matches (cdiag, stat)))
+    {
+      git_commit_dialog_update (cdiag);
+      return;
+    }
+
+  if (git_commit_get_has_stat_data (priv->commit))
+    priv->stat_checked = TRUE;
+
+  if (stat_length == priv->stat_shown)
+    return;
+
+  gtk_text_buffer_get_end_iter (buffer, &iter);
+
+  if (priv->stat_shown == 0)
+    gtk_text_buffer_insert (buffer, &iter, "\n", -1);
+
+  gtk_text_buffer_insert (buffer, &iter,
+                          stat + priv->stat_shown,
+                          stat_length - priv->stat_shown);
+  priv->stat_shown = stat_length;
+}
+
 static void
 git_commit_dialog_update (GitCommitDialog *cdiag)
 {
@@ -304,7 +399,9 @@ git_commit_dialog_update (GitCommitDialog *cdiag)
                           : "");
     }
 
-  if (priv->grid && priv->commit && git_commit_get_has_log_data (priv->commit))
+  /* The parents may be known from the commit-graph before the rest
+     of the log has arrived */
+  if (priv->grid && priv->commit && git_commit_get_has_parents (priv->commit))
     {
       int y = 1;
 
@@ -342,6 +439,21 @@ git_commit_dialog_update (GitCommitDialog *cdiag)
                                 ? git_commit_get_log_data (priv->commit)
                                 : _("Loading..."),
                                 -1);
+      priv->stat_shown = 0;
+      priv->stat_checked = FALSE;
+
+      /* The stat is only requested once the header has arrived so
+         that the cheap part of the log is never held up by it */
+      if (priv->commit && git_commit_get_has_log_data (priv->commit))
+        {
+          if (!priv->stat_requested)
+            {
+              priv->stat_requested = TRUE;
+              git_commit_fetch_stat_data (priv->commit);
+            }
+
+          git_commit_dialog_update_stat (cdiag);
+        }
     }
 }
 
@@ -367,6 +479,16 @@ git_commit_dialog_set_commit (GitCommitDialog *cdiag,
         = g_signal_connect_swapped (commit, "notify::has-log-data",
                                     G_CALLBACK (git_commit_dialog_update),
                                     cdiag);
+      priv->has_parents_handler
+        = g_signal_connect_swapped (commit, "notify::has-parents",
+                                    G_CALLBACK (git_commit_dialog_update),
+                                    cdiag);
+      priv->stat_data_handler
+        = g_signal_connect_swapped (commit, "notify::stat-data",
+                                    G_CALLBACK (git_commit_dialog_update_stat),
+                                    cdiag);
+
+      git_commit_load_parents (commit);
       git_commit_fetch_log_data (commit);
     }
 
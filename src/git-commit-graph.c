@@ -0,0 +1,702 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-commit-graph.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "git-oid.h"
+
+/* Reads the commit-graph files that git maintenance writes to the
+   object database. These contain the parents of every commit that
+   they cover so we can get them without running git. The files are
+   memory-mapped and searched in place. Both a single commit-graph
+   file and a chain of split graphs are supported. */
+
+#define GIT_COMMIT_GRAPH_SIGNATURE "CGPH"
+
+#define GIT_COMMIT_GRAPH_CHUNK_OID_FANOUT 0x4f494446 /* OIDF */
+#define GIT_COMMIT_GRAPH_CHUNK_OID_LOOKUP 0x4f49444c /* OIDL */
+#define GIT_COMMIT_GRAPH_CHUNK_COMMIT_DATA 0x43444154 /* CDAT */
+#define GIT_COMMIT_GRAPH_CHUNK_EXTRA_EDGES 0x45444745 /* EDGE */
+
+#define GIT_COMMIT_GRAPH_PARENT_NONE 0x70000000
+#define GIT_COMMIT_GRAPH_EDGE_FLAG 0x80000000
+
+/* Don’t check whether the files have changed more often than this */
+#define GIT_COMMIT_GRAPH_RECHECK_INTERVAL G_USEC_PER_SEC
+
+typedef struct
+{
+  GMappedFile *file;
+
+  const guint8 *fanout;
+  const guint8 *oids;
+  const guint8 *commit_data;
+  const guint8 *extra_edges;
+  guint32 n_extra_edges;
+
+  guint32 n_commits;
+  /* The number of commits in all of the layers below this one. The
+     parent positions are indices into all of the layers as if they
+     were concatenated. */
+  guint32 base_position;
+} GitCommitGraphLayer;
+
+struct _GitCommitGraph
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  gchar *common_dir;
+  gchar *info_dir;
+
+  /* The layers of the graph starting from the base */
+  GArray *layers;
+  guint8 hash_len;
+
+  /* Used to notice when git writes a new graph */
+  gint64 mtime;
+  gint64 last_check_time;
+
+  /* Whether grafts, replace refs or a shallow clone change the
+     history so that the graph can’t be used */
+  gboolean altered;
+  /* Whether packed-refs had any replace refs the last time it was
+     read and when it was modified then */
+  gboolean packed_replace_refs;
+  gint64 packed_refs_mtime;
+} GitCommitGraphPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitCommitGraph,
+                                  git_commit_graph,
+                                  G_TYPE_OBJECT);
+
+static void git_commit_graph_finalize (GObject *object);
+static gint64 git_commit_graph_get_current_mtime (GitCommitGraph *graph);
+
+static void
+git_commit_graph_class_init (GitCommitGraphClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = git_commit_graph_finalize;
+}
+
+static void
+git_commit_graph_init (GitCommitGraph *self)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (self);
+
+  priv->layers = g_array_new (FALSE, FALSE, sizeof (GitCommitGraphLayer));
+  priv->mtime = -1;
+  priv->packed_refs_mtime = -1;
+}
+
+static void
+git_commit_graph_clear (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  guint i;
+
+  for (i = 0; i < priv->layers->len; i++)
+    g_mapped_file_unref (g_array_index (priv->layers,
+                                        GitCommitGraphLayer,
+                                        i).file);
+
+  g_array_set_size (priv->layers, 0);
+  priv->hash_len = 0;
+}
+
+static void
+git_commit_graph_finalize (GObject *object)
+{
+  GitCommitGraph *self = (GitCommitGraph *) object;
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (self);
+
+  git_commit_graph_clear (self);
+  g_array_free (priv->layers, TRUE);
+  g_free (priv->info_dir);
+  g_free (priv->common_dir);
+
+  G_OBJECT_CLASS (git_commit_graph_parent_class)->finalize (object);
+}
+
+static inline guint32
+git_commit_graph_get_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16)
+    | ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+static inline guint64
+git_commit_graph_get_be64 (const guint8 *p)
+{
+  return ((guint64) git_commit_graph_get_be32 (p) << 32)
+    | git_commit_graph_get_be32 (p + 4);
+}
+
+/* Maps a graph file and finds its chunks. Returns FALSE if the file
+   is missing or doesn’t look valid. */
+static gboolean
+git_commit_graph_load_layer (GitCommitGraph *graph,
+                             const gchar *filename,
+                             guint n_base_graphs)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  GitCommitGraphLayer layer = { 0 };
+  const guint8 *data, *chunk;
+  guint8 hash_len, n_chunks;
+  gsize size, commit_data_size = 0;
+  guint i;
+
+  layer.file = g_mapped_file_new (filename, FALSE, NULL);
+
+  if (layer.file == NULL)
+    return FALSE;
+
+  data = (const guint8 *) g_mapped_file_get_contents (layer.file);
+  size = g_mapped_file_get_length (layer.file);
+
+  if (size < 8
+      || memcmp (data, GIT_COMMIT_GRAPH_SIGNATURE, 4)
+      || data[4] != 1)
+    goto error;
+
+  switch (data[5])
+    {
+    case 1: hash_len = GIT_OID_SHA1_LENGTH; break;
+    case 2: hash_len = GIT_OID_SHA256_LENGTH; break;
+    default: goto error;
+    }
+
+  /* All of the layers must use the same hash and each layer must
+     build on all of the ones below it */
+  if ((priv->hash_len && hash_len != priv->hash_len)
+      || data[7] != n_base_graphs)
+    goto error;
+
+  n_chunks = data[6];
+
+  if (size < 8 + (n_chunks + 1) * 12)
+    goto error;
+
+  for (i = 0, chunk = data + 8; i < n_chunks; i++, chunk += 12)
+    {
+      guint32 id = git_commit_graph_get_be32 (chunk);
+      guint64 offset = git_commit_graph_get_be64 (chunk + 4);
+      guint64 next_offset = git_commit_graph_get_be64 (chunk + 16);
+
+      if (next_offset < offset || next_offset > size)
+        goto error;
+
+      switch (id)
+        {
+        case GIT_COMMIT_GRAPH_CHUNK_OID_FANOUT:
+          if (next_offset - offset != 256 * 4)
+            goto error;
+          layer.fanout = data + offset;
+          break;
+
+        case GIT_COMMIT_GRAPH_CHUNK_OID_LOOKUP:
+          if ((next_offset - offset) % hash_len)
+            goto error;
+          layer.oids = data + offset;
+          layer.n_commits = (next_offset - offset) / hash_len;
+          break;
+
+        case GIT_COMMIT_GRAPH_CHUNK_COMMIT_DATA:
+          layer.commit_data = data + offset;
+          commit_data_size = next_offset - offset;
+          break;
+
+        case GIT_COMMIT_GRAPH_CHUNK_EXTRA_EDGES:
+          layer.extra_edges = data + offset;
+          layer.n_extra_edges = (next_offset - offset) / 4;
+          break;
+        }
+    }
+
+  if (layer.fanout == NULL
+      || layer.oids == NULL
+      || layer.commit_data == NULL
+      || commit_data_size != (gsize) layer.n_commits * (hash_len + 16))
+    goto error;
+
+  /* The fanout gives the range to search for each first byte so a
+     corrupt one could make the search read past the ids */
+  for (i = 0; i < 256; i++)
+    {
+      guint32 count = git_commit_graph_get_be32 (layer.fanout + i * 4);
+
+      if (count > layer.n_commits
+          || (i > 0
+              && count < git_commit_graph_get_be32 (layer.fanout
+                                                    + (i - 1) * 4)))
+        goto error;
+    }
+
+  if (git_commit_graph_get_be32 (layer.fanout + 255 * 4) != layer.n_commits)
+    goto error;
+
+  if (priv->layers->len > 0)
+    {
+      const GitCommitGraphLayer *below
+        = &g_array_index (priv->layers,
+                          GitCommitGraphLayer,
+                          priv->layers->len - 1);
+
+      layer.base_position = below->base_position + below->n_commits;
+    }
+
+  priv->hash_len = hash_len;
+  g_array_append_val (priv->layers, layer);
+
+  return TRUE;
+
+ error:
+  g_mapped_file_unref (layer.file);
+  return FALSE;
+}
+
+static gint64
+git_commit_graph_get_mtime (const gchar *filename)
+{
+  struct stat buf;
+
+  if (stat (filename, &buf) == -1)
+    return -1;
+
+  return (gint64) buf.st_mtim.tv_sec * G_USEC_PER_SEC
+    + buf.st_mtim.tv_nsec / 1000;
+}
+
+/* Returns whether there are any replace refs in packed-refs. The file
+   is only read again when it changes. */
+static gboolean
+git_commit_graph_has_packed_replace_refs (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  gchar *filename = g_build_filename (priv->common_dir, "packed-refs", NULL);
+  gint64 mtime = git_commit_graph_get_mtime (filename);
+  gchar *contents;
+
+  if (mtime != priv->packed_refs_mtime)
+    {
+      priv->packed_refs_mtime = mtime;
+      priv->packed_replace_refs = FALSE;
+
+      if (mtime != -1
+          && g_file_get_contents (filename, &contents, NULL, NULL))
+        {
+          priv->packed_replace_refs
+            = strstr (contents, " refs/replace/") != NULL;
+          g_free (contents);
+        }
+    }
+
+  g_free (filename);
+
+  return priv->packed_replace_refs;
+}
+
+/* Returns whether the history is changed by grafts, replace refs or a
+   shallow clone. Git doesn’t use the commit-graph then because it has
+   the real parents, so we don’t either. */
+static gboolean
+git_commit_graph_check_altered (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  gchar *filename;
+  gboolean altered;
+  GDir *dir;
+
+  filename = g_build_filename (priv->common_dir, "info", "grafts", NULL);
+  altered = g_file_test (filename, G_FILE_TEST_EXISTS);
+  g_free (filename);
+
+  if (!altered)
+    {
+      filename = g_build_filename (priv->common_dir, "shallow", NULL);
+      altered = g_file_test (filename, G_FILE_TEST_EXISTS);
+      g_free (filename);
+    }
+
+  if (!altered)
+    {
+      filename = g_build_filename (priv->common_dir, "refs", "replace", NULL);
+      dir = g_dir_open (filename, 0, NULL);
+      g_free (filename);
+
+      if (dir)
+        {
+          altered = g_dir_read_name (dir) != NULL;
+          g_dir_close (dir);
+        }
+    }
+
+  if (!altered)
+    altered = git_commit_graph_has_packed_replace_refs (graph);
+
+  return altered;
+}
+
+static void
+git_commit_graph_load (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  gchar *chain_filename = g_build_filename (priv->info_dir,
+                                            "commit-graphs",
+                                            "commit-graph-chain",
+                                            NULL);
+  gchar *contents;
+
+  git_commit_graph_clear (graph);
+
+  priv->altered = git_commit_graph_check_altered (graph);
+
+  if (priv->altered)
+    priv->mtime = git_commit_graph_get_current_mtime (graph);
+  else if (g_file_get_contents (chain_filename, &contents, NULL, NULL))
+    {
+      gchar **lines = g_strsplit (contents, "\n", -1);
+
+      priv->mtime = git_commit_graph_get_mtime (chain_filename);
+
+      /* The chain lists the layers starting from the base. If a layer
+         fails to load then the ones below it are still usable. */
+      for (guint i = 0; lines[i] && *lines[i]; i++)
+        {
+          gchar *basename = g_strconcat ("graph-", lines[i], ".graph", NULL);
+          gchar *filename = g_build_filename (priv->info_dir,
+                                              "commit-graphs",
+                                              basename,
+                                              NULL);
+          gboolean loaded = git_commit_graph_load_layer (graph, filename, i);
+
+          g_free (filename);
+          g_free (basename);
+
+          if (!loaded)
+            break;
+        }
+
+      g_strfreev (lines);
+      g_free (contents);
+    }
+  else
+    {
+      gchar *filename = g_build_filename (priv->info_dir,
+                                          "commit-graph",
+                                          NULL);
+
+      priv->mtime = git_commit_graph_get_mtime (filename);
+      git_commit_graph_load_layer (graph, filename, 0);
+
+      g_free (filename);
+    }
+
+  g_free (chain_filename);
+
+  priv->last_check_time = g_get_monotonic_time ();
+}
+
+/* Returns the modification time of the file that says which graph
+   to use. This is the chain file if there is one. */
+static gint64
+git_commit_graph_get_current_mtime (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  gchar *filename = g_build_filename (priv->info_dir,
+                                      "commit-graphs",
+                                      "commit-graph-chain",
+                                      NULL);
+  gint64 mtime = git_commit_graph_get_mtime (filename);
+
+  g_free (filename);
+
+  if (mtime == -1)
+    {
+      filename = g_build_filename (priv->info_dir, "commit-graph", NULL);
+      mtime = git_commit_graph_get_mtime (filename);
+      g_free (filename);
+    }
+
+  return mtime;
+}
+
+/* Reloads the graph if git has written a new one since we loaded it
+   or if the history has been altered or restored since then. This is
+   only checked once in a while. Returns TRUE if the graph was
+   reloaded. */
+static gboolean
+git_commit_graph_check_reload (GitCommitGraph *graph)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  gint64 now = g_get_monotonic_time ();
+
+  if (priv->info_dir == NULL
+      || now - priv->last_check_time < GIT_COMMIT_GRAPH_RECHECK_INTERVAL)
+    return FALSE;
+
+  priv->last_check_time = now;
+
+  if (git_commit_graph_get_current_mtime (graph) == priv->mtime
+      && git_commit_graph_check_altered (graph) == priv->altered)
+    return FALSE;
+
+  git_commit_graph_load (graph);
+
+  return TRUE;
+}
+
+GitCommitGraph *
+git_commit_graph_new (GFile *common_dir)
+{
+  g_return_val_if_fail (G_IS_FILE (common_dir), NULL);
+
+  GitCommitGraph *self = g_object_new (GIT_TYPE_COMMIT_GRAPH, NULL);
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (self);
+  gchar *common_path = g_file_get_path (common_dir);
+
+  if (common_path)
+    {
+      priv->common_dir = common_path;
+      priv->info_dir = g_build_filename (common_path,
+                                         "objects",
+                                         "info",
+                                         NULL);
+      git_commit_graph_load (self);
+    }
+
+  return self;
+}
+
+static gboolean
+git_commit_graph_find_in_layers (GitCommitGraph *graph,
+                                 const GitOid *oid,
+                                 guint32 *position)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  guint i;
+
+  if (oid->len != priv->hash_len)
+    return FALSE;
+
+  for (i = 0; i < priv->layers->len; i++)
+    {
+      const GitCommitGraphLayer *layer
+        = &g_array_index (priv->layers, GitCommitGraphLayer, i);
+      guint32 lo, hi;
+
+      lo = oid->id[0] == 0
+        ? 0
+        : git_commit_graph_get_be32 (layer->fanout + (oid->id[0] - 1) * 4);
+      hi = git_commit_graph_get_be32 (layer->fanout + oid->id[0] * 4);
+
+      while (lo < hi)
+        {
+          guint32 mid = lo + (hi - lo) / 2;
+          int cmp = memcmp (oid->id,
+                            layer->oids + (gsize) mid * priv->hash_len,
+                            priv->hash_len);
+
+          if (cmp == 0)
+            {
+              *position = layer->base_position + mid;
+              return TRUE;
+            }
+          else if (cmp < 0)
+            hi = mid;
+          else
+            lo = mid + 1;
+        }
+    }
+
+  return FALSE;
+}
+
+static gboolean
+git_commit_graph_find (GitCommitGraph *graph,
+                       const GitOid *oid,
+                       guint32 *position)
+{
+  /* A replace ref might have been added since the graph was loaded
+     and a commit that isn’t found might be in a new graph */
+  git_commit_graph_check_reload (graph);
+
+  return git_commit_graph_find_in_layers (graph, oid, position);
+}
+
+static const GitCommitGraphLayer *
+git_commit_graph_get_layer (GitCommitGraph *graph, guint32 position)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  guint i;
+
+  for (i = priv->layers->len; i > 0; i--)
+    {
+      const GitCommitGraphLayer *layer
+        = &g_array_index (priv->layers, GitCommitGraphLayer, i - 1);
+
+      if (position >= layer->base_position)
+        return (position - layer->base_position < layer->n_commits
+                ? layer
+                : NULL);
+    }
+
+  return NULL;
+}
+
+static const guint8 *
+git_commit_graph_get_commit_data (GitCommitGraph *graph,
+                                  guint32 position,
+                                  const GitCommitGraphLayer **layer_out)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  const GitCommitGraphLayer *layer = git_commit_graph_get_layer (graph,
+                                                                 position);
+
+  if (layer == NULL)
+    return NULL;
+
+  if (layer_out)
+    *layer_out = layer;
+
+  return (layer->commit_data
+          + (gsize) (position - layer->base_position) * (priv->hash_len + 16));
+}
+
+/* Calls func for the position of each parent of the commit at
+   position. Returns FALSE if the graph is corrupt. */
+static gboolean
+git_commit_graph_foreach_parent (GitCommitGraph *graph,
+                                 guint32 position,
+                                 void (* func) (guint32 parent,
+                                                gpointer user_data),
+                                 gpointer user_data)
+{
+  GitCommitGraphPrivate *priv = git_commit_graph_get_instance_private (graph);
+  const GitCommitGraphLayer *layer;
+  const guint8 *data = git_commit_graph_get_commit_data (graph,
+                                                         position,
+                                                         &layer);
+  guint32 parent1, parent2, edge;
+
+  if (data == NULL)
+    return FALSE;
+
+  parent1 = git_commit_graph_get_be32 (data + priv->hash_len);
+  parent2 = git_commit_graph_get_be32 (data + priv->hash_len + 4);
+
+  if (parent1 != GIT_COMMIT_GRAPH_PARENT_NONE)
+    func (parent1, user_data);
+
+  if (parent2 == GIT_COMMIT_GRAPH_PARENT_NONE)
+    return TRUE;
+
+  if (!(parent2 & GIT_COMMIT_GRAPH_EDGE_FLAG))
+    {
+      func (parent2, user_data);
+      return TRUE;
+    }
+
+  /* Octopus merges store the rest of their parents in the extra
+     edges list. The last one has the top bit set. */
+  for (edge = parent2 & ~GIT_COMMIT_GRAPH_EDGE_FLAG;
+       edge < layer->n_extra_edges;
+       edge++)
+    {
+      guint32 parent = git_commit_graph_get_be32 (layer->extra_edges
+                                                  + (gsize) edge * 4);
+
+      func (parent & ~GIT_COMMIT_GRAPH_EDGE_FLAG, user_data);
+
+      if (parent & GIT_COMMIT_GRAPH_EDGE_FLAG)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+typedef struct
+{
+  GitCommitGraph *graph;
+  GArray *parents;
+  gboolean valid;
+} GitCommitGraphParentsData;
+
+static void
+git_commit_graph_add_parent_oid (guint32 position, gpointer user_data)
+{
+  GitCommitGraphParentsData *data = user_data;
+  GitCommitGraphPrivate *priv =
+    git_commit_graph_get_instance_private (data->graph);
+  const GitCommitGraphLayer *layer
+    = git_commit_graph_get_layer (data->graph, position);
+  GitOid oid;
+
+  if (layer == NULL)
+    {
+      data->valid = FALSE;
+      return;
+    }
+
+  oid.len = priv->hash_len;
+  memcpy (oid.id,
+          layer->oids + (gsize) (position - layer->base_position) * oid.len,
+          oid.len);
+
+  g_array_append_val (data->parents, oid);
+}
+
+/* Appends the ids of the parents of the commit to parents, which
+   should be an array of GitOid. Returns FALSE if the commit isn’t
+   covered by the graph. */
+gboolean
+git_commit_graph_get_parents (GitCommitGraph *graph,
+                              const GitOid *oid,
+                              GArray *parents)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_GRAPH (graph), FALSE);
+  g_return_val_if_fail (oid != NULL, FALSE);
+
+  GitCommitGraphParentsData data = { graph, parents, TRUE };
+  guint old_len = parents->len;
+  guint32 position;
+
+  if (!git_commit_graph_find (graph, oid, &position))
+    return FALSE;
+
+  if (!git_commit_graph_foreach_parent (graph, position,
+                                        git_commit_graph_add_parent_oid,
+                                        &data)
+      || !data.valid)
+    {
+      g_array_set_size (parents, old_len);
+      return FALSE;
+    }
+
+  return TRUE;
+}
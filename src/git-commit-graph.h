@@ -0,0 +1,43 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_COMMIT_GRAPH_H__
+#define __GIT_COMMIT_GRAPH_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-oid.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_COMMIT_GRAPH git_commit_graph_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitCommitGraph,
+                      git_commit_graph,
+                      GIT,
+                      COMMIT_GRAPH,
+                      GObject);
+
+GitCommitGraph *git_commit_graph_new (GFile *common_dir);
+
+gboolean git_commit_graph_get_parents (GitCommitGraph *graph,
+                                       const GitOid *oid,
+                                       GArray *parents);
+
+G_END_DECLS
+
+#endif /* __GIT_COMMIT_GRAPH_H__ */
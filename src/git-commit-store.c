@@ -0,0 +1,989 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-commit-store.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "git-oid.h"
+
+/* Commits never change so anything we learn about them can be kept
+   forever. Each object database gets a file in the user’s cache
+   directory. The file is a header followed by a list of records that
+   is only ever appended to. Appending is done under an flock so that
+   several instances can share the file. If the application crashes
+   while appending then the truncated record is cut off the next time
+   the file is opened or appended to. Nothing ever waits for the lock:
+   if another instance holds it then the store is skipped for that
+   operation. Records that other instances append are picked up when
+   a lookup misses. Once the file gets too big it is rewritten with
+   only the newest records and renamed over the old one. */
+
+#define GIT_COMMIT_STORE_MAGIC "BBCS"
+#define GIT_COMMIT_STORE_VERSION 1
+#define GIT_COMMIT_STORE_RECORD_MAGIC 0x52434242 /* “BBCR” */
+
+/* Sanity limit on the size of a record so that a corrupt file can’t
+   make us allocate a silly amount of memory */
+#define GIT_COMMIT_STORE_MAX_PAYLOAD (64 * 1024 * 1024)
+
+/* The file is compacted down to half this size when it would grow
+   past it */
+#define GIT_COMMIT_STORE_MAX_SIZE (32 * 1024 * 1024)
+
+/* If the file can’t be opened, for example because another instance
+   has it locked, then it is tried again after a delay that doubles
+   each time between these limits */
+#define GIT_COMMIT_STORE_MIN_RETRY_DELAY G_USEC_PER_SEC
+#define GIT_COMMIT_STORE_MAX_RETRY_DELAY (60 * G_USEC_PER_SEC)
+
+typedef enum
+{
+  GIT_COMMIT_STORE_STATE_CLOSED,
+  /* The file is being opened and scanned in a thread */
+  GIT_COMMIT_STORE_STATE_OPENING,
+  GIT_COMMIT_STORE_STATE_OPEN,
+  /* Something went wrong while writing so it isn’t used again */
+  GIT_COMMIT_STORE_STATE_BROKEN
+} GitCommitStoreState;
+
+typedef enum
+{
+  GIT_COMMIT_STORE_RECORD_LOG = 1,
+  GIT_COMMIT_STORE_RECORD_STAT = 2
+} GitCommitStoreRecordType;
+
+typedef struct
+{
+  char magic[4];
+  guint32 version;
+} GitCommitStoreFileHeader;
+
+/* All of the numbers are stored little-endian. The header is followed
+   by the object id and then the payload. A log record’s payload is
+   the number of parents as a byte, the ids of the parents and then
+   the log text. A stat record just contains the text. */
+typedef struct
+{
+  guint32 magic;
+  guint8 type;
+  guint8 oid_len;
+  guint16 reserved;
+  guint32 payload_length;
+} GitCommitStoreRecordHeader;
+
+typedef struct
+{
+  GitOid oid;
+  /* Offsets of the records in the file or zero if there isn’t one.
+     Zero is never a valid record offset because of the file
+     header. */
+  goffset log_offset;
+  goffset stat_offset;
+} GitCommitStoreEntry;
+
+struct _GitCommitStore
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  gchar *filename;
+
+  /* The file is opened lazily the first time it is needed. Reading
+     the index can take a while for a big file so it is done in a
+     thread and the store acts as if it is empty until that has
+     finished. If opening fails then the store silently does nothing
+     until it is retried. */
+  GitCommitStoreState state;
+  gint64 retry_time;
+  gint64 retry_delay;
+  int fd;
+
+  /* How much of the file has been indexed */
+  goffset scanned_size;
+
+  /* Map from GitOid to a GitCommitStoreEntry */
+  GHashTable *entries;
+} GitCommitStorePrivate;
+
+/* The result of opening the file in a thread */
+typedef struct
+{
+  int fd;
+  GHashTable *entries;
+  goffset scanned_size;
+} GitCommitStoreOpenData;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitCommitStore,
+                                  git_commit_store,
+                                  G_TYPE_OBJECT);
+
+static void git_commit_store_finalize (GObject *object);
+
+static void
+git_commit_store_class_init (GitCommitStoreClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = git_commit_store_finalize;
+}
+
+static guint
+git_commit_store_hash_oid (gconstpointer key)
+{
+  return git_oid_hash (key);
+}
+
+static gboolean
+git_commit_store_equal_oid (gconstpointer a, gconstpointer b)
+{
+  return git_oid_equal (a, b);
+}
+
+static void
+git_commit_store_free_entry (GitCommitStoreEntry *entry)
+{
+  g_slice_free (GitCommitStoreEntry, entry);
+}
+
+/* The key is the oid embedded in the entry */
+static GHashTable *
+git_commit_store_new_entries (void)
+{
+  return g_hash_table_new_full (git_commit_store_hash_oid,
+                                git_commit_store_equal_oid,
+                                NULL,
+                                (GDestroyNotify) git_commit_store_free_entry);
+}
+
+static void
+git_commit_store_init (GitCommitStore *self)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (self);
+
+  priv->fd = -1;
+  priv->entries = git_commit_store_new_entries ();
+}
+
+static void
+git_commit_store_finalize (GObject *object)
+{
+  GitCommitStore *self = (GitCommitStore *) object;
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (self);
+
+  if (priv->fd != -1)
+    close (priv->fd);
+
+  g_hash_table_destroy (priv->entries);
+  g_free (priv->filename);
+
+  G_OBJECT_CLASS (git_commit_store_parent_class)->finalize (object);
+}
+
+/* Creates a store for the object database in common_dir. Nothing is
+   read from the disk until the store is first used. */
+GitCommitStore *
+git_commit_store_new (GFile *common_dir)
+{
+  g_return_val_if_fail (G_IS_FILE (common_dir), NULL);
+
+  GitCommitStore *self = g_object_new (GIT_TYPE_COMMIT_STORE, NULL);
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (self);
+  gchar *uri = g_file_get_uri (common_dir);
+  gchar *checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  gchar *basename = g_strconcat (checksum, ".commits", NULL);
+
+  priv->filename = g_build_filename (g_get_user_cache_dir (),
+                                     "blame-browse",
+                                     basename,
+                                     NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_free (uri);
+
+  return self;
+}
+
+static gboolean
+git_commit_store_read_all (int fd, goffset offset, gpointer buf, gsize length)
+{
+  while (length > 0)
+    {
+      ssize_t got = pread (fd, buf, length, offset);
+
+      if (got == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+      if (got == 0)
+        return FALSE;
+
+      buf = (guint8 *) buf + got;
+      length -= got;
+      offset += got;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+git_commit_store_write_all (int fd, gconstpointer buf, gsize length)
+{
+  while (length > 0)
+    {
+      ssize_t wrote = write (fd, buf, length);
+
+      if (wrote == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+
+      buf = (const guint8 *) buf + wrote;
+      length -= wrote;
+    }
+
+  return TRUE;
+}
+
+/* Reads and validates the header of the record at offset. The oid of
+   the record is returned in oid. */
+static gboolean
+git_commit_store_read_record_header (int fd,
+                                     goffset offset,
+                                     goffset file_size,
+                                     GitCommitStoreRecordHeader *header,
+                                     GitOid *oid)
+{
+  if (!git_commit_store_read_all (fd, offset, header, sizeof *header))
+    return FALSE;
+
+  header->magic = GUINT32_FROM_LE (header->magic);
+  header->payload_length = GUINT32_FROM_LE (header->payload_length);
+
+  if (header->magic != GIT_COMMIT_STORE_RECORD_MAGIC
+      || (header->type != GIT_COMMIT_STORE_RECORD_LOG
+          && header->type != GIT_COMMIT_STORE_RECORD_STAT)
+      || (header->oid_len != GIT_OID_SHA1_LENGTH
+          && header->oid_len != GIT_OID_SHA256_LENGTH)
+      || header->payload_length > GIT_COMMIT_STORE_MAX_PAYLOAD
+      || (file_size >= 0
+          && (offset + sizeof *header + header->oid_len
+              + header->payload_length) > file_size))
+    return FALSE;
+
+  oid->len = header->oid_len;
+
+  return git_commit_store_read_all (fd, offset + sizeof *header,
+                                    oid->id, oid->len);
+}
+
+static void
+git_commit_store_index_record (GHashTable *entries,
+                               const GitCommitStoreRecordHeader *header,
+                               const GitOid *oid,
+                               goffset offset)
+{
+  GitCommitStoreEntry *entry = g_hash_table_lookup (entries, oid);
+
+  if (entry == NULL)
+    {
+      entry = g_slice_new0 (GitCommitStoreEntry);
+      entry->oid = *oid;
+      g_hash_table_insert (entries, &entry->oid, entry);
+    }
+
+  if (header->type == GIT_COMMIT_STORE_RECORD_LOG)
+    entry->log_offset = offset;
+  else
+    entry->stat_offset = offset;
+}
+
+static gboolean
+git_commit_store_init_file (int fd)
+{
+  GitCommitStoreFileHeader header;
+
+  memcpy (header.magic, GIT_COMMIT_STORE_MAGIC, sizeof header.magic);
+  header.version = GUINT32_TO_LE (GIT_COMMIT_STORE_VERSION);
+
+  return (ftruncate (fd, 0) == 0
+          && lseek (fd, 0, SEEK_SET) == 0
+          && git_commit_store_write_all (fd, &header, sizeof header));
+}
+
+/* Indexes the valid records from offset up to file_size. Returns the
+   offset after the last one. */
+static goffset
+git_commit_store_scan_records (int fd,
+                               GHashTable *entries,
+                               goffset offset,
+                               goffset file_size)
+{
+  GitCommitStoreRecordHeader header;
+  GitOid oid;
+
+  for (;
+       git_commit_store_read_record_header (fd, offset, file_size,
+                                            &header, &oid);
+       offset += sizeof header + header.oid_len + header.payload_length)
+    git_commit_store_index_record (entries, &header, &oid, offset);
+
+  return offset;
+}
+
+/* Reads the whole file into entries. This is called from a thread
+   with the file locked. */
+static gboolean
+git_commit_store_scan (int fd, GHashTable *entries, goffset *scanned_size)
+{
+  GitCommitStoreFileHeader file_header;
+  goffset offset, file_size;
+  struct stat statbuf;
+
+  if (fstat (fd, &statbuf) == -1)
+    return FALSE;
+
+  file_size = statbuf.st_size;
+
+  /* Start again if the file is empty or was written by an
+     incompatible version */
+  if (!git_commit_store_read_all (fd, 0, &file_header, sizeof file_header)
+      || memcmp (file_header.magic,
+                 GIT_COMMIT_STORE_MAGIC,
+                 sizeof file_header.magic)
+      || GUINT32_FROM_LE (file_header.version) != GIT_COMMIT_STORE_VERSION)
+    {
+      if (!git_commit_store_init_file (fd))
+        return FALSE;
+      *scanned_size = sizeof file_header;
+      return TRUE;
+    }
+
+  offset = git_commit_store_scan_records (fd, entries,
+                                          sizeof file_header,
+                                          file_size);
+
+  /* Cut off anything after the last valid record so that new records
+     will be reachable */
+  if (offset < file_size && ftruncate (fd, offset) == -1)
+    return FALSE;
+
+  *scanned_size = offset;
+
+  return TRUE;
+}
+
+static void
+git_commit_store_free_open_data (GitCommitStoreOpenData *data)
+{
+  if (data->fd != -1)
+    close (data->fd);
+  if (data->entries)
+    g_hash_table_destroy (data->entries);
+  g_free (data);
+}
+
+static void
+git_commit_store_open_thread (GTask *task,
+                              gpointer source_object,
+                              gpointer task_data,
+                              GCancellable *cancellable)
+{
+  const gchar *filename = task_data;
+  gchar *dirname = g_path_get_dirname (filename);
+  GitCommitStoreOpenData *data = g_new0 (GitCommitStoreOpenData, 1);
+
+  data->fd = -1;
+
+  if (g_mkdir_with_parents (dirname, 0700) == 0)
+    data->fd = open (filename, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+
+  g_free (dirname);
+
+  /* If another instance is writing to the file then it is tried again
+     later rather than waiting */
+  if (data->fd == -1 || flock (data->fd, LOCK_EX | LOCK_NB) == -1)
+    goto error;
+
+  data->entries = git_commit_store_new_entries ();
+
+  if (!git_commit_store_scan (data->fd, data->entries, &data->scanned_size))
+    goto error;
+
+  flock (data->fd, LOCK_UN);
+
+  g_task_return_pointer (task,
+                         data,
+                         (GDestroyNotify) git_commit_store_free_open_data);
+
+  return;
+
+ error:
+  git_commit_store_free_open_data (data);
+  g_task_return_pointer (task, NULL, NULL);
+}
+
+static void
+git_commit_store_on_opened (GObject *source_object,
+                            GAsyncResult *result,
+                            gpointer user_data)
+{
+  GitCommitStore *store = GIT_COMMIT_STORE (source_object);
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  GitCommitStoreOpenData *data
+    = g_task_propagate_pointer (G_TASK (result), NULL);
+
+  if (data == NULL)
+    {
+      priv->state = GIT_COMMIT_STORE_STATE_CLOSED;
+      priv->retry_delay = CLAMP (priv->retry_delay * 2,
+                                 GIT_COMMIT_STORE_MIN_RETRY_DELAY,
+                                 GIT_COMMIT_STORE_MAX_RETRY_DELAY);
+      priv->retry_time = g_get_monotonic_time () + priv->retry_delay;
+      return;
+    }
+
+  priv->state = GIT_COMMIT_STORE_STATE_OPEN;
+  priv->retry_delay = 0;
+  priv->fd = data->fd;
+  priv->scanned_size = data->scanned_size;
+  g_hash_table_destroy (priv->entries);
+  priv->entries = data->entries;
+
+  data->fd = -1;
+  data->entries = NULL;
+  git_commit_store_free_open_data (data);
+}
+
+/* Returns whether the file can be used. If it isn’t open yet then it
+   starts opening it in the background and returns FALSE. */
+static gboolean
+git_commit_store_ensure_open (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+
+  if (priv->state == GIT_COMMIT_STORE_STATE_CLOSED
+      && g_get_monotonic_time () >= priv->retry_time)
+    {
+      GTask *task = g_task_new (store, NULL, git_commit_store_on_opened, NULL);
+
+      priv->state = GIT_COMMIT_STORE_STATE_OPENING;
+
+      g_task_set_task_data (task, g_strdup (priv->filename), g_free);
+      g_task_run_in_thread (task, git_commit_store_open_thread);
+      g_object_unref (task);
+    }
+
+  return priv->state == GIT_COMMIT_STORE_STATE_OPEN;
+}
+
+/* Forgets the file so that it will be opened again. This is needed
+   when another instance has replaced it by compacting it. */
+static void
+git_commit_store_close (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+
+  if (priv->fd != -1)
+    close (priv->fd);
+
+  priv->fd = -1;
+  priv->state = GIT_COMMIT_STORE_STATE_CLOSED;
+  g_hash_table_remove_all (priv->entries);
+}
+
+/* Stops using the file for good */
+static void
+git_commit_store_break (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+
+  git_commit_store_close (store);
+  priv->state = GIT_COMMIT_STORE_STATE_BROKEN;
+}
+
+/* Picks up any records that other instances have appended since the
+   file was last scanned */
+static void
+git_commit_store_scan_tail (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  struct stat statbuf;
+
+  if (fstat (priv->fd, &statbuf) == -1
+      || statbuf.st_size <= priv->scanned_size)
+    return;
+
+  priv->scanned_size = git_commit_store_scan_records (priv->fd,
+                                                      priv->entries,
+                                                      priv->scanned_size,
+                                                      statbuf.st_size);
+}
+
+static gboolean
+git_commit_store_is_replaced (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  struct stat fd_stat, file_stat;
+
+  return (fstat (priv->fd, &fd_stat) == -1
+          || stat (priv->filename, &file_stat) == -1
+          || fd_stat.st_dev != file_stat.st_dev
+          || fd_stat.st_ino != file_stat.st_ino);
+}
+
+static gint
+git_commit_store_compare_offsets (gconstpointer a, gconstpointer b)
+{
+  goffset offset_a = *(const goffset *) a;
+  goffset offset_b = *(const goffset *) b;
+
+  return offset_a < offset_b ? -1 : offset_a > offset_b ? 1 : 0;
+}
+
+/* Copies the record at offset to the end of out_fd */
+static gboolean
+git_commit_store_copy_record (GitCommitStore *store,
+                              goffset offset,
+                              gsize length,
+                              int out_fd)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  guint8 *record = g_malloc (length);
+  gboolean ret;
+
+  ret = (git_commit_store_read_all (priv->fd, offset, record, length)
+         && git_commit_store_write_all (out_fd, record, length));
+
+  g_free (record);
+
+  return ret;
+}
+
+/* Writes the newest records to a new file, up to half of the maximum
+   size, and renames it over the old one. Must be called with the file
+   locked. On success the store uses the new file, which is left
+   unlocked. */
+static gboolean
+git_commit_store_compact (GitCommitStore *store)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  GArray *offsets = g_array_new (FALSE, FALSE, sizeof (goffset));
+  GHashTable *old_entries = priv->entries;
+  GHashTableIter iter;
+  GitCommitStoreEntry *entry;
+  GitCommitStoreRecordHeader header;
+  GitOid oid;
+  gchar *tmp_filename = NULL;
+  gsize size = sizeof (GitCommitStoreFileHeader);
+  goffset out_offset;
+  int out_fd = -1;
+  guint i, first_kept;
+
+  g_hash_table_iter_init (&iter, old_entries);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      if (entry->log_offset)
+        g_array_append_val (offsets, entry->log_offset);
+      if (entry->stat_offset)
+        g_array_append_val (offsets, entry->stat_offset);
+    }
+
+  g_array_sort (offsets, git_commit_store_compare_offsets);
+
+  /* Keep the newest records that fit */
+  for (first_kept = offsets->len; first_kept > 0; first_kept--)
+    {
+      goffset offset = g_array_index (offsets, goffset, first_kept - 1);
+
+      if (!git_commit_store_read_record_header (priv->fd, offset, -1,
+                                                &header, &oid))
+        goto error;
+
+      size += sizeof header + header.oid_len + header.payload_length;
+
+      if (size > GIT_COMMIT_STORE_MAX_SIZE / 2)
+        break;
+    }
+
+  tmp_filename = g_strconcat (priv->filename, ".XXXXXX", NULL);
+  out_fd = g_mkstemp_full (tmp_filename, O_RDWR | O_CLOEXEC, 0600);
+
+  if (out_fd == -1 || !git_commit_store_init_file (out_fd))
+    goto error;
+
+  priv->entries = git_commit_store_new_entries ();
+  out_offset = sizeof (GitCommitStoreFileHeader);
+
+  for (i = first_kept; i < offsets->len; i++)
+    {
+      goffset offset = g_array_index (offsets, goffset, i);
+      gsize length;
+
+      if (!git_commit_store_read_record_header (priv->fd, offset, -1,
+                                                &header, &oid))
+        goto error_entries;
+
+      length = sizeof header + header.oid_len + header.payload_length;
+
+      if (!git_commit_store_copy_record (store, offset, length, out_fd))
+        goto error_entries;
+
+      git_commit_store_index_record (priv->entries,
+                                     &header, &oid, out_offset);
+      out_offset += length;
+    }
+
+  if (rename (tmp_filename, priv->filename) == -1)
+    goto error_entries;
+
+  /* Closing the old file drops the lock. Any other instance that
+     still has it open notices that it was replaced before appending
+     to it. */
+  close (priv->fd);
+  priv->fd = out_fd;
+  priv->scanned_size = out_offset;
+  if (fcntl (priv->fd, F_SETFL, O_APPEND) == -1)
+    git_commit_store_close (store);
+
+  g_hash_table_destroy (old_entries);
+  g_array_free (offsets, TRUE);
+  g_free (tmp_filename);
+
+  return TRUE;
+
+ error_entries:
+  g_hash_table_destroy (priv->entries);
+  priv->entries = old_entries;
+ error:
+  if (out_fd != -1)
+    {
+      close (out_fd);
+      unlink (tmp_filename);
+    }
+  g_array_free (offsets, TRUE);
+  g_free (tmp_filename);
+
+  return FALSE;
+}
+
+/* Reads the payload of the record at offset. The payload is
+   terminated with a nul byte so that text can be used directly. */
+static guint8 *
+git_commit_store_read_payload (GitCommitStore *store,
+                               goffset offset,
+                               GitCommitStoreRecordType type,
+                               const GitOid *oid,
+                               gsize *length)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  GitCommitStoreRecordHeader header;
+  GitOid record_oid;
+  guint8 *payload;
+
+  if (offset == 0
+      || !git_commit_store_read_record_header (priv->fd, offset, -1,
+                                               &header, &record_oid)
+      || header.type != type
+      || !git_oid_equal (&record_oid, oid))
+    return NULL;
+
+  payload = g_malloc (header.payload_length + 1);
+
+  if (!git_commit_store_read_all (priv->fd,
+                                  offset + sizeof header + header.oid_len,
+                                  payload,
+                                  header.payload_length))
+    {
+      g_free (payload);
+      return NULL;
+    }
+
+  payload[header.payload_length] = '\0';
+  *length = header.payload_length;
+
+  return payload;
+}
+
+static goffset
+git_commit_store_get_offset (GitCommitStore *store,
+                             const GitOid *oid,
+                             GitCommitStoreRecordType type)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  GitCommitStoreEntry *entry = g_hash_table_lookup (priv->entries, oid);
+
+  if (entry == NULL)
+    return 0;
+
+  return type == GIT_COMMIT_STORE_RECORD_LOG ? entry->log_offset
+    : entry->stat_offset;
+}
+
+/* Returns the offset of the record or zero if there isn’t one */
+static goffset
+git_commit_store_lookup (GitCommitStore *store,
+                         const GitOid *oid,
+                         GitCommitStoreRecordType type)
+{
+  goffset offset;
+
+  if (!git_commit_store_ensure_open (store))
+    return 0;
+
+  offset = git_commit_store_get_offset (store, oid, type);
+
+  if (offset)
+    return offset;
+
+  /* Another instance might have added it since the file was read */
+  if (git_commit_store_is_replaced (store))
+    {
+      git_commit_store_close (store);
+      git_commit_store_ensure_open (store);
+      return 0;
+    }
+
+  git_commit_store_scan_tail (store);
+
+  return git_commit_store_get_offset (store, oid, type);
+}
+
+/* Looks up the log data for a commit. If it is found then the ids of
+   the parents are appended to parents, which should be an array of
+   GitOid, and the log text is returned in log_data. */
+gboolean
+git_commit_store_get_log (GitCommitStore *store,
+                          const GitOid *oid,
+                          GArray *parents,
+                          gchar **log_data)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_STORE (store), FALSE);
+
+  goffset offset = git_commit_store_lookup (store, oid,
+                                            GIT_COMMIT_STORE_RECORD_LOG);
+  guint8 *payload;
+  gsize length, parents_length;
+  guint i;
+
+  if (!(payload = git_commit_store_read_payload (store,
+                                                 offset,
+                                                 GIT_COMMIT_STORE_RECORD_LOG,
+                                                 oid,
+                                                 &length)))
+    return FALSE;
+
+  parents_length = length > 0 ? 1 + payload[0] * oid->len : 1;
+
+  if (length < parents_length)
+    {
+      g_free (payload);
+      return FALSE;
+    }
+
+  for (i = 0; i < payload[0]; i++)
+    {
+      GitOid parent;
+
+      parent.len = oid->len;
+      memcpy (parent.id, payload + 1 + i * oid->len, oid->len);
+      g_array_append_val (parents, parent);
+    }
+
+  *log_data = g_strdup ((const gchar *) payload + parents_length);
+
+  g_free (payload);
+
+  return TRUE;
+}
+
+/* Returns the stored diffstat for a commit or NULL if there isn’t
+   one */
+gchar *
+git_commit_store_get_stat (GitCommitStore *store, const GitOid *oid)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT_STORE (store), NULL);
+
+  goffset offset = git_commit_store_lookup (store, oid,
+                                            GIT_COMMIT_STORE_RECORD_STAT);
+  gsize length;
+
+  return (gchar *) git_commit_store_read_payload (store,
+                                                  offset,
+                                                  GIT_COMMIT_STORE_RECORD_STAT,
+                                                  oid,
+                                                  &length);
+}
+
+static void
+git_commit_store_append (GitCommitStore *store,
+                         GitCommitStoreRecordType type,
+                         const GitOid *oid,
+                         GByteArray *payload)
+{
+  GitCommitStorePrivate *priv = git_commit_store_get_instance_private (store);
+  GitCommitStoreRecordHeader header;
+  GByteArray *record;
+  goffset offset;
+
+  /* Huge records would leave no room for anything else */
+  if (payload->len > GIT_COMMIT_STORE_MAX_SIZE / 4
+      || !git_commit_store_ensure_open (store))
+    return;
+
+  header.magic = GUINT32_TO_LE (GIT_COMMIT_STORE_RECORD_MAGIC);
+  header.type = type;
+  header.oid_len = oid->len;
+  header.reserved = 0;
+  header.payload_length = GUINT32_TO_LE (payload->len);
+
+  /* Write the whole record with a single write so that other readers
+     are unlikely to ever see half of it */
+  record = g_byte_array_sized_new (sizeof header + oid->len + payload->len);
+  g_byte_array_append (record, (const guint8 *) &header, sizeof header);
+  g_byte_array_append (record, oid->id, oid->len);
+  g_byte_array_append (record, payload->data, payload->len);
+
+  /* Skip the record rather than wait if another instance is using the
+     file */
+  if (flock (priv->fd, LOCK_EX | LOCK_NB) == -1)
+    goto done;
+
+  /* If another instance compacted the file then the new one is
+     opened. Nothing is written this time. */
+  if (git_commit_store_is_replaced (store))
+    {
+      git_commit_store_close (store);
+      goto done;
+    }
+
+  /* Index what the other instances have added and cut off anything
+     after that which one of them didn’t finish writing */
+  git_commit_store_scan_tail (store);
+
+  offset = lseek (priv->fd, 0, SEEK_END);
+
+  if (offset > priv->scanned_size)
+    {
+      if (ftruncate (priv->fd, priv->scanned_size) == -1)
+        goto unlock;
+      offset = priv->scanned_size;
+    }
+
+  if (offset + record->len > GIT_COMMIT_STORE_MAX_SIZE)
+    {
+      /* If that fails then the store isn’t used again rather than
+         letting it grow or trying again for every record */
+      if (!git_commit_store_compact (store))
+        {
+          git_commit_store_break (store);
+          goto done;
+        }
+
+      if (priv->fd == -1
+          || flock (priv->fd, LOCK_EX | LOCK_NB) == -1)
+        goto done;
+
+      offset = lseek (priv->fd, 0, SEEK_END);
+    }
+
+  if (offset > 0
+      && git_commit_store_write_all (priv->fd, record->data, record->len))
+    {
+      header.payload_length = payload->len;
+      git_commit_store_index_record (priv->entries, &header, oid, offset);
+      priv->scanned_size = offset + record->len;
+    }
+
+ unlock:
+  flock (priv->fd, LOCK_UN);
+
+ done:
+  g_byte_array_free (record, TRUE);
+}
+
+void
+git_commit_store_add_log (GitCommitStore *store,
+                          const GitOid *oid,
+                          const GitOid *parents,
+                          guint n_parents,
+                          const gchar *log_data)
+{
+  g_return_if_fail (GIT_IS_COMMIT_STORE (store));
+  g_return_if_fail (n_parents <= G_MAXUINT8);
+
+  GByteArray *payload;
+  guint8 n_parents_byte = n_parents;
+  guint i;
+
+  /* The parents are stored without their length so they must use the
+     same hash as the commit */
+  for (i = 0; i < n_parents; i++)
+    g_return_if_fail (parents[i].len == oid->len);
+
+  payload = g_byte_array_new ();
+
+  g_byte_array_append (payload, &n_parents_byte, 1);
+
+  for (i = 0; i < n_parents; i++)
+    g_byte_array_append (payload, parents[i].id, oid->len);
+
+  g_byte_array_append (payload,
+                       (const guint8 *) log_data,
+                       strlen (log_data));
+
+  git_commit_store_append (store, GIT_COMMIT_STORE_RECORD_LOG, oid, payload);
+
+  g_byte_array_free (payload, TRUE);
+}
+
+void
+git_commit_store_add_stat (GitCommitStore *store,
+                           const GitOid *oid,
+                           const gchar *stat_data)
+{
+  g_return_if_fail (GIT_IS_COMMIT_STORE (store));
+
+  GByteArray *payload = g_byte_array_new ();
+
+  g_byte_array_append (payload,
+                       (const guint8 *) stat_data,
+                       strlen (stat_data));
+
+  git_commit_store_append (store, GIT_COMMIT_STORE_RECORD_STAT, oid, payload);
+
+  g_byte_array_free (payload, TRUE);
+}
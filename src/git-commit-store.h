@@ -0,0 +1,55 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_COMMIT_STORE_H__
+#define __GIT_COMMIT_STORE_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-oid.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_COMMIT_STORE git_commit_store_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitCommitStore,
+                      git_commit_store,
+                      GIT,
+                      COMMIT_STORE,
+                      GObject);
+
+GitCommitStore *git_commit_store_new (GFile *common_dir);
+
+gboolean git_commit_store_get_log (GitCommitStore *store,
+                                   const GitOid *oid,
+                                   GArray *parents,
+                                   gchar **log_data);
+gchar *git_commit_store_get_stat (GitCommitStore *store,
+                                  const GitOid *oid);
+
+void git_commit_store_add_log (GitCommitStore *store,
+                               const GitOid *oid,
+                               const GitOid *parents,
+                               guint n_parents,
+                               const gchar *log_data);
+void git_commit_store_add_stat (GitCommitStore *store,
+                                const GitOid *oid,
+                                const gchar *stat_data);
+
+G_END_DECLS
+
+#endif /* __GIT_COMMIT_STORE_H__ */
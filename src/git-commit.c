@@ -21,10 +21,14 @@
 
 #include <glib-object.h>
 #include <string.h>
+#include <sys/wait.h>
 
 #include "git-reader.h"
 #include "git-common.h"
 #include "git-commit-bag.h"
+#include "git-commit-graph.h"
+#include "git-object-db.h"
+#include "git-oid.h"
 
 #define GIT_COMMIT_DEFAULT_HASH "0000000000000000000000000000000000000000"
 
@@ -35,20 +39,44 @@ static void git_commit_set_property (GObject *object, guint property_id,
 static void git_commit_get_property (GObject *object, guint property_id,
                                      GValue *value, GParamSpec *pspec);
 static void git_commit_unref_reader (GitCommit *commit);
+static void git_commit_unref_stat_reader (GitCommit *commit);
 static void git_commit_free_parents (GitCommit *commit);
+static void git_commit_discard_parsed_parents (GitCommit *commit);
 
 struct _GitCommit
 {
   GObject parent;
 };
 
+typedef struct _GitCommitBatch GitCommitBatch;
+
+/* A single git process that fetches the log data for many commits at
+   once. The commits are first looked for in the object database in a
+   thread and only the ones that can’t be read that way are passed to
+   git. */
+struct _GitCommitBatch
+{
+  GitReader *reader;
+  gint priority;
+  /* The commits waiting for data. The batch holds a reference on
+     each of them. */
+  GPtrArray *commits;
+  /* The commit that the lines currently being read belong to */
+  GitCommit *current;
+  GFile *repo;
+};
+
 typedef struct
 {
   gchar *hash;
+  GitOid oid;
   GFile *repo;
   GHashTable *props;
 
   gboolean has_log_data;
+  /* The parents can be known before the log data if they were found
+     in the commit-graph */
+  gboolean has_parents;
   GSList *parents;
   gchar *log_data;
 
@@ -56,6 +84,27 @@ typedef struct
   guint line_handler, completed_handler;
   GString *log_buf;
   gboolean got_parents;
+  /* Set while the commit is being read from the object database in a
+     thread */
+  gboolean reading_object;
+
+  /* The batch that is fetching the log data for this commit, if
+     any */
+  GitCommitBatch *batch;
+  /* Set if git_commit_fetch_log_data was called while the batch was
+     running so that it can be fetched separately if the batch fails */
+  gboolean fetch_requested;
+
+  /* The diffstat is fetched separately because it can take a long
+     time to generate for big commits. stat_data is filled in as the
+     output arrives. */
+  gboolean has_stat_data;
+  GString *stat_data;
+  GitReader *stat_reader;
+  guint stat_line_handler, stat_completed_handler;
+  /* Number of callers that are waiting for the stat. The process is
+     cancelled when this drops to zero. */
+  guint stat_requests;
 } GitCommitPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitCommit,
@@ -68,7 +117,10 @@ enum
 
     PROP_HASH,
     PROP_REPO,
-    PROP_HAS_LOG_DATA
+    PROP_HAS_LOG_DATA,
+    PROP_HAS_PARENTS,
+    PROP_HAS_STAT_DATA,
+    PROP_STAT_DATA
   };
 
 static void
@@ -106,6 +158,30 @@ git_commit_class_init (GitCommitClass *klass)
                                 FALSE,
                                 G_PARAM_READABLE);
   g_object_class_install_property (gobject_class, PROP_HAS_LOG_DATA, pspec);
+
+  pspec = g_param_spec_boolean ("has-parents",
+                                "has parents",
+                                "Whether the parents of the commit are "
+                                "known",
+                                FALSE,
+                                G_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_HAS_PARENTS, pspec);
+
+  pspec = g_param_spec_boolean ("has-stat-data",
+                                "has stat data",
+                                "Whether the diffstat for the commit has "
+                                "been completely retrieved",
+                                FALSE,
+                                G_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_HAS_STAT_DATA, pspec);
+
+  pspec = g_param_spec_string ("stat-data",
+                               "stat data",
+                               "The part of the diffstat that has been "
+                               "retrieved so far",
+                               NULL,
+                               G_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_STAT_DATA, pspec);
 }
 
 static void
@@ -129,6 +205,9 @@ git_commit_finalize (GObject *object)
     g_object_unref (priv->repo);
   if (priv->log_buf)
     g_string_free (priv->log_buf, TRUE);
+  g_free (priv->log_data);
+  if (priv->stat_data)
+    g_string_free (priv->stat_data, TRUE);
   g_hash_table_destroy (priv->props);
 
   G_OBJECT_CLASS (git_commit_parent_class)->finalize (object);
@@ -140,9 +219,10 @@ git_commit_dispose (GObject *object)
   GitCommit *self = (GitCommit *) object;
 
   git_commit_unref_reader (self);
+  git_commit_unref_stat_reader (self);
   git_commit_free_parents (self);
 
-  G_OBJECT_CLASS (git_commit_parent_class)->finalize (object);
+  G_OBJECT_CLASS (git_commit_parent_class)->dispose (object);
 }
 
 static void
@@ -158,6 +238,11 @@ git_commit_set_property (GObject *object, guint property_id,
       if (priv->hash)
         g_free (priv->hash);
       priv->hash = g_strdup (g_value_get_string (value));
+      if (!git_oid_from_hex (&priv->oid, priv->hash))
+        {
+          g_warning ("Invalid commit hash");
+          memset (&priv->oid, 0, sizeof (priv->oid));
+        }
       break;
 
     case PROP_REPO:
@@ -187,9 +272,23 @@ git_commit_get_property (GObject *object, guint property_id,
 
     case PROP_REPO:
       g_value_set_object (value, priv->repo);
+      break;
 
     case PROP_HAS_LOG_DATA:
       g_value_set_boolean (value, priv->has_log_data);
+      break;
+
+    case PROP_HAS_PARENTS:
+      g_value_set_boolean (value, priv->has_parents);
+      break;
+
+    case PROP_HAS_STAT_DATA:
+      g_value_set_boolean (value, priv->has_stat_data);
+      break;
+
+    case PROP_STAT_DATA:
+      g_value_set_string (value, priv->stat_data ? priv->stat_data->str : NULL);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -218,6 +317,16 @@ git_commit_get_hash (GitCommit *commit)
   return priv->hash;
 }
 
+const GitOid *
+git_commit_get_oid (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), NULL);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  return &priv->oid;
+}
+
 GFile *
 git_commit_get_repo (GitCommit *commit)
 {
@@ -257,36 +366,654 @@ git_commit_get_parents (GitCommit *commit)
 
   GitCommitPrivate *priv = git_commit_get_instance_private (commit);
 
-  g_return_val_if_fail (priv->has_log_data, NULL);
+  g_return_val_if_fail (priv->has_parents || priv->has_log_data, NULL);
 
   return priv->parents;
 }
 
+gboolean
+git_commit_get_has_parents (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), FALSE);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  return priv->has_parents;
+}
+
 static void
-git_commit_on_completed (GitReader *reader, const GError *error,
-                         GitCommit *commit)
+git_commit_set_parent_oids (GitCommit *commit, GArray *parents)
 {
   GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  guint i;
 
-  git_commit_unref_reader (commit);
+  for (i = 0; i < parents->len; i++)
+    {
+      GitCommit *parent
+        = git_commit_bag_get_oid (commit_bag,
+                                  &g_array_index (parents, GitOid, i),
+                                  priv->repo);
+
+      priv->parents = g_slist_prepend (priv->parents, g_object_ref (parent));
+    }
+
+  priv->parents = g_slist_reverse (priv->parents);
+  priv->has_parents = TRUE;
+  g_object_notify (G_OBJECT (commit), "has-parents");
+}
+
+/* Tries to find the parents of the commit in the repository’s
+   commit-graph without running git. Returns TRUE if the parents are
+   now known. */
+gboolean
+git_commit_load_parents (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), FALSE);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitGraph *graph;
+  GArray *parents;
+
+  if (priv->has_parents)
+    return TRUE;
+
+  /* If the log is being read then the parents are being parsed from
+     it so leave them alone */
+  if (priv->log_buf || git_oid_is_zero (&priv->oid))
+    return FALSE;
+
+  graph = git_commit_bag_get_graph (git_commit_bag_get_default (),
+                                    priv->repo);
+  parents = g_array_new (FALSE, FALSE, sizeof (GitOid));
+
+  if (git_commit_graph_get_parents (graph, &priv->oid, parents))
+    git_commit_set_parent_oids (commit, parents);
+
+  g_array_free (parents, TRUE);
+
+  return priv->has_parents;
+}
+
+/* Returns the on-disk store that should be used for this commit or
+   NULL if the commit shouldn’t be stored */
+static GitCommitStore *
+git_commit_get_store (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  /* Uncommitted changes don’t have a real commit */
+  if (git_oid_is_zero (&priv->oid))
+    return NULL;
+
+  return git_commit_bag_get_store (git_commit_bag_get_default (), priv->repo);
+}
+
+static void
+git_commit_store_log_data (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitStore *store = git_commit_get_store (commit);
+  GArray *parents;
+
+  if (store == NULL)
+    return;
+
+  parents = g_array_new (FALSE, FALSE, sizeof (GitOid));
+
+  for (const GSList *node = priv->parents; node; node = node->next)
+    g_array_append_vals (parents, git_commit_get_oid (node->data), 1);
+
+  git_commit_store_add_log (store, &priv->oid,
+                            (const GitOid *) parents->data, parents->len,
+                            priv->log_data);
+
+  g_array_free (parents, TRUE);
+}
+
+/* Tries to get the log data from the on-disk store so that git
+   doesn’t need to be run at all */
+static gboolean
+git_commit_load_stored_log_data (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitStore *store = git_commit_get_store (commit);
+  GArray *parents;
+  gchar *log_data;
+
+  if (store == NULL)
+    return FALSE;
+
+  parents = g_array_new (FALSE, FALSE, sizeof (GitOid));
+
+  if (!git_commit_store_get_log (store, &priv->oid, parents, &log_data))
+    {
+      g_array_free (parents, TRUE);
+      return FALSE;
+    }
+
+  if (!priv->has_parents)
+    git_commit_set_parent_oids (commit, parents);
+  priv->got_parents = TRUE;
+  priv->log_data = log_data;
+
+  g_array_free (parents, TRUE);
+
+  priv->has_log_data = TRUE;
+  g_object_notify (G_OBJECT (commit), "has-log-data");
+
+  return TRUE;
+}
+
+/* Appends the author line and date in the same format as git-log’s
+   default ‘medium’ format. The date is shown in the author’s own time
+   zone. */
+static gboolean
+git_commit_format_author (GString *buf, const gchar *line, gsize length)
+{
+  static const gchar days[][4] =
+    { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun" };
+  static const gchar months[][4] =
+    {
+      "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+      "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+  const gchar *email_end = g_strrstr_len (line, length, ">");
+  gchar *time_str, *tz_end;
+  gint64 timestamp;
+  gint tz_value;
+  GTimeZone *tz;
+  GDateTime *utc, *dt;
+
+  if (email_end == NULL || email_end[1] != ' ')
+    return FALSE;
+
+  time_str = g_strndup (email_end + 2, line + length - (email_end + 2));
+  timestamp = g_ascii_strtoll (time_str, &tz_end, 10);
+
+  if (*tz_end != ' '
+      || (tz_end[1] != '+' && tz_end[1] != '-')
+      || strlen (tz_end + 2) != 4
+      || strspn (tz_end + 2, "0123456789") != 4)
+    {
+      g_free (time_str);
+      return FALSE;
+    }
+
+  tz_value = g_ascii_strtoull (tz_end + 2, NULL, 10);
+  tz = g_time_zone_new_offset ((tz_end[1] == '-' ? -1 : 1)
+                               * ((tz_value / 100) * 3600
+                                  + (tz_value % 100) * 60));
+  utc = g_date_time_new_from_unix_utc (timestamp);
+  dt = utc ? g_date_time_to_timezone (utc, tz) : NULL;
+
+  if (dt)
+    {
+      g_string_append (buf, "Author: ");
+      g_string_append_len (buf, line, email_end + 1 - line);
+      g_string_append_printf (buf,
+                              "\nDate:   %s %s %i %02i:%02i:%02i %i %s\n",
+                              days[g_date_time_get_day_of_week (dt) - 1],
+                              months[g_date_time_get_month (dt) - 1],
+                              g_date_time_get_day_of_month (dt),
+                              g_date_time_get_hour (dt),
+                              g_date_time_get_minute (dt),
+                              g_date_time_get_second (dt),
+                              g_date_time_get_year (dt),
+                              tz_end + 1);
+      g_date_time_unref (dt);
+    }
+
+  if (utc)
+    g_date_time_unref (utc);
+  g_time_zone_unref (tz);
+  g_free (time_str);
+
+  return dt != NULL;
+}
+
+/* Appends the commit message indented by four spaces with the tabs
+   expanded like git-log does. Blank lines at the start and end are
+   left out. */
+static void
+git_commit_format_message (GString *buf, const gchar *message)
+{
+  gboolean first = TRUE;
+  guint n_blank_lines = 0;
+
+  while (*message)
+    {
+      const gchar *end = strchr (message, '\n');
+      gsize length = end ? end - message : strlen (message);
+      gsize trimmed = length;
+      guint column = 0;
+
+      while (trimmed > 0 && g_ascii_isspace (message[trimmed - 1]))
+        trimmed--;
+
+      /* Blank lines are only added once another line follows them */
+      if (trimmed == 0)
+        {
+          if (!first)
+            n_blank_lines++;
+        }
+      else
+        {
+          first = FALSE;
+
+          for (; n_blank_lines > 0; n_blank_lines--)
+            g_string_append (buf, "    \n");
+
+          g_string_append (buf, "    ");
+
+          for (gsize i = 0; i < trimmed; i++)
+            {
+              if (message[i] == '\t')
+                {
+                  do
+                    g_string_append_c (buf, ' ');
+                  while (++column % 8);
+                }
+              else
+                {
+                  g_string_append_c (buf, message[i]);
+                  /* Don’t count UTF-8 continuation bytes */
+                  if ((message[i] & 0xc0) != 0x80)
+                    column++;
+                }
+            }
+
+          g_string_append_c (buf, '\n');
+        }
+
+      message += length;
+      if (*message == '\n')
+        message++;
+    }
+}
+
+/* Builds the log text from the raw commit object in the same format
+   that git-log would use. Returns NULL if the commit uses anything that
+   git-log would show differently and that isn’t handled here. Merges
+   are left to git-log because it abbreviates the parents to a length
+   that depends on the repository. */
+static gchar *
+git_commit_format_raw_log (const gchar *raw, GArray *parents)
+{
+  GString *buf = g_string_new ("");
+  gboolean got_author = FALSE;
+  GitOid oid;
+
+  while (*raw != '\n')
+    {
+      const gchar *end = strchr (raw, '\n');
+
+      if (end == NULL)
+        goto error;
+
+      if (g_str_has_prefix (raw, "parent "))
+        {
+          if (git_oid_parse_hex (&oid, raw + 7, end - (raw + 7))
+              != end - (raw + 7))
+            goto error;
+          g_array_append_val (parents, oid);
+        }
+      else if (g_str_has_prefix (raw, "author "))
+        {
+          if (parents->len > 1
+              || !git_commit_format_author (buf, raw + 7, end - (raw + 7)))
+            goto error;
+
+          got_author = TRUE;
+        }
+      else if (g_str_has_prefix (raw, "encoding "))
+        {
+          /* git-log would reencode the message */
+          goto error;
+        }
+
+      raw = end + 1;
+    }
+
+  if (!got_author)
+    goto error;
+
+  g_string_append_c (buf, '\n');
+  git_commit_format_message (buf, raw + 1);
+
+  return g_string_free (buf, FALSE);
+
+ error:
+  g_string_free (buf, TRUE);
+  return NULL;
+}
+
+/* The log data of a commit made by reading it straight out of the
+   object database so that git doesn’t need to be run. log_data is
+   NULL if it couldn’t be made that way. */
+typedef struct
+{
+  GitOid oid;
+  gchar *log_data;
+  GArray *parents;
+} GitCommitObjectLog;
+
+typedef struct
+{
+  GFile *repo;
+  GitObjectDb *object_db;
+  /* Array of GitCommitObjectLog */
+  GArray *logs;
+} GitCommitObjectLogData;
+
+static void
+git_commit_free_object_log_data (GitCommitObjectLogData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->logs->len; i++)
+    {
+      GitCommitObjectLog *log
+        = &g_array_index (data->logs, GitCommitObjectLog, i);
+
+      g_free (log->log_data);
+      if (log->parents)
+        g_array_free (log->parents, TRUE);
+    }
+
+  g_array_free (data->logs, TRUE);
+  g_object_unref (data->object_db);
+  g_object_unref (data->repo);
+  g_slice_free (GitCommitObjectLogData, data);
+}
+
+static GMutex git_commit_plain_log_mutex;
+/* Map from a repository to whether its log can be made from the
+   objects. There is only ever a handful of repositories. */
+static GHashTable *git_commit_plain_log_repos;
+
+/* Runs git and returns whether it succeeded and printed anything */
+static gboolean
+git_commit_run_git_check (GFile *repo,
+                          const gchar * const *argv,
+                          gboolean *has_output)
+{
+  gchar *repo_path = g_file_get_path (repo);
+  gchar **envp = git_get_repo_environ (repo);
+  gchar *output = NULL;
+  gint status = 0;
+  gboolean ret;
+
+  ret = (repo_path
+         && g_spawn_sync (repo_path, (gchar **) argv, envp,
+                          G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+                          NULL, NULL,
+                          &output, NULL,
+                          &status,
+                          NULL));
+
+  *has_output = ret && output && *output;
+  g_free (output);
+  g_strfreev (envp);
+  g_free (repo_path);
+
+  /* git config exits with 1 if there was nothing to show */
+  return ret && (WIFEXITED (status)
+                 && (WEXITSTATUS (status) == 0 || WEXITSTATUS (status) == 1));
+}
+
+/* Returns whether git-log would show the commits of the repository
+   exactly as git_commit_format_raw_log() does. Config that changes the
+   default format or rewrites the author, and notes or replaced
+   commits, all mean that git-log has to be asked instead. This runs
+   git so it must only be called from a thread. */
+static gboolean
+git_commit_repo_has_plain_log (GFile *repo)
+{
+  static const gchar * const config_argv[] =
+    {
+      "git", "config", "--get-regexp",
+      "^(format\\.pretty|log\\.|mailmap\\.|i18n\\.logoutputencoding"
+      "|notes\\.|core\\.notesref)",
+      NULL
+    };
+  static const gchar * const refs_argv[] =
+    {
+      "git", "for-each-ref", "--count=1", "refs/notes/", "refs/replace/",
+      NULL
+    };
+  gpointer value;
+  gboolean plain, has_config, has_refs;
+
+  g_mutex_lock (&git_commit_plain_log_mutex);
+
+  if (git_commit_plain_log_repos == NULL)
+    git_commit_plain_log_repos
+      = g_hash_table_new_full (g_file_hash,
+                               (GEqualFunc) g_file_equal,
+                               g_object_unref,
+                               NULL);
+
+  value = g_hash_table_lookup (git_commit_plain_log_repos, repo);
+
+  g_mutex_unlock (&git_commit_plain_log_mutex);
+
+  if (value)
+    return GPOINTER_TO_INT (value) - 1;
+
+  plain = (git_commit_run_git_check (repo, config_argv, &has_config)
+           && !has_config
+           && git_commit_run_git_check (repo, refs_argv, &has_refs)
+           && !has_refs);
+
+  g_mutex_lock (&git_commit_plain_log_mutex);
+  g_hash_table_replace (git_commit_plain_log_repos,
+                        g_object_ref (repo),
+                        GINT_TO_POINTER (plain + 1));
+  g_mutex_unlock (&git_commit_plain_log_mutex);
+
+  return plain;
+}
+
+static void
+git_commit_object_log_thread (GTask *task,
+                              gpointer source_object,
+                              gpointer task_data,
+                              GCancellable *cancellable)
+{
+  GitCommitObjectLogData *data = task_data;
+  GFile *mailmap;
+  gboolean has_mailmap;
+  guint i;
+
+  /* git-log would rewrite the author using the mailmap */
+  mailmap = g_file_get_child (data->repo, ".mailmap");
+  has_mailmap = g_file_query_exists (mailmap, NULL);
+  g_object_unref (mailmap);
+
+  if (has_mailmap || !git_commit_repo_has_plain_log (data->repo))
+    {
+      g_task_return_boolean (task, TRUE);
+      return;
+    }
+
+  for (i = 0; i < data->logs->len; i++)
+    {
+      GitCommitObjectLog *log
+        = &g_array_index (data->logs, GitCommitObjectLog, i);
+      GitObjectType type;
+      GBytes *raw = git_object_db_read (data->object_db, &log->oid,
+                                        &type, NULL);
+
+      if (raw == NULL)
+        continue;
+
+      log->parents = g_array_new (FALSE, FALSE, sizeof (GitOid));
+
+      if (type == GIT_OBJECT_TYPE_COMMIT)
+        log->log_data
+          = git_commit_format_raw_log (g_bytes_get_data (raw, NULL),
+                                       log->parents);
+
+      g_bytes_unref (raw);
+
+      if (log->log_data == NULL)
+        {
+          g_array_free (log->parents, TRUE);
+          log->parents = NULL;
+        }
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/* Starts making the log data for the commits in a thread. logs is an
+   array of GitCommitObjectLog with just the ids filled in. The task
+   data is the GitCommitObjectLogData once it’s done. */
+static void
+git_commit_start_object_logs (GFile *repo,
+                              GArray *logs,
+                              gpointer source_object,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+  GitCommitObjectLogData *data = g_slice_new (GitCommitObjectLogData);
+  GitObjectDb *object_db
+    = git_commit_bag_get_object_db (git_commit_bag_get_default (), repo);
+  GTask *task;
+
+  data->repo = g_object_ref (repo);
+  data->object_db = g_object_ref (object_db);
+  data->logs = logs;
+
+  task = g_task_new (source_object, NULL, callback, user_data);
+  g_task_set_task_data (task,
+                        data,
+                        (GDestroyNotify) git_commit_free_object_log_data);
+  g_task_run_in_thread (task, git_commit_object_log_thread);
+  g_object_unref (task);
+}
+
+static GArray *
+git_commit_new_object_logs (void)
+{
+  return g_array_new (FALSE, TRUE, sizeof (GitCommitObjectLog));
+}
+
+static void
+git_commit_add_object_log (GArray *logs, GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitObjectLog log = { 0 };
+
+  log.oid = priv->oid;
+  g_array_append_val (logs, log);
+}
+
+/* Takes the log data that was made in the thread. Returns FALSE if
+   there wasn’t any. */
+static gboolean
+git_commit_take_object_log (GitCommit *commit, GitCommitObjectLog *log)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  if (log->log_data == NULL || priv->has_log_data)
+    return FALSE;
+
+  if (!priv->has_parents)
+    git_commit_set_parent_oids (commit, log->parents);
+  priv->got_parents = TRUE;
+  priv->log_data = log->log_data;
+  log->log_data = NULL;
+
+  priv->has_log_data = TRUE;
+  g_object_notify (G_OBJECT (commit), "has-log-data");
+
+  return TRUE;
+}
+
+static void
+git_commit_finish_log_data (GitCommit *commit, const GError *error)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
 
   if (error)
     {
       priv->log_data = g_strdup (error->message);
       g_string_free (priv->log_buf, TRUE);
       priv->log_buf = NULL;
-      git_commit_free_parents (commit);
+      git_commit_discard_parsed_parents (commit);
     }
   else
     {
       priv->log_data = g_string_free (priv->log_buf, FALSE);
       priv->log_buf = NULL;
+
+      if (!priv->has_parents)
+        {
+          priv->has_parents = TRUE;
+          g_object_notify (G_OBJECT (commit), "has-parents");
+        }
+
+      git_commit_store_log_data (commit);
     }
 
   priv->has_log_data = TRUE;
   g_object_notify (G_OBJECT (commit), "has-log-data");
 }
 
+static void
+git_commit_on_completed (GitReader *reader, const GError *error,
+                         GitCommit *commit)
+{
+  git_commit_unref_reader (commit);
+  git_commit_finish_log_data (commit, error);
+}
+
+static gboolean
+git_commit_parse_header (GitCommit *commit, guint length, const gchar *line)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitBag *commit_bag = git_commit_bag_get_default ();
+  GitOid oid;
+  gsize hash_length;
+
+  /* The first line should be the word ‘commit’, the hash of the
+     commit and then the hashes of its parents */
+  if (length < 7
+      || memcmp (line, "commit ", 7)
+      || !(hash_length = git_oid_parse_hex (&oid, line + 7, length - 7))
+      || !git_oid_equal (&oid, &priv->oid))
+    return FALSE;
+
+  line += hash_length + 7;
+  length -= hash_length + 7;
+
+  while (length > 1
+         && *line == ' '
+         && (hash_length = git_oid_parse_hex (&oid, line + 1, length - 1)))
+    {
+      /* If the parents were already found in the commit-graph then
+         they only need to be skipped */
+      if (!priv->has_parents)
+        {
+          GitCommit *parent = git_commit_bag_get_oid (commit_bag, &oid,
+                                                      priv->repo);
+
+          priv->parents = g_slist_prepend (priv->parents,
+                                           g_object_ref (parent));
+        }
+
+      length -= hash_length + 1;
+      line += hash_length + 1;
+    }
+
+  if (!priv->has_parents)
+    priv->parents = g_slist_reverse (priv->parents);
+
+  return length == 1 && *line == '\n';
+}
+
 static gboolean
 git_commit_on_line (GitReader *reader, guint length, const gchar *line,
                     GitCommit *commit)
@@ -296,10 +1023,9 @@ git_commit_on_line (GitReader *reader, guint length, const gchar *line,
 
   if (priv->got_parents)
     g_string_append_len (priv->log_buf, line, length);
-  else if (length < GIT_COMMIT_HASH_LENGTH + 7
-           || memcmp (line, "commit ", 7)
-           || strlen (priv->hash) != GIT_COMMIT_HASH_LENGTH
-           || memcmp (line + 7, priv->hash, GIT_COMMIT_HASH_LENGTH))
+  else if (git_commit_parse_header (commit, length, line))
+    priv->got_parents = TRUE;
+  else
     {
       GError *error = NULL;
 
@@ -310,90 +1036,569 @@ git_commit_on_line (GitReader *reader, guint length, const gchar *line,
 
       ret = FALSE;
     }
+
+  return ret;
+}
+
+static void
+git_commit_start_log_reader (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GError *error = NULL;
+
+  priv->reader = git_reader_new ();
+  priv->log_buf = g_string_new ("");
+
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_commit_on_line), commit);
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_commit_on_completed), commit);
+
+  git_reader_start (priv->reader, priv->repo, &error,
+                    "log", "-n", "1", "--parents",
+                    priv->hash, NULL);
+
+  if (error)
+    {
+      git_commit_on_completed (priv->reader, error, commit);
+      g_error_free (error);
+    }
+}
+
+static void
+git_commit_on_object_log (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+  GitCommit *commit = GIT_COMMIT (source_object);
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GitCommitObjectLogData *data = g_task_get_task_data (G_TASK (result));
+
+  priv->reading_object = FALSE;
+
+  if (!git_commit_take_object_log (commit,
+                                   &g_array_index (data->logs,
+                                                   GitCommitObjectLog,
+                                                   0))
+      && !priv->has_log_data)
+    git_commit_start_log_reader (commit);
+}
+
+void
+git_commit_fetch_log_data (GitCommit *commit)
+{
+  g_return_if_fail (GIT_IS_COMMIT (commit));
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  if (priv->batch)
+    {
+      /* The data will arrive along with the rest of the batch */
+      priv->fetch_requested = TRUE;
+      return;
+    }
+
+  if (priv->has_log_data
+      || priv->reader
+      || priv->reading_object
+      || git_commit_load_stored_log_data (commit))
+    return;
+
+  if (git_oid_is_zero (&priv->oid))
+    {
+      git_commit_start_log_reader (commit);
+      return;
+    }
+
+  /* Try the object database first without blocking the main loop. git
+     is only run if that doesn’t work. */
+  GArray *logs = git_commit_new_object_logs ();
+
+  git_commit_add_object_log (logs, commit);
+  priv->reading_object = TRUE;
+  git_commit_start_object_logs (priv->repo, logs, commit,
+                                git_commit_on_object_log, NULL);
+}
+
+static void
+git_commit_on_stat_completed (GitReader *reader, const GError *error,
+                              GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  git_commit_unref_stat_reader (commit);
+
+  /* This is set before the error replaces the stat so that anything
+     showing the stat can tell that it is complete */
+  priv->has_stat_data = TRUE;
+
+  if (error)
+    {
+      g_string_assign (priv->stat_data, error->message);
+      g_object_notify (G_OBJECT (commit), "stat-data");
+    }
   else
     {
-      GitCommitBag *commit_bag = git_commit_bag_get_default ();
+      GitCommitStore *store = git_commit_get_store (commit);
 
-      line += GIT_COMMIT_HASH_LENGTH + 7;
-      length -= GIT_COMMIT_HASH_LENGTH + 7;
+      if (store)
+        git_commit_store_add_stat (store, &priv->oid, priv->stat_data->str);
+    }
 
-      while (length > GIT_COMMIT_HASH_LENGTH)
-        {
-          int i;
-          gchar *hash;
-          GitCommit *commit;
+  g_object_notify (G_OBJECT (commit), "has-stat-data");
+}
 
-          if (*line != ' ')
-            break;
+static gboolean
+git_commit_on_stat_line (GitReader *reader, guint length, const gchar *line,
+                         GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
 
-          for (i = 1; i <= GIT_COMMIT_HASH_LENGTH
-                 && ((line[i] >= 'a' && line[i] <= 'f')
-                     || (line[i] >= '0' && line[i] <= '9'));
-               i++);
+  /* Skip the blank line that git-log puts before the stat */
+  if (priv->stat_data->len == 0 && length == 1 && *line == '\n')
+    return TRUE;
 
-          if (i <= GIT_COMMIT_HASH_LENGTH)
-            break;
+  g_string_append_len (priv->stat_data, line, length);
+  g_object_notify (G_OBJECT (commit), "stat-data");
 
-          hash = g_strndup (line + 1, GIT_COMMIT_HASH_LENGTH);
-          commit = git_commit_bag_get (commit_bag, hash, priv->repo);
-          g_free (hash);
+  return TRUE;
+}
 
-          priv->parents = g_slist_prepend (priv->parents,
-                                           g_object_ref (commit));
+/* Starts fetching the diffstat for the commit. This is kept separate
+   from the rest of the log data because git may have to diff a lot of
+   files to generate it. Each call should be paired with a call to
+   git_commit_cancel_stat_data once the caller is no longer interested
+   in it. The stat-data property is updated as the data arrives. */
+void
+git_commit_fetch_stat_data (GitCommit *commit)
+{
+  g_return_if_fail (GIT_IS_COMMIT (commit));
 
-          length -= GIT_COMMIT_HASH_LENGTH + 1;
-          line += GIT_COMMIT_HASH_LENGTH + 1;
-        }
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
 
-      if (length != 1 || *line != '\n')
+  priv->stat_requests++;
+
+  if (!priv->has_stat_data && priv->stat_reader == NULL)
+    {
+      GitCommitStore *store = git_commit_get_store (commit);
+      gchar *stored_stat = store
+        ? git_commit_store_get_stat (store, &priv->oid)
+        : NULL;
+
+      if (stored_stat)
         {
-          GError *error = NULL;
+          if (priv->stat_data)
+            g_string_free (priv->stat_data, TRUE);
+          priv->stat_data = g_string_new (stored_stat);
+          g_free (stored_stat);
 
-          g_set_error (&error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
-                       "Invalid output from git-log");
-          git_commit_on_completed (priv->reader, error, commit);
-          g_error_free (error);
+          priv->has_stat_data = TRUE;
+          g_object_notify (G_OBJECT (commit), "stat-data");
+          g_object_notify (G_OBJECT (commit), "has-stat-data");
 
-          ret = FALSE;
+          return;
         }
+
+      GError *error = NULL;
+
+      priv->stat_reader = git_reader_new ();
+
+      if (priv->stat_data)
+        g_string_truncate (priv->stat_data, 0);
       else
-        priv->got_parents = TRUE;
-    }
+        priv->stat_data = g_string_new ("");
+
+      priv->stat_line_handler
+        = g_signal_connect (priv->stat_reader, "line",
+                            G_CALLBACK (git_commit_on_stat_line), commit);
+      priv->stat_completed_handler
+        = g_signal_connect (priv->stat_reader, "completed",
+                            G_CALLBACK (git_commit_on_stat_completed),
+                            commit);
+
+      git_reader_start (priv->stat_reader, priv->repo, &error,
+                        "log", "-n", "1", "--stat", "--format=",
+                        priv->hash, NULL);
 
-  return ret;
+      if (error)
+        {
+          git_commit_on_stat_completed (priv->stat_reader, error, commit);
+          g_error_free (error);
+        }
+    }
 }
 
+/* Releases a request made with git_commit_fetch_stat_data. If nothing
+   else is waiting for the stat then the git process is killed. */
 void
-git_commit_fetch_log_data (GitCommit *commit)
+git_commit_cancel_stat_data (GitCommit *commit)
 {
   g_return_if_fail (GIT_IS_COMMIT (commit));
 
   GitCommitPrivate *priv = git_commit_get_instance_private (commit);
 
-  if (!priv->has_log_data && priv->reader == NULL)
+  g_return_if_fail (priv->stat_requests > 0);
+
+  if (--priv->stat_requests > 0 || priv->stat_reader == NULL)
+    return;
+
+  git_commit_unref_stat_reader (commit);
+
+  /* Throw away the partial stat so that it will be started again
+     from scratch next time */
+  g_string_free (priv->stat_data, TRUE);
+  priv->stat_data = NULL;
+  g_object_notify (G_OBJECT (commit), "stat-data");
+}
+
+gboolean
+git_commit_get_has_stat_data (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), FALSE);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  return priv->has_stat_data;
+}
+
+/* Returns as much of the diffstat as has been retrieved so far or
+   NULL if it hasn’t been requested */
+const gchar *
+git_commit_get_stat_data (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), NULL);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  return priv->stat_data ? priv->stat_data->str : NULL;
+}
+
+static void
+git_commit_batch_finish_current (GitCommitBatch *batch, const GError *error)
+{
+  GitCommit *commit = batch->current;
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  GString *buf = priv->log_buf;
+
+  batch->current = NULL;
+  priv->batch = NULL;
+
+  /* git-log puts a blank line between the commits which wouldn’t be
+     there if the commit was fetched on its own */
+  if (buf->len >= 2 && buf->str[buf->len - 1] == '\n'
+      && buf->str[buf->len - 2] == '\n')
+    g_string_truncate (buf, buf->len - 1);
+
+  git_commit_finish_log_data (commit, error);
+}
+
+static gboolean
+git_commit_batch_on_line (GitReader *reader, guint length, const gchar *line,
+                          GitCommitBatch *batch)
+{
+  GitCommitPrivate *priv;
+  GitCommit *commit;
+  GitOid oid;
+
+  /* Only the header of each commit starts with ‘commit’ in the first
+     column. The message and the stat are always indented. */
+  if (length < 7 || memcmp (line, "commit ", 7))
     {
-      GError *error = NULL;
+      if (batch->current)
+        {
+          priv = git_commit_get_instance_private (batch->current);
+          g_string_append_len (priv->log_buf, line, length);
+        }
+
+      return TRUE;
+    }
 
-      priv->reader = git_reader_new ();
-      priv->log_buf = g_string_new ("");
+  if (batch->current)
+    git_commit_batch_finish_current (batch, NULL);
 
-      priv->line_handler
-        = g_signal_connect (priv->reader, "line",
-                            G_CALLBACK (git_commit_on_line), commit);
-      priv->completed_handler
-        = g_signal_connect (priv->reader, "completed",
-                            G_CALLBACK (git_commit_on_completed), commit);
+  if (!git_oid_parse_hex (&oid, line + 7, length - 7))
+    return TRUE;
 
-      git_reader_start (priv->reader, priv->repo, &error,
-                        "log", "-n", "1", "--stat", "--parents",
-                        priv->hash, NULL);
+  /* Ignore any commits that we didn’t ask for. They are looked up
+     without adding them so that stray output doesn’t fill the bag. */
+  commit = git_commit_bag_lookup_oid (git_commit_bag_get_default (),
+                                      &oid, batch->repo);
+
+  if (commit == NULL)
+    return TRUE;
+
+  priv = git_commit_get_instance_private (commit);
+
+  if (priv->batch != batch)
+    return TRUE;
+
+  priv->log_buf = g_string_new ("");
+
+  if (git_commit_parse_header (commit, length, line))
+    {
+      priv->got_parents = TRUE;
+      batch->current = commit;
+    }
+  else
+    {
+      g_string_free (priv->log_buf, TRUE);
+      priv->log_buf = NULL;
+      git_commit_discard_parsed_parents (commit);
+    }
+
+  return TRUE;
+}
+
+static void
+git_commit_batch_on_completed (GitReader *reader, const GError *error,
+                               GitCommitBatch *batch)
+{
+  guint i;
 
+  if (batch->current)
+    {
       if (error)
         {
-          git_commit_on_completed (priv->reader, error, commit);
-          g_error_free (error);
+          GitCommitPrivate *priv
+            = git_commit_get_instance_private (batch->current);
+
+          /* The log for the current commit is probably truncated so
+             throw it away */
+          g_string_free (priv->log_buf, TRUE);
+          priv->log_buf = NULL;
+          git_commit_discard_parsed_parents (batch->current);
+          priv->got_parents = FALSE;
+          batch->current = NULL;
+        }
+      else
+        git_commit_batch_finish_current (batch, NULL);
+    }
+
+  g_signal_handlers_disconnect_by_data (batch->reader, batch);
+  g_object_unref (batch->reader);
+
+  /* Any commits that didn’t get any data are released from the batch
+     so that they can be fetched normally if someone wants them */
+  for (i = 0; i < batch->commits->len; i++)
+    {
+      GitCommit *commit = g_ptr_array_index (batch->commits, i);
+      GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+      if (priv->batch != batch)
+        continue;
+
+      priv->batch = NULL;
+
+      if (priv->fetch_requested)
+        {
+          priv->fetch_requested = FALSE;
+          git_commit_fetch_log_data (commit);
         }
     }
+
+  g_ptr_array_free (batch->commits, TRUE);
+  g_object_unref (batch->repo);
+  g_slice_free (GitCommitBatch, batch);
+}
+
+static void
+git_commit_batch_start_reader (GitCommitBatch *batch, GString *input)
+{
+  GError *error = NULL;
+
+  batch->reader = git_reader_new ();
+
+  if (input->len == 0)
+    {
+      git_commit_batch_on_completed (batch->reader, NULL, batch);
+      g_string_free (input, TRUE);
+      return;
+    }
+
+  GBytes *input_bytes = g_string_free_to_bytes (input);
+  git_reader_set_input (batch->reader, input_bytes);
+  g_bytes_unref (input_bytes);
+
+  git_reader_set_priority (batch->reader, batch->priority);
+
+  g_signal_connect (batch->reader, "line",
+                    G_CALLBACK (git_commit_batch_on_line), batch);
+  g_signal_connect (batch->reader, "completed",
+                    G_CALLBACK (git_commit_batch_on_completed), batch);
+
+  git_reader_start (batch->reader, batch->repo, &error,
+                    "log", "--no-walk", "--stdin", "--parents",
+                    NULL);
+
+  if (error)
+    {
+      git_commit_batch_on_completed (batch->reader, error, batch);
+      g_error_free (error);
+    }
+}
+
+static void
+git_commit_batch_on_object_logs (GObject *source_object,
+                                 GAsyncResult *result,
+                                 gpointer user_data)
+{
+  GitCommitBatch *batch = user_data;
+  GitCommitObjectLogData *data = g_task_get_task_data (G_TASK (result));
+  GString *input = g_string_new ("");
+  guint i;
+
+  /* Only the commits that couldn’t be read from the object database
+     are left in the batch */
+  for (i = 0; i < batch->commits->len; i++)
+    {
+      GitCommit *commit = g_ptr_array_index (batch->commits, i);
+      GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+      GitCommitObjectLog *log
+        = &g_array_index (data->logs, GitCommitObjectLog, i);
+
+      if (git_commit_take_object_log (commit, log))
+        {
+          priv->batch = NULL;
+          priv->fetch_requested = FALSE;
+        }
+      else
+        {
+          g_string_append (input, priv->hash);
+          g_string_append_c (input, '\n');
+        }
+    }
+
+  git_commit_batch_start_reader (batch, input);
+}
+
+/* Fetches the log data for all of the given commits with a single
+   git process. Commits that already have their data or that are
+   already being fetched are skipped. The output is handled at the
+   given main loop priority so this can be used to prefetch data in
+   the background. */
+void
+git_commit_fetch_log_data_batch (GFile *repo,
+                                 GitCommit * const *commits,
+                                 guint n_commits,
+                                 gint priority)
+{
+  g_return_if_fail (G_IS_FILE (repo));
+
+  GitCommitBatch *batch;
+  GArray *logs;
+  guint i;
+
+  batch = g_slice_new (GitCommitBatch);
+  batch->commits = g_ptr_array_new_with_free_func (g_object_unref);
+  batch->current = NULL;
+  batch->repo = g_object_ref (repo);
+  batch->priority = priority;
+  batch->reader = NULL;
+
+  logs = git_commit_new_object_logs ();
+
+  for (i = 0; i < n_commits; i++)
+    {
+      GitCommitPrivate *priv = git_commit_get_instance_private (commits[i]);
+
+      if (priv->has_log_data
+          || priv->reader
+          || priv->batch
+          || priv->reading_object
+          /* Uncommitted changes don’t have any log */
+          || git_oid_is_zero (&priv->oid)
+          || git_commit_load_stored_log_data (commits[i]))
+        continue;
+
+      priv->batch = batch;
+      priv->fetch_requested = FALSE;
+      g_ptr_array_add (batch->commits, g_object_ref (commits[i]));
+      git_commit_add_object_log (logs, commits[i]);
+    }
+
+  if (batch->commits->len == 0)
+    {
+      g_array_free (logs, TRUE);
+      git_commit_batch_start_reader (batch, g_string_new (""));
+      return;
+    }
+
+  git_commit_start_object_logs (repo, logs, NULL,
+                                git_commit_batch_on_object_logs, batch);
+}
+
+/* Throws away the log data to save memory. It can be fetched again
+   later with git_commit_fetch_log_data. Returns FALSE if there was
+   nothing to free. */
+gboolean
+git_commit_drop_log_data (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), FALSE);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  if (!priv->has_log_data)
+    return FALSE;
+
+  g_free (priv->log_data);
+  priv->log_data = NULL;
+  git_commit_free_parents (commit);
+  priv->got_parents = FALSE;
+
+  priv->has_log_data = FALSE;
+  g_object_notify (G_OBJECT (commit), "has-log-data");
+
+  if (priv->has_parents)
+    {
+      priv->has_parents = FALSE;
+      g_object_notify (G_OBJECT (commit), "has-parents");
+    }
+
+  if (priv->has_stat_data)
+    {
+      g_string_free (priv->stat_data, TRUE);
+      priv->stat_data = NULL;
+      priv->has_stat_data = FALSE;
+      g_object_notify (G_OBJECT (commit), "stat-data");
+      g_object_notify (G_OBJECT (commit), "has-stat-data");
+    }
+
+  return TRUE;
+}
+
+static void
+git_commit_add_prop_size (gpointer key, gpointer value, gpointer user_data)
+{
+  gsize *size = user_data;
+
+  *size += strlen (key) + strlen (value) + 2 + 3 * sizeof (gpointer);
+}
+
+/* Returns a rough estimate of the number of bytes used by the
+   commit */
+gsize
+git_commit_get_memory_usage (GitCommit *commit)
+{
+  g_return_val_if_fail (GIT_IS_COMMIT (commit), 0);
+
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+  gsize size = sizeof (GitCommit) + sizeof (GitCommitPrivate);
+
+  size += strlen (priv->hash) + 1;
+  g_hash_table_foreach (priv->props, git_commit_add_prop_size, &size);
+
+  if (priv->log_data)
+    size += strlen (priv->log_data) + 1;
+  if (priv->log_buf)
+    size += priv->log_buf->allocated_len;
+  if (priv->stat_data)
+    size += priv->stat_data->allocated_len;
+
+  size += g_slist_length (priv->parents) * sizeof (GSList);
+
+  return size;
 }
 
 void
@@ -422,35 +1627,15 @@ git_commit_get_prop (GitCommit *commit, const gchar *prop_name)
 void
 git_commit_get_color (GitCommit *commit, GdkRGBA *color)
 {
-  int i;
-
   g_return_if_fail (GIT_IS_COMMIT (commit));
 
   GitCommitPrivate *priv = git_commit_get_instance_private (commit);
-
-  guint16 bytes[3] = { 0, 0, 0 };
+  const guint8 *id = priv->oid.id;
 
   /* Use the first 6 bytes of the commit hash as a colour */
-  for (i = 0; i < 12; i++)
-    {
-      int nibble;
-
-      if ((priv->hash[i] < 'a' || priv->hash[i] > 'f')
-          && (priv->hash[i] < '0' || priv->hash[i] > '9'))
-        {
-          g_warning ("Invalid commit hash");
-          return;
-        }
-
-      nibble = priv->hash[i] >= 'a'
-        ? priv->hash[i] - 'a' + 10 : priv->hash[i] - '0';
-
-      bytes[i / 4] = (bytes[i / 4] << 4) | nibble;
-    }
-
-  color->red = bytes[0] / 65535.0;
-  color->green = bytes[1] / 65535.0;
-  color->blue = bytes[2] / 65535.0;
+  color->red = ((id[0] << 8) | id[1]) / 65535.0;
+  color->green = ((id[2] << 8) | id[3]) / 65535.0;
+  color->blue = ((id[4] << 8) | id[5]) / 65535.0;
   color->alpha = 1.0;
 }
 
@@ -468,6 +1653,22 @@ git_commit_unref_reader (GitCommit *commit)
     }
 }
 
+static void
+git_commit_unref_stat_reader (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  if (priv->stat_reader)
+    {
+      g_signal_handler_disconnect (priv->stat_reader,
+                                   priv->stat_line_handler);
+      g_signal_handler_disconnect (priv->stat_reader,
+                                   priv->stat_completed_handler);
+      g_object_unref (priv->stat_reader);
+      priv->stat_reader = NULL;
+    }
+}
+
 static void
 git_commit_free_parents (GitCommit *commit)
 {
@@ -477,3 +1678,14 @@ git_commit_free_parents (GitCommit *commit)
   g_slist_free (priv->parents);
   priv->parents = NULL;
 }
+
+/* Throws away any parents that were parsed from a log that failed.
+   Parents that were already known from the commit-graph are kept. */
+static void
+git_commit_discard_parsed_parents (GitCommit *commit)
+{
+  GitCommitPrivate *priv = git_commit_get_instance_private (commit);
+
+  if (!priv->has_parents)
+    git_commit_free_parents (commit);
+}
@@ -20,6 +20,7 @@
 
 #include <glib-object.h>
 #include <gdk/gdk.h>
+#include "git-oid.h"
 
 G_BEGIN_DECLS
 
@@ -31,17 +32,30 @@ G_DECLARE_FINAL_TYPE (GitCommit,
                       COMMIT,
                       GObject);
 
-#define GIT_COMMIT_HASH_LENGTH 40
-
 GitCommit *git_commit_new (const gchar *hash, GFile *repo);
 
 const gchar *git_commit_get_hash (GitCommit *commit);
+const GitOid *git_commit_get_oid (GitCommit *commit);
 GFile *git_commit_get_repo (GitCommit *commit);
 
 gboolean git_commit_get_has_log_data (GitCommit *commit);
 const gchar *git_commit_get_log_data (GitCommit *commit);
 const GSList *git_commit_get_parents (GitCommit *commit);
+gboolean git_commit_get_has_parents (GitCommit *commit);
+gboolean git_commit_load_parents (GitCommit *commit);
 void git_commit_fetch_log_data (GitCommit *commit);
+void git_commit_fetch_log_data_batch (GFile *repo,
+                                      GitCommit * const *commits,
+                                      guint n_commits,
+                                      gint priority);
+gboolean git_commit_drop_log_data (GitCommit *commit);
+
+gboolean git_commit_get_has_stat_data (GitCommit *commit);
+const gchar *git_commit_get_stat_data (GitCommit *commit);
+void git_commit_fetch_stat_data (GitCommit *commit);
+void git_commit_cancel_stat_data (GitCommit *commit);
+
+gsize git_commit_get_memory_usage (GitCommit *commit);
 
 void git_commit_set_prop (GitCommit *commit, const gchar *prop_name,
                           const gchar *value);
@@ -46,31 +46,496 @@ _git_boolean_continue_accumulator (GSignalInvocationHint *ihint,
   return continue_emission;
 }
 
-GFile *
-git_find_repo (GFile *filename)
+/* Only this many directories are remembered */
+#define GIT_REPO_CACHE_MAX_DIRS 256
+/* A repo that was seen more recently than this is trusted without
+   looking at the file system again */
+#define GIT_REPO_CACHE_FRESH_TIME (5 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  GFile *dir;
+  GFile *repo;
+  /* When the repo was last seen to still be there */
+  gint64 check_time;
+  GList link;
+} GitRepoCacheEntry;
+
+/* Directories that have been looked in before mapped to the top of
+   the working tree that they are in so that opening more files from
+   the same repo doesn’t need to walk the file system again. Only
+   repos that were found are remembered and the least recently used
+   directories are dropped. */
+static GMutex git_repo_cache_mutex;
+static GHashTable *git_repo_cache = NULL;
+static GQueue git_repo_cache_lru = G_QUEUE_INIT;
+
+static void
+git_repo_cache_free_entry (GitRepoCacheEntry *entry)
+{
+  g_object_unref (entry->dir);
+  g_object_unref (entry->repo);
+  g_slice_free (GitRepoCacheEntry, entry);
+}
+
+/* Must be called with the mutex locked */
+static void
+git_repo_cache_remove (GitRepoCacheEntry *entry)
+{
+  g_queue_unlink (&git_repo_cache_lru, &entry->link);
+  g_hash_table_remove (git_repo_cache, entry->dir);
+}
+
+/* Returns a reference to the repo that the directory was in last time
+   it was looked at. fresh is set if it was seen recently enough that
+   it doesn’t need checking again. */
+static GFile *
+git_repo_cache_lookup (GFile *dir, gboolean *fresh)
 {
-  GFile *repo = g_object_ref (filename);
+  GitRepoCacheEntry *entry = NULL;
+  GFile *repo = NULL;
+
+  g_mutex_lock (&git_repo_cache_mutex);
+
+  if (git_repo_cache)
+    entry = g_hash_table_lookup (git_repo_cache, dir);
 
-  while (true)
+  if (entry)
     {
-      GFile *parent = g_file_get_parent (repo);
+      repo = g_object_ref (entry->repo);
+      *fresh = (g_get_monotonic_time () - entry->check_time
+                < GIT_REPO_CACHE_FRESH_TIME);
 
-      g_object_unref (repo);
+      g_queue_unlink (&git_repo_cache_lru, &entry->link);
+      g_queue_push_head_link (&git_repo_cache_lru, &entry->link);
+    }
+
+  g_mutex_unlock (&git_repo_cache_mutex);
 
-      if (parent == NULL)
-        return NULL;
+  return repo;
+}
 
-      repo = parent;
+/* Remembers that each of the directories is in the repo or, if repo
+   is NULL, forgets them */
+static void
+git_repo_cache_add (GPtrArray *dirs, GFile *repo)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint i;
+
+  g_mutex_lock (&git_repo_cache_mutex);
+
+  if (git_repo_cache == NULL)
+    git_repo_cache
+      = g_hash_table_new_full (g_file_hash,
+                               (GEqualFunc) g_file_equal,
+                               NULL,
+                               (GDestroyNotify) git_repo_cache_free_entry);
+
+  for (i = 0; i < dirs->len; i++)
+    {
+      GFile *dir = g_ptr_array_index (dirs, i);
+      GitRepoCacheEntry *entry = g_hash_table_lookup (git_repo_cache, dir);
+
+      if (entry)
+        git_repo_cache_remove (entry);
+
+      if (repo == NULL)
+        continue;
+
+      entry = g_slice_new (GitRepoCacheEntry);
+      entry->dir = g_object_ref (dir);
+      entry->repo = g_object_ref (repo);
+      entry->check_time = now;
+      entry->link.data = entry;
+      entry->link.prev = entry->link.next = NULL;
+
+      g_hash_table_insert (git_repo_cache, entry->dir, entry);
+      g_queue_push_head_link (&git_repo_cache_lru, &entry->link);
+    }
+
+  while (git_repo_cache_lru.length > GIT_REPO_CACHE_MAX_DIRS)
+    git_repo_cache_remove (git_repo_cache_lru.tail->data);
+
+  g_mutex_unlock (&git_repo_cache_mutex);
+}
+
+typedef struct
+{
+  GFile *work_tree;
+  GFile *git_dir;
+} GitEnvRepo;
+
+/* Working trees whose git directory was given with GIT_DIR rather
+   than being found in a ‘.git’ inside them. These come from the
+   environment of each command line so that a resident instance uses
+   the environment of whoever ran it rather than its own. */
+static GMutex git_env_repo_mutex;
+static GArray *git_env_repos = NULL;
+
+/* Remembers that the working tree uses git_dir as its git directory,
+   as given by GIT_DIR and GIT_WORK_TREE. Files in the working tree
+   are then found to be in that repo and git is run with the same
+   variables for it. */
+void
+git_set_env_repo (GFile *git_dir, GFile *work_tree)
+{
+  g_return_if_fail (G_IS_FILE (git_dir));
+  g_return_if_fail (G_IS_FILE (work_tree));
+
+  GitEnvRepo *env_repo;
+  guint i;
+
+  g_mutex_lock (&git_env_repo_mutex);
+
+  if (git_env_repos == NULL)
+    git_env_repos = g_array_new (FALSE, FALSE, sizeof (GitEnvRepo));
+
+  for (i = 0; i < git_env_repos->len; i++)
+    {
+      env_repo = &g_array_index (git_env_repos, GitEnvRepo, i);
+
+      if (g_file_equal (env_repo->work_tree, work_tree))
+        {
+          g_object_unref (env_repo->git_dir);
+          env_repo->git_dir = g_object_ref (git_dir);
+          break;
+        }
+    }
+
+  if (i >= git_env_repos->len)
+    {
+      GitEnvRepo new_repo;
+
+      new_repo.work_tree = g_object_ref (work_tree);
+      new_repo.git_dir = g_object_ref (git_dir);
+      g_array_append_val (git_env_repos, new_repo);
+    }
+
+  g_mutex_unlock (&git_env_repo_mutex);
+}
+
+/* Returns a reference to the innermost working tree given with
+   git_set_env_repo() that contains the file, or NULL if there isn’t
+   one. If git_dir is not NULL it gets a reference to the git
+   directory of the working tree. */
+static GFile *
+git_lookup_env_repo (GFile *file, GFile **git_dir)
+{
+  GitEnvRepo *best = NULL;
+  GFile *work_tree = NULL;
+
+  g_mutex_lock (&git_env_repo_mutex);
+
+  for (guint i = 0; git_env_repos && i < git_env_repos->len; i++)
+    {
+      GitEnvRepo *env_repo = &g_array_index (git_env_repos, GitEnvRepo, i);
+
+      if ((g_file_equal (file, env_repo->work_tree)
+           || g_file_has_prefix (file, env_repo->work_tree))
+          && (best == NULL
+              || g_file_has_prefix (env_repo->work_tree, best->work_tree)))
+        best = env_repo;
+    }
+
+  if (best)
+    {
+      work_tree = g_object_ref (best->work_tree);
+      if (git_dir)
+        *git_dir = g_object_ref (best->git_dir);
+    }
+
+  g_mutex_unlock (&git_env_repo_mutex);
+
+  return work_tree;
+}
+
+/* Returns an environment to run git in for a file in the repo. Any
+   GIT_DIR and GIT_WORK_TREE of this process are left out because
+   they might have come from a different command line. They are set
+   instead if the repo was given with git_set_env_repo(). */
+gchar **
+git_get_repo_environ (GFile *repo)
+{
+  g_return_val_if_fail (G_IS_FILE (repo), NULL);
+
+  gchar **envp = g_get_environ ();
+  GFile *git_dir, *work_tree;
+
+  envp = g_environ_unsetenv (envp, "GIT_DIR");
+  envp = g_environ_unsetenv (envp, "GIT_WORK_TREE");
+
+  if ((work_tree = git_lookup_env_repo (repo, &git_dir)))
+    {
+      gchar *git_dir_path = g_file_get_path (git_dir);
+      gchar *work_tree_path = g_file_get_path (work_tree);
+
+      if (git_dir_path && work_tree_path)
+        {
+          envp = g_environ_setenv (envp, "GIT_DIR", git_dir_path, TRUE);
+          envp = g_environ_setenv (envp, "GIT_WORK_TREE", work_tree_path,
+                                   TRUE);
+        }
+
+      g_free (git_dir_path);
+      g_free (work_tree_path);
+      g_object_unref (git_dir);
+      g_object_unref (work_tree);
+    }
+
+  return envp;
+}
+
+/* Looks for a ‘.git’ in each parent directory of the file. This can
+   be called from any thread. */
+static GFile *
+git_find_repo_walk (GFile *filename, GCancellable *cancellable)
+{
+  GPtrArray *dirs;
+  GFile *dir, *repo;
+
+  if ((repo = git_lookup_env_repo (filename, NULL)))
+    return repo;
+
+  dirs = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (dir = g_file_get_parent (filename);
+       dir;
+       dir = g_file_get_parent (dir))
+    {
+      gboolean fresh;
+
+      g_ptr_array_add (dirs, dir);
+
+      if ((repo = git_repo_cache_lookup (dir, &fresh)))
+        {
+          GFile *dot_git;
+          gboolean exists;
 
-      GFile *dot_git = g_file_get_child (repo, ".git");
+          /* Only the directories below it need remembering */
+          if (fresh)
+            {
+              g_ptr_array_remove_index (dirs, dirs->len - 1);
+              break;
+            }
 
-      gboolean found = g_file_query_exists (dot_git, NULL);
+          /* The repo might have been moved or deleted since */
+          dot_git = g_file_get_child (repo, ".git");
+          exists = g_file_query_exists (dot_git, cancellable);
+          g_object_unref (dot_git);
+
+          if (exists)
+            break;
+
+          g_clear_object (&repo);
+        }
+
+      /* This is a directory in a normal repo but a file in a linked
+         worktree or a submodule */
+      GFile *dot_git = g_file_get_child (dir, ".git");
+
+      gboolean found = g_file_query_exists (dot_git, cancellable);
 
       g_object_unref (dot_git);
 
       if (found)
-        return repo;
+        {
+          repo = g_object_ref (dir);
+          break;
+        }
+
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+    }
+
+  /* Any stale entries for the directories are dropped if the repo
+     wasn’t found */
+  if (!g_cancellable_is_cancelled (cancellable))
+    git_repo_cache_add (dirs, repo);
+
+  g_ptr_array_free (dirs, TRUE);
+
+  return repo;
+}
+
+static GError *
+git_find_repo_error (GFile *filename)
+{
+  char *parse_name = g_file_get_parse_name (filename);
+  GError *error = g_error_new (GIT_ERROR, GIT_ERROR_NO_REPO,
+                               "No repo found for %s", parse_name);
+
+  g_free (parse_name);
+
+  return error;
+}
+
+/* Returns the top of the working tree that contains the file or NULL
+   if it isn’t in one. This blocks if the repo hasn’t been found
+   before so git_find_repo_async is better from the main thread. */
+GFile *
+git_find_repo (GFile *filename)
+{
+  return git_find_repo_walk (filename, NULL);
+}
+
+static void
+git_find_repo_thread (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+  GFile *repo = git_find_repo_walk (source_object, cancellable);
+
+  if (repo)
+    g_task_return_pointer (task, repo, g_object_unref);
+  else if (!g_task_return_error_if_cancelled (task))
+    g_task_return_error (task, git_find_repo_error (source_object));
+}
+
+/* Finds the repo in a thread so that a slow file system doesn’t hold
+   up the UI, unless it is already known */
+void
+git_find_repo_async (GFile *filename,
+                     GCancellable *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer user_data)
+{
+  g_return_if_fail (G_IS_FILE (filename));
+
+  GTask *task = g_task_new (filename, cancellable, callback, user_data);
+  GFile *repo = git_lookup_env_repo (filename, NULL);
+  gboolean fresh = repo != NULL;
+
+  if (repo == NULL)
+    {
+      GFile *parent = g_file_get_parent (filename);
+
+      if (parent)
+        {
+          repo = git_repo_cache_lookup (parent, &fresh);
+          g_object_unref (parent);
+        }
+    }
+
+  /* Anything older is checked again in the thread */
+  if (repo && fresh)
+    g_task_return_pointer (task, repo, g_object_unref);
+  else
+    {
+      if (repo)
+        g_object_unref (repo);
+      g_task_run_in_thread (task, git_find_repo_thread);
+    }
+
+  g_object_unref (task);
+}
+
+/* Returns a reference to the repo or NULL with GIT_ERROR_NO_REPO if
+   the file isn’t in one */
+GFile *
+git_find_repo_finish (GFile *filename,
+                      GAsyncResult *result,
+                      GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, filename), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Reads a file that contains a path to another file, such as the
+   ‘.git’ file of a worktree or the ‘commondir’ file in its git
+   directory, and resolves it relative to base. Returns NULL if the
+   file can’t be read. */
+static GFile *
+git_read_path_file (GFile *file, const gchar *prefix, GFile *base)
+{
+  gchar *contents;
+  gsize length;
+  GFile *ret = NULL;
+
+  if (!g_file_load_contents (file, NULL, &contents, &length, NULL, NULL))
+    return NULL;
+
+  g_strchomp (contents);
+
+  if (g_str_has_prefix (contents, prefix))
+    ret = g_file_resolve_relative_path (base, contents + strlen (prefix));
+
+  g_free (contents);
+
+  return ret;
+}
+
+/* Returns the git directory of the working tree. This is where its
+   HEAD is kept. */
+GFile *
+git_find_git_dir (GFile *repo)
+{
+  GFile *dot_git, *git_dir, *work_tree;
+
+  if ((work_tree = git_lookup_env_repo (repo, &git_dir)))
+    {
+      gboolean same = g_file_equal (repo, work_tree);
+
+      g_object_unref (work_tree);
+
+      if (same)
+        return git_dir;
+
+      g_object_unref (git_dir);
     }
+
+  dot_git = g_file_get_child (repo, ".git");
+
+  /* In a linked worktree ‘.git’ is a file pointing to the real git
+     directory. If it is a directory then loading it will fail. */
+  git_dir = git_read_path_file (dot_git, "gitdir: ", repo);
+
+  if (git_dir)
+    g_object_unref (dot_git);
+  else
+    git_dir = dot_git;
+
+  return git_dir;
+}
+
+/* Returns the git directory that holds the object database for the
+   repo. Linked worktrees of the same repository share the same common
+   directory so this can be used to tell that they have the same
+   commits. */
+GFile *
+git_find_common_dir (GFile *repo)
+{
+  GFile *git_dir = git_find_git_dir (repo);
+  GFile *commondir_file, *common_dir;
+
+  commondir_file = g_file_get_child (git_dir, "commondir");
+  common_dir = git_read_path_file (commondir_file, "", git_dir);
+  g_object_unref (commondir_file);
+
+  if (common_dir)
+    g_object_unref (git_dir);
+  else
+    common_dir = git_dir;
+
+  return common_dir;
+}
+
+/* Returns whether the revision is a full commit hash rather than
+   something symbolic like a branch name. Only these can be assumed to
+   always refer to the same thing. */
+gboolean
+git_is_object_id (const gchar *revision)
+{
+  const gchar *p;
+
+  if (revision == NULL)
+    return FALSE;
+
+  for (p = revision; (*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'); p++);
+
+  return *p == '\0' && (p - revision == 40 || p - revision == 64);
 }
 
 /* This function is stolen from Tweet and then later adapted to use
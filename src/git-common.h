@@ -27,7 +27,10 @@
 typedef enum {
   GIT_ERROR_EXIT_STATUS,
   GIT_ERROR_PARSE_ERROR,
-  GIT_ERROR_NO_REPO
+  GIT_ERROR_NO_REPO,
+  GIT_ERROR_NOT_FOUND,
+  GIT_ERROR_TOO_LARGE,
+  GIT_ERROR_BINARY
 } GitError;
 
 GQuark git_error_quark (void);
@@ -39,5 +42,18 @@ gboolean _git_boolean_continue_accumulator (GSignalInvocationHint *ihint,
 gchar *git_format_time_for_display (GDateTime *dt);
 
 GFile *git_find_repo (GFile *file);
+void git_find_repo_async (GFile *file,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+GFile *git_find_repo_finish (GFile *file,
+                             GAsyncResult *result,
+                             GError **error);
+GFile *git_find_git_dir (GFile *repo);
+GFile *git_find_common_dir (GFile *repo);
+void git_set_env_repo (GFile *git_dir, GFile *work_tree);
+gchar **git_get_repo_environ (GFile *repo);
+
+gboolean git_is_object_id (const gchar *revision);
 
 #endif /* __GIT_COMMON_H__ */
@@ -0,0 +1,354 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-file-revisions.h"
+
+#include <glib-object.h>
+#include <string.h>
+
+#include "git-common.h"
+#include "git-reader.h"
+
+static void git_file_revisions_dispose (GObject *object);
+static void git_file_revisions_finalize (GObject *object);
+
+struct _GitFileRevisions
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  GitReader *reader;
+  guint completed_handler;
+  guint line_handler;
+
+  GFile *file;
+  /* Array of commit hashes. These are collected newest first while
+     git log is running and then reversed once it completes. */
+  GPtrArray *revisions;
+  gboolean completed;
+} GitFileRevisionsPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitFileRevisions,
+                                  git_file_revisions,
+                                  G_TYPE_OBJECT);
+
+enum
+  {
+    COMPLETED,
+
+    LAST_SIGNAL
+  };
+
+static guint client_signals[LAST_SIGNAL];
+
+static void
+git_file_revisions_class_init (GitFileRevisionsClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_file_revisions_dispose;
+  gobject_class->finalize = git_file_revisions_finalize;
+
+  client_signals[COMPLETED]
+    = g_signal_new ("completed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_POINTER);
+}
+
+static void
+git_file_revisions_init (GitFileRevisions *self)
+{
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (self);
+
+  priv->revisions = g_ptr_array_new_with_free_func (g_free);
+}
+
+/* Stops the process without emitting anything */
+void
+git_file_revisions_cancel (GitFileRevisions *revisions)
+{
+  g_return_if_fail (GIT_IS_FILE_REVISIONS (revisions));
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  /* Destroying the reader kills the process */
+  if (priv->reader)
+    {
+      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
+      g_signal_handler_disconnect (priv->reader, priv->line_handler);
+      g_object_unref (priv->reader);
+      priv->reader = NULL;
+    }
+}
+
+static void
+git_file_revisions_dispose (GObject *object)
+{
+  GitFileRevisions *self = (GitFileRevisions *) object;
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (self);
+
+  git_file_revisions_cancel (self);
+
+  if (priv->file)
+    {
+      g_object_unref (priv->file);
+      priv->file = NULL;
+    }
+
+  G_OBJECT_CLASS (git_file_revisions_parent_class)->dispose (object);
+}
+
+static void
+git_file_revisions_finalize (GObject *object)
+{
+  GitFileRevisions *self = (GitFileRevisions *) object;
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (self);
+
+  g_ptr_array_free (priv->revisions, TRUE);
+
+  G_OBJECT_CLASS (git_file_revisions_parent_class)->finalize (object);
+}
+
+GitFileRevisions *
+git_file_revisions_new (void)
+{
+  GitFileRevisions *self = g_object_new (GIT_TYPE_FILE_REVISIONS, NULL);
+
+  return self;
+}
+
+static void
+git_file_revisions_on_completed (GitReader *reader,
+                                 const GError *error,
+                                 GitFileRevisions *revisions)
+{
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+  guint i;
+
+  /* Keep the object alive in case a handler drops the last reference */
+  g_object_ref (revisions);
+
+  git_file_revisions_cancel (revisions);
+
+  if (error)
+    g_ptr_array_set_size (priv->revisions, 0);
+  else
+    {
+      for (i = 0; i < priv->revisions->len / 2; i++)
+        {
+          gpointer *a = priv->revisions->pdata + i;
+          gpointer *b = priv->revisions->pdata + priv->revisions->len - 1 - i;
+          gpointer tmp = *a;
+
+          *a = *b;
+          *b = tmp;
+        }
+
+      priv->completed = TRUE;
+    }
+
+  g_signal_emit (revisions, client_signals[COMPLETED], 0, error);
+
+  g_object_unref (revisions);
+}
+
+static gboolean
+git_file_revisions_on_line (GitReader *reader,
+                            guint length, const gchar *str,
+                            GitFileRevisions *revisions)
+{
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+  gchar *hash = g_strndup (str, length);
+
+  g_strchomp (hash);
+
+  if (git_is_object_id (hash))
+    g_ptr_array_add (priv->revisions, hash);
+  else
+    g_free (hash);
+
+  return TRUE;
+}
+
+gboolean
+git_file_revisions_fetch (GitFileRevisions *revisions,
+                          GFile *file,
+                          GError **error)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), FALSE);
+  g_return_val_if_fail (file != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  git_file_revisions_cancel (revisions);
+
+  g_ptr_array_set_size (priv->revisions, 0);
+  priv->completed = FALSE;
+
+  g_object_ref (file);
+  if (priv->file)
+    g_object_unref (priv->file);
+  priv->file = file;
+
+  GFile *repo = git_find_repo (file);
+
+  if (repo == NULL)
+    {
+      char *parse_name = g_file_get_parse_name (file);
+
+      g_set_error (error, GIT_ERROR, GIT_ERROR_NO_REPO,
+                   "No repo found for %s", parse_name);
+
+      g_free (parse_name);
+
+      return FALSE;
+    }
+
+  char *relative_file = g_file_get_relative_path (repo, file);
+
+  if (relative_file == NULL)
+    {
+      char *parse_name = g_file_get_parse_name (file);
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   G_FILE_ERROR_NOENT,
+                   "Couldn’t convert %s to relative path",
+                   parse_name);
+
+      g_free (parse_name);
+      g_object_unref (repo);
+
+      return FALSE;
+    }
+
+  priv->reader = git_reader_new ();
+
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_file_revisions_on_completed),
+                        revisions);
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_file_revisions_on_line),
+                        revisions);
+
+  /* The list is only used to move around in the background so it
+     shouldn’t get in the way of the blame that is being shown */
+  git_reader_set_priority (priv->reader, G_PRIORITY_LOW);
+
+  gboolean ret = git_reader_start (priv->reader, repo, error,
+                                   "log",
+                                   "--format=%H",
+                                   "--",
+                                   relative_file,
+                                   NULL);
+
+  g_free (relative_file);
+  g_object_unref (repo);
+
+  if (!ret)
+    git_file_revisions_cancel (revisions);
+
+  return ret;
+}
+
+GFile *
+git_file_revisions_get_file (GitFileRevisions *revisions)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), NULL);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  return priv->file;
+}
+
+gboolean
+git_file_revisions_get_completed (GitFileRevisions *revisions)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), FALSE);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  return priv->completed;
+}
+
+guint
+git_file_revisions_get_n_revisions (GitFileRevisions *revisions)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), 0);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  return priv->completed ? priv->revisions->len : 0;
+}
+
+const gchar *
+git_file_revisions_get_revision (GitFileRevisions *revisions,
+                                 guint index)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), NULL);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+
+  g_return_val_if_fail (priv->completed, NULL);
+  g_return_val_if_fail (index < priv->revisions->len, NULL);
+
+  return g_ptr_array_index (priv->revisions, index);
+}
+
+/* Returns the index of the revision or -1 if it didn’t touch the
+   file. The revision must be a full commit hash. */
+gint
+git_file_revisions_find (GitFileRevisions *revisions,
+                         const gchar *revision)
+{
+  g_return_val_if_fail (GIT_IS_FILE_REVISIONS (revisions), -1);
+
+  GitFileRevisionsPrivate *priv =
+    git_file_revisions_get_instance_private (revisions);
+  guint i;
+
+  if (!priv->completed || revision == NULL)
+    return -1;
+
+  for (i = 0; i < priv->revisions->len; i++)
+    if (!strcmp (g_ptr_array_index (priv->revisions, i), revision))
+      return i;
+
+  return -1;
+}
@@ -0,0 +1,56 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_FILE_REVISIONS_H__
+#define __GIT_FILE_REVISIONS_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_FILE_REVISIONS git_file_revisions_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitFileRevisions,
+                      git_file_revisions,
+                      GIT,
+                      FILE_REVISIONS,
+                      GObject);
+
+/* Gets the list of commits that touched a file on the current branch
+   using git log. The ‘completed’ signal is emitted once the whole list
+   is available. The revisions are ordered from the oldest to the
+   newest. */
+
+GitFileRevisions *git_file_revisions_new (void);
+
+gboolean git_file_revisions_fetch (GitFileRevisions *revisions,
+                                   GFile *file,
+                                   GError **error);
+void git_file_revisions_cancel (GitFileRevisions *revisions);
+
+GFile *git_file_revisions_get_file (GitFileRevisions *revisions);
+gboolean git_file_revisions_get_completed (GitFileRevisions *revisions);
+guint git_file_revisions_get_n_revisions (GitFileRevisions *revisions);
+const gchar *git_file_revisions_get_revision (GitFileRevisions *revisions,
+                                              guint index);
+gint git_file_revisions_find (GitFileRevisions *revisions,
+                              const gchar *revision);
+
+G_END_DECLS
+
+#endif /* __GIT_FILE_REVISIONS_H__ */
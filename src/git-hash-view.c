@@ -20,6 +20,7 @@
 #include "git-hash-view.h"
 
 #include <gtk/gtk.h>
+#include <glib/gi18n.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
@@ -73,6 +74,8 @@ typedef struct
   guint adjustment_handler;
   guint adjustment_value_handler;
   GtkAdjustment *text_view_adjustment;
+
+  guint attribution_changed_handler;
 } GitHashViewPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GitHashView,
@@ -82,6 +85,7 @@ G_DEFINE_TYPE_WITH_PRIVATE (GitHashView,
 enum
   {
     COMMIT_SELECTED,
+    PREVIOUS_SELECTED,
 
     LAST_SIGNAL
   };
@@ -141,6 +145,19 @@ git_hash_view_class_init (GitHashViewClass *klass)
                     _git_marshal_VOID__OBJECT,
                     G_TYPE_NONE, 1,
                     GIT_TYPE_COMMIT);
+
+  /* Emitted when a line is clicked with Control held down to blame
+     the version of the file before the line’s commit changed it */
+  client_signals[PREVIOUS_SELECTED]
+    = g_signal_new ("previous-selected",
+                    G_OBJECT_CLASS_TYPE (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitHashViewClass, previous_selected),
+                    NULL, NULL,
+                    _git_marshal_VOID__OBJECT_STRING,
+                    G_TYPE_NONE, 2,
+                    GIT_TYPE_COMMIT,
+                    G_TYPE_STRING);
 }
 
 static void
@@ -206,6 +223,8 @@ git_hash_view_unref_source (GitHashView *hview)
 
   if (priv->source)
     {
+      g_signal_handler_disconnect (priv->source,
+                                   priv->attribution_changed_handler);
       g_object_unref (priv->source);
       priv->source = NULL;
     }
@@ -223,22 +242,33 @@ git_hash_view_dispose (GObject *object)
 }
 
 static void
-git_hash_view_set_text_for_commit (PangoLayout *layout, GitCommit *commit)
+git_hash_view_set_text_for_line (PangoLayout *layout,
+                                 const GitAnnotatedSourceLine *line)
 {
-  const gchar *hash = git_commit_get_hash (commit), *p;
+  GitCommit *commit = line->commit;
+  const gchar *hash = git_commit_get_hash (commit);
   int len = strlen (hash);
 
   /* If the hash is all zeroes then it represents lines in the working
      copy that have not been committed */
-  for (p = hash; *p == '0'; p++);
-  if (p - hash == len && len == GIT_COMMIT_HASH_LENGTH)
+  if (git_oid_is_zero (git_commit_get_oid (commit)))
     pango_layout_set_markup (layout, "<i>WIP</i>", -1);
   else
     {
       if (len > GIT_HASH_VIEW_COMMIT_HASH_LENGTH)
         len = GIT_HASH_VIEW_COMMIT_HASH_LENGTH;
 
-      pango_layout_set_text (layout, hash, len);
+      /* Lines that might be older than the commit are marked with a
+         caret in the same way as git-blame */
+      if (line->boundary)
+        {
+          gchar *text = g_strdup_printf ("^%.*s", len - 1, hash);
+          pango_layout_set_text (layout, text, -1);
+          g_free (text);
+        }
+      else
+        pango_layout_set_text (layout, hash, len);
+
       pango_layout_set_attributes (layout, NULL);
     }
 }
@@ -304,6 +334,14 @@ git_hash_view_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
         = git_annotated_source_get_line (priv->source, line_num);
       GdkRGBA color;
 
+      /* Lines that the blame hasn’t reached yet are left blank */
+      if (line->commit == NULL)
+        {
+          if (!gtk_text_view_forward_display_line (priv->text_view, &iter))
+            break;
+          continue;
+        }
+
       git_commit_get_color (line->commit, &color);
 
       gtk_snapshot_append_color (snapshot,
@@ -317,7 +355,7 @@ git_hash_view_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
       color.green = 1.0 - color.green;
       color.blue = 1.0 - color.blue;
 
-      git_hash_view_set_text_for_commit (layout, line->commit);
+      git_hash_view_set_text_for_line (layout, line);
 
       gtk_snapshot_save (snapshot);
       gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, window_y));
@@ -335,8 +373,8 @@ git_hash_view_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
   g_object_unref (layout);
 }
 
-static GitCommit *
-get_iter_and_commit_at_y (GitHashView *hview, int window_y, GtkTextIter *iter)
+static const GitAnnotatedSourceLine *
+get_iter_and_line_at_y (GitHashView *hview, int window_y, GtkTextIter *iter)
 {
   GitHashViewPrivate *priv = git_hash_view_get_instance_private (hview);
 
@@ -362,7 +400,20 @@ get_iter_and_commit_at_y (GitHashView *hview, int window_y, GtkTextIter *iter)
       || line_num >= git_annotated_source_get_n_lines (priv->source))
     return NULL;
 
-  return git_annotated_source_get_line (priv->source, line_num)->commit;
+  const GitAnnotatedSourceLine *line
+    = git_annotated_source_get_line (priv->source, line_num);
+
+  /* There’s nothing to show for a line that isn’t blamed yet */
+  return line->commit ? line : NULL;
+}
+
+static GitCommit *
+get_iter_and_commit_at_y (GitHashView *hview, int window_y, GtkTextIter *iter)
+{
+  const GitAnnotatedSourceLine *line
+    = get_iter_and_line_at_y (hview, window_y, iter);
+
+  return line ? line->commit : NULL;
 }
 
 static gboolean
@@ -375,14 +426,16 @@ git_hash_view_query_tooltip (GtkWidget *widget,
   GitHashViewPrivate *priv = git_hash_view_get_instance_private (hview);
 
   GtkTextIter iter;
-  GitCommit *commit = get_iter_and_commit_at_y (hview, y, &iter);
+  const GitAnnotatedSourceLine *line = get_iter_and_line_at_y (hview, y, &iter);
 
-  if (commit == NULL)
+  if (line == NULL)
     return FALSE;
 
   if (priv->source == NULL || priv->text_view == NULL)
     return FALSE;
 
+  GitCommit *commit = line->commit;
+
   gboolean ret = TRUE;
 
   GString *markup = g_string_new ("");
@@ -446,6 +499,28 @@ git_hash_view_query_tooltip (GtkWidget *widget,
       g_string_append (markup, part_markup);
       g_free (part_markup);
     }
+  if (markup->len > 0 && line->boundary)
+    {
+      g_string_append_c (markup, '\n');
+      const char *note
+        = (git_annotated_source_get_refining (priv->source)
+           ? _("Looking further back in the history for this line…")
+           : _("This line might be older than the commit"));
+      char *part_markup
+        = g_markup_printf_escaped ("<small>%s</small>", note);
+      g_string_append (markup, part_markup);
+      g_free (part_markup);
+    }
+  if (markup->len > 0 && line->previous_commit)
+    {
+      g_string_append_c (markup, '\n');
+      char *part_markup
+        = g_markup_printf_escaped ("<small>%s</small>",
+                                   _("Ctrl+click to blame the version "
+                                     "before this change"));
+      g_string_append (markup, part_markup);
+      g_free (part_markup);
+    }
 
   if (markup->len > 0)
     {
@@ -573,14 +648,29 @@ git_hash_view_click_released_cb (GtkGestureClick *self,
   GitHashView *hview = user_data;
 
   GtkTextIter iter;
-  GitCommit *commit = get_iter_and_commit_at_y (hview, y, &iter);
+  const GitAnnotatedSourceLine *line = get_iter_and_line_at_y (hview, y, &iter);
 
-  if (commit)
+  if (line == NULL)
+    return;
+
+  GdkModifierType state
+    = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER
+                                                    (self));
+
+  if ((state & GDK_CONTROL_MASK) && line->previous_commit)
+    {
+      g_signal_emit (hview,
+                     client_signals[PREVIOUS_SELECTED],
+                     0,
+                     line->previous_commit,
+                     line->previous_path);
+    }
+  else
     {
       g_signal_emit (hview,
                      client_signals[COMMIT_SELECTED],
                      0,
-                     commit);
+                     line->commit);
     }
 }
 
@@ -705,7 +795,13 @@ void git_hash_view_set_source (GitHashView *hview,
   git_hash_view_unref_source (hview);
 
   if (source)
-    priv->source = g_object_ref (source);
+    {
+      priv->source = g_object_ref (source);
+      priv->attribution_changed_handler
+        = g_signal_connect_swapped (source, "attribution-changed",
+                                    G_CALLBACK (gtk_widget_queue_draw),
+                                    hview);
+    }
 
   if (gtk_widget_get_realized (GTK_WIDGET (hview)))
       gtk_widget_queue_draw (GTK_WIDGET (hview));
@@ -38,6 +38,9 @@ struct _GitHashViewClass
 
   void (* commit_selected) (GitHashView *hash_view,
                             GitCommit *commit);
+  void (* previous_selected) (GitHashView *hash_view,
+                              GitCommit *previous_commit,
+                              const gchar *previous_path);
 };
 
 GtkWidget *git_hash_view_new (GtkTextView *hview);
@@ -0,0 +1,746 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-line-diff.h"
+
+#include <glib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* A line diff using Myers’ algorithm with the linear space
+   refinement. Only the lines that match are reported because that is
+   all that blame needs. Lines are first replaced with integer keys so
+   that comparing them is cheap. */
+
+typedef struct
+{
+  const guint64 *a, *b;
+  GArray *matches;
+  guint max_cost;
+  /* Number of diagonals that a search with a max_cost can still visit
+     over all of the bisections */
+  gint64 budget;
+} GitLineDiffState;
+
+/* The total work for a diff with a max_cost is limited to this many
+   times max_cost² diagonals. After that the remaining ranges are left
+   without any matches. */
+#define GIT_LINE_DIFF_BUDGET_SCALE 64
+
+/* Splits the text into lines. Returns an array of n_lines + 1 offsets
+   where line i runs from offset i to offset i + 1 including the
+   newline. A final line without a newline still counts. */
+guint *
+git_line_diff_split (const gchar *text, gsize length, guint *n_lines)
+{
+  GArray *starts = g_array_new (FALSE, FALSE, sizeof (guint));
+  const gchar *p = text, *end = text + length;
+  guint offset = 0;
+
+  g_array_append_val (starts, offset);
+
+  while (p < end)
+    {
+      const gchar *nl = memchr (p, '\n', end - p);
+
+      p = nl ? nl + 1 : end;
+      offset = p - text;
+      g_array_append_val (starts, offset);
+    }
+
+  *n_lines = starts->len - 1;
+
+  return (guint *) g_array_free (starts, FALSE);
+}
+
+static void
+git_line_diff_add_match (GitLineDiffState *state,
+                         guint a_line, guint b_line, guint n_lines)
+{
+  GitLineDiffMatch *last;
+  GitLineDiffMatch match;
+
+  if (n_lines == 0)
+    return;
+
+  /* Join onto the previous match if it is contiguous */
+  if (state->matches->len > 0)
+    {
+      last = &g_array_index (state->matches,
+                             GitLineDiffMatch,
+                             state->matches->len - 1);
+
+      if (last->a_line + last->n_lines == a_line
+          && last->b_line + last->n_lines == b_line)
+        {
+          last->n_lines += n_lines;
+          return;
+        }
+    }
+
+  match.a_line = a_line;
+  match.b_line = b_line;
+  match.n_lines = n_lines;
+  g_array_append_val (state->matches, match);
+}
+
+static void git_line_diff_recurse (GitLineDiffState *state,
+                                   guint a0, guint a1,
+                                   guint b0, guint b1);
+
+/* Finds the middle of the shortest edit script between the two ranges
+   and splits the problem there. Returns FALSE if the ranges have
+   nothing in common. If max_cost is set and the search goes on for
+   longer than that then it gives up on finding the best split and
+   instead cuts at the point the front path has got furthest along.
+   The result is then no longer minimal but the time taken for two
+   very different files stays reasonable. Once the whole budget has
+   been used it gives up without splitting. */
+static gboolean
+git_line_diff_bisect (GitLineDiffState *state,
+                      guint a0, guint a1,
+                      guint b0, guint b1)
+{
+  const guint64 *a = state->a + a0, *b = state->b + b0;
+  gint n = a1 - a0, m = b1 - b0;
+  gint max_d = (n + m + 1) / 2;
+  gboolean limited = state->max_cost > 0 && max_d > state->max_cost;
+  gint v_offset = max_d, v_length = 2 * max_d + 2;
+  gint *v1 = g_new (gint, v_length * 2), *v2 = v1 + v_length;
+  gint delta = n - m;
+  gboolean front = (delta & 1) != 0;
+  gint k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+  gint d, k1, k2, x1 = 0, y1 = 0, x2, y2;
+
+  if (limited)
+    {
+      max_d = state->max_cost;
+      v_offset = max_d;
+      v_length = 2 * max_d + 2;
+      v2 = v1 + v_length;
+    }
+
+  for (d = 0; d < v_length; d++)
+    v1[d] = v2[d] = -1;
+  v1[v_offset + 1] = 0;
+  v2[v_offset + 1] = 0;
+
+  for (d = 0; d < max_d; d++)
+    {
+      if (state->max_cost > 0 && (state->budget -= 2 * d + 2) < 0)
+        break;
+
+      /* Walk the front path one step */
+      for (k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2)
+        {
+          gint k1_offset = v_offset + k1;
+
+          if (k1 == -d
+              || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+            x1 = v1[k1_offset + 1];
+          else
+            x1 = v1[k1_offset - 1] + 1;
+
+          y1 = x1 - k1;
+
+          while (x1 < n && y1 < m && a[x1] == b[y1])
+            {
+              x1++;
+              y1++;
+            }
+
+          v1[k1_offset] = x1;
+
+          if (x1 > n)
+            k1_end += 2;
+          else if (y1 > m)
+            k1_start += 2;
+          else if (front)
+            {
+              gint k2_offset = v_offset + delta - k1;
+
+              if (k2_offset >= 0 && k2_offset < v_length
+                  && v2[k2_offset] != -1
+                  && x1 >= n - v2[k2_offset])
+                goto split;
+            }
+        }
+
+      /* Walk the reverse path one step */
+      for (k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2)
+        {
+          gint k2_offset = v_offset + k2;
+
+          if (k2 == -d
+              || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+            x2 = v2[k2_offset + 1];
+          else
+            x2 = v2[k2_offset - 1] + 1;
+
+          y2 = x2 - k2;
+
+          while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1])
+            {
+              x2++;
+              y2++;
+            }
+
+          v2[k2_offset] = x2;
+
+          if (x2 > n)
+            k2_end += 2;
+          else if (y2 > m)
+            k2_start += 2;
+          else if (!front)
+            {
+              gint k1_offset = v_offset + delta - k2;
+
+              if (k1_offset >= 0 && k1_offset < v_length
+                  && v1[k1_offset] != -1)
+                {
+                  x1 = v1[k1_offset];
+                  y1 = v_offset + x1 - k1_offset;
+
+                  if (x1 >= n - x2)
+                    goto split;
+                }
+            }
+        }
+    }
+
+  if (limited && state->budget >= 0)
+    {
+      /* Cut at the furthest point reached by the front path */
+      gint best = -1;
+
+      d--;
+
+      for (k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2)
+        {
+          gint x = MIN (v1[v_offset + k1], n);
+          gint y = CLAMP (x - k1, 0, m);
+
+          if (x + y > best)
+            {
+              best = x + y;
+              x1 = x;
+              y1 = y;
+            }
+        }
+
+      if (best > 0 && best < n + m)
+        goto split;
+    }
+
+  g_free (v1);
+
+  return FALSE;
+
+ split:
+  g_free (v1);
+
+  git_line_diff_recurse (state, a0, a0 + x1, b0, b0 + y1);
+  git_line_diff_recurse (state, a0 + x1, a1, b0 + y1, b1);
+
+  return TRUE;
+}
+
+static void
+git_line_diff_recurse (GitLineDiffState *state,
+                       guint a0, guint a1,
+                       guint b0, guint b1)
+{
+  guint prefix = 0, suffix = 0;
+
+  /* Lines that are the same at the start and end of both ranges are
+     always part of the result */
+  while (a0 + prefix < a1
+         && b0 + prefix < b1
+         && state->a[a0 + prefix] == state->b[b0 + prefix])
+    prefix++;
+
+  git_line_diff_add_match (state, a0, b0, prefix);
+  a0 += prefix;
+  b0 += prefix;
+
+  while (a1 - suffix > a0
+         && b1 - suffix > b0
+         && state->a[a1 - suffix - 1] == state->b[b1 - suffix - 1])
+    suffix++;
+
+  if (a0 < a1 - suffix && b0 < b1 - suffix)
+    git_line_diff_bisect (state, a0, a1 - suffix, b0, b1 - suffix);
+
+  git_line_diff_add_match (state, a1 - suffix, b1 - suffix, suffix);
+}
+
+/* Compares two sequences of line keys and returns an array of
+   GitLineDiffMatch in order. If max_cost is not zero the result may
+   not be minimal, see git_line_diff_bisect(). */
+GArray *
+git_line_diff_ids (const guint64 *a, guint a_n,
+                   const guint64 *b, guint b_n,
+                   guint max_cost)
+{
+  GitLineDiffState state;
+
+  state.a = a;
+  state.b = b;
+  state.max_cost = max_cost;
+  state.budget = (gint64) max_cost * max_cost * GIT_LINE_DIFF_BUDGET_SCALE;
+  state.matches = g_array_new (FALSE, FALSE, sizeof (GitLineDiffMatch));
+
+  git_line_diff_recurse (&state, 0, a_n, 0, b_n);
+
+  return state.matches;
+}
+
+typedef struct
+{
+  const gchar *text;
+  gsize length;
+  guint64 hash;
+} GitLineDiffLine;
+
+static inline guint64
+git_line_diff_finish_hash (guint64 h)
+{
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+
+  return h;
+}
+
+#ifdef __SSE2__
+
+/* Hashes 16 bytes at a time. Each 64-bit lane is multiplied by its
+   low half and has the high half folded back in, then the lanes are
+   swapped so that every byte ends up affecting the whole hash. This
+   doesn’t need to be a very good hash because the diff compares
+   lines with the same hash anyway. Callers that only want a rough
+   mapping can diff the hashes directly with git_line_diff_ids(). */
+guint64
+git_line_diff_hash (const gchar *text, gsize length)
+{
+  const __m128i k = _mm_set1_epi32 (0x85ebca6b);
+  __m128i acc = _mm_set_epi64x (G_GINT64_CONSTANT (0x9e3779b97f4a7c15),
+                                length);
+  const gchar *p = text, *end = text + length;
+  guint64 lanes[2];
+
+  while (TRUE)
+    {
+      __m128i block;
+
+      if (end - p >= 16)
+        {
+          block = _mm_loadu_si128 ((const __m128i *) p);
+          p += 16;
+        }
+      else if (p < end && p > text)
+        {
+          /* Load the last 16 bytes again instead of copying the tail.
+             The overlap doesn’t matter because the same text always
+             overlaps in the same way. */
+          block = _mm_loadu_si128 ((const __m128i *) (end - 16));
+          p = end;
+        }
+      else if (p < end)
+        {
+          gchar tail[16] = { 0 };
+
+          memcpy (tail, p, end - p);
+          block = _mm_loadu_si128 ((const __m128i *) tail);
+          p = end;
+        }
+      else
+        break;
+
+      acc = _mm_xor_si128 (acc, block);
+      acc = _mm_add_epi64 (_mm_mul_epu32 (acc, k), _mm_srli_epi64 (acc, 32));
+      acc = _mm_shuffle_epi32 (acc, _MM_SHUFFLE (1, 0, 3, 2));
+    }
+
+  _mm_storeu_si128 ((__m128i *) lanes, acc);
+
+  return git_line_diff_finish_hash (lanes[0]
+                                    ^ git_line_diff_finish_hash (lanes[1]));
+}
+
+#else /* __SSE2__ */
+
+guint64
+git_line_diff_hash (const gchar *text, gsize length)
+{
+  guint64 h = G_GUINT64_CONSTANT (0x9e3779b97f4a7c15) ^ length;
+  const gchar *p = text, *end = text + length;
+  guint64 word;
+
+  for (; end - p >= 8; p += 8)
+    {
+      memcpy (&word, p, 8);
+      h = (h ^ word) * G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+      h ^= h >> 29;
+    }
+
+  if (p < end)
+    {
+      word = 0;
+      memcpy (&word, p, end - p);
+      h = (h ^ word) * G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+    }
+
+  return git_line_diff_finish_hash (h);
+}
+
+#endif /* __SSE2__ */
+
+/* Replaces each line with a small integer so that identical lines get
+   the same number. This uses an open addressing table rather than a
+   GHashTable because it is a lot faster for files with hundreds of
+   thousands of lines. Each slot keeps the top half of the hash so
+   that most collisions can be skipped without looking at the line. */
+
+typedef struct
+{
+  guint32 hash_high;
+  /* Index of the first line with this content plus one so that zero
+     can mean the slot is empty */
+  guint32 line;
+} GitLineDiffSlot;
+
+static guint32 *
+git_line_diff_intern (GitLineDiffLine *lines, guint n_lines, guint *n_ids)
+{
+  guint32 *ids = g_new (guint32, n_lines);
+  GitLineDiffSlot *slots;
+  guint mask = 15, i;
+  guint32 next_id = 0;
+
+  while (mask < n_lines * 2)
+    mask = mask * 2 + 1;
+
+  slots = g_new0 (GitLineDiffSlot, mask + 1);
+
+  for (i = 0; i < n_lines; i++)
+    {
+      const GitLineDiffLine *line = lines + i;
+      guint32 hash_high = line->hash >> 32;
+      guint pos = line->hash & mask;
+
+      while (TRUE)
+        {
+          GitLineDiffSlot *slot = slots + pos;
+          const GitLineDiffLine *other;
+
+          if (slot->line == 0)
+            {
+              slot->hash_high = hash_high;
+              slot->line = i + 1;
+              ids[i] = next_id++;
+              break;
+            }
+
+          other = lines + slot->line - 1;
+
+          if (slot->hash_high == hash_high
+              && other->length == line->length
+              && !memcmp (other->text, line->text, line->length))
+            {
+              ids[i] = ids[slot->line - 1];
+              break;
+            }
+
+          pos = (pos + 1) & mask;
+        }
+    }
+
+  g_free (slots);
+
+  *n_ids = next_id;
+
+  return ids;
+}
+
+static void
+git_line_diff_fill_lines (GitLineDiffLine *lines,
+                          const gchar *text,
+                          const guint *starts,
+                          guint n_lines)
+{
+  guint i;
+
+  for (i = 0; i < n_lines; i++)
+    {
+      lines[i].text = text + starts[i];
+      lines[i].length = starts[i + 1] - starts[i];
+    }
+}
+
+static gboolean
+git_line_diff_lines_equal (const GitLineDiffLine *a, const GitLineDiffLine *b)
+{
+  return (a->length == b->length
+          && (a->text == b->text || !memcmp (a->text, b->text, a->length)));
+}
+
+/* Copies the ids of the lines that also appear somewhere in the other
+   text. The others can never be part of a match so leaving them out
+   makes the diff much quicker when the texts are very different.
+   index_map is filled with the original line number of each kept
+   line. Returns the number of lines kept. */
+static guint
+git_line_diff_discard (const guint32 *ids,
+                       guint n_lines,
+                       const guint8 *other_has_id,
+                       guint64 *kept_ids,
+                       guint *index_map)
+{
+  guint n_kept = 0, i;
+
+  for (i = 0; i < n_lines; i++)
+    {
+      if (other_has_id[ids[i]])
+        {
+          kept_ids[n_kept] = ids[i];
+          index_map[n_kept] = i;
+          n_kept++;
+        }
+    }
+
+  return n_kept;
+}
+
+/* Diffs the lines between the common prefix and suffix. The lines of
+   both texts are in the one array. */
+static void
+git_line_diff_middle (GitLineDiffState *state,
+                      GitLineDiffLine *lines,
+                      guint a_n,
+                      guint b_n,
+                      guint offset,
+                      guint max_cost)
+{
+  guint n_ids, a_kept, b_kept, i, j;
+  guint32 *line_ids;
+  guint64 *kept_ids;
+  guint *index_map;
+  guint8 *has_id;
+  GArray *kept_matches;
+
+  for (i = 0; i < a_n + b_n; i++)
+    lines[i].hash = git_line_diff_hash (lines[i].text, lines[i].length);
+
+  line_ids = git_line_diff_intern (lines, a_n + b_n, &n_ids);
+  kept_ids = g_new (guint64, a_n + b_n);
+  index_map = g_new (guint, a_n + b_n);
+  has_id = g_new0 (guint8, n_ids);
+
+  /* Bit 0 is set for ids in the first text and bit 1 for the second */
+  for (i = 0; i < a_n + b_n; i++)
+    has_id[line_ids[i]] |= i < a_n ? 1 : 2;
+
+  for (i = 0; i < n_ids; i++)
+    has_id[i] = has_id[i] == 3;
+
+  a_kept = git_line_diff_discard (line_ids, a_n, has_id,
+                                  kept_ids, index_map);
+  b_kept = git_line_diff_discard (line_ids + a_n, b_n, has_id,
+                                  kept_ids + a_kept, index_map + a_kept);
+
+  kept_matches = git_line_diff_ids (kept_ids, a_kept,
+                                    kept_ids + a_kept, b_kept,
+                                    max_cost);
+
+  /* Map the matches back to the original line numbers. Runs of kept
+     lines might have discarded lines in between so they need to be
+     added one at a time. */
+  for (i = 0; i < kept_matches->len; i++)
+    {
+      const GitLineDiffMatch *match
+        = &g_array_index (kept_matches, GitLineDiffMatch, i);
+
+      for (j = 0; j < match->n_lines; j++)
+        git_line_diff_add_match (state,
+                                 offset + index_map[match->a_line + j],
+                                 offset + index_map[a_kept + match->b_line + j],
+                                 1);
+    }
+
+  g_array_free (kept_matches, TRUE);
+  g_free (has_id);
+  g_free (index_map);
+  g_free (kept_ids);
+  g_free (line_ids);
+}
+
+static GArray *
+git_line_diff_lines (GitLineDiffLine *a_lines,
+                     guint a_n,
+                     GitLineDiffLine *b_lines,
+                     guint b_n,
+                     guint max_cost)
+{
+  GitLineDiffState state;
+  guint prefix = 0, suffix = 0;
+
+  state.matches = g_array_new (FALSE, FALSE, sizeof (GitLineDiffMatch));
+
+  /* Moving between nearby revisions usually only changes a few lines
+     so it is a lot quicker to skip the common ends before hashing */
+  while (prefix < a_n && prefix < b_n
+         && git_line_diff_lines_equal (a_lines + prefix, b_lines + prefix))
+    prefix++;
+
+  while (suffix < a_n - prefix && suffix < b_n - prefix
+         && git_line_diff_lines_equal (a_lines + a_n - suffix - 1,
+                                       b_lines + b_n - suffix - 1))
+    suffix++;
+
+  git_line_diff_add_match (&state, 0, 0, prefix);
+
+  if (prefix + suffix < a_n && prefix + suffix < b_n)
+    {
+      guint a_middle = a_n - prefix - suffix;
+      guint b_middle = b_n - prefix - suffix;
+      GitLineDiffLine *lines = g_new (GitLineDiffLine, a_middle + b_middle);
+
+      memcpy (lines, a_lines + prefix, a_middle * sizeof (GitLineDiffLine));
+      memcpy (lines + a_middle, b_lines + prefix,
+              b_middle * sizeof (GitLineDiffLine));
+
+      git_line_diff_middle (&state, lines, a_middle, b_middle, prefix,
+                            max_cost);
+
+      g_free (lines);
+    }
+
+  git_line_diff_add_match (&state, a_n - suffix, b_n - suffix, suffix);
+
+  return state.matches;
+}
+
+/* Compares two texts that have been split with git_line_diff_split()
+   and returns an array of GitLineDiffMatch in order */
+GArray *
+git_line_diff (const gchar *a_text,
+               const guint *a_starts,
+               guint a_n,
+               const gchar *b_text,
+               const guint *b_starts,
+               guint b_n)
+{
+  GitLineDiffLine *lines = g_new (GitLineDiffLine, a_n + b_n);
+  GArray *matches;
+
+  git_line_diff_fill_lines (lines, a_text, a_starts, a_n);
+  git_line_diff_fill_lines (lines + a_n, b_text, b_starts, b_n);
+
+  matches = git_line_diff_lines (lines, a_n, lines + a_n, b_n, 0);
+
+  g_free (lines);
+
+  return matches;
+}
+
+/* Compares two arrays of nul-terminated lines. This is meant for
+   mapping positions between two versions of a file so max_cost can be
+   used to bound the time it takes. */
+GArray *
+git_line_diff_strings (const gchar * const *a, guint a_n,
+                       const gchar * const *b, guint b_n,
+                       guint max_cost)
+{
+  GitLineDiffLine *lines = g_new (GitLineDiffLine, a_n + b_n);
+  GArray *matches;
+  guint i;
+
+  for (i = 0; i < a_n + b_n; i++)
+    {
+      lines[i].text = i < a_n ? a[i] : b[i - a_n];
+      lines[i].length = strlen (lines[i].text);
+    }
+
+  matches = git_line_diff_lines (lines, a_n, lines + a_n, b_n, max_cost);
+
+  g_free (lines);
+
+  return matches;
+}
+
+/* Returns the line in the second text that corresponds to line in the
+   first text according to the matches. If the line was changed then
+   it is placed at the same distance from the end of the previous
+   unchanged run, but without going past the start of the next one.
+   exact is set to whether the line was unchanged. */
+guint
+git_line_diff_map_line (GArray *matches,
+                        guint line,
+                        guint b_n,
+                        gboolean *exact)
+{
+  guint lo = 0, hi = matches->len;
+  guint b_line;
+
+  if (exact)
+    *exact = FALSE;
+
+  if (b_n == 0)
+    return 0;
+
+  /* Find the first match that starts after the line */
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+
+      if (g_array_index (matches, GitLineDiffMatch, mid).a_line <= line)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo > 0)
+    {
+      const GitLineDiffMatch *prev
+        = &g_array_index (matches, GitLineDiffMatch, lo - 1);
+
+      if (line < prev->a_line + prev->n_lines)
+        {
+          if (exact)
+            *exact = TRUE;
+          return prev->b_line + line - prev->a_line;
+        }
+
+      b_line = prev->b_line + prev->n_lines + line - (prev->a_line
+                                                      + prev->n_lines);
+    }
+  else
+    b_line = line;
+
+  if (lo < matches->len)
+    b_line = MIN (b_line, g_array_index (matches, GitLineDiffMatch, lo).b_line);
+
+  return MIN (b_line, b_n - 1);
+}
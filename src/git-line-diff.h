@@ -0,0 +1,61 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_LINE_DIFF_H__
+#define __GIT_LINE_DIFF_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A run of lines that are the same in both texts. Line numbers count
+   from 0. */
+typedef struct
+{
+  guint a_line, b_line;
+  guint n_lines;
+} GitLineDiffMatch;
+
+guint *git_line_diff_split (const gchar *text,
+                            gsize length,
+                            guint *n_lines);
+
+guint64 git_line_diff_hash (const gchar *text, gsize length);
+
+GArray *git_line_diff_ids (const guint64 *a, guint a_n,
+                           const guint64 *b, guint b_n,
+                           guint max_cost);
+
+GArray *git_line_diff (const gchar *a_text,
+                       const guint *a_starts,
+                       guint a_n,
+                       const gchar *b_text,
+                       const guint *b_starts,
+                       guint b_n);
+
+GArray *git_line_diff_strings (const gchar * const *a, guint a_n,
+                               const gchar * const *b, guint b_n,
+                               guint max_cost);
+
+guint git_line_diff_map_line (GArray *matches,
+                              guint line,
+                              guint b_n,
+                              gboolean *exact);
+
+G_END_DECLS
+
+#endif /* __GIT_LINE_DIFF_H__ */
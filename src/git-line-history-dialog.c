@@ -0,0 +1,618 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-line-history-dialog.h"
+
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include <string.h>
+
+#include "git-common.h"
+#include "git-line-log.h"
+#include "git-marshal.h"
+
+static void git_line_history_dialog_dispose (GObject *object);
+
+static void git_line_history_dialog_on_revision (GitLineLog *log,
+                                                 GitCommit *commit,
+                                                 GitLineHistoryDialog *hdiag);
+static void git_line_history_dialog_on_line (GitLineLog *log,
+                                             const gchar *line,
+                                             GitLineHistoryDialog *hdiag);
+static void git_line_history_dialog_on_completed (GitLineLog *log,
+                                                  const GError *error,
+                                                  GitLineHistoryDialog *hdiag);
+
+static void git_line_history_dialog_stop (GitLineHistoryDialog *hdiag);
+
+static void git_line_history_dialog_on_view_blame (GtkButton *button,
+                                                   gpointer user_data);
+
+static gboolean git_line_history_dialog_on_close_request (GtkWindow *window,
+                                                          gpointer user_data);
+
+static gboolean git_line_history_dialog_on_escape (GtkWidget *widget,
+                                                   GVariant *args,
+                                                   gpointer user_data);
+
+/* Where each commit starts in the text buffer. The path is where the
+   file was in that commit, relative to the top of the repo, as
+   reported by the diff. It is NULL until the diff is seen. */
+typedef struct
+{
+  gint line;
+  GitCommit *commit;
+  gchar *path;
+} GitLineHistoryDialogRevision;
+
+typedef struct
+{
+  GitLineLog *log;
+  guint revision_handler;
+  guint line_handler;
+  guint completed_handler;
+
+  /* Array of GitLineHistoryDialogRevision in order */
+  GArray *revisions;
+
+  /* The file that the history was started from and the top of its
+     repo that the paths in the diffs are relative to */
+  GFile *file;
+  GFile *repo;
+
+  GtkWidget *range_label, *spinner, *log_view;
+  GtkWidget *stop_button, *view_blame_button, *close_button;
+
+  guint stop_handler;
+  guint view_blame_handler;
+  guint close_handler;
+  guint close_request_handler;
+} GitLineHistoryDialogPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE (GitLineHistoryDialog,
+                            git_line_history_dialog,
+                            GTK_TYPE_WINDOW);
+
+enum
+  {
+    VIEW_BLAME,
+
+    LAST_SIGNAL
+  };
+
+static guint client_signals[LAST_SIGNAL];
+
+static void
+git_line_history_dialog_class_init (GitLineHistoryDialogClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_line_history_dialog_dispose;
+
+  client_signals[VIEW_BLAME]
+    = g_signal_new ("view-blame",
+                    G_OBJECT_CLASS_TYPE (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitLineHistoryDialogClass, view_blame),
+                    NULL, NULL,
+                    _git_marshal_VOID__OBJECT_OBJECT,
+                    G_TYPE_NONE, 2,
+                    GIT_TYPE_COMMIT,
+                    G_TYPE_FILE);
+
+  gtk_widget_class_add_binding (GTK_WIDGET_CLASS (klass),
+                                GDK_KEY_Escape,
+                                0, /* mods */
+                                git_line_history_dialog_on_escape,
+                                NULL /* format_string */);
+
+  const char *resource_name = "/uk/co/busydoingnothing/blamebrowse/"
+    "line-history-dialog.ui";
+
+  gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
+                                               resource_name);
+
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                range_label);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                spinner);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                log_view);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                stop_button);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                view_blame_button);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitLineHistoryDialog,
+                                                close_button);
+}
+
+static void
+git_line_history_dialog_init (GitLineHistoryDialog *self)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (self);
+
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  priv->revisions = g_array_new (FALSE, FALSE,
+                                 sizeof (GitLineHistoryDialogRevision));
+
+  priv->log = git_line_log_new ();
+  priv->revision_handler
+    = g_signal_connect (priv->log, "revision",
+                        G_CALLBACK (git_line_history_dialog_on_revision),
+                        self);
+  priv->line_handler
+    = g_signal_connect (priv->log, "line",
+                        G_CALLBACK (git_line_history_dialog_on_line),
+                        self);
+  priv->completed_handler
+    = g_signal_connect (priv->log, "completed",
+                        G_CALLBACK (git_line_history_dialog_on_completed),
+                        self);
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+
+  gtk_text_buffer_create_tag (buffer, "commit",
+                              "weight", PANGO_WEIGHT_BOLD,
+                              NULL);
+  gtk_text_buffer_create_tag (buffer, "file",
+                              "weight", PANGO_WEIGHT_BOLD,
+                              NULL);
+  gtk_text_buffer_create_tag (buffer, "hunk",
+                              "foreground", "#1c71d8",
+                              NULL);
+  gtk_text_buffer_create_tag (buffer, "added",
+                              "foreground", "#26a269",
+                              NULL);
+  gtk_text_buffer_create_tag (buffer, "removed",
+                              "foreground", "#c01c28",
+                              NULL);
+
+  priv->stop_handler =
+    g_signal_connect_swapped (priv->stop_button,
+                              "clicked",
+                              G_CALLBACK (git_line_history_dialog_stop),
+                              self);
+
+  priv->view_blame_handler =
+    g_signal_connect (priv->view_blame_button,
+                      "clicked",
+                      G_CALLBACK (git_line_history_dialog_on_view_blame),
+                      self);
+
+  priv->close_handler =
+    g_signal_connect_swapped (priv->close_button,
+                              "clicked",
+                              G_CALLBACK (gtk_window_close),
+                              self);
+
+  /* There’s no point in carrying on with the log once the window is
+     closed */
+  priv->close_request_handler =
+    g_signal_connect (self,
+                      "close-request",
+                      G_CALLBACK (git_line_history_dialog_on_close_request),
+                      NULL);
+}
+
+static void
+git_line_history_dialog_clear_revisions (GitLineHistoryDialog *hdiag)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+  guint i;
+
+  for (i = 0; i < priv->revisions->len; i++)
+    {
+      GitLineHistoryDialogRevision *revision
+        = &g_array_index (priv->revisions, GitLineHistoryDialogRevision, i);
+
+      g_object_unref (revision->commit);
+      g_free (revision->path);
+    }
+
+  g_array_set_size (priv->revisions, 0);
+}
+
+static void
+git_line_history_dialog_dispose (GObject *object)
+{
+  GitLineHistoryDialog *self = (GitLineHistoryDialog *) object;
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (self);
+
+  if (priv->log)
+    {
+      g_signal_handler_disconnect (priv->log, priv->revision_handler);
+      g_signal_handler_disconnect (priv->log, priv->line_handler);
+      g_signal_handler_disconnect (priv->log, priv->completed_handler);
+      g_object_unref (priv->log);
+      priv->log = NULL;
+    }
+
+  if (priv->revisions)
+    {
+      git_line_history_dialog_clear_revisions (self);
+      g_array_free (priv->revisions, TRUE);
+      priv->revisions = NULL;
+    }
+
+  g_clear_object (&priv->file);
+  g_clear_object (&priv->repo);
+
+  if (priv->close_request_handler)
+    {
+      g_signal_handler_disconnect (self, priv->close_request_handler);
+      priv->close_request_handler = 0;
+    }
+
+  if (priv->stop_button)
+    g_signal_handler_disconnect (priv->stop_button, priv->stop_handler);
+
+  if (priv->view_blame_button)
+    {
+      g_signal_handler_disconnect (priv->view_blame_button,
+                                   priv->view_blame_handler);
+    }
+
+  if (priv->close_button)
+    g_signal_handler_disconnect (priv->close_button, priv->close_handler);
+
+  gtk_widget_dispose_template (GTK_WIDGET (self),
+                               GIT_TYPE_LINE_HISTORY_DIALOG);
+
+  G_OBJECT_CLASS (git_line_history_dialog_parent_class)->dispose (object);
+}
+
+GtkWidget *
+git_line_history_dialog_new (GtkWindow *parent)
+{
+  GtkWidget *self = g_object_new (GIT_TYPE_LINE_HISTORY_DIALOG, NULL);
+
+  if (parent)
+    {
+      gtk_window_set_transient_for (GTK_WINDOW (self), parent);
+      gtk_window_set_destroy_with_parent (GTK_WINDOW (self), TRUE);
+    }
+
+  return self;
+}
+
+static void
+git_line_history_dialog_set_running (GitLineHistoryDialog *hdiag,
+                                     gboolean running)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+
+  if (priv->spinner)
+    gtk_spinner_set_spinning (GTK_SPINNER (priv->spinner), running);
+
+  if (priv->stop_button)
+    gtk_widget_set_sensitive (priv->stop_button, running);
+}
+
+static void
+git_line_history_dialog_append (GitLineHistoryDialog *hdiag,
+                                const gchar *text,
+                                const gchar *tag_name)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+
+  if (priv->log_view == NULL)
+    return;
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+  gchar *valid_text = g_utf8_make_valid (text, -1);
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_end_iter (buffer, &iter);
+
+  if (tag_name)
+    gtk_text_buffer_insert_with_tags_by_name (buffer, &iter,
+                                              valid_text, -1,
+                                              tag_name, NULL);
+  else
+    gtk_text_buffer_insert (buffer, &iter, valid_text, -1);
+
+  gtk_text_buffer_insert (buffer, &iter, "\n", 1);
+
+  g_free (valid_text);
+}
+
+static void
+git_line_history_dialog_on_revision (GitLineLog *log,
+                                     GitCommit *commit,
+                                     GitLineHistoryDialog *hdiag)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+  GitLineHistoryDialogRevision revision;
+
+  if (priv->log_view == NULL)
+    return;
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+
+  if (priv->revisions->len > 0)
+    git_line_history_dialog_append (hdiag, "", NULL);
+
+  revision.line = gtk_text_buffer_get_line_count (buffer) - 1;
+  revision.commit = g_object_ref (commit);
+  revision.path = NULL;
+  g_array_append_val (priv->revisions, revision);
+
+  gchar *header = g_strconcat ("commit ", git_commit_get_hash (commit), NULL);
+  git_line_history_dialog_append (hdiag, header, "commit");
+  g_free (header);
+}
+
+/* Gets the path out of the ‘+++’ line of a diff. Returns NULL if it
+   isn’t a file in the commit. */
+static gchar *
+parse_diff_path (const gchar *name)
+{
+  gchar *path;
+
+  /* Paths with unusual characters are quoted like a C string */
+  if (*name == '"')
+    {
+      const gchar *end = name + 1;
+
+      while (*end && *end != '"')
+        {
+          if (*end == '\\' && end[1])
+            end++;
+          end++;
+        }
+
+      gchar *quoted = g_strndup (name + 1, end - name - 1);
+      path = g_strcompress (quoted);
+      g_free (quoted);
+    }
+  else
+    {
+      /* Git puts a tab after a path that contains a space */
+      gsize length = strlen (name);
+
+      if (length > 0 && name[length - 1] == '\t')
+        length--;
+
+      path = g_strndup (name, length);
+    }
+
+  if (!g_str_has_prefix (path, "b/") || path[2] == '\0')
+    {
+      g_free (path);
+      return NULL;
+    }
+
+  memmove (path, path + 2, strlen (path + 2) + 1);
+
+  return path;
+}
+
+static void
+git_line_history_dialog_on_line (GitLineLog *log,
+                                 const gchar *line,
+                                 GitLineHistoryDialog *hdiag)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+  const gchar *tag_name = NULL;
+
+  /* Remember where the file was in this commit so that blaming it
+     still works after a rename */
+  if (g_str_has_prefix (line, "+++ ") && priv->revisions->len > 0)
+    {
+      GitLineHistoryDialogRevision *revision
+        = &g_array_index (priv->revisions,
+                          GitLineHistoryDialogRevision,
+                          priv->revisions->len - 1);
+
+      if (revision->path == NULL)
+        revision->path = parse_diff_path (line + 4);
+    }
+
+  if (g_str_has_prefix (line, "diff ")
+      || g_str_has_prefix (line, "--- ")
+      || g_str_has_prefix (line, "+++ "))
+    tag_name = "file";
+  else if (g_str_has_prefix (line, "@@"))
+    tag_name = "hunk";
+  else if (*line == '+')
+    tag_name = "added";
+  else if (*line == '-')
+    tag_name = "removed";
+
+  git_line_history_dialog_append (hdiag, line, tag_name);
+}
+
+static void
+git_line_history_dialog_on_completed (GitLineLog *log,
+                                      const GError *error,
+                                      GitLineHistoryDialog *hdiag)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+
+  git_line_history_dialog_set_running (hdiag, FALSE);
+
+  if (error)
+    {
+      if (priv->revisions->len > 0)
+        git_line_history_dialog_append (hdiag, "", NULL);
+      git_line_history_dialog_append (hdiag, error->message, NULL);
+    }
+  else if (priv->revisions->len == 0)
+    git_line_history_dialog_append (hdiag, _("No history was found."), NULL);
+}
+
+/* Kills the git process but keeps whatever has already arrived */
+static void
+git_line_history_dialog_stop (GitLineHistoryDialog *hdiag)
+{
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+
+  if (priv->log && git_line_log_get_running (priv->log))
+    {
+      git_line_log_cancel (priv->log);
+      git_line_history_dialog_set_running (hdiag, FALSE);
+    }
+}
+
+void
+git_line_history_dialog_start (GitLineHistoryDialog *hdiag,
+                               GFile *file,
+                               const gchar *revision,
+                               guint start_line,
+                               guint end_line)
+{
+  GError *error = NULL;
+
+  g_return_if_fail (GIT_IS_LINE_HISTORY_DIALOG (hdiag));
+  g_return_if_fail (file != NULL);
+  g_return_if_fail (start_line >= 1 && end_line >= start_line);
+
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+
+  git_line_log_cancel (priv->log);
+  git_line_history_dialog_clear_revisions (hdiag);
+
+  g_clear_object (&priv->file);
+  g_clear_object (&priv->repo);
+  priv->file = g_object_ref (file);
+  priv->repo = git_find_repo (file);
+
+  if (priv->log_view)
+    {
+      GtkTextBuffer *buffer
+        = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+
+      gtk_text_buffer_set_text (buffer, "", 0);
+    }
+
+  if (priv->range_label)
+    {
+      gchar *basename = g_file_get_basename (file);
+      gchar *label;
+
+      if (start_line == end_line)
+        label = g_strdup_printf (_("Line %u of %s"), start_line, basename);
+      else
+        label = g_strdup_printf (_("Lines %u–%u of %s"),
+                                 start_line, end_line, basename);
+
+      gtk_label_set_text (GTK_LABEL (priv->range_label), label);
+
+      g_free (label);
+      g_free (basename);
+    }
+
+  if (git_line_log_start (priv->log, file, revision,
+                          start_line, end_line,
+                          &error))
+    git_line_history_dialog_set_running (hdiag, TRUE);
+  else
+    {
+      git_line_history_dialog_set_running (hdiag, FALSE);
+      git_line_history_dialog_append (hdiag, error->message, NULL);
+      g_error_free (error);
+    }
+}
+
+static void
+git_line_history_dialog_on_view_blame (GtkButton *button,
+                                       gpointer user_data)
+{
+  GitLineHistoryDialog *hdiag = user_data;
+  GitLineHistoryDialogPrivate *priv =
+    git_line_history_dialog_get_instance_private (hdiag);
+  const GitLineHistoryDialogRevision *found = NULL;
+  GFile *file;
+  GtkTextIter iter;
+  gint line;
+  guint i;
+
+  if (priv->log_view == NULL || priv->revisions->len == 0)
+    return;
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->log_view));
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter,
+                                    gtk_text_buffer_get_insert (buffer));
+  line = gtk_text_iter_get_line (&iter);
+
+  /* Use the revision that the cursor is in */
+  for (i = 0; i < priv->revisions->len; i++)
+    {
+      const GitLineHistoryDialogRevision *revision
+        = &g_array_index (priv->revisions, GitLineHistoryDialogRevision, i);
+
+      if (revision->line > line && found)
+        break;
+
+      found = revision;
+    }
+
+  /* The file might have been somewhere else in that commit */
+  if (found->path && priv->repo)
+    file = g_file_resolve_relative_path (priv->repo, found->path);
+  else
+    file = g_object_ref (priv->file);
+
+  g_signal_emit (hdiag, client_signals[VIEW_BLAME], 0, found->commit, file);
+
+  g_object_unref (file);
+}
+
+static gboolean
+git_line_history_dialog_on_close_request (GtkWindow *window,
+                                          gpointer user_data)
+{
+  git_line_history_dialog_stop (GIT_LINE_HISTORY_DIALOG (window));
+
+  return FALSE;
+}
+
+static gboolean
+git_line_history_dialog_on_escape (GtkWidget *widget,
+                                   GVariant *args,
+                                   gpointer user_data)
+{
+  GitLineHistoryDialog *hdiag = GIT_LINE_HISTORY_DIALOG (widget);
+
+  gtk_window_close (GTK_WINDOW (hdiag));
+
+  return TRUE;
+}
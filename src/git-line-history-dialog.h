@@ -0,0 +1,53 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_LINE_HISTORY_DIALOG_H__
+#define __GIT_LINE_HISTORY_DIALOG_H__
+
+#include <gtk/gtk.h>
+#include "git-commit.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_LINE_HISTORY_DIALOG git_line_history_dialog_get_type ()
+
+G_DECLARE_DERIVABLE_TYPE (GitLineHistoryDialog,
+                          git_line_history_dialog,
+                          GIT,
+                          LINE_HISTORY_DIALOG,
+                          GtkWindow);
+
+struct _GitLineHistoryDialogClass
+{
+  GtkWindowClass parent_class;
+
+  void (* view_blame) (GitLineHistoryDialog *hdiag,
+                       GitCommit *commit,
+                       GFile *file);
+};
+
+GtkWidget *git_line_history_dialog_new (GtkWindow *parent);
+
+void git_line_history_dialog_start (GitLineHistoryDialog *hdiag,
+                                    GFile *file,
+                                    const gchar *revision,
+                                    guint start_line,
+                                    guint end_line);
+
+G_END_DECLS
+
+#endif /* __GIT_LINE_HISTORY_DIALOG_H__ */
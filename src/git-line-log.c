@@ -0,0 +1,318 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-line-log.h"
+
+#include <glib-object.h>
+#include <string.h>
+
+#include "git-commit-bag.h"
+#include "git-common.h"
+#include "git-marshal.h"
+#include "git-oid.h"
+#include "git-reader.h"
+
+static void git_line_log_dispose (GObject *object);
+static void git_line_log_finalize (GObject *object);
+
+struct _GitLineLog
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  GitReader *reader;
+  guint completed_handler;
+  guint line_handler;
+
+  GFile *repo;
+  GString *text;
+} GitLineLogPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitLineLog,
+                                  git_line_log,
+                                  G_TYPE_OBJECT);
+
+enum
+  {
+    REVISION,
+    LINE,
+    COMPLETED,
+
+    LAST_SIGNAL
+  };
+
+static guint client_signals[LAST_SIGNAL];
+
+/* Each commit starts with a line like this. Nothing else can look
+   like it because the message is indented and the lines of the diff
+   start with ‘diff’, ‘---’, ‘+++’, ‘@@’, a space, a plus or a
+   minus. */
+#define GIT_LINE_LOG_COMMIT_PREFIX "commit "
+
+static void
+git_line_log_class_init (GitLineLogClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_line_log_dispose;
+  gobject_class->finalize = git_line_log_finalize;
+
+  client_signals[REVISION]
+    = g_signal_new ("revision",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    0, NULL, NULL,
+                    _git_marshal_VOID__OBJECT,
+                    G_TYPE_NONE, 1,
+                    GIT_TYPE_COMMIT);
+
+  client_signals[LINE]
+    = g_signal_new ("line",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__STRING,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_STRING);
+
+  client_signals[COMPLETED]
+    = g_signal_new ("completed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_POINTER);
+}
+
+static void
+git_line_log_init (GitLineLog *self)
+{
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (self);
+
+  priv->text = g_string_new ("");
+}
+
+/* Stops the process without emitting anything */
+void
+git_line_log_cancel (GitLineLog *log)
+{
+  g_return_if_fail (GIT_IS_LINE_LOG (log));
+
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (log);
+
+  /* Destroying the reader kills the process */
+  if (priv->reader)
+    {
+      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
+      g_signal_handler_disconnect (priv->reader, priv->line_handler);
+      g_object_unref (priv->reader);
+      priv->reader = NULL;
+    }
+
+  if (priv->repo)
+    {
+      g_object_unref (priv->repo);
+      priv->repo = NULL;
+    }
+}
+
+static void
+git_line_log_dispose (GObject *object)
+{
+  git_line_log_cancel ((GitLineLog *) object);
+
+  G_OBJECT_CLASS (git_line_log_parent_class)->dispose (object);
+}
+
+static void
+git_line_log_finalize (GObject *object)
+{
+  GitLineLog *self = (GitLineLog *) object;
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (self);
+
+  g_string_free (priv->text, TRUE);
+
+  G_OBJECT_CLASS (git_line_log_parent_class)->finalize (object);
+}
+
+GitLineLog *
+git_line_log_new (void)
+{
+  GitLineLog *self = g_object_new (GIT_TYPE_LINE_LOG, NULL);
+
+  return self;
+}
+
+gboolean
+git_line_log_get_running (GitLineLog *log)
+{
+  g_return_val_if_fail (GIT_IS_LINE_LOG (log), FALSE);
+
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (log);
+
+  return priv->reader != NULL;
+}
+
+static void
+git_line_log_on_completed (GitReader *reader,
+                           const GError *error,
+                           GitLineLog *log)
+{
+  /* Keep the object alive in case a handler drops the last reference */
+  g_object_ref (log);
+  git_line_log_cancel (log);
+  g_signal_emit (log, client_signals[COMPLETED], 0, error);
+  g_object_unref (log);
+}
+
+static gboolean
+git_line_log_on_line (GitReader *reader,
+                      guint length, const gchar *str,
+                      GitLineLog *log)
+{
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (log);
+  const gsize prefix_length = sizeof (GIT_LINE_LOG_COMMIT_PREFIX) - 1;
+  GitOid oid;
+
+  if (length > 0 && str[length - 1] == '\n')
+    length--;
+
+  if (length > prefix_length
+      && !memcmp (str, GIT_LINE_LOG_COMMIT_PREFIX, prefix_length)
+      && (git_oid_parse_hex (&oid, str + prefix_length,
+                             length - prefix_length)
+          == length - prefix_length))
+    {
+      GitCommit *commit
+        = g_object_ref (git_commit_bag_get_oid (git_commit_bag_get_default (),
+                                                &oid,
+                                                priv->repo));
+
+      g_signal_emit (log, client_signals[REVISION], 0, commit);
+
+      g_object_unref (commit);
+    }
+  else
+    {
+      g_string_truncate (priv->text, 0);
+      g_string_append_len (priv->text, str, length);
+
+      g_signal_emit (log, client_signals[LINE], 0, priv->text->str);
+    }
+
+  /* A handler might have cancelled */
+  return priv->reader == reader;
+}
+
+gboolean
+git_line_log_start (GitLineLog *log,
+                    GFile *file,
+                    const gchar *revision,
+                    guint start_line,
+                    guint end_line,
+                    GError **error)
+{
+  g_return_val_if_fail (GIT_IS_LINE_LOG (log), FALSE);
+  g_return_val_if_fail (file != NULL, FALSE);
+  g_return_val_if_fail (start_line >= 1 && end_line >= start_line, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  GitLineLogPrivate *priv = git_line_log_get_instance_private (log);
+
+  git_line_log_cancel (log);
+
+  GFile *repo = git_find_repo (file);
+
+  if (repo == NULL)
+    {
+      char *parse_name = g_file_get_parse_name (file);
+
+      g_set_error (error, GIT_ERROR, GIT_ERROR_NO_REPO,
+                   "No repo found for %s", parse_name);
+
+      g_free (parse_name);
+
+      return FALSE;
+    }
+
+  char *relative_file = g_file_get_relative_path (repo, file);
+
+  if (relative_file == NULL)
+    {
+      char *parse_name = g_file_get_parse_name (file);
+
+      g_set_error (error,
+                   G_FILE_ERROR,
+                   G_FILE_ERROR_NOENT,
+                   "Couldn’t convert %s to relative path",
+                   parse_name);
+
+      g_free (parse_name);
+      g_object_unref (repo);
+
+      return FALSE;
+    }
+
+  priv->repo = repo;
+  priv->reader = git_reader_new ();
+
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_line_log_on_completed),
+                        log);
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_line_log_on_line),
+                        log);
+
+  gchar *range = g_strdup_printf ("-L%u,%u:%s",
+                                  start_line, end_line,
+                                  relative_file);
+
+  /* Revision can be NULL in which case it will terminate the argument
+     list early and git will start from HEAD */
+  gboolean ret = git_reader_start (priv->reader, repo, error,
+                                   "log",
+                                   "--no-color",
+                                   /* The prefixes are relied on to
+                                      find the path of the file in
+                                      each commit */
+                                   "--src-prefix=a/",
+                                   "--dst-prefix=b/",
+                                   "--format=" GIT_LINE_LOG_COMMIT_PREFIX
+                                   "%H%n"
+                                   "Author: %an <%ae>%n"
+                                   "Date:   %ad%n"
+                                   "%n"
+                                   "    %s%n",
+                                   range,
+                                   revision,
+                                   NULL);
+
+  g_free (range);
+  g_free (relative_file);
+
+  if (!ret)
+    git_line_log_cancel (log);
+
+  return ret;
+}
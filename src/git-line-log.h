@@ -0,0 +1,56 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_LINE_LOG_H__
+#define __GIT_LINE_LOG_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-commit.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_LINE_LOG git_line_log_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitLineLog,
+                      git_line_log,
+                      GIT,
+                      LINE_LOG,
+                      GObject);
+
+/* Runs git log -L to follow the history of a range of lines. The
+   output is passed on a line at a time as it arrives. The ‘revision’
+   signal is emitted with the GitCommit at the start of each commit and
+   then ‘line’ is emitted for each line of its header and diff without
+   the newline. The paths in the diff always have the a/ and b/
+   prefixes regardless of the user’s configuration. */
+
+GitLineLog *git_line_log_new (void);
+
+gboolean git_line_log_start (GitLineLog *log,
+                             GFile *file,
+                             const gchar *revision,
+                             guint start_line,
+                             guint end_line,
+                             GError **error);
+void git_line_log_cancel (GitLineLog *log);
+
+gboolean git_line_log_get_running (GitLineLog *log);
+
+G_END_DECLS
+
+#endif /* __GIT_LINE_LOG_H__ */
@@ -25,7 +25,11 @@
 
 #include "git-source-view.h"
 #include "git-commit-dialog.h"
+#include "git-line-history-dialog.h"
+#include "git-file-revisions.h"
+#include "git-blame-prefetcher.h"
 #include "git-common.h"
+#include "git-application.h"
 
 typedef struct _GitMainWindowHistoryItem GitMainWindowHistoryItem;
 
@@ -40,6 +44,10 @@ static void git_main_window_on_commit_selected (GitSourceView *source_view,
 static void git_main_window_on_view_blame (GitCommitDialog *cdiag,
                                            GitCommit *commit,
                                            GitMainWindow *main_window);
+static void git_main_window_on_blame_previous (GitSourceView *source_view,
+                                               GFile *file,
+                                               GitCommit *commit,
+                                               GitMainWindow *main_window);
 
 static void git_main_window_free_history_item (GitMainWindowHistoryItem *item);
 
@@ -55,9 +63,20 @@ static void git_main_window_on_back (GSimpleAction *action,
 static void git_main_window_on_forward (GSimpleAction *action,
                                         GVariant *parameter,
                                         gpointer user_data);
+static void git_main_window_on_line_history (GSimpleAction *action,
+                                             GVariant *parameter,
+                                             gpointer user_data);
+static void git_main_window_on_follow_moved_lines (GSimpleAction *action,
+                                                   GVariant *value,
+                                                   gpointer user_data);
 
 static void git_main_window_on_revision (GtkText *entry,
                                          GitMainWindow *main_window);
+static void git_main_window_on_slider_changed (GtkRange *range,
+                                               GitMainWindow *main_window);
+static void git_main_window_on_file_revisions (GitFileRevisions *revisions,
+                                               const GError *error,
+                                               GitMainWindow *main_window);
 
 struct _GitMainWindow
 {
@@ -67,13 +86,24 @@ struct _GitMainWindow
 typedef struct
 {
   GtkWidget *revision_bar, *source_view, *menu_button;
+  GtkWidget *revision_slider;
   GtkWidget *commit_dialog;
+  GtkWidget *line_history_dialog;
 
   GCancellable *file_dialog_cancellable;
 
   guint commit_selected_handler;
+  guint blame_previous_handler;
   guint view_blame_handler;
+  guint line_history_view_blame_handler;
   guint revision_activated_handler;
+  guint slider_changed_handler;
+
+  /* The commits that touched the current file, used for the slider,
+     and the blames of them that are done in the background */
+  GitFileRevisions *file_revisions;
+  guint file_revisions_handler;
+  GitBlamePrefetcher *prefetcher;
 
   GList *history;
   GList *history_pos;
@@ -98,6 +128,10 @@ git_main_window_actions[] =
     { .name = "about", .activate = git_main_window_on_about },
     { .name = "back", .activate = git_main_window_on_back },
     { .name = "forward", .activate = git_main_window_on_forward },
+    { .name = "line-history", .activate = git_main_window_on_line_history },
+    { .name = "follow-moved-lines",
+      .state = "false",
+      .change_state = git_main_window_on_follow_moved_lines },
   };
 
 static void
@@ -122,6 +156,34 @@ git_main_window_class_init (GitMainWindowClass *klass)
   gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
                                                 GitMainWindow,
                                                 menu_button);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitMainWindow,
+                                                revision_slider);
+}
+
+static gchar *
+git_main_window_format_slider_value (GtkScale *scale,
+                                     double value,
+                                     gpointer user_data)
+{
+  GitMainWindow *main_window = user_data;
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  guint n_revisions
+    = git_file_revisions_get_n_revisions (priv->file_revisions);
+  guint index = value;
+
+  /* The working copy comes after the newest commit */
+  if (index == n_revisions)
+    return g_strdup (_("Working copy"));
+
+  if (index > n_revisions)
+    return g_strdup ("");
+
+  /* Show an abbreviated hash like git does */
+  return g_strdup_printf ("%.7s",
+                          git_file_revisions_get_revision
+                          (priv->file_revisions, index));
 }
 
 static void
@@ -148,9 +210,28 @@ git_main_window_init (GitMainWindow *self)
                         G_CALLBACK (git_main_window_on_revision),
                         self);
 
+  priv->file_revisions = git_file_revisions_new ();
+  priv->file_revisions_handler
+    = g_signal_connect (priv->file_revisions, "completed",
+                        G_CALLBACK (git_main_window_on_file_revisions),
+                        self);
+
+  gtk_range_set_increments (GTK_RANGE (priv->revision_slider), 1.0, 10.0);
+  gtk_scale_set_format_value_func (GTK_SCALE (priv->revision_slider),
+                                   git_main_window_format_slider_value,
+                                   self,
+                                   NULL);
+  priv->slider_changed_handler
+    = g_signal_connect (priv->revision_slider, "value-changed",
+                        G_CALLBACK (git_main_window_on_slider_changed),
+                        self);
+
   priv->commit_selected_handler = g_signal_connect
     (priv->source_view, "commit-selected",
      G_CALLBACK (git_main_window_on_commit_selected), self);
+  priv->blame_previous_handler = g_signal_connect
+    (priv->source_view, "blame-previous",
+     G_CALLBACK (git_main_window_on_blame_previous), self);
 
   const char *menu_resource = "/uk/co/busydoingnothing/blamebrowse/menu.ui";
   GtkBuilder *builder = gtk_builder_new_from_resource (menu_resource);
@@ -179,6 +260,8 @@ git_main_window_dispose (GObject *object)
     {
       g_signal_handler_disconnect (priv->source_view,
                                    priv->commit_selected_handler);
+      g_signal_handler_disconnect (priv->source_view,
+                                   priv->blame_previous_handler);
     }
 
   if (priv->revision_bar)
@@ -187,6 +270,28 @@ git_main_window_dispose (GObject *object)
                                    priv->revision_activated_handler);
     }
 
+  if (priv->revision_slider)
+    {
+      g_signal_handler_disconnect (priv->revision_slider,
+                                   priv->slider_changed_handler);
+      gtk_scale_set_format_value_func (GTK_SCALE (priv->revision_slider),
+                                       NULL, NULL, NULL);
+    }
+
+  if (priv->file_revisions)
+    {
+      g_signal_handler_disconnect (priv->file_revisions,
+                                   priv->file_revisions_handler);
+      g_object_unref (priv->file_revisions);
+      priv->file_revisions = NULL;
+    }
+
+  if (priv->prefetcher)
+    {
+      g_object_unref (priv->prefetcher);
+      priv->prefetcher = NULL;
+    }
+
   if (priv->commit_dialog)
     {
       g_signal_handler_disconnect (priv->commit_dialog,
@@ -195,6 +300,14 @@ git_main_window_dispose (GObject *object)
       priv->commit_dialog = NULL;
     }
 
+  if (priv->line_history_dialog)
+    {
+      g_signal_handler_disconnect (priv->line_history_dialog,
+                                   priv->line_history_view_blame_handler);
+      g_object_unref (priv->line_history_dialog);
+      priv->line_history_dialog = NULL;
+    }
+
   if (priv->back_action)
     {
       g_object_unref (priv->back_action);
@@ -230,10 +343,88 @@ git_main_window_new (GtkApplication *app)
   GtkWidget *self = g_object_new (GIT_TYPE_MAIN_WINDOW,
                                   "application", app,
                                   NULL);
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (GIT_MAIN_WINDOW (self));
+
+  /* Share the blame results with all of the other windows */
+  if (GIT_IS_APPLICATION (app) && priv->source_view)
+    {
+      GitSourceCache *cache =
+        git_application_get_source_cache (GIT_APPLICATION (app));
+
+      git_source_view_set_cache (GIT_SOURCE_VIEW (priv->source_view), cache);
+
+      /* The revisions either side of the current one are blamed in
+         the background so that the slider can move to them
+         instantly */
+      priv->prefetcher = git_blame_prefetcher_new (cache);
+    }
 
   return self;
 }
 
+/* Moves the slider to the revision without blaming it again */
+static void
+git_main_window_sync_slider (GitMainWindow *main_window,
+                             const gchar *revision)
+{
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  guint n_revisions
+    = git_file_revisions_get_n_revisions (priv->file_revisions);
+  gint index;
+
+  if (n_revisions == 0)
+    return;
+
+  /* The working copy has its own position after the newest commit */
+  if (revision == NULL)
+    index = n_revisions;
+  else
+    {
+      index = git_file_revisions_find (priv->file_revisions, revision);
+
+      /* Anything that isn’t one of the commits, such as a branch
+         name, is most likely to be near the newest one */
+      if (index < 0)
+        index = n_revisions - 1;
+    }
+
+  g_signal_handler_block (priv->revision_slider,
+                          priv->slider_changed_handler);
+  gtk_range_set_value (GTK_RANGE (priv->revision_slider), index);
+  g_signal_handler_unblock (priv->revision_slider,
+                            priv->slider_changed_handler);
+
+  if (priv->prefetcher)
+    git_blame_prefetcher_set_position (priv->prefetcher, index);
+}
+
+static void
+git_main_window_update_slider (GitMainWindow *main_window,
+                               GFile *file,
+                               const gchar *revision)
+{
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  GFile *old_file = git_file_revisions_get_file (priv->file_revisions);
+
+  if (old_file && g_file_equal (old_file, file))
+    {
+      git_main_window_sync_slider (main_window, revision);
+      return;
+    }
+
+  /* The slider is shown again once the list of revisions for the new
+     file is ready */
+  gtk_widget_set_visible (priv->revision_slider, FALSE);
+
+  if (priv->prefetcher)
+    git_blame_prefetcher_set_revisions (priv->prefetcher, NULL);
+
+  git_file_revisions_fetch (priv->file_revisions, file, NULL);
+}
+
 static void
 git_main_window_do_set_file (GitMainWindow *main_window,
                              GFile *file,
@@ -249,6 +440,9 @@ git_main_window_do_set_file (GitMainWindow *main_window,
   if (priv->revision_bar)
     gtk_editable_set_text (GTK_EDITABLE (priv->revision_bar),
                            revision ? revision : "");
+
+  if (priv->revision_slider)
+    git_main_window_update_slider (main_window, file, revision);
 }
 
 static void
@@ -350,6 +544,18 @@ git_main_window_on_view_blame (GitCommitDialog *cdiag,
   gtk_widget_set_visible (GTK_WIDGET (cdiag), FALSE);
 }
 
+/* The blame already knows which commit and path the lines came from
+   so this can go straight there without asking git for the parents.
+   The file can differ from the current one if it was renamed. */
+static void
+git_main_window_on_blame_previous (GitSourceView *source_view,
+                                   GFile *file,
+                                   GitCommit *commit,
+                                   GitMainWindow *main_window)
+{
+  git_main_window_set_file (main_window, file, git_commit_get_hash (commit));
+}
+
 static void
 git_main_window_on_commit_selected (GitSourceView *source_view,
                                     GitCommit *commit,
@@ -498,6 +704,88 @@ git_main_window_on_forward (GSimpleAction *action,
     }
 }
 
+static void
+git_main_window_on_line_history_view_blame (GitLineHistoryDialog *hdiag,
+                                            GitCommit *commit,
+                                            GFile *file,
+                                            GitMainWindow *main_window)
+{
+  git_main_window_set_file (main_window, file, git_commit_get_hash (commit));
+}
+
+/* Turns on the slower blame that is refined in the background and
+   follows lines that were moved or copied */
+static void
+git_main_window_on_follow_moved_lines (GSimpleAction *action,
+                                       GVariant *value,
+                                       gpointer user_data)
+{
+  GitMainWindow *main_window = user_data;
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  gboolean refine = g_variant_get_boolean (value);
+
+  g_simple_action_set_state (action, value);
+
+  if (priv->prefetcher)
+    git_blame_prefetcher_set_refine (priv->prefetcher, refine);
+
+  if (priv->source_view)
+    git_source_view_set_refine (GIT_SOURCE_VIEW (priv->source_view), refine);
+}
+
+/* Shows the history of the selected lines with a single git log -L
+   rather than having to blame each revision in turn */
+static void
+git_main_window_on_line_history (GSimpleAction *action,
+                                 GVariant *parameter,
+                                 gpointer user_data)
+{
+  GitMainWindow *main_window = user_data;
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  guint start_line, end_line;
+  gchar *revision;
+
+  /* For the working copy this maps the lines to HEAD because that is
+     where git log starts */
+  if (priv->history_pos == NULL
+      || priv->source_view == NULL
+      || !git_source_view_get_history_range (GIT_SOURCE_VIEW
+                                             (priv->source_view),
+                                             &revision,
+                                             &start_line, &end_line))
+    return;
+
+  GitMainWindowHistoryItem *item
+    = (GitMainWindowHistoryItem *) priv->history_pos->data;
+
+  if (priv->line_history_dialog == NULL)
+    {
+      priv->line_history_dialog
+        = git_line_history_dialog_new (GTK_WINDOW (main_window));
+      g_object_ref_sink (priv->line_history_dialog);
+
+      /* Keep the window alive when it is closed */
+      gtk_window_set_hide_on_close (GTK_WINDOW (priv->line_history_dialog),
+                                    TRUE);
+
+      priv->line_history_view_blame_handler = g_signal_connect
+              (priv->line_history_dialog, "view-blame",
+               G_CALLBACK (git_main_window_on_line_history_view_blame),
+               main_window);
+    }
+
+  git_line_history_dialog_start (GIT_LINE_HISTORY_DIALOG
+                                 (priv->line_history_dialog),
+                                 item->file, revision,
+                                 start_line, end_line);
+
+  g_free (revision);
+
+  gtk_window_present (GTK_WINDOW (priv->line_history_dialog));
+}
+
 static void
 git_main_window_on_revision (GtkText *entry,
                              GitMainWindow *main_window)
@@ -522,3 +810,67 @@ git_main_window_on_revision (GtkText *entry,
       g_free (revision);
     }
 }
+
+static void
+git_main_window_on_file_revisions (GitFileRevisions *revisions,
+                                   const GError *error,
+                                   GitMainWindow *main_window)
+{
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  guint n_revisions = git_file_revisions_get_n_revisions (revisions);
+
+  /* There’s always the working copy so there’s something to slide
+     through as long as there is a commit */
+  if (error || n_revisions < 1 || priv->history_pos == NULL)
+    return;
+
+  GitMainWindowHistoryItem *item
+    = (GitMainWindowHistoryItem *) priv->history_pos->data;
+
+  g_signal_handler_block (priv->revision_slider,
+                          priv->slider_changed_handler);
+  gtk_range_set_range (GTK_RANGE (priv->revision_slider),
+                       0.0, n_revisions);
+  g_signal_handler_unblock (priv->revision_slider,
+                            priv->slider_changed_handler);
+
+  if (priv->prefetcher)
+    git_blame_prefetcher_set_revisions (priv->prefetcher, revisions);
+
+  git_main_window_sync_slider (main_window, item->revision);
+
+  gtk_widget_set_visible (priv->revision_slider, TRUE);
+}
+
+/* Dragging the slider replaces the revision of the current history
+   item rather than adding a new one for every step */
+static void
+git_main_window_on_slider_changed (GtkRange *range,
+                                   GitMainWindow *main_window)
+{
+  GitMainWindowPrivate *priv =
+    git_main_window_get_instance_private (main_window);
+  guint n_revisions
+    = git_file_revisions_get_n_revisions (priv->file_revisions);
+  guint index = gtk_range_get_value (range);
+
+  if (priv->history_pos == NULL || index > n_revisions)
+    return;
+
+  GitMainWindowHistoryItem *item
+    = (GitMainWindowHistoryItem *) priv->history_pos->data;
+  /* The last position is the working copy */
+  const gchar *revision
+    = (index < n_revisions
+       ? git_file_revisions_get_revision (priv->file_revisions, index)
+       : NULL);
+
+  if (g_strcmp0 (item->revision, revision) == 0)
+    return;
+
+  g_free (item->revision);
+  item->revision = g_strdup (revision);
+
+  git_main_window_do_set_file (main_window, item->file, item->revision);
+}
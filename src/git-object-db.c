@@ -0,0 +1,1388 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-object-db.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "git-common.h"
+#include "git-oid.h"
+
+/* A read-only view of the object database of a repository so that
+   objects can be read without running git. Loose objects are
+   inflated directly and pack files are memory-mapped and searched
+   through their index. Deltas are resolved here and the bases that
+   they use are kept in a small cache because objects in the same
+   delta chain tend to be read together. Object directories listed
+   in objects/info/alternates are searched after the repository’s
+   own. The database can be used from several threads at once. */
+
+#define GIT_OBJECT_DB_PACK_IDX_SIGNATURE 0xff744f63 /* “\377tOc” */
+
+#define GIT_OBJECT_DB_PACK_OFS_DELTA 6
+#define GIT_OBJECT_DB_PACK_REF_DELTA 7
+
+/* Limits to stop a corrupt pack from sending us round in circles */
+#define GIT_OBJECT_DB_MAX_DELTA_CHAIN 10000
+#define GIT_OBJECT_DB_MAX_REF_DEPTH 64
+
+/* git doesn’t follow alternates that are nested deeper than this */
+#define GIT_OBJECT_DB_MAX_ALTERNATE_DEPTH 5
+
+/* Deflate can’t compress by more than about 1032 to 1, so an object
+   that claims to be bigger than that is corrupt. Checking stops a bad
+   header from making us allocate a huge buffer. */
+#define GIT_OBJECT_DB_MAX_DEFLATE_RATIO 1032
+
+/* Don’t look for new pack files more often than this */
+#define GIT_OBJECT_DB_RESCAN_INTERVAL G_USEC_PER_SEC
+
+/* Readers keep a reference on the pack while they use it without the
+   mutex so that a rescan can’t unmap it under them */
+typedef struct
+{
+  gint ref_count;
+
+  GMappedFile *idx_file;
+  GMappedFile *pack_file;
+
+  const guint8 *pack;
+  gsize pack_size;
+
+  guint32 n_objects;
+  const guint8 *fanout;
+  const guint8 *oids;
+  const guint8 *offsets;
+  const guint8 *large_offsets;
+  guint32 n_large_offsets;
+} GitObjectDbPack;
+
+typedef struct
+{
+  const GitObjectDbPack *pack;
+  guint64 offset;
+} GitObjectDbCacheKey;
+
+typedef struct
+{
+  GitObjectDbCacheKey key;
+  GitObjectType type;
+  GBytes *data;
+  GList link;
+} GitObjectDbCacheEntry;
+
+struct _GitObjectDb
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  /* The repository’s objects directory followed by its alternates,
+     or NULL if the repository isn’t local */
+  GPtrArray *objects_dirs;
+  guint8 hash_len;
+
+  /* Protects the pack list and the delta cache below. Objects are
+   inflated and deltas applied without it. */
+  GMutex mutex;
+
+  GPtrArray *packs;
+  gint64 last_scan_time;
+  /* Incremented whenever the packs are replaced so that bases read
+     from an old pack aren’t added to the cache */
+  guint pack_generation;
+
+  /* Delta bases keyed by their pack and offset */
+  GHashTable *delta_cache;
+  GQueue delta_lru;
+  gsize delta_cache_size;
+} GitObjectDbPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitObjectDb,
+                                  git_object_db,
+                                  G_TYPE_OBJECT);
+
+static void git_object_db_finalize (GObject *object);
+
+static GBytes *git_object_db_read_internal (GitObjectDb *db,
+                                            const GitOid *oid,
+                                            GitObjectType *type,
+                                            guint depth,
+                                            GError **error);
+
+static void
+git_object_db_class_init (GitObjectDbClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = git_object_db_finalize;
+}
+
+static GitObjectDbPack *
+git_object_db_ref_pack (GitObjectDbPack *pack)
+{
+  g_atomic_int_inc (&pack->ref_count);
+
+  return pack;
+}
+
+static void
+git_object_db_unref_pack (GitObjectDbPack *pack)
+{
+  if (g_atomic_int_dec_and_test (&pack->ref_count))
+    {
+      g_mapped_file_unref (pack->idx_file);
+      g_mapped_file_unref (pack->pack_file);
+      g_slice_free (GitObjectDbPack, pack);
+    }
+}
+
+static guint
+git_object_db_hash_cache_key (gconstpointer data)
+{
+  const GitObjectDbCacheKey *key = data;
+
+  return g_direct_hash (key->pack) ^ (guint) (key->offset * 2654435761u);
+}
+
+static gboolean
+git_object_db_equal_cache_key (gconstpointer a, gconstpointer b)
+{
+  const GitObjectDbCacheKey *key_a = a, *key_b = b;
+
+  return key_a->pack == key_b->pack && key_a->offset == key_b->offset;
+}
+
+static void
+git_object_db_free_cache_entry (GitObjectDbCacheEntry *entry)
+{
+  g_bytes_unref (entry->data);
+  g_slice_free (GitObjectDbCacheEntry, entry);
+}
+
+static void
+git_object_db_init (GitObjectDb *self)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (self);
+
+  g_mutex_init (&priv->mutex);
+  priv->hash_len = GIT_OID_SHA1_LENGTH;
+  priv->packs
+    = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                      git_object_db_unref_pack);
+  priv->delta_cache
+    = g_hash_table_new_full (git_object_db_hash_cache_key,
+                             git_object_db_equal_cache_key,
+                             NULL,
+                             (GDestroyNotify) git_object_db_free_cache_entry);
+  g_queue_init (&priv->delta_lru);
+}
+
+static void
+git_object_db_finalize (GObject *object)
+{
+  GitObjectDb *self = (GitObjectDb *) object;
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (self);
+
+  /* The cache keys point to the packs so it has to go first */
+  g_hash_table_destroy (priv->delta_cache);
+  g_ptr_array_free (priv->packs, TRUE);
+  g_mutex_clear (&priv->mutex);
+  if (priv->objects_dirs)
+    g_ptr_array_free (priv->objects_dirs, TRUE);
+
+  G_OBJECT_CLASS (git_object_db_parent_class)->finalize (object);
+}
+
+static inline guint32
+git_object_db_get_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16)
+    | ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+static GitObjectDbPack *
+git_object_db_open_pack (GitObjectDb *db, const gchar *idx_filename)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  GitObjectDbPack *pack = g_slice_new0 (GitObjectDbPack);
+  const guint8 *idx;
+  gsize idx_size, table_size;
+  gchar *pack_filename;
+  guint8 hash_len = priv->hash_len;
+
+  pack->idx_file = g_mapped_file_new (idx_filename, FALSE, NULL);
+  if (pack->idx_file == NULL)
+    goto error;
+
+  idx = (const guint8 *) g_mapped_file_get_contents (pack->idx_file);
+  idx_size = g_mapped_file_get_length (pack->idx_file);
+
+  /* Only version 2 of the index is supported. That has been the
+     default since git 1.5.2. */
+  if (idx_size < 8 + 256 * 4
+      || git_object_db_get_be32 (idx) != GIT_OBJECT_DB_PACK_IDX_SIGNATURE
+      || git_object_db_get_be32 (idx + 4) != 2)
+    goto error;
+
+  pack->fanout = idx + 8;
+  pack->n_objects = git_object_db_get_be32 (pack->fanout + 255 * 4);
+
+  /* Each object has an id, a CRC and a 32-bit offset. The index ends
+     with the checksum of the pack and of itself. */
+  table_size = 8 + 256 * 4 + (gsize) pack->n_objects * (hash_len + 8);
+  if (idx_size < table_size + 2 * hash_len)
+    goto error;
+
+  pack->oids = pack->fanout + 256 * 4;
+  pack->offsets = pack->oids + (gsize) pack->n_objects * (hash_len + 4);
+  pack->large_offsets = pack->offsets + (gsize) pack->n_objects * 4;
+  pack->n_large_offsets = (idx_size - table_size - 2 * hash_len) / 8;
+
+  /* Swap the “idx” extension for “pack” */
+  pack_filename = g_strdup_printf ("%.*spack",
+                                   (int) (strlen (idx_filename) - 3),
+                                   idx_filename);
+  pack->pack_file = g_mapped_file_new (pack_filename, FALSE, NULL);
+  g_free (pack_filename);
+
+  if (pack->pack_file == NULL)
+    goto error;
+
+  pack->pack = (const guint8 *) g_mapped_file_get_contents (pack->pack_file);
+  pack->pack_size = g_mapped_file_get_length (pack->pack_file);
+
+  if (pack->pack_size < 12 + hash_len
+      || memcmp (pack->pack, "PACK", 4)
+      || (git_object_db_get_be32 (pack->pack + 4) != 2
+          && git_object_db_get_be32 (pack->pack + 4) != 3)
+      || git_object_db_get_be32 (pack->pack + 8) != pack->n_objects)
+    goto error;
+
+  pack->ref_count = 1;
+
+  return pack;
+
+ error:
+  if (pack->idx_file)
+    g_mapped_file_unref (pack->idx_file);
+  if (pack->pack_file)
+    g_mapped_file_unref (pack->pack_file);
+  g_slice_free (GitObjectDbPack, pack);
+
+  return NULL;
+}
+
+static void
+git_object_db_add_packs (GitObjectDb *db,
+                         const gchar *objects_dir,
+                         GPtrArray *packs)
+{
+  gchar *pack_dir = g_build_filename (objects_dir, "pack", NULL);
+  GDir *dir = g_dir_open (pack_dir, 0, NULL);
+  const gchar *name;
+
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          if (g_str_has_prefix (name, "pack-")
+              && g_str_has_suffix (name, ".idx"))
+            {
+              gchar *filename = g_build_filename (pack_dir, name, NULL);
+              GitObjectDbPack *pack = git_object_db_open_pack (db, filename);
+
+              if (pack)
+                g_ptr_array_add (packs, pack);
+
+              g_free (filename);
+            }
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_free (pack_dir);
+}
+
+/* Opens the packs without the mutex and then swaps them in */
+static void
+git_object_db_scan_packs (GitObjectDb *db)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  GPtrArray *packs, *old_packs;
+  guint i;
+
+  packs = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                          git_object_db_unref_pack);
+
+  for (i = 0; i < priv->objects_dirs->len; i++)
+    git_object_db_add_packs (db,
+                             g_ptr_array_index (priv->objects_dirs, i),
+                             packs);
+
+  g_mutex_lock (&priv->mutex);
+
+  /* The cached bases belong to the old packs */
+  g_hash_table_remove_all (priv->delta_cache);
+  g_queue_init (&priv->delta_lru);
+  priv->delta_cache_size = 0;
+
+  old_packs = priv->packs;
+  priv->packs = packs;
+  priv->pack_generation++;
+
+  g_mutex_unlock (&priv->mutex);
+
+  /* Readers might still be using some of them */
+  g_ptr_array_free (old_packs, TRUE);
+}
+
+/* Repositories using SHA-256 say so in their config */
+static guint8
+git_object_db_read_hash_len (const gchar *common_path)
+{
+  gchar *config_filename = g_build_filename (common_path, "config", NULL);
+  gchar *contents;
+  guint8 hash_len = GIT_OID_SHA1_LENGTH;
+
+  if (g_file_get_contents (config_filename, &contents, NULL, NULL))
+    {
+      gchar **lines = g_strsplit (contents, "\n", -1);
+
+      for (guint i = 0; lines[i]; i++)
+        {
+          gchar *line = g_ascii_strdown (lines[i], -1);
+
+          if (strstr (line, "objectformat") && strstr (line, "sha256"))
+            hash_len = GIT_OID_SHA256_LENGTH;
+
+          g_free (line);
+        }
+
+      g_strfreev (lines);
+      g_free (contents);
+    }
+
+  g_free (config_filename);
+
+  return hash_len;
+}
+
+/* Adds the object directories listed in the alternates file of
+   objects_dir, and then their alternates in turn */
+static void
+git_object_db_add_alternates (GPtrArray *objects_dirs,
+                              const gchar *objects_dir,
+                              guint depth)
+{
+  gchar *filename = g_build_filename (objects_dir,
+                                      "info", "alternates",
+                                      NULL);
+  gchar *contents;
+
+  if (depth <= GIT_OBJECT_DB_MAX_ALTERNATE_DEPTH
+      && g_file_get_contents (filename, &contents, NULL, NULL))
+    {
+      gchar **lines = g_strsplit (contents, "\n", -1);
+
+      for (guint i = 0; lines[i]; i++)
+        {
+          gchar *line = lines[i], *path, *canonical;
+
+          if (*line == '\0' || *line == '#')
+            continue;
+
+          /* Paths with unusual characters are quoted like a C
+             string */
+          if (*line == '"' && g_str_has_suffix (line + 1, "\""))
+            {
+              line[strlen (line) - 1] = '\0';
+              path = g_strcompress (line + 1);
+            }
+          else
+            path = g_strdup (line);
+
+          /* Relative paths are relative to the objects directory */
+          canonical = g_canonicalize_filename (path, objects_dir);
+          g_free (path);
+
+          if (g_ptr_array_find_with_equal_func (objects_dirs,
+                                                canonical,
+                                                g_str_equal,
+                                                NULL))
+            g_free (canonical);
+          else
+            {
+              g_ptr_array_add (objects_dirs, canonical);
+              git_object_db_add_alternates (objects_dirs,
+                                            canonical,
+                                            depth + 1);
+            }
+        }
+
+      g_strfreev (lines);
+      g_free (contents);
+    }
+
+  g_free (filename);
+}
+
+GitObjectDb *
+git_object_db_new (GFile *common_dir)
+{
+  g_return_val_if_fail (G_IS_FILE (common_dir), NULL);
+
+  GitObjectDb *self = g_object_new (GIT_TYPE_OBJECT_DB, NULL);
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (self);
+  gchar *common_path = g_file_get_path (common_dir);
+
+  if (common_path)
+    {
+      gchar *objects_dir = g_build_filename (common_path, "objects", NULL);
+
+      priv->objects_dirs = g_ptr_array_new_with_free_func (g_free);
+      g_ptr_array_add (priv->objects_dirs, objects_dir);
+      git_object_db_add_alternates (priv->objects_dirs, objects_dir, 1);
+
+      priv->hash_len = git_object_db_read_hash_len (common_path);
+      priv->last_scan_time = g_get_monotonic_time ();
+      git_object_db_scan_packs (self);
+      g_free (common_path);
+    }
+
+  return self;
+}
+
+/* Inflates exactly out_size bytes from the start of the compressed
+   data. The returned buffer has an extra nul byte at the end. */
+static guint8 *
+git_object_db_inflate (const guint8 *in, gsize in_size, gsize out_size)
+{
+  z_stream stream;
+  guint8 *out;
+  int ret;
+
+  if (out_size / GIT_OBJECT_DB_MAX_DEFLATE_RATIO > in_size)
+    return NULL;
+
+  out = g_malloc (out_size + 1);
+
+  memset (&stream, 0, sizeof stream);
+
+  if (inflateInit (&stream) != Z_OK)
+    {
+      g_free (out);
+      return NULL;
+    }
+
+  stream.next_in = (Bytef *) in;
+  stream.avail_in = MIN (in_size, G_MAXUINT);
+  stream.next_out = out;
+  stream.avail_out = out_size;
+
+  do
+    ret = inflate (&stream, Z_FINISH);
+  while (ret == Z_OK && stream.avail_out > 0);
+
+  inflateEnd (&stream);
+
+  if (ret != Z_STREAM_END || stream.total_out != out_size)
+    {
+      g_free (out);
+      return NULL;
+    }
+
+  out[out_size] = '\0';
+
+  return out;
+}
+
+static gboolean
+git_object_db_find_in_pack (GitObjectDb *db,
+                            const GitObjectDbPack *pack,
+                            const GitOid *oid,
+                            guint64 *offset)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  guint32 lo, hi;
+
+  lo = oid->id[0] == 0
+    ? 0
+    : git_object_db_get_be32 (pack->fanout + (oid->id[0] - 1) * 4);
+  hi = git_object_db_get_be32 (pack->fanout + oid->id[0] * 4);
+
+  if (hi > pack->n_objects)
+    return FALSE;
+
+  while (lo < hi)
+    {
+      guint32 mid = lo + (hi - lo) / 2;
+      int cmp = memcmp (oid->id,
+                        pack->oids + (gsize) mid * priv->hash_len,
+                        priv->hash_len);
+
+      if (cmp == 0)
+        {
+          guint32 small = git_object_db_get_be32 (pack->offsets
+                                                  + (gsize) mid * 4);
+
+          if (small & 0x80000000)
+            {
+              guint32 index = small & 0x7fffffff;
+              const guint8 *p;
+
+              if (index >= pack->n_large_offsets)
+                return FALSE;
+
+              p = pack->large_offsets + (gsize) index * 8;
+              *offset = ((guint64) git_object_db_get_be32 (p) << 32)
+                | git_object_db_get_be32 (p + 4);
+            }
+          else
+            *offset = small;
+
+          return TRUE;
+        }
+      else if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return FALSE;
+}
+
+typedef struct
+{
+  int type;
+  gsize size;
+  /* Offset of the start of the entry */
+  guint64 offset;
+  /* Offset of the compressed data */
+  guint64 data_offset;
+  /* For OFS_DELTA */
+  guint64 base_offset;
+  /* For REF_DELTA */
+  GitOid base_oid;
+} GitObjectDbPackEntry;
+
+static gboolean
+git_object_db_parse_pack_entry (GitObjectDb *db,
+                                const GitObjectDbPack *pack,
+                                guint64 offset,
+                                GitObjectDbPackEntry *entry)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  /* Don’t read into the checksum at the end */
+  guint64 end = pack->pack_size - priv->hash_len;
+  const guint8 *p = pack->pack;
+  guint8 c;
+  int shift;
+
+  if (offset < 12 || offset >= end)
+    return FALSE;
+
+  entry->offset = offset;
+
+  c = p[offset++];
+  entry->type = (c >> 4) & 7;
+  entry->size = c & 15;
+  shift = 4;
+
+  while (c & 0x80)
+    {
+      if (offset >= end || shift > 57)
+        return FALSE;
+      c = p[offset++];
+      entry->size |= (gsize) (c & 0x7f) << shift;
+      shift += 7;
+    }
+
+  switch (entry->type)
+    {
+    case GIT_OBJECT_TYPE_COMMIT:
+    case GIT_OBJECT_TYPE_TREE:
+    case GIT_OBJECT_TYPE_BLOB:
+    case GIT_OBJECT_TYPE_TAG:
+      break;
+
+    case GIT_OBJECT_DB_PACK_OFS_DELTA:
+      {
+        guint64 base_distance;
+
+        if (offset >= end)
+          return FALSE;
+        c = p[offset++];
+        base_distance = c & 0x7f;
+
+        while (c & 0x80)
+          {
+            if (offset >= end || base_distance > (G_MAXUINT64 >> 8))
+              return FALSE;
+            c = p[offset++];
+            base_distance = ((base_distance + 1) << 7) | (c & 0x7f);
+          }
+
+        /* The distance is measured from the start of this entry */
+        if (base_distance == 0 || base_distance > entry->offset)
+          return FALSE;
+
+        entry->base_offset = entry->offset - base_distance;
+      }
+      break;
+
+    case GIT_OBJECT_DB_PACK_REF_DELTA:
+      if (offset + priv->hash_len > end)
+        return FALSE;
+      entry->base_oid.len = priv->hash_len;
+      memcpy (entry->base_oid.id, p + offset, priv->hash_len);
+      offset += priv->hash_len;
+      break;
+
+    default:
+      return FALSE;
+    }
+
+  entry->data_offset = offset;
+
+  return TRUE;
+}
+
+static guint8 *
+git_object_db_inflate_pack_entry (GitObjectDb *db,
+                                  const GitObjectDbPack *pack,
+                                  const GitObjectDbPackEntry *entry)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+
+  return git_object_db_inflate (pack->pack + entry->data_offset,
+                                pack->pack_size - priv->hash_len
+                                - entry->data_offset,
+                                entry->size);
+}
+
+static gboolean
+git_object_db_read_delta_size (const guint8 **p,
+                               const guint8 *end,
+                               gsize *size)
+{
+  int shift = 0;
+  guint8 c;
+
+  *size = 0;
+
+  do
+    {
+      if (*p >= end || shift > 57)
+        return FALSE;
+      c = *((*p)++);
+      *size |= (gsize) (c & 0x7f) << shift;
+      shift += 7;
+    }
+  while (c & 0x80);
+
+  return TRUE;
+}
+
+static GBytes *
+git_object_db_apply_delta (GBytes *base_bytes,
+                           const guint8 *delta,
+                           gsize delta_size)
+{
+  gsize base_size, result_size, base_length;
+  const guint8 *base = g_bytes_get_data (base_bytes, &base_length);
+  const guint8 *end = delta + delta_size;
+  guint8 *result, *out;
+
+  if (!git_object_db_read_delta_size (&delta, end, &base_size)
+      || base_size != base_length
+      || !git_object_db_read_delta_size (&delta, end, &result_size)
+      /* Each byte of the delta can copy at most the whole base */
+      || result_size / MAX (base_size, 0x7f) > delta_size)
+    return NULL;
+
+  out = result = g_malloc (result_size + 1);
+
+  while (delta < end)
+    {
+      guint8 op = *(delta++);
+
+      if (op & 0x80)
+        {
+          /* Copy from the base. The bits of the op say which bytes of
+             the offset and size follow. */
+          gsize copy_offset = 0, copy_size = 0;
+          int i;
+
+          for (i = 0; i < 4; i++)
+            if (op & (1 << i))
+              {
+                if (delta >= end)
+                  goto error;
+                copy_offset |= (gsize) *(delta++) << (i * 8);
+              }
+
+          for (i = 0; i < 3; i++)
+            if (op & (0x10 << i))
+              {
+                if (delta >= end)
+                  goto error;
+                copy_size |= (gsize) *(delta++) << (i * 8);
+              }
+
+          if (copy_size == 0)
+            copy_size = 0x10000;
+
+          if (copy_offset + copy_size > base_size
+              || copy_size > result_size - (out - result))
+            goto error;
+
+          memcpy (out, base + copy_offset, copy_size);
+          out += copy_size;
+        }
+      else if (op)
+        {
+          /* Insert new data */
+          if (op > end - delta || op > result_size - (out - result))
+            goto error;
+
+          memcpy (out, delta, op);
+          out += op;
+          delta += op;
+        }
+      else
+        goto error;
+    }
+
+  if (out - result != result_size)
+    goto error;
+
+  *out = '\0';
+
+  /* The length doesn’t include the extra nul byte */
+  return g_bytes_new_take (result, result_size);
+
+ error:
+  g_free (result);
+  return NULL;
+}
+
+/* Returns a new reference to the cached base or NULL */
+static GBytes *
+git_object_db_cache_lookup (GitObjectDb *db,
+                            const GitObjectDbPack *pack,
+                            guint64 offset,
+                            GitObjectType *type)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  GitObjectDbCacheKey key = { pack, offset };
+  GitObjectDbCacheEntry *entry;
+  GBytes *data = NULL;
+
+  g_mutex_lock (&priv->mutex);
+
+  entry = g_hash_table_lookup (priv->delta_cache, &key);
+
+  if (entry)
+    {
+      g_queue_unlink (&priv->delta_lru, &entry->link);
+      g_queue_push_head_link (&priv->delta_lru, &entry->link);
+      data = g_bytes_ref (entry->data);
+      *type = entry->type;
+    }
+
+  g_mutex_unlock (&priv->mutex);
+
+  return data;
+}
+
+static void
+git_object_db_cache_add (GitObjectDb *db,
+                         const GitObjectDbPack *pack,
+                         guint pack_generation,
+                         guint64 offset,
+                         GitObjectType type,
+                         GBytes *data)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  gsize size = g_bytes_get_size (data);
+  GitObjectDbCacheKey key = { pack, offset };
+  GitObjectDbCacheEntry *entry;
+
+  /* Don’t let one huge object flush everything else */
+  if (size > GIT_OBJECT_DB_DELTA_CACHE_SIZE / 4)
+    return;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Another thread might have got there first or rescanned the packs
+     while the base was being read */
+  if (pack_generation != priv->pack_generation
+      || g_hash_table_contains (priv->delta_cache, &key))
+    {
+      g_mutex_unlock (&priv->mutex);
+      return;
+    }
+
+  entry = g_slice_new (GitObjectDbCacheEntry);
+  entry->key.pack = pack;
+  entry->key.offset = offset;
+  entry->type = type;
+  entry->data = g_bytes_ref (data);
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+
+  g_hash_table_insert (priv->delta_cache, &entry->key, entry);
+  g_queue_push_head_link (&priv->delta_lru, &entry->link);
+  priv->delta_cache_size += size;
+
+  while (priv->delta_cache_size > GIT_OBJECT_DB_DELTA_CACHE_SIZE)
+    {
+      GitObjectDbCacheEntry *old = priv->delta_lru.tail->data;
+
+      g_queue_unlink (&priv->delta_lru, &old->link);
+      priv->delta_cache_size -= g_bytes_get_size (old->data);
+      g_hash_table_remove (priv->delta_cache, &old->key);
+    }
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+git_object_db_set_corrupt_error (GError **error)
+{
+  g_set_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+               "Corrupt object in pack file");
+}
+
+/* Reads the object at offset in the pack, following any chain of
+   deltas. The caller must hold a reference on the pack. */
+static GBytes *
+git_object_db_read_pack_object (GitObjectDb *db,
+                                const GitObjectDbPack *pack,
+                                guint pack_generation,
+                                guint64 offset,
+                                GitObjectType *type,
+                                guint depth,
+                                GError **error)
+{
+  GArray *chain = g_array_new (FALSE, FALSE, sizeof (GitObjectDbPackEntry));
+  GitObjectDbPackEntry entry;
+  GBytes *data = NULL;
+  GitObjectType base_type = GIT_OBJECT_TYPE_NONE;
+  gboolean cache_base = FALSE;
+
+  /* Walk back along the chain of deltas until we find an object that
+     isn’t a delta or that is in the cache */
+  while (TRUE)
+    {
+      if ((data = git_object_db_cache_lookup (db, pack, offset,
+                                              &base_type)))
+        break;
+
+      if (chain->len >= GIT_OBJECT_DB_MAX_DELTA_CHAIN
+          || !git_object_db_parse_pack_entry (db, pack, offset, &entry))
+        {
+          git_object_db_set_corrupt_error (error);
+          goto done;
+        }
+
+      if (entry.type == GIT_OBJECT_DB_PACK_OFS_DELTA)
+        {
+          g_array_append_val (chain, entry);
+          offset = entry.base_offset;
+        }
+      else if (entry.type == GIT_OBJECT_DB_PACK_REF_DELTA)
+        {
+          g_array_append_val (chain, entry);
+
+          /* The base can be anywhere in the database so it isn’t
+             cached under this offset */
+          data = git_object_db_read_internal (db, &entry.base_oid,
+                                              &base_type,
+                                              depth + 1, error);
+          if (data == NULL)
+            goto done;
+          break;
+        }
+      else
+        {
+          guint8 *buf = git_object_db_inflate_pack_entry (db, pack, &entry);
+
+          if (buf == NULL)
+            {
+              git_object_db_set_corrupt_error (error);
+              goto done;
+            }
+
+          data = g_bytes_new_take (buf, entry.size);
+          base_type = entry.type;
+          cache_base = TRUE;
+          break;
+        }
+    }
+
+  /* Apply the deltas from the base upwards */
+  for (guint i = chain->len; i > 0; i--)
+    {
+      const GitObjectDbPackEntry *delta_entry
+        = &g_array_index (chain, GitObjectDbPackEntry, i - 1);
+      guint8 *delta = git_object_db_inflate_pack_entry (db, pack, delta_entry);
+      GBytes *result;
+
+      /* Anything that is used as a base is likely to be used again */
+      if (cache_base)
+        git_object_db_cache_add (db, pack, pack_generation,
+                                 offset, base_type, data);
+      cache_base = TRUE;
+
+      if (delta == NULL
+          || !(result = git_object_db_apply_delta (data,
+                                                   delta,
+                                                   delta_entry->size)))
+        {
+          g_free (delta);
+          g_bytes_unref (data);
+          data = NULL;
+          git_object_db_set_corrupt_error (error);
+          goto done;
+        }
+
+      g_free (delta);
+      g_bytes_unref (data);
+      data = result;
+      offset = delta_entry->offset;
+    }
+
+  *type = base_type;
+
+ done:
+  g_array_free (chain, TRUE);
+
+  return data;
+}
+
+static GBytes *
+git_object_db_read_loose (GitObjectDb *db,
+                          const GitOid *oid,
+                          GitObjectType *type,
+                          GError **error)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  gchar hex[GIT_OID_MAX_HEX_LENGTH + 1];
+  gchar *contents = NULL;
+  gsize length;
+  z_stream stream;
+  guint8 header[64];
+  guint8 *nul, *space, *out;
+  gsize header_length, size;
+  guint64 size64;
+  guint i;
+  int ret;
+
+  git_oid_to_hex (oid, hex);
+
+  for (i = 0; i < priv->objects_dirs->len && contents == NULL; i++)
+    {
+      gchar *filename
+        = g_strdup_printf ("%s/%.2s/%s",
+                           (const gchar *) g_ptr_array_index
+                           (priv->objects_dirs, i),
+                           hex, hex + 2);
+
+      if (!g_file_get_contents (filename, &contents, &length, NULL))
+        contents = NULL;
+
+      g_free (filename);
+    }
+
+  if (contents == NULL)
+    {
+      g_set_error (error, GIT_ERROR, GIT_ERROR_NOT_FOUND,
+                   "Object %s not found", hex);
+      return NULL;
+    }
+
+  memset (&stream, 0, sizeof stream);
+
+  if (inflateInit (&stream) != Z_OK)
+    {
+      g_free (contents);
+      git_object_db_set_corrupt_error (error);
+      return NULL;
+    }
+
+  /* Inflate enough to read the header, which is the type and size
+     followed by a nul byte */
+  stream.next_in = (Bytef *) contents;
+  stream.avail_in = length;
+  stream.next_out = header;
+  stream.avail_out = sizeof header;
+
+  ret = inflate (&stream, Z_NO_FLUSH);
+  header_length = sizeof header - stream.avail_out;
+
+  if ((ret != Z_OK && ret != Z_STREAM_END)
+      || !(nul = memchr (header, '\0', header_length)))
+    goto corrupt;
+
+  if (g_str_has_prefix ((gchar *) header, "commit "))
+    *type = GIT_OBJECT_TYPE_COMMIT;
+  else if (g_str_has_prefix ((gchar *) header, "tree "))
+    *type = GIT_OBJECT_TYPE_TREE;
+  else if (g_str_has_prefix ((gchar *) header, "blob "))
+    *type = GIT_OBJECT_TYPE_BLOB;
+  else if (g_str_has_prefix ((gchar *) header, "tag "))
+    *type = GIT_OBJECT_TYPE_TAG;
+  else
+    goto corrupt;
+
+  /* The size must be plain decimal digits and not more than the
+     compressed data could possibly hold */
+  space = (guint8 *) strchr ((gchar *) header, ' ');
+
+  if (!g_ascii_string_to_unsigned ((gchar *) space + 1, 10,
+                                   0, G_MAXSIZE - 1,
+                                   &size64, NULL)
+      || size64 / GIT_OBJECT_DB_MAX_DEFLATE_RATIO > length)
+    goto corrupt;
+
+  size = size64;
+
+  if (header + header_length - (nul + 1) > size)
+    goto corrupt;
+
+  out = g_malloc (size + 1);
+  memcpy (out, nul + 1, header + header_length - (nul + 1));
+
+  stream.next_out = out + (header + header_length - (nul + 1));
+  stream.avail_out = size - (header + header_length - (nul + 1));
+
+  while (ret == Z_OK)
+    ret = inflate (&stream, Z_FINISH);
+
+  if (ret != Z_STREAM_END || stream.avail_out != 0)
+    {
+      g_free (out);
+      goto corrupt;
+    }
+
+  inflateEnd (&stream);
+  g_free (contents);
+
+  out[size] = '\0';
+
+  return g_bytes_new_take (out, size);
+
+ corrupt:
+  inflateEnd (&stream);
+  g_free (contents);
+  g_set_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+               "Corrupt loose object %s", hex);
+  return NULL;
+}
+
+static GBytes *
+git_object_db_read_internal (GitObjectDb *db,
+                             const GitOid *oid,
+                             GitObjectType *type,
+                             guint depth,
+                             GError **error)
+{
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  gboolean rescanned = FALSE;
+  guint64 offset;
+  guint i;
+
+  if (depth > GIT_OBJECT_DB_MAX_REF_DEPTH || oid->len != priv->hash_len)
+    {
+      git_object_db_set_corrupt_error (error);
+      return NULL;
+    }
+
+  while (TRUE)
+    {
+      GitObjectDbPack *pack = NULL;
+      guint pack_generation;
+      GError *loose_error = NULL;
+      GBytes *data;
+      gboolean rescan;
+
+      g_mutex_lock (&priv->mutex);
+
+      for (i = 0; i < priv->packs->len; i++)
+        {
+          GitObjectDbPack *p = g_ptr_array_index (priv->packs, i);
+
+          if (git_object_db_find_in_pack (db, p, oid, &offset))
+            {
+              pack = git_object_db_ref_pack (p);
+              break;
+            }
+        }
+
+      pack_generation = priv->pack_generation;
+
+      g_mutex_unlock (&priv->mutex);
+
+      if (pack)
+        {
+          data = git_object_db_read_pack_object (db, pack, pack_generation,
+                                                 offset, type, depth, error);
+          git_object_db_unref_pack (pack);
+          return data;
+        }
+
+      data = git_object_db_read_loose (db, oid, type, &loose_error);
+
+      if (data
+          || !g_error_matches (loose_error, GIT_ERROR, GIT_ERROR_NOT_FOUND)
+          || rescanned)
+        rescan = FALSE;
+      else
+        {
+          gint64 now = g_get_monotonic_time ();
+
+          /* Claim the rescan so that other threads don’t repeat it */
+          g_mutex_lock (&priv->mutex);
+          rescan = (now - priv->last_scan_time
+                    >= GIT_OBJECT_DB_RESCAN_INTERVAL);
+          if (rescan)
+            priv->last_scan_time = now;
+          g_mutex_unlock (&priv->mutex);
+        }
+
+      if (!rescan)
+        {
+          if (loose_error)
+            g_propagate_error (error, loose_error);
+          return data;
+        }
+
+      /* git might have repacked since we last looked */
+      g_error_free (loose_error);
+      git_object_db_scan_packs (db);
+      rescanned = TRUE;
+    }
+}
+
+/* Reads an object from the database. The returned data always has a
+   nul byte after the end which isn’t included in its size. */
+GBytes *
+git_object_db_read (GitObjectDb *db,
+                    const GitOid *oid,
+                    GitObjectType *type,
+                    GError **error)
+{
+  g_return_val_if_fail (GIT_IS_OBJECT_DB (db), NULL);
+  g_return_val_if_fail (oid != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+  GitObjectType dummy_type;
+
+  if (priv->objects_dirs == NULL)
+    {
+      g_set_error (error, GIT_ERROR, GIT_ERROR_NO_REPO,
+                   "Repository isn’t local");
+      return NULL;
+    }
+
+  return git_object_db_read_internal (db, oid,
+                                      type ? type : &dummy_type,
+                                      0, error);
+}
+
+static GBytes *
+git_object_db_read_typed (GitObjectDb *db,
+                          const GitOid *oid,
+                          GitObjectType expected_type,
+                          GError **error)
+{
+  GitObjectType type;
+  GBytes *data = git_object_db_read (db, oid, &type, error);
+
+  if (data && type != expected_type)
+    {
+      g_bytes_unref (data);
+      g_set_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Object has an unexpected type");
+      return NULL;
+    }
+
+  return data;
+}
+
+/* Finds the entry called name in a tree object */
+static gboolean
+git_object_db_find_tree_entry (GBytes *tree,
+                               const gchar *name,
+                               gsize name_length,
+                               guint8 hash_len,
+                               guint32 *mode,
+                               GitOid *oid)
+{
+  gsize length;
+  const guint8 *p = g_bytes_get_data (tree, &length);
+  const guint8 *end = p + length;
+
+  /* Each entry is an octal mode, a space, the name, a nul byte and
+     then the binary id */
+  while (p < end)
+    {
+      const guint8 *space = memchr (p, ' ', end - p);
+      const guint8 *nul;
+
+      if (space == NULL
+          || !(nul = memchr (space, '\0', end - space))
+          || end - (nul + 1) < hash_len)
+        return FALSE;
+
+      if (nul - (space + 1) == name_length
+          && !memcmp (space + 1, name, name_length))
+        {
+          *mode = 0;
+          for (const guint8 *m = p; m < space; m++)
+            *mode = *mode * 8 + (*m - '0');
+
+          oid->len = hash_len;
+          memcpy (oid->id, nul + 1, hash_len);
+
+          return TRUE;
+        }
+
+      p = nul + 1 + hash_len;
+    }
+
+  return FALSE;
+}
+
+/* Finds the id of the blob for the file at path in the tree of the
+   given commit without reading the blob itself */
+gboolean
+git_object_db_find_blob_at_path (GitObjectDb *db,
+                                 const GitOid *commit,
+                                 const gchar *path,
+                                 GitOid *blob,
+                                 GError **error)
+{
+  g_return_val_if_fail (GIT_IS_OBJECT_DB (db), FALSE);
+  g_return_val_if_fail (commit != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (blob != NULL, FALSE);
+
+  GBytes *data = git_object_db_read_typed (db, commit,
+                                           GIT_OBJECT_TYPE_COMMIT, error);
+  const gchar *commit_text;
+  GitOid oid;
+  guint32 mode = 040000;
+
+  if (data == NULL)
+    return FALSE;
+
+  /* The first line of a commit is always the tree */
+  commit_text = g_bytes_get_data (data, NULL);
+
+  if (!g_str_has_prefix (commit_text, "tree ")
+      || !git_oid_parse_hex (&oid, commit_text + 5,
+                             g_bytes_get_size (data) - 5))
+    {
+      g_bytes_unref (data);
+      g_set_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                   "Invalid commit object");
+      return FALSE;
+    }
+
+  g_bytes_unref (data);
+
+  while (TRUE)
+    {
+      const gchar *slash;
+      gsize name_length;
+
+      while (*path == '/')
+        path++;
+
+      if (*path == '\0')
+        break;
+
+      /* Only directories can have children */
+      if ((mode & 0170000) != 040000)
+        goto not_found;
+
+      data = git_object_db_read_typed (db, &oid, GIT_OBJECT_TYPE_TREE, error);
+      if (data == NULL)
+        return FALSE;
+
+      slash = strchr (path, '/');
+      name_length = slash ? slash - path : strlen (path);
+
+      if (!git_object_db_find_tree_entry (data, path, name_length,
+                                          oid.len, &mode, &oid))
+        {
+          g_bytes_unref (data);
+          goto not_found;
+        }
+
+      g_bytes_unref (data);
+      path += name_length;
+    }
+
+  /* Regular files and symlinks are both stored as blobs */
+  if ((mode & 0170000) != 0100000 && (mode & 0170000) != 0120000)
+    goto not_found;
+
+  *blob = oid;
+
+  return TRUE;
+
+ not_found:
+  g_set_error (error, GIT_ERROR, GIT_ERROR_NOT_FOUND,
+               "File not found in commit");
+  return FALSE;
+}
+
+/* Reads a blob, failing if the object is something else */
+GBytes *
+git_object_db_read_blob (GitObjectDb *db,
+                         const GitOid *blob,
+                         GError **error)
+{
+  g_return_val_if_fail (GIT_IS_OBJECT_DB (db), NULL);
+  g_return_val_if_fail (blob != NULL, NULL);
+
+  return git_object_db_read_typed (db, blob, GIT_OBJECT_TYPE_BLOB, error);
+}
+
+/* Returns the number of bytes in an object id of the repository,
+   which depends on whether it uses SHA-1 or SHA-256 */
+guint
+git_object_db_get_hash_len (GitObjectDb *db)
+{
+  g_return_val_if_fail (GIT_IS_OBJECT_DB (db), GIT_OID_SHA1_LENGTH);
+
+  GitObjectDbPrivate *priv = git_object_db_get_instance_private (db);
+
+  return priv->hash_len;
+}
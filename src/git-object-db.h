@@ -0,0 +1,66 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_OBJECT_DB_H__
+#define __GIT_OBJECT_DB_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-oid.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_OBJECT_DB git_object_db_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitObjectDb,
+                      git_object_db,
+                      GIT,
+                      OBJECT_DB,
+                      GObject);
+
+/* These have the same values as the types in a pack file */
+typedef enum
+{
+  GIT_OBJECT_TYPE_NONE = 0,
+  GIT_OBJECT_TYPE_COMMIT = 1,
+  GIT_OBJECT_TYPE_TREE = 2,
+  GIT_OBJECT_TYPE_BLOB = 3,
+  GIT_OBJECT_TYPE_TAG = 4
+} GitObjectType;
+
+/* Maximum number of bytes of delta bases to keep around */
+#define GIT_OBJECT_DB_DELTA_CACHE_SIZE (16 * 1024 * 1024)
+
+GitObjectDb *git_object_db_new (GFile *common_dir);
+
+GBytes *git_object_db_read (GitObjectDb *db,
+                            const GitOid *oid,
+                            GitObjectType *type,
+                            GError **error);
+GBytes *git_object_db_read_blob (GitObjectDb *db,
+                                 const GitOid *blob,
+                                 GError **error);
+gboolean git_object_db_find_blob_at_path (GitObjectDb *db,
+                                          const GitOid *commit,
+                                          const gchar *path,
+                                          GitOid *blob,
+                                          GError **error);
+guint git_object_db_get_hash_len (GitObjectDb *db);
+
+G_END_DECLS
+
+#endif /* __GIT_OBJECT_DB_H__ */
@@ -0,0 +1,113 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-oid.h"
+
+#include <glib.h>
+#include <string.h>
+
+static inline int
+git_oid_hex_value (gchar c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  else if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  else
+    return -1;
+}
+
+/* Parses an object id from the hex digits at the start of str,
+   looking at no more than length bytes. The run of hex digits must be
+   exactly the length of either a SHA-1 or a SHA-256 id. Returns the
+   number of characters used or 0 if there isn’t a valid id. */
+gsize
+git_oid_parse_hex (GitOid *oid, const gchar *str, gsize length)
+{
+  gsize i;
+
+  for (i = 0; i < length && i < GIT_OID_MAX_HEX_LENGTH; i += 2)
+    {
+      int high, low;
+
+      if ((high = git_oid_hex_value (str[i])) == -1)
+        break;
+      if (i + 1 >= length || (low = git_oid_hex_value (str[i + 1])) == -1)
+        return 0;
+
+      oid->id[i / 2] = (high << 4) | low;
+    }
+
+  if (i < length && git_oid_hex_value (str[i]) != -1)
+    return 0;
+
+  if (i != GIT_OID_SHA1_LENGTH * 2 && i != GIT_OID_SHA256_LENGTH * 2)
+    return 0;
+
+  oid->len = i / 2;
+
+  return i;
+}
+
+gboolean
+git_oid_from_hex (GitOid *oid, const gchar *hex)
+{
+  gsize length = strlen (hex);
+
+  return length > 0 && git_oid_parse_hex (oid, hex, length) == length;
+}
+
+/* Writes the id as a nul-terminated hex string. hex must have room for
+   at least GIT_OID_MAX_HEX_LENGTH + 1 bytes. */
+void
+git_oid_to_hex (const GitOid *oid, gchar *hex)
+{
+  static const gchar digits[] = "0123456789abcdef";
+  int i;
+
+  for (i = 0; i < oid->len; i++)
+    {
+      *(hex++) = digits[oid->id[i] >> 4];
+      *(hex++) = digits[oid->id[i] & 0xf];
+    }
+
+  *hex = '\0';
+}
+
+gboolean
+git_oid_equal (const GitOid *a, const GitOid *b)
+{
+  return a->len == b->len && !memcmp (a->id, b->id, a->len);
+}
+
+/* The id made of all zeroes is used by git-blame to represent changes
+   that haven’t been committed yet */
+gboolean
+git_oid_is_zero (const GitOid *oid)
+{
+  int i;
+
+  for (i = 0; i < oid->len; i++)
+    if (oid->id[i])
+      return FALSE;
+
+  return TRUE;
+}
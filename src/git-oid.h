@@ -0,0 +1,59 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_OID_H__
+#define __GIT_OID_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Number of bytes in a SHA-1 and a SHA-256 object id */
+#define GIT_OID_SHA1_LENGTH 20
+#define GIT_OID_SHA256_LENGTH 32
+
+#define GIT_OID_MAX_LENGTH GIT_OID_SHA256_LENGTH
+#define GIT_OID_MAX_HEX_LENGTH (GIT_OID_MAX_LENGTH * 2)
+
+/* A binary object id. Only the first len bytes of id are used. */
+typedef struct
+{
+  guint8 len;
+  guint8 id[GIT_OID_MAX_LENGTH];
+} GitOid;
+
+gsize git_oid_parse_hex (GitOid *oid, const gchar *str, gsize length);
+gboolean git_oid_from_hex (GitOid *oid, const gchar *hex);
+void git_oid_to_hex (const GitOid *oid, gchar *hex);
+
+gboolean git_oid_equal (const GitOid *a, const GitOid *b);
+gboolean git_oid_is_zero (const GitOid *oid);
+
+/* The object id is already a good hash so just use the first few
+   bytes of it */
+static inline guint
+git_oid_hash (const GitOid *oid)
+{
+  return ((guint) oid->id[0] << 24
+          | (guint) oid->id[1] << 16
+          | (guint) oid->id[2] << 8
+          | (guint) oid->id[3]);
+}
+
+G_END_DECLS
+
+#endif /* __GIT_OID_H__ */
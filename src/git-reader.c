@@ -40,14 +40,23 @@ typedef struct
 {
   gboolean has_child;
   GPid child_pid;
+  GIOChannel *child_stdin;
   GIOChannel *child_stdout;
   GIOChannel *child_stderr;
   guint child_watch_source;
+  guint child_stdin_source;
   guint child_stdout_source;
   guint child_stderr_source;
   gint child_exit_code;
   GString *error_string;
   GString *line_string;
+
+  /* Data to write to the child’s stdin and how much of it has been
+     written so far */
+  GBytes *input;
+  gsize input_offset;
+
+  gint priority;
 } GitReaderPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GitReader,
@@ -93,6 +102,10 @@ git_reader_class_init (GitReaderClass *klass)
                     G_TYPE_BOOLEAN, 2,
                     G_TYPE_UINT,
                     G_TYPE_STRING);
+
+  /* If git exits before reading all of its input then writing to the
+     pipe would otherwise kill us */
+  signal (SIGPIPE, SIG_IGN);
 }
 
 static void
@@ -102,6 +115,26 @@ git_reader_init (GitReader *self)
 
   priv->error_string = g_string_new ("");
   priv->line_string = g_string_new ("");
+  priv->priority = G_PRIORITY_DEFAULT;
+}
+
+static void
+git_reader_close_stdin (GitReader *reader)
+{
+  GitReaderPrivate *priv = git_reader_get_instance_private (reader);
+
+  if (priv->child_stdin_source)
+    {
+      g_source_remove (priv->child_stdin_source);
+      priv->child_stdin_source = 0;
+    }
+
+  if (priv->child_stdin)
+    {
+      g_io_channel_shutdown (priv->child_stdin, FALSE, NULL);
+      g_io_channel_unref (priv->child_stdin);
+      priv->child_stdin = NULL;
+    }
 }
 
 static void
@@ -114,6 +147,8 @@ git_reader_close_process (GitReader *reader,
     {
       priv->has_child = FALSE;
 
+      git_reader_close_stdin (reader);
+
       if (priv->child_stdout_source)
         g_source_remove (priv->child_stdout_source);
       if (priv->child_stderr_source)
@@ -173,6 +208,9 @@ git_reader_finalize (GObject *object)
   g_string_free (priv->error_string, TRUE);
   g_string_free (priv->line_string, TRUE);
 
+  if (priv->input)
+    g_bytes_unref (priv->input);
+
   G_OBJECT_CLASS (git_reader_parent_class)->finalize (object);
 }
 
@@ -384,20 +422,117 @@ git_reader_on_child_stderr (GIOChannel *io_source,
   return ret;
 }
 
+static gboolean
+git_reader_on_child_stdin (GIOChannel *io_source,
+                           GIOCondition condition, gpointer data)
+{
+  GitReader *reader = (GitReader *) data;
+  GitReaderPrivate *priv = git_reader_get_instance_private (reader);
+  gsize input_length;
+  const gchar *input = g_bytes_get_data (priv->input, &input_length);
+  gsize bytes_written;
+
+  switch (g_io_channel_write_chars (io_source,
+                                    input + priv->input_offset,
+                                    input_length - priv->input_offset,
+                                    &bytes_written, NULL))
+    {
+    case G_IO_STATUS_NORMAL:
+      priv->input_offset += bytes_written;
+      if (priv->input_offset < input_length)
+        return TRUE;
+      break;
+
+    case G_IO_STATUS_AGAIN:
+      return TRUE;
+
+    default:
+      /* If the write fails then git has probably closed its end of
+         the pipe. Any problem will be reported by its exit status so
+         the error is ignored here. */
+      break;
+    }
+
+  /* Closing the pipe lets git know that there is no more input */
+  priv->child_stdin_source = 0;
+  git_reader_close_stdin (reader);
+
+  return FALSE;
+}
+
+/* Sets data that will be written to the standard input of the git
+   process the next time git_reader_start is called. If this is NULL
+   then git won’t be given a standard input. */
+void
+git_reader_set_input (GitReader *reader, GBytes *input)
+{
+  g_return_if_fail (GIT_IS_READER (reader));
+
+  GitReaderPrivate *priv = git_reader_get_instance_private (reader);
+
+  if (input)
+    g_bytes_ref (input);
+  if (priv->input)
+    g_bytes_unref (priv->input);
+  priv->input = input;
+}
+
+/* Sets the main loop priority used to handle the output of the
+   process. Work that isn’t needed straight away can use a low
+   priority so that it doesn’t get in the way of redrawing. */
+void
+git_reader_set_priority (GitReader *reader, gint priority)
+{
+  g_return_if_fail (GIT_IS_READER (reader));
+
+  GitReaderPrivate *priv = git_reader_get_instance_private (reader);
+
+  priv->priority = priority;
+}
+
 gboolean
 git_reader_start (GitReader *reader,
                   GFile *working_directory,
                   GError **error,
                   ...)
 {
-  gchar **args;
+  GPtrArray *args = g_ptr_array_new ();
   const gchar *arg;
+  gboolean ret;
+  va_list ap;
+
+  va_start (ap, error);
+  while ((arg = va_arg (ap, const gchar *)))
+    g_ptr_array_add (args, (gpointer) arg);
+  va_end (ap);
+
+  g_ptr_array_add (args, NULL);
+
+  ret = git_reader_startv (reader, working_directory,
+                           (const gchar * const *) args->pdata,
+                           error);
+
+  g_ptr_array_free (args, TRUE);
+
+  return ret;
+}
+
+/* Same as git_reader_start except that the arguments are passed as a
+   NULL-terminated array. This is handy when some of them are
+   optional. */
+gboolean
+git_reader_startv (GitReader *reader,
+                   GFile *working_directory,
+                   const gchar * const *argv,
+                   GError **error)
+{
+  gchar **args, **envp;
   gboolean spawn_ret;
-  gint stdout_fd, stderr_fd;
-  va_list ap_copy, ap;
-  int argc = 1, i;
+  gint stdin_fd, stdout_fd, stderr_fd;
+  int argc, i;
 
   g_return_val_if_fail (GIT_IS_READER (reader), FALSE);
+  g_return_val_if_fail (argv != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
   GitReaderPrivate *priv = git_reader_get_instance_private (reader);
@@ -421,57 +556,78 @@ git_reader_start (GitReader *reader,
       return FALSE;
     }
 
-  /* Count the number of arguments */
-  va_start (ap, error);
-  G_VA_COPY (ap_copy, ap);
-  while ((arg = va_arg (ap, const gchar *)))
-    argc++;
+  argc = g_strv_length ((gchar **) argv);
 
   /* Copy the arguments to a string array */
-  args = g_new (gchar *, argc + 1);
+  args = g_new (gchar *, argc + 2);
   args[0] = g_strdup ("git");
-  i = 1;
-  while ((arg = va_arg (ap_copy, const gchar *)))
-    args[i++] = g_strdup (arg);
-  args[i] = NULL;
+  for (i = 0; i < argc; i++)
+    args[i + 1] = g_strdup (argv[i]);
+  args[i + 1] = NULL;
 
-  va_end (ap);
+  envp = git_get_repo_environ (working_directory);
 
-  spawn_ret = g_spawn_async_with_pipes (working_directory_str, args, NULL,
+  spawn_ret = g_spawn_async_with_pipes (working_directory_str, args, envp,
                                         G_SPAWN_SEARCH_PATH
                                         | G_SPAWN_DO_NOT_REAP_CHILD,
                                         NULL, NULL, &priv->child_pid,
-                                        NULL, &stdout_fd, &stderr_fd,
+                                        priv->input ? &stdin_fd : NULL,
+                                        &stdout_fd, &stderr_fd,
                                         error);
 
   g_free (working_directory_str);
   g_strfreev (args);
+  g_strfreev (envp);
 
   if (!spawn_ret)
     return FALSE;
 
   priv->child_watch_source
-    = g_child_watch_add (priv->child_pid,
-                         git_reader_on_child_exit,
-                         reader);
+    = g_child_watch_add_full (priv->priority,
+                              priv->child_pid,
+                              git_reader_on_child_exit,
+                              reader,
+                              NULL);
+
+  if (priv->input)
+    {
+      priv->input_offset = 0;
+      priv->child_stdin = g_io_channel_unix_new (stdin_fd);
+      g_io_channel_set_encoding (priv->child_stdin, NULL, NULL);
+      g_io_channel_set_buffered (priv->child_stdin, FALSE);
+      g_io_channel_set_flags (priv->child_stdin, G_IO_FLAG_NONBLOCK, NULL);
+      priv->child_stdin_source
+        = g_io_add_watch_full (priv->child_stdin,
+                               priv->priority,
+                               G_IO_OUT | G_IO_HUP | G_IO_ERR,
+                               git_reader_on_child_stdin,
+                               reader,
+                               NULL);
+    }
 
   priv->child_stdout = g_io_channel_unix_new (stdout_fd);
   /* We want unbuffered data otherwise the call to read will block */
   g_io_channel_set_encoding (priv->child_stdout, NULL, NULL);
   g_io_channel_set_buffered (priv->child_stdout, FALSE);
   priv->child_stdout_source
-    = g_io_add_watch (priv->child_stdout, G_IO_IN | G_IO_HUP | G_IO_ERR,
-                      git_reader_on_child_stdout,
-                      reader);
+    = g_io_add_watch_full (priv->child_stdout,
+                           priv->priority,
+                           G_IO_IN | G_IO_HUP | G_IO_ERR,
+                           git_reader_on_child_stdout,
+                           reader,
+                           NULL);
 
   priv->child_stderr = g_io_channel_unix_new (stderr_fd);
   /* We want unbuffered data otherwise the call to read will block */
   g_io_channel_set_encoding (priv->child_stderr, NULL, NULL);
   g_io_channel_set_buffered (priv->child_stderr, FALSE);
   priv->child_stderr_source
-    = g_io_add_watch (priv->child_stderr, G_IO_IN | G_IO_HUP | G_IO_ERR,
-                      git_reader_on_child_stderr,
-                      reader);
+    = g_io_add_watch_full (priv->child_stderr,
+                           priv->priority,
+                           G_IO_IN | G_IO_HUP | G_IO_ERR,
+                           git_reader_on_child_stderr,
+                           reader,
+                           NULL);
 
   priv->has_child = TRUE;
 
@@ -41,10 +41,17 @@ struct _GitReaderClass
 
 GitReader *git_reader_new (void);
 
+void git_reader_set_input (GitReader *reader, GBytes *input);
+void git_reader_set_priority (GitReader *reader, gint priority);
+
 gboolean git_reader_start (GitReader *reader,
                            GFile *working_directory,
                            GError **error,
                            ...) G_GNUC_NULL_TERMINATED;
+gboolean git_reader_startv (GitReader *reader,
+                            GFile *working_directory,
+                            const gchar * const *argv,
+                            GError **error);
 
 G_END_DECLS
 
@@ -0,0 +1,421 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-ref-resolver.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "git-common.h"
+#include "git-reader.h"
+
+static void git_ref_resolver_dispose (GObject *object);
+
+struct _GitRefResolver
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  GFile *repo;
+  gchar *revision;
+
+  GitReader *reader;
+  guint completed_handler;
+  guint line_handler;
+  /* The hash from the reader that is currently running */
+  gchar *new_hash;
+
+  /* The hash from the last time the revision was resolved */
+  gchar *hash;
+
+  GPtrArray *monitors;
+  GArray *monitor_handlers;
+  guint changed_timeout;
+} GitRefResolverPrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitRefResolver,
+                                  git_ref_resolver,
+                                  G_TYPE_OBJECT);
+
+enum
+  {
+    COMPLETED,
+
+    LAST_SIGNAL
+  };
+
+static guint client_signals[LAST_SIGNAL];
+
+/* The files in the git directory of the working tree that change when
+   HEAD moves or something is fetched */
+static const gchar * const
+git_ref_resolver_git_dir_files[] =
+  {
+    "HEAD",
+    "logs/HEAD",
+    "FETCH_HEAD",
+  };
+
+/* The files and directories in the common directory that hold the
+   branches and tags. The directories aren’t watched recursively so
+   refs with a slash in their name below these are only noticed if
+   they are packed or HEAD points to them. */
+static const gchar * const
+git_ref_resolver_common_dir_files[] =
+  {
+    "packed-refs",
+    "refs/heads",
+    "refs/tags",
+  };
+
+static void
+git_ref_resolver_class_init (GitRefResolverClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_ref_resolver_dispose;
+
+  client_signals[COMPLETED]
+    = g_signal_new ("completed",
+                    G_TYPE_FROM_CLASS (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    0, NULL, NULL,
+                    g_cclosure_marshal_VOID__POINTER,
+                    G_TYPE_NONE, 1,
+                    G_TYPE_POINTER);
+}
+
+static void
+git_ref_resolver_init (GitRefResolver *self)
+{
+  GitRefResolverPrivate *priv = git_ref_resolver_get_instance_private (self);
+
+  priv->monitors = g_ptr_array_new ();
+  priv->monitor_handlers = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static void
+git_ref_resolver_stop_reader (GitRefResolver *resolver)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+
+  /* Destroying the reader kills the process */
+  if (priv->reader)
+    {
+      g_signal_handler_disconnect (priv->reader, priv->completed_handler);
+      g_signal_handler_disconnect (priv->reader, priv->line_handler);
+      g_object_unref (priv->reader);
+      priv->reader = NULL;
+    }
+
+  g_free (priv->new_hash);
+  priv->new_hash = NULL;
+}
+
+/* Stops resolving and watching the revision without emitting
+   anything */
+void
+git_ref_resolver_cancel (GitRefResolver *resolver)
+{
+  g_return_if_fail (GIT_IS_REF_RESOLVER (resolver));
+
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  guint i;
+
+  git_ref_resolver_stop_reader (resolver);
+
+  for (i = 0; i < priv->monitors->len; i++)
+    {
+      GFileMonitor *monitor = g_ptr_array_index (priv->monitors, i);
+
+      g_signal_handler_disconnect (monitor,
+                                   g_array_index (priv->monitor_handlers,
+                                                  guint, i));
+      g_file_monitor_cancel (monitor);
+      g_object_unref (monitor);
+    }
+
+  g_ptr_array_set_size (priv->monitors, 0);
+  g_array_set_size (priv->monitor_handlers, 0);
+
+  if (priv->changed_timeout)
+    {
+      g_source_remove (priv->changed_timeout);
+      priv->changed_timeout = 0;
+    }
+
+  if (priv->repo)
+    {
+      g_object_unref (priv->repo);
+      priv->repo = NULL;
+    }
+
+  g_free (priv->revision);
+  priv->revision = NULL;
+
+  g_free (priv->hash);
+  priv->hash = NULL;
+}
+
+static void
+git_ref_resolver_dispose (GObject *object)
+{
+  GitRefResolver *self = (GitRefResolver *) object;
+  GitRefResolverPrivate *priv = git_ref_resolver_get_instance_private (self);
+
+  if (priv->monitors)
+    {
+      git_ref_resolver_cancel (self);
+
+      g_ptr_array_free (priv->monitors, TRUE);
+      priv->monitors = NULL;
+      g_array_free (priv->monitor_handlers, TRUE);
+      priv->monitor_handlers = NULL;
+    }
+
+  G_OBJECT_CLASS (git_ref_resolver_parent_class)->dispose (object);
+}
+
+GitRefResolver *
+git_ref_resolver_new (void)
+{
+  GitRefResolver *self = g_object_new (GIT_TYPE_REF_RESOLVER, NULL);
+
+  return self;
+}
+
+static void
+git_ref_resolver_on_completed (GitReader *reader,
+                               const GError *error,
+                               GitRefResolver *resolver)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  GError *parse_error = NULL;
+
+  if (error == NULL)
+    {
+      if (priv->new_hash)
+        {
+          g_free (priv->hash);
+          priv->hash = priv->new_hash;
+          priv->new_hash = NULL;
+        }
+      else
+        {
+          g_set_error (&parse_error, GIT_ERROR, GIT_ERROR_PARSE_ERROR,
+                       "Unexpected output from git rev-parse");
+          error = parse_error;
+        }
+    }
+
+  /* Keep the object alive in case a handler drops the last reference */
+  g_object_ref (resolver);
+
+  git_ref_resolver_stop_reader (resolver);
+
+  g_signal_emit (resolver, client_signals[COMPLETED], 0, error);
+
+  g_object_unref (resolver);
+
+  if (parse_error)
+    g_error_free (parse_error);
+}
+
+static gboolean
+git_ref_resolver_on_line (GitReader *reader,
+                          guint length, const gchar *str,
+                          GitRefResolver *resolver)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  gchar *hash = g_strndup (str, length);
+
+  g_strchomp (hash);
+
+  if (priv->new_hash == NULL && git_is_object_id (hash))
+    priv->new_hash = hash;
+  else
+    g_free (hash);
+
+  return TRUE;
+}
+
+static gboolean
+git_ref_resolver_run (GitRefResolver *resolver, GError **error)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+
+  git_ref_resolver_stop_reader (resolver);
+
+  priv->reader = git_reader_new ();
+
+  priv->completed_handler
+    = g_signal_connect (priv->reader, "completed",
+                        G_CALLBACK (git_ref_resolver_on_completed),
+                        resolver);
+  priv->line_handler
+    = g_signal_connect (priv->reader, "line",
+                        G_CALLBACK (git_ref_resolver_on_line),
+                        resolver);
+
+  /* Peel tags so that the result can be blamed */
+  gchar *commit_revision = g_strconcat (priv->revision, "^{commit}", NULL);
+
+  gboolean ret = git_reader_start (priv->reader, priv->repo, error,
+                                   "rev-parse",
+                                   "--verify",
+                                   commit_revision,
+                                   NULL);
+
+  g_free (commit_revision);
+
+  if (!ret)
+    git_ref_resolver_stop_reader (resolver);
+
+  return ret;
+}
+
+static gboolean
+git_ref_resolver_changed_cb (gpointer user_data)
+{
+  GitRefResolver *resolver = user_data;
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  GError *error = NULL;
+
+  priv->changed_timeout = 0;
+
+  if (!git_ref_resolver_run (resolver, &error))
+    {
+      g_signal_emit (resolver, client_signals[COMPLETED], 0, error);
+      g_error_free (error);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+git_ref_resolver_on_changed (GFileMonitor *monitor,
+                             GFile *file,
+                             GFile *other_file,
+                             GFileMonitorEvent event_type,
+                             GitRefResolver *resolver)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+
+  /* Updating a ref touches several of the files so wait for them to
+     settle down */
+  if (priv->changed_timeout)
+    g_source_remove (priv->changed_timeout);
+
+  priv->changed_timeout = g_timeout_add (GIT_REF_RESOLVER_DELAY,
+                                         git_ref_resolver_changed_cb,
+                                         resolver);
+}
+
+static void
+git_ref_resolver_watch (GitRefResolver *resolver,
+                        GFile *dir,
+                        const gchar *path)
+{
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  GFile *file = g_file_resolve_relative_path (dir, path);
+  GFileMonitor *monitor;
+  guint handler;
+
+  /* Git updates the files by renaming a lock file over them */
+  monitor = g_file_monitor (file, G_FILE_MONITOR_WATCH_MOVES,
+                            NULL /* cancellable */,
+                            NULL /* error */);
+
+  g_object_unref (file);
+
+  if (monitor == NULL)
+    return;
+
+  handler = g_signal_connect (monitor, "changed",
+                              G_CALLBACK (git_ref_resolver_on_changed),
+                              resolver);
+
+  g_ptr_array_add (priv->monitors, monitor);
+  g_array_append_val (priv->monitor_handlers, handler);
+}
+
+gboolean
+git_ref_resolver_start (GitRefResolver *resolver,
+                        GFile *repo,
+                        const gchar *revision,
+                        GError **error)
+{
+  g_return_val_if_fail (GIT_IS_REF_RESOLVER (resolver), FALSE);
+  g_return_val_if_fail (repo != NULL, FALSE);
+  g_return_val_if_fail (revision != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+  GFile *git_dir, *common_dir;
+  guint i;
+
+  git_ref_resolver_cancel (resolver);
+
+  priv->repo = g_object_ref (repo);
+  priv->revision = g_strdup (revision);
+
+  git_dir = git_find_git_dir (repo);
+  for (i = 0; i < G_N_ELEMENTS (git_ref_resolver_git_dir_files); i++)
+    git_ref_resolver_watch (resolver, git_dir,
+                            git_ref_resolver_git_dir_files[i]);
+  g_object_unref (git_dir);
+
+  common_dir = git_find_common_dir (repo);
+  for (i = 0; i < G_N_ELEMENTS (git_ref_resolver_common_dir_files); i++)
+    git_ref_resolver_watch (resolver, common_dir,
+                            git_ref_resolver_common_dir_files[i]);
+  g_object_unref (common_dir);
+
+  if (!git_ref_resolver_run (resolver, error))
+    {
+      git_ref_resolver_cancel (resolver);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Returns the hash from the last time the revision was resolved or
+   NULL if it hasn’t been resolved yet */
+const gchar *
+git_ref_resolver_get_hash (GitRefResolver *resolver)
+{
+  g_return_val_if_fail (GIT_IS_REF_RESOLVER (resolver), NULL);
+
+  GitRefResolverPrivate *priv =
+    git_ref_resolver_get_instance_private (resolver);
+
+  return priv->hash;
+}
@@ -0,0 +1,56 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_REF_RESOLVER_H__
+#define __GIT_REF_RESOLVER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_REF_RESOLVER git_ref_resolver_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitRefResolver,
+                      git_ref_resolver,
+                      GIT,
+                      REF_RESOLVER,
+                      GObject);
+
+/* Resolves a symbolic revision such as HEAD or a branch name to a
+   commit hash with git rev-parse. The files where git keeps its refs
+   are then watched and the revision is resolved again whenever they
+   change. The ‘completed’ signal is emitted each time it has been
+   resolved. */
+
+/* Time in milliseconds to wait for the refs to stop changing before
+   resolving the revision again */
+#define GIT_REF_RESOLVER_DELAY 200
+
+GitRefResolver *git_ref_resolver_new (void);
+
+gboolean git_ref_resolver_start (GitRefResolver *resolver,
+                                 GFile *repo,
+                                 const gchar *revision,
+                                 GError **error);
+void git_ref_resolver_cancel (GitRefResolver *resolver);
+
+const gchar *git_ref_resolver_get_hash (GitRefResolver *resolver);
+
+G_END_DECLS
+
+#endif /* __GIT_REF_RESOLVER_H__ */
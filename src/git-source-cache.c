@@ -0,0 +1,482 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "git-source-cache.h"
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "git-annotated-source.h"
+#include "git-common.h"
+
+static void git_source_cache_dispose (GObject *object);
+static void git_source_cache_finalize (GObject *object);
+
+typedef struct _GitSourceCacheEntry GitSourceCacheEntry;
+
+struct _GitSourceCache
+{
+  GObject parent;
+};
+
+typedef struct
+{
+  /* Map from a key made from the file, the revision and whether the
+     blame was refined to an entry */
+  GHashTable *entries;
+  /* Entries ordered from most recently used to least recently
+     used */
+  GQueue lru;
+
+  /* Map from a key made from the file and a symbolic revision such
+     as HEAD to the commit hash that it was last resolved to. This
+     lets the source be shown straight away while checking whether
+     the revision has moved. The mapping is only useful while the
+     source for the hash is cached so it is dropped when the source
+     is evicted. */
+  GHashTable *resolved;
+
+  gsize size, max_size;
+} GitSourceCachePrivate;
+
+G_DEFINE_FINAL_TYPE_WITH_PRIVATE (GitSourceCache,
+                                  git_source_cache,
+                                  G_TYPE_OBJECT);
+
+struct _GitSourceCacheEntry
+{
+  GitSourceCache *cache;
+  gchar *key;
+  /* The URI of the file and the commit hash that the source was
+     blamed at, used to find the resolved entries that point to it */
+  gchar *uri;
+  gchar *hash;
+  GitAnnotatedSource *source;
+  guint completed_handler;
+  guint text_changed_handler;
+  guint refining_changed_handler;
+  /* The memory usage of the source when it was last measured. This
+     is counted while the source is still loading too. */
+  gsize size;
+  GList link;
+};
+
+static void
+git_source_cache_class_init (GitSourceCacheClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->dispose = git_source_cache_dispose;
+  gobject_class->finalize = git_source_cache_finalize;
+}
+
+static void
+git_source_cache_free_entry (GitSourceCacheEntry *entry)
+{
+  GitSourceCachePrivate *priv =
+    git_source_cache_get_instance_private (entry->cache);
+
+  g_queue_unlink (&priv->lru, &entry->link);
+  priv->size -= entry->size;
+
+  g_signal_handler_disconnect (entry->source, entry->completed_handler);
+  g_signal_handler_disconnect (entry->source, entry->text_changed_handler);
+  g_signal_handler_disconnect (entry->source,
+                               entry->refining_changed_handler);
+  g_object_unref (entry->source);
+  g_free (entry->key);
+  g_free (entry->uri);
+  g_free (entry->hash);
+
+  g_slice_free (GitSourceCacheEntry, entry);
+}
+
+static void
+git_source_cache_init (GitSourceCache *self)
+{
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (self);
+
+  /* The key is owned by the entry so the table only frees the
+     entry */
+  priv->entries
+    = g_hash_table_new_full (g_str_hash, g_str_equal,
+                             NULL,
+                             (GDestroyNotify) git_source_cache_free_entry);
+  g_queue_init (&priv->lru);
+  priv->resolved = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, g_free);
+  priv->max_size = GIT_SOURCE_CACHE_DEFAULT_MAX_SIZE;
+}
+
+static void
+git_source_cache_dispose (GObject *object)
+{
+  GitSourceCache *self = (GitSourceCache *) object;
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (self);
+
+  g_hash_table_remove_all (priv->entries);
+
+  G_OBJECT_CLASS (git_source_cache_parent_class)->dispose (object);
+}
+
+static void
+git_source_cache_finalize (GObject *object)
+{
+  GitSourceCache *self = (GitSourceCache *) object;
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (self);
+
+  g_hash_table_destroy (priv->entries);
+  g_hash_table_destroy (priv->resolved);
+
+  G_OBJECT_CLASS (git_source_cache_parent_class)->finalize (object);
+}
+
+GitSourceCache *
+git_source_cache_new (void)
+{
+  GitSourceCache *self = g_object_new (GIT_TYPE_SOURCE_CACHE, NULL);
+
+  return self;
+}
+
+static gchar *
+git_source_cache_make_uri_key (const gchar *uri, const gchar *revision)
+{
+  /* URIs can’t contain a newline so it’s safe to use as a separator */
+  return g_strconcat (revision, "\n", uri, NULL);
+}
+
+static gchar *
+git_source_cache_make_file_key (GFile *file, const gchar *revision)
+{
+  gchar *uri = g_file_get_uri (file);
+  gchar *key = git_source_cache_make_uri_key (uri, revision);
+
+  g_free (uri);
+
+  return key;
+}
+
+/* Sources that are blamed progressively and follow moved lines can
+   attribute lines differently from a plain blame so the two are
+   cached separately */
+static gchar *
+git_source_cache_make_key (GFile *file,
+                           const gchar *revision,
+                           gboolean refine)
+{
+  gchar *key;
+
+  /* Only full commit hashes are cached because anything else such as
+     a branch name or the working tree might change under our feet */
+  if (!git_is_object_id (revision))
+    return NULL;
+
+  if (!refine)
+    return git_source_cache_make_file_key (file, revision);
+
+  gchar *refined_revision = g_strconcat (revision, " refined", NULL);
+
+  key = git_source_cache_make_file_key (file, refined_revision);
+
+  g_free (refined_revision);
+
+  return key;
+}
+
+static gboolean
+git_source_cache_resolved_points_to (const gchar *key,
+                                     const gchar *hash,
+                                     GitSourceCacheEntry *entry)
+{
+  const gchar *uri = strchr (key, '\n');
+
+  return !strcmp (hash, entry->hash) && !strcmp (uri + 1, entry->uri);
+}
+
+/* Removes an entry along with any resolved revisions that point to
+   its source unless the source is still cached with the other refine
+   setting */
+static void
+git_source_cache_remove_entry (GitSourceCache *cache,
+                               GitSourceCacheEntry *entry)
+{
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+  gchar *refined_revision = g_strconcat (entry->hash, " refined", NULL);
+  gchar *plain_key = git_source_cache_make_uri_key (entry->uri,
+                                                    entry->hash);
+  gchar *refined_key = git_source_cache_make_uri_key (entry->uri,
+                                                      refined_revision);
+  gint n_with_hash = (g_hash_table_contains (priv->entries, plain_key)
+                      + g_hash_table_contains (priv->entries,
+                                               refined_key));
+
+  g_free (refined_key);
+  g_free (plain_key);
+  g_free (refined_revision);
+
+  if (n_with_hash <= 1)
+    g_hash_table_foreach_remove (priv->resolved,
+                                 (GHRFunc)
+                                 git_source_cache_resolved_points_to,
+                                 entry);
+
+  g_hash_table_remove (priv->entries, entry->key);
+}
+
+static void
+git_source_cache_trim (GitSourceCache *cache)
+{
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+  GList *node, *prev;
+
+  /* Throw away the least recently used sources until we are within
+     the limit. Sources that are still loading are counted too
+     because a large file takes up most of its memory long before the
+     blame finishes. Throwing one away only drops the cache’s
+     reference so a view that is showing it is not affected. */
+  for (node = priv->lru.tail;
+       node && priv->size > priv->max_size;
+       node = prev)
+    {
+      GitSourceCacheEntry *entry = node->data;
+
+      prev = node->prev;
+
+      git_source_cache_remove_entry (cache, entry);
+    }
+}
+
+static void
+git_source_cache_update_size (GitSourceCacheEntry *entry)
+{
+  GitSourceCache *cache = entry->cache;
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  priv->size -= entry->size;
+  entry->size = git_annotated_source_get_memory_usage (entry->source);
+  priv->size += entry->size;
+
+  /* This might free the entry */
+  git_source_cache_trim (cache);
+}
+
+static void
+git_source_cache_on_size_changed (GitAnnotatedSource *source,
+                                  GitSourceCacheEntry *entry)
+{
+  git_source_cache_update_size (entry);
+}
+
+static void
+git_source_cache_on_completed (GitAnnotatedSource *source,
+                               const GError *error,
+                               GitSourceCacheEntry *entry)
+{
+  if (error)
+    {
+      /* Don’t remember failures so that the next lookup will try
+         again */
+      git_source_cache_remove_entry (entry->cache, entry);
+    }
+  else
+    {
+      git_source_cache_update_size (entry);
+    }
+}
+
+GitAnnotatedSource *
+git_source_cache_lookup (GitSourceCache *cache,
+                         GFile *file,
+                         const gchar *revision,
+                         gboolean refine)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), NULL);
+  g_return_val_if_fail (file != NULL, NULL);
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+  gchar *key = git_source_cache_make_key (file, revision, refine);
+  GitSourceCacheEntry *entry;
+
+  if (key == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (priv->entries, key);
+
+  g_free (key);
+
+  if (entry == NULL)
+    return NULL;
+
+  /* Move the entry to the front of the LRU list */
+  g_queue_unlink (&priv->lru, &entry->link);
+  g_queue_push_head_link (&priv->lru, &entry->link);
+
+  return g_object_ref (entry->source);
+}
+
+/* Returns whether the source is either loaded or being loaded without
+   counting it as a use */
+gboolean
+git_source_cache_contains (GitSourceCache *cache,
+                           GFile *file,
+                           const gchar *revision,
+                           gboolean refine)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), FALSE);
+  g_return_val_if_fail (file != NULL, FALSE);
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+  gchar *key = git_source_cache_make_key (file, revision, refine);
+  gboolean ret;
+
+  if (key == NULL)
+    return FALSE;
+
+  ret = g_hash_table_contains (priv->entries, key);
+
+  g_free (key);
+
+  return ret;
+}
+
+void
+git_source_cache_add (GitSourceCache *cache,
+                      GFile *file,
+                      const gchar *revision,
+                      gboolean refine,
+                      GitAnnotatedSource *source)
+{
+  g_return_if_fail (GIT_IS_SOURCE_CACHE (cache));
+  g_return_if_fail (file != NULL);
+  g_return_if_fail (GIT_IS_ANNOTATED_SOURCE (source));
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+  gchar *key = git_source_cache_make_key (file, revision, refine);
+
+  if (key == NULL)
+    return;
+
+  GitSourceCacheEntry *entry = g_slice_new (GitSourceCacheEntry);
+
+  entry->cache = cache;
+  entry->key = key;
+  entry->uri = g_file_get_uri (file);
+  entry->hash = g_strdup (revision);
+  entry->source = g_object_ref (source);
+  entry->size = 0;
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+
+  entry->completed_handler
+    = g_signal_connect (source, "completed",
+                        G_CALLBACK (git_source_cache_on_completed),
+                        entry);
+  /* The text arrives long before the blame completes and refining
+     adds the line hashes afterwards so measure again each time */
+  entry->text_changed_handler
+    = g_signal_connect (source, "text-changed",
+                        G_CALLBACK (git_source_cache_on_size_changed),
+                        entry);
+  entry->refining_changed_handler
+    = g_signal_connect (source, "refining-changed",
+                        G_CALLBACK (git_source_cache_on_size_changed),
+                        entry);
+
+  /* This will free any existing entry with the same key */
+  g_hash_table_replace (priv->entries, key, entry);
+  g_queue_push_head_link (&priv->lru, &entry->link);
+
+  git_source_cache_update_size (entry);
+}
+
+/* Remembers what a symbolic revision resolved to for a file */
+void
+git_source_cache_set_resolved (GitSourceCache *cache,
+                               GFile *file,
+                               const gchar *revision,
+                               const gchar *hash)
+{
+  g_return_if_fail (GIT_IS_SOURCE_CACHE (cache));
+  g_return_if_fail (file != NULL);
+  g_return_if_fail (revision != NULL);
+  g_return_if_fail (git_is_object_id (hash));
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  g_hash_table_replace (priv->resolved,
+                        git_source_cache_make_file_key (file, revision),
+                        g_strdup (hash));
+}
+
+/* Returns the hash that the symbolic revision was last resolved to or
+   NULL if it isn’t known. It might be out of date. */
+const gchar *
+git_source_cache_get_resolved (GitSourceCache *cache,
+                               GFile *file,
+                               const gchar *revision)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), NULL);
+  g_return_val_if_fail (file != NULL, NULL);
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  if (revision == NULL)
+    return NULL;
+
+  gchar *key = git_source_cache_make_file_key (file, revision);
+  const gchar *hash = g_hash_table_lookup (priv->resolved, key);
+
+  g_free (key);
+
+  return hash;
+}
+
+void
+git_source_cache_set_max_size (GitSourceCache *cache, gsize max_size)
+{
+  g_return_if_fail (GIT_IS_SOURCE_CACHE (cache));
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  priv->max_size = max_size;
+
+  git_source_cache_trim (cache);
+}
+
+gsize
+git_source_cache_get_max_size (GitSourceCache *cache)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), 0);
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  return priv->max_size;
+}
+
+gsize
+git_source_cache_get_size (GitSourceCache *cache)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_CACHE (cache), 0);
+
+  GitSourceCachePrivate *priv = git_source_cache_get_instance_private (cache);
+
+  return priv->size;
+}
@@ -0,0 +1,68 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIT_SOURCE_CACHE_H__
+#define __GIT_SOURCE_CACHE_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "git-annotated-source.h"
+
+G_BEGIN_DECLS
+
+#define GIT_TYPE_SOURCE_CACHE git_source_cache_get_type ()
+
+G_DECLARE_FINAL_TYPE (GitSourceCache,
+                      git_source_cache,
+                      GIT,
+                      SOURCE_CACHE,
+                      GObject);
+
+/* Default number of bytes of annotated source to keep around */
+#define GIT_SOURCE_CACHE_DEFAULT_MAX_SIZE (64 * 1024 * 1024)
+
+GitSourceCache *git_source_cache_new (void);
+
+GitAnnotatedSource *git_source_cache_lookup (GitSourceCache *cache,
+                                             GFile *file,
+                                             const gchar *revision,
+                                             gboolean refine);
+gboolean git_source_cache_contains (GitSourceCache *cache,
+                                    GFile *file,
+                                    const gchar *revision,
+                                    gboolean refine);
+void git_source_cache_add (GitSourceCache *cache,
+                           GFile *file,
+                           const gchar *revision,
+                           gboolean refine,
+                           GitAnnotatedSource *source);
+
+void git_source_cache_set_resolved (GitSourceCache *cache,
+                                    GFile *file,
+                                    const gchar *revision,
+                                    const gchar *hash);
+const gchar *git_source_cache_get_resolved (GitSourceCache *cache,
+                                            GFile *file,
+                                            const gchar *revision);
+
+void git_source_cache_set_max_size (GitSourceCache *cache, gsize max_size);
+gsize git_source_cache_get_max_size (GitSourceCache *cache);
+gsize git_source_cache_get_size (GitSourceCache *cache);
+
+G_END_DECLS
+
+#endif /* __GIT_SOURCE_CACHE_H__ */
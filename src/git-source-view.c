@@ -20,6 +20,7 @@
 #include "git-source-view.h"
 
 #include <gtk/gtk.h>
+#include <glib/gi18n.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
@@ -27,26 +28,109 @@
 
 #include "git-hash-view.h"
 #include "git-annotated-source.h"
+#include "git-commit-bag.h"
 #include "git-marshal.h"
 #include "git-common.h"
 #include "git-enum-types.h"
+#include "git-line-diff.h"
+#include "git-object-db.h"
+#include "git-oid.h"
+#include "git-ref-resolver.h"
+
+/* Limit on the effort spent diffing two revisions to find where the
+   view should move to. See git_line_diff_ids(). */
+#define GIT_SOURCE_VIEW_MAP_MAX_COST 256
+
+/* Time in milliseconds to wait for the working copy to stop changing
+   before updating it. Editors often write a file in several steps. */
+#define GIT_SOURCE_VIEW_REFRESH_DELAY 500
+
+/* Number of lines that can be added or removed in the working copy
+   before it is blamed again rather than applying the changes to the
+   last blame */
+#define GIT_SOURCE_VIEW_MAX_EDITED_LINES 256
+
+/* Lines longer than this many bytes, such as in minified or generated
+   files, are cut short in the text view because laying them out is
+   very slow. They can be clicked to show the rest. */
+#define GIT_SOURCE_VIEW_MAX_LINE_LENGTH 4096
 
 static void git_source_view_dispose (GObject *object);
 
 static void git_source_view_on_commit_selected (GitHashView *source,
                                                 GitCommit *commit,
                                                 GitSourceView *sview);
+static void git_source_view_on_previous_selected (GitHashView *source,
+                                                  GitCommit *previous_commit,
+                                                  const gchar *previous_path,
+                                                  GitSourceView *sview);
+static void
+git_source_view_text_click_released_cb (GtkGestureClick *gesture,
+                                        gint n_press,
+                                        gdouble x,
+                                        gdouble y,
+                                        gpointer user_data);
+static void git_source_view_blame_anyway (GitSourceView *sview);
+static void git_source_view_load (GitSourceView *sview,
+                                  GFile *file,
+                                  const gchar *revision,
+                                  gboolean guarded);
 
 typedef struct
 {
   GitAnnotatedSource *paint_source, *load_source;
+  guint paint_refining_handler;
+  GitSourceCache *cache;
   guint loading_completed_handler;
+  guint loading_text_changed_handler;
   guint commit_selected_handler;
-  guint pulse_timeout;
+  guint previous_selected_handler;
+  guint loading_progress_handler;
+  /* When the progress was first known and how far it had got then,
+     used to guess how long is left */
+  gint64 progress_start_time;
+  gdouble progress_start_fraction;
+
+  /* While the working copy is shown the file is watched for changes.
+     Small changes are blamed on top of the last full blame without
+     running git again. The file is blamed again properly when HEAD or
+     the index changes or when the edits get too big. */
+  GFile *file;
+  GFileMonitor *monitor;
+  guint monitor_changed_handler;
+  GFileMonitor *index_monitor;
+  guint index_changed_handler;
+  /* Whether the source being shown is a finished blame of the working
+     copy that the changes can be applied to */
+  gboolean working_copy_blamed;
+  GCancellable *refresh_cancellable;
+  guint refresh_timeout;
+  gboolean refresh_pending;
+  gboolean reblame_pending;
+
+  /* Symbolic revisions are resolved to a commit hash which is then
+     kept up to date in case the ref moves. For the working copy, HEAD
+     is resolved to notice commits and checkouts. */
+  GitRefResolver *ref_resolver;
+  guint resolved_handler;
+  GCancellable *repo_cancellable;
+  gchar *revision;
+  gchar *resolved_hash;
+
+  /* What was last loaded so that it can be blamed anyway if the file
+     turned out to be too big or binary */
+  gchar *load_revision;
+  gboolean load_guarded;
+
+  /* Whether the blame is done progressively with a final pass to
+     follow moved and copied lines. This is off by default because the
+     extra passes are expensive. */
+  gboolean refine;
 
   GtkWidget *source_box, *scrolled_win, *text_view, *hash_view;
-  GtkWidget *error_box, *error_label;
+  GtkWidget *error_box, *error_label, *blame_anyway_button;
   GtkWidget *progress_bar;
+  GtkWidget *refine_box, *refine_spinner;
 } GitSourceViewPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GitSourceView,
@@ -56,6 +140,7 @@ G_DEFINE_TYPE_WITH_PRIVATE (GitSourceView,
 enum
   {
     COMMIT_SELECTED,
+    BLAME_PREVIOUS,
 
     LAST_SIGNAL
   };
@@ -79,6 +164,17 @@ git_source_view_class_init (GitSourceViewClass *klass)
                     G_TYPE_NONE, 1,
                     GIT_TYPE_COMMIT);
 
+  client_signals[BLAME_PREVIOUS]
+    = g_signal_new ("blame-previous",
+                    G_OBJECT_CLASS_TYPE (gobject_class),
+                    G_SIGNAL_RUN_LAST,
+                    G_STRUCT_OFFSET (GitSourceViewClass, blame_previous),
+                    NULL, NULL,
+                    _git_marshal_VOID__OBJECT_OBJECT,
+                    G_TYPE_NONE, 2,
+                    G_TYPE_FILE,
+                    GIT_TYPE_COMMIT);
+
   const char *resource_name
     = "/uk/co/busydoingnothing/blamebrowse/source-view.ui";
 
@@ -103,11 +199,21 @@ git_source_view_class_init (GitSourceViewClass *klass)
   gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
                                                 GitSourceView,
                                                 error_label);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitSourceView,
+                                                blame_anyway_button);
 
   gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
                                                 GitSourceView,
                                                 progress_bar);
 
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitSourceView,
+                                                refine_box);
+  gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                GitSourceView,
+                                                refine_spinner);
+
   gtk_widget_class_set_layout_manager_type ((GtkWidgetClass *) (klass),
                                             GTK_TYPE_BOX_LAYOUT);
 }
@@ -124,6 +230,27 @@ git_source_view_init (GitSourceView *sview)
   priv->commit_selected_handler
     = g_signal_connect (priv->hash_view, "commit-selected",
                         G_CALLBACK (git_source_view_on_commit_selected), sview);
+  priv->previous_selected_handler
+    = g_signal_connect (priv->hash_view, "previous-selected",
+                        G_CALLBACK (git_source_view_on_previous_selected),
+                        sview);
+
+  GtkGesture *gesture = gtk_gesture_click_new ();
+  gtk_gesture_single_set_button (GTK_GESTURE_SINGLE (gesture),
+                                 GDK_BUTTON_PRIMARY);
+  g_signal_connect (gesture,
+                    "released",
+                    G_CALLBACK (git_source_view_text_click_released_cb),
+                    sview);
+  GtkEventController *event_controller = GTK_EVENT_CONTROLLER (gesture);
+  gtk_event_controller_set_propagation_phase (event_controller,
+                                              GTK_PHASE_CAPTURE);
+  gtk_widget_add_controller (priv->text_view, event_controller);
+
+  g_signal_connect_swapped (priv->blame_anyway_button,
+                            "clicked",
+                            G_CALLBACK (git_source_view_blame_anyway),
+                            sview);
 
   GtkLayoutManager *layout = gtk_widget_get_layout_manager (GTK_WIDGET (sview));
   gtk_orientable_set_orientation (GTK_ORIENTABLE (layout),
@@ -139,21 +266,75 @@ git_source_view_unref_loading_source (GitSourceView *sview)
     {
       g_signal_handler_disconnect (priv->load_source,
                                    priv->loading_completed_handler);
+      g_signal_handler_disconnect (priv->load_source,
+                                   priv->loading_text_changed_handler);
+      g_signal_handler_disconnect (priv->load_source,
+                                   priv->loading_progress_handler);
       g_object_unref (priv->load_source);
       priv->load_source = NULL;
     }
 }
 
 static void
-remove_pulse_timeout (GitSourceView *sview)
+git_source_view_stop_monitor (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (priv->monitor)
+    {
+      g_signal_handler_disconnect (priv->monitor,
+                                   priv->monitor_changed_handler);
+      g_file_monitor_cancel (priv->monitor);
+      g_object_unref (priv->monitor);
+      priv->monitor = NULL;
+    }
+
+  if (priv->refresh_timeout)
+    {
+      g_source_remove (priv->refresh_timeout);
+      priv->refresh_timeout = 0;
+    }
+
+  if (priv->index_monitor)
+    {
+      g_signal_handler_disconnect (priv->index_monitor,
+                                   priv->index_changed_handler);
+      g_file_monitor_cancel (priv->index_monitor);
+      g_object_unref (priv->index_monitor);
+      priv->index_monitor = NULL;
+    }
+
+  if (priv->refresh_cancellable)
+    {
+      g_cancellable_cancel (priv->refresh_cancellable);
+      g_object_unref (priv->refresh_cancellable);
+      priv->refresh_cancellable = NULL;
+    }
+
+  priv->working_copy_blamed = FALSE;
+  priv->refresh_pending = FALSE;
+  priv->reblame_pending = FALSE;
+}
+
+static void
+git_source_view_stop_resolver (GitSourceView *sview)
 {
   GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
 
-  if (priv->pulse_timeout)
+  if (priv->repo_cancellable)
     {
-      g_source_remove (priv->pulse_timeout);
-      priv->pulse_timeout = 0;
+      g_cancellable_cancel (priv->repo_cancellable);
+      g_object_unref (priv->repo_cancellable);
+      priv->repo_cancellable = NULL;
     }
+
+  if (priv->ref_resolver)
+    git_ref_resolver_cancel (priv->ref_resolver);
+
+  g_free (priv->revision);
+  priv->revision = NULL;
+  g_free (priv->resolved_hash);
+  priv->resolved_hash = NULL;
 }
 
 static void
@@ -164,20 +345,48 @@ git_source_view_dispose (GObject *object)
 
   if (priv->paint_source)
     {
+      g_signal_handler_disconnect (priv->paint_source,
+                                   priv->paint_refining_handler);
       g_object_unref (priv->paint_source);
       priv->paint_source = NULL;
     }
 
   git_source_view_unref_loading_source (sview);
 
+  git_source_view_stop_monitor (sview);
+
+  if (priv->ref_resolver)
+    {
+      git_source_view_stop_resolver (sview);
+      g_signal_handler_disconnect (priv->ref_resolver,
+                                   priv->resolved_handler);
+      g_object_unref (priv->ref_resolver);
+      priv->ref_resolver = NULL;
+    }
+
+  if (priv->file)
+    {
+      g_object_unref (priv->file);
+      priv->file = NULL;
+    }
+
+  g_free (priv->load_revision);
+  priv->load_revision = NULL;
+
+  if (priv->cache)
+    {
+      g_object_unref (priv->cache);
+      priv->cache = NULL;
+    }
+
   if (priv->hash_view)
     {
       g_signal_handler_disconnect (priv->hash_view,
                                    priv->commit_selected_handler);
+      g_signal_handler_disconnect (priv->hash_view,
+                                   priv->previous_selected_handler);
     }
 
-  remove_pulse_timeout (sview);
-
   gtk_widget_dispose_template (GTK_WIDGET (sview), GIT_TYPE_SOURCE_VIEW);
 
   G_OBJECT_CLASS (git_source_view_parent_class)->dispose (object);
@@ -192,39 +401,100 @@ git_source_view_new (void)
   return widget;
 }
 
+/* Inserts length bytes of s at iter, replacing invalid UTF-8. The
+   iter is moved to the end of the inserted text. */
 static void
-copy_string_to_buffer (GtkTextBuffer *buffer, const char *s)
+copy_string_to_buffer (GtkTextBuffer *buffer,
+                       GtkTextIter *iter,
+                       const char *s,
+                       gsize length)
 {
-  while (*s)
+  const char *end = s + length;
+
+  while (s < end)
     {
       const char *invalid;
-      gboolean is_valid = g_utf8_validate (s, -1, &invalid);
+      gboolean is_valid = g_utf8_validate (s, end - s, &invalid);
 
-      GtkTextIter iter;
-      gtk_text_buffer_get_end_iter (buffer, &iter);
-      gtk_text_buffer_insert (buffer, &iter, s, invalid - s);
+      gtk_text_buffer_insert (buffer, iter, s, invalid - s);
 
       if (is_valid)
         break;
 
       /* append U+FFFD REPLACEMENT CHARACTER */
-      gtk_text_buffer_get_end_iter (buffer, &iter);
-      gtk_text_buffer_insert (buffer, &iter, "\357\277\275", -1);
+      gtk_text_buffer_insert (buffer, iter, "\357\277\275", -1);
 
       s = invalid + 1;
     }
 }
 
+static GtkTextTag *
+get_elided_tag (GtkTextBuffer *buffer)
+{
+  GtkTextTagTable *tag_table = gtk_text_buffer_get_tag_table (buffer);
+  GtkTextTag *tag = gtk_text_tag_table_lookup (tag_table, "elided");
+
+  if (tag == NULL)
+    tag = gtk_text_buffer_create_tag (buffer, "elided",
+                                      "style", PANGO_STYLE_ITALIC,
+                                      "underline", PANGO_UNDERLINE_SINGLE,
+                                      NULL);
+
+  return tag;
+}
+
+/* Inserts a line of the source. If it is too long then only the start
+   is inserted followed by a marker that can be clicked to show the
+   rest. */
+static void
+copy_line_to_buffer (GtkTextBuffer *buffer,
+                     GtkTextIter *iter,
+                     const char *text)
+{
+  gsize length = strlen (text);
+  gsize cut;
+
+  if (length <= GIT_SOURCE_VIEW_MAX_LINE_LENGTH)
+    {
+      copy_string_to_buffer (buffer, iter, text, length);
+      return;
+    }
+
+  /* Don’t cut a character in half */
+  for (cut = GIT_SOURCE_VIEW_MAX_LINE_LENGTH;
+       cut > 0 && (text[cut] & 0xc0) == 0x80;
+       cut--);
+
+  copy_string_to_buffer (buffer, iter, text, cut);
+
+  /* The newline stays after the marker */
+  gboolean has_newline = text[length - 1] == '\n';
+  gchar *size = g_format_size (length - cut - has_newline);
+  gchar *marker = g_strdup_printf (_(" … (click to show %s more)"), size);
+
+  gtk_text_buffer_insert_with_tags (buffer, iter, marker, -1,
+                                    get_elided_tag (buffer),
+                                    NULL);
+
+  g_free (marker);
+  g_free (size);
+
+  if (has_newline)
+    gtk_text_buffer_insert (buffer, iter, "\n", 1);
+}
+
 static void
 copy_source_to_text_view (GtkTextView *text_view,
                           GitAnnotatedSource *source)
 {
   GtkTextBuffer *buffer = gtk_text_view_get_buffer (text_view);
+  GtkTextIter iter;
 
   if (buffer == NULL)
     return;
 
   gtk_text_buffer_set_text (buffer, "", 0);
+  gtk_text_buffer_get_start_iter (buffer, &iter);
 
   gsize n_lines = git_annotated_source_get_n_lines (source);
 
@@ -233,10 +503,76 @@ copy_source_to_text_view (GtkTextView *text_view,
       const GitAnnotatedSourceLine *line =
         git_annotated_source_get_line (source, i);
 
-      copy_string_to_buffer (buffer, line->text);
+      copy_line_to_buffer (buffer, &iter, line->text);
     }
 }
 
+/* Replaces a line that was cut short with the whole line. This is only
+   done on request because laying it out can take a long time. */
+static void
+git_source_view_expand_line (GitSourceView *sview, gint line_num)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GtkTextBuffer *buffer;
+  GtkTextIter start, end;
+
+  if (priv->paint_source == NULL
+      || priv->text_view == NULL
+      || line_num < 0
+      || line_num >= git_annotated_source_get_n_lines (priv->paint_source))
+    return;
+
+  buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->text_view));
+
+  const gchar *text
+    = git_annotated_source_get_line (priv->paint_source, line_num)->text;
+  gsize length = strlen (text);
+
+  if (length > 0 && text[length - 1] == '\n')
+    length--;
+
+  gtk_text_buffer_get_iter_at_line (buffer, &start, line_num);
+  end = start;
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
+
+  gtk_text_buffer_delete (buffer, &start, &end);
+  copy_string_to_buffer (buffer, &start, text, length);
+}
+
+static void
+git_source_view_text_click_released_cb (GtkGestureClick *gesture,
+                                        gint n_press,
+                                        gdouble x,
+                                        gdouble y,
+                                        gpointer user_data)
+{
+  GitSourceView *sview = user_data;
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GtkTextView *text_view = GTK_TEXT_VIEW (priv->text_view);
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer (text_view);
+  GtkTextTag *tag;
+  GtkTextIter iter;
+  gint buffer_x, buffer_y;
+
+  if (buffer == NULL
+      || (tag = gtk_text_tag_table_lookup (gtk_text_buffer_get_tag_table
+                                           (buffer),
+                                           "elided")) == NULL)
+    return;
+
+  gtk_text_view_window_to_buffer_coords (text_view,
+                                         GTK_TEXT_WINDOW_WIDGET,
+                                         x, y,
+                                         &buffer_x, &buffer_y);
+
+  if (gtk_text_view_get_iter_at_location (text_view,
+                                          &iter,
+                                          buffer_x, buffer_y)
+      && gtk_text_iter_has_tag (&iter, tag))
+    git_source_view_expand_line (sview, gtk_text_iter_get_line (&iter));
+}
+
 static void
 git_source_view_on_commit_selected (GitHashView *source,
                                     GitCommit *commit,
@@ -248,16 +584,39 @@ git_source_view_on_commit_selected (GitHashView *source,
                  commit);
 }
 
+static void
+git_source_view_on_previous_selected (GitHashView *source,
+                                      GitCommit *previous_commit,
+                                      const gchar *previous_path,
+                                      GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GFile *repo;
+
+  if (priv->paint_source == NULL
+      || (repo = git_annotated_source_get_repo (priv->paint_source)) == NULL)
+    return;
+
+  /* The path is relative to the top of the repo and might not be the
+     file currently shown if it was renamed */
+  GFile *file = g_file_resolve_relative_path (repo, previous_path);
+
+  g_signal_emit (sview,
+                 client_signals[BLAME_PREVIOUS],
+                 0,
+                 file,
+                 previous_commit);
+
+  g_object_unref (file);
+}
+
 static void
 hide_progress_bar (GitSourceView *sview)
 {
   GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
 
   if (priv->progress_bar)
-    {
-      remove_pulse_timeout (sview);
-      gtk_widget_set_visible (priv->progress_bar, FALSE);
-    }
+    gtk_widget_set_visible (priv->progress_bar, FALSE);
 }
 
 static void
@@ -271,103 +630,1188 @@ set_error_state (GitSourceView *sview, const GError *error)
   if (priv->source_box)
     gtk_widget_set_visible (priv->source_box, FALSE);
 
+  if (priv->refine_box)
+    gtk_widget_set_visible (priv->refine_box, FALSE);
+
   if (priv->error_label)
     gtk_label_set_text (GTK_LABEL (priv->error_label), error->message);
+
+  if (priv->blame_anyway_button)
+    gtk_widget_set_visible (priv->blame_anyway_button, FALSE);
+}
+
+/* The part of the file that is being looked at, remembered so that
+   it can be found again in a different revision */
+typedef struct
+{
+  gint top_line;
+  gint cursor_line, cursor_offset;
+  gint bound_line, bound_offset;
+} GitSourceViewPosition;
+
+static void
+get_text_view_position (GtkTextView *text_view,
+                        GitSourceViewPosition *position)
+{
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer (text_view);
+  GdkRectangle visible_rect;
+  GtkTextIter iter;
+
+  gtk_text_view_get_visible_rect (text_view, &visible_rect);
+  gtk_text_view_get_line_at_y (text_view, &iter, visible_rect.y, NULL);
+  position->top_line = gtk_text_iter_get_line (&iter);
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter,
+                                    gtk_text_buffer_get_insert (buffer));
+  position->cursor_line = gtk_text_iter_get_line (&iter);
+  position->cursor_offset = gtk_text_iter_get_line_offset (&iter);
+
+  gtk_text_buffer_get_iter_at_mark (buffer, &iter,
+                                    gtk_text_buffer_get_selection_bound (buffer));
+  position->bound_line = gtk_text_iter_get_line (&iter);
+  position->bound_offset = gtk_text_iter_get_line_offset (&iter);
 }
 
 static void
-git_source_view_on_completed (GitAnnotatedSource *source,
-                              const GError *error,
-                              GitSourceView *sview)
+map_line_position (GArray *matches,
+                   guint n_lines,
+                   gint *line,
+                   gint *offset)
 {
-  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  gboolean exact;
 
-  hide_progress_bar (sview);
+  *line = git_line_diff_map_line (matches, *line, n_lines, &exact);
 
-  if (error)
-    set_error_state (sview, error);
-  else
+  /* The column only means anything if the line is the same */
+  if (offset && !exact)
+    *offset = 0;
+}
+
+static void
+get_iter_at_line_offset (GtkTextBuffer *buffer,
+                         GtkTextIter *iter,
+                         gint line,
+                         gint offset)
+{
+  gtk_text_buffer_get_iter_at_line (buffer, iter, line);
+
+  if (offset > 0 && !gtk_text_iter_ends_line (iter))
     {
-      /* Forget the old painting source */
-      if (priv->paint_source)
-        g_object_unref (priv->paint_source);
-      /* Use the loading source to paint with */
-      priv->paint_source = g_object_ref (source);
+      GtkTextIter line_end = *iter;
+
+      gtk_text_iter_forward_to_line_end (&line_end);
+      gtk_text_iter_set_line_offset
+        (iter, MIN (offset, gtk_text_iter_get_line_offset (&line_end)));
+    }
+}
+
+/* Moves the view and the selection to the lines in the new source that
+   correspond to where they were in the old source, so that moving to
+   a different revision keeps showing the same code */
+static void
+map_text_view_position (GtkTextView *text_view,
+                        GitAnnotatedSource *old_source,
+                        GitAnnotatedSource *new_source,
+                        const GitSourceViewPosition *old_position)
+{
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer (text_view);
+  guint old_n_lines = git_annotated_source_get_n_lines (old_source);
+  guint new_n_lines = git_annotated_source_get_n_lines (new_source);
+  GitSourceViewPosition position = *old_position;
+  GtkTextIter cursor, bound;
+  GtkTextMark *top_mark;
+  GArray *matches;
+
+  if (buffer == NULL || old_n_lines == 0 || new_n_lines == 0)
+    return;
+
+  /* Lines with the same hash are taken to be the same. It doesn’t
+     matter if this is occasionally wrong because the result is only
+     used to guess where to scroll to. */
+  matches = git_line_diff_ids (git_annotated_source_get_line_hashes
+                               (old_source),
+                               old_n_lines,
+                               git_annotated_source_get_line_hashes
+                               (new_source),
+                               new_n_lines,
+                               GIT_SOURCE_VIEW_MAP_MAX_COST);
+
+  map_line_position (matches, new_n_lines, &position.top_line, NULL);
+  map_line_position (matches, new_n_lines,
+                     &position.cursor_line, &position.cursor_offset);
+  map_line_position (matches, new_n_lines,
+                     &position.bound_line, &position.bound_offset);
+
+  g_array_free (matches, TRUE);
+
+  get_iter_at_line_offset (buffer, &cursor,
+                           position.cursor_line, position.cursor_offset);
+  get_iter_at_line_offset (buffer, &bound,
+                           position.bound_line, position.bound_offset);
+  gtk_text_buffer_select_range (buffer, &cursor, &bound);
+
+  /* The text view can only scroll once the new text has been laid out
+     so this needs a mark rather than an iter */
+  get_iter_at_line_offset (buffer, &cursor, position.top_line, 0);
+  top_mark = gtk_text_buffer_get_mark (buffer, "git-source-view-top");
+  if (top_mark)
+    gtk_text_buffer_move_mark (buffer, top_mark, &cursor);
+  else
+    top_mark = gtk_text_buffer_create_mark (buffer, "git-source-view-top",
+                                            &cursor, TRUE);
 
-      if (priv->text_view)
-        copy_source_to_text_view (GTK_TEXT_VIEW (priv->text_view), source);
+  gtk_text_view_scroll_to_mark (text_view, top_mark, 0.0, TRUE, 0.0, 0.0);
+}
 
-      if (priv->hash_view)
-        git_hash_view_set_source (GIT_HASH_VIEW (priv->hash_view), source);
+static void
+git_source_view_update_refining (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  /* The old source might still be refining behind an error */
+  gboolean refining = (priv->paint_source
+                       && git_annotated_source_get_refining
+                       (priv->paint_source)
+                       && priv->source_box
+                       && gtk_widget_get_visible (priv->source_box));
+
+  if (priv->refine_box)
+    gtk_widget_set_visible (priv->refine_box, refining);
+  if (priv->refine_spinner)
+    gtk_spinner_set_spinning (GTK_SPINNER (priv->refine_spinner), refining);
+}
 
-      if (priv->error_box)
-        gtk_widget_set_visible (priv->error_box, FALSE);
+static void
+git_source_view_set_paint_source (GitSourceView *sview,
+                                  GitAnnotatedSource *source)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GitAnnotatedSource *old_source = priv->paint_source;
+  GitSourceViewPosition position;
+
+  if (old_source && priv->text_view)
+    get_text_view_position (GTK_TEXT_VIEW (priv->text_view), &position);
+
+  /* Keep hold of the old painting source until the position has been
+     mapped over to the new one */
+  if (old_source)
+    g_signal_handler_disconnect (old_source, priv->paint_refining_handler);
+  priv->paint_source = g_object_ref (source);
+  priv->paint_refining_handler
+    = g_signal_connect_swapped (source, "refining-changed",
+                                G_CALLBACK (git_source_view_update_refining),
+                                sview);
+
+  if (priv->text_view)
+    {
+      copy_source_to_text_view (GTK_TEXT_VIEW (priv->text_view), source);
 
-      if (priv->source_box)
-        gtk_widget_set_visible (priv->source_box, TRUE);
+      if (old_source && old_source != source)
+        map_text_view_position (GTK_TEXT_VIEW (priv->text_view),
+                                old_source, source, &position);
     }
 
-  git_source_view_unref_loading_source (sview);
+  if (old_source)
+    g_object_unref (old_source);
+
+  if (priv->hash_view)
+    git_hash_view_set_source (GIT_HASH_VIEW (priv->hash_view), source);
+
+  if (priv->error_box)
+    gtk_widget_set_visible (priv->error_box, FALSE);
+
+  if (priv->source_box)
+    gtk_widget_set_visible (priv->source_box, TRUE);
+
+  git_source_view_update_refining (sview);
 }
 
 static gboolean
-pulse_cb (gpointer user_data)
+sources_have_same_text (GitAnnotatedSource *a,
+                        GitAnnotatedSource *b)
+{
+  gsize n_lines = git_annotated_source_get_n_lines (a);
+
+  if (git_annotated_source_get_n_lines (b) != n_lines)
+    return FALSE;
+
+  for (gsize i = 0; i < n_lines; i++)
+    {
+      if (strcmp (git_annotated_source_get_line (a, i)->text,
+                  git_annotated_source_get_line (b, i)->text))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+git_source_view_reblame (GitSourceView *sview)
 {
-  GitSourceView *sview = user_data;
   GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
 
-  if (priv->progress_bar)
+  priv->refresh_pending = FALSE;
+  priv->reblame_pending = FALSE;
+
+  if (priv->refresh_cancellable)
     {
-      gtk_progress_bar_pulse (GTK_PROGRESS_BAR (priv->progress_bar));
-      return G_SOURCE_CONTINUE;
+      g_cancellable_cancel (priv->refresh_cancellable);
+      g_clear_object (&priv->refresh_cancellable);
     }
-  else
+
+  /* The blame also picks up any changes to the file */
+  git_source_view_load (sview, priv->file, NULL, priv->load_guarded);
+}
+
+static void
+refresh_with_contents (GitSourceView *sview,
+                       const gchar *contents,
+                       gsize length)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  g_clear_object (&priv->refresh_cancellable);
+
+  if (priv->working_copy_blamed)
     {
-      priv->pulse_timeout = 0;
-      return G_SOURCE_REMOVE;
+      GitAnnotatedSource *source
+        = git_annotated_source_new_edited (priv->paint_source,
+                                           contents, length);
+
+      /* After a lot of edits the diff against the old blame is slow
+         and more likely to match the wrong lines */
+      if (git_annotated_source_get_n_edited_lines (source)
+          > GIT_SOURCE_VIEW_MAX_EDITED_LINES)
+        git_source_view_reblame (sview);
+      /* Editors often save without changing anything */
+      else if (!sources_have_same_text (priv->paint_source, source))
+        git_source_view_set_paint_source (sview, source);
+
+      g_object_unref (source);
     }
 }
 
-void
-git_source_view_set_file (GitSourceView *sview,
-                          GFile *file,
-                          const gchar *revision)
+static void
+refresh_contents_cb (GObject *object,
+                     GAsyncResult *result,
+                     gpointer user_data)
 {
+  GitSourceView *sview = user_data;
   GError *error = NULL;
+  gchar *contents;
+  gsize length;
 
-  g_return_if_fail (GIT_IS_SOURCE_VIEW (sview));
-  g_return_if_fail (file != NULL);
+  if (!g_file_load_contents_finish (G_FILE (object), result,
+                                    &contents, &length,
+                                    NULL /* etag */,
+                                    &error))
+    {
+      /* The view might have been destroyed if it was cancelled.
+         Otherwise the file has probably been deleted in which case
+         keep showing the last version. */
+      g_error_free (error);
+      return;
+    }
 
-  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  refresh_with_contents (sview, contents, length);
 
-  /* If we're currently trying to load some source then cancel it */
-  git_source_view_unref_loading_source (sview);
+  g_free (contents);
+}
 
-  priv->load_source = git_annotated_source_new ();
-  priv->loading_completed_handler
-    = g_signal_connect (priv->load_source, "completed",
-                        G_CALLBACK (git_source_view_on_completed), sview);
+static void
+refresh_info_cb (GObject *object,
+                 GAsyncResult *result,
+                 gpointer user_data)
+{
+  GitSourceView *sview = user_data;
+  GError *error = NULL;
+  GFileInfo *info;
 
-  if (git_annotated_source_fetch (priv->load_source,
-                                  file, revision,
-                                  &error))
+  info = g_file_query_info_finish (G_FILE (object), result, &error);
+
+  if (info == NULL)
     {
-      if (priv->progress_bar)
-        {
-          gtk_widget_set_visible (priv->progress_bar, TRUE);
-          gtk_progress_bar_pulse (GTK_PROGRESS_BAR (priv->progress_bar));
+      /* Same as for loading the contents */
+      g_error_free (error);
+      return;
+    }
 
-          if (priv->pulse_timeout == 0)
-            priv->pulse_timeout = g_timeout_add (100, pulse_cb, sview);
-        }
+  /* A symlink is blamed as the path that it points to, the same as
+     when the blame is loaded */
+  if (g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK)
+    {
+      const gchar *target = g_file_info_get_symlink_target (info);
+
+      if (target)
+        refresh_with_contents (sview, target, strlen (target));
     }
   else
     {
-      set_error_state (sview, error);
-      git_source_view_unref_loading_source (sview);
+      GitSourceViewPrivate *priv =
+        git_source_view_get_instance_private (sview);
 
-      hide_progress_bar (sview);
+      g_file_load_contents_async (G_FILE (object),
+                                  priv->refresh_cancellable,
+                                  refresh_contents_cb,
+                                  sview);
+    }
 
-      g_error_free (error);
+  g_object_unref (info);
+}
+
+static gboolean
+refresh_timeout_cb (gpointer user_data)
+{
+  GitSourceView *sview = user_data;
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  priv->refresh_timeout = 0;
+
+  /* HEAD or the index changed so the attribution of lines that
+     haven’t been edited might be wrong too */
+  if (priv->reblame_pending)
+    {
+      git_source_view_reblame (sview);
+      return G_SOURCE_REMOVE;
+    }
+
+  /* If the blame is still running it might have read the file before
+     it changed so refresh again once it finishes */
+  if (priv->load_source)
+    {
+      priv->refresh_pending = TRUE;
+      return G_SOURCE_REMOVE;
+    }
+
+  if (!priv->working_copy_blamed)
+    return G_SOURCE_REMOVE;
+
+  if (priv->refresh_cancellable)
+    {
+      g_cancellable_cancel (priv->refresh_cancellable);
+      g_object_unref (priv->refresh_cancellable);
     }
+
+  priv->refresh_cancellable = g_cancellable_new ();
+
+  g_file_query_info_async (priv->file,
+                           G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                           G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
+                           G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                           G_PRIORITY_DEFAULT,
+                           priv->refresh_cancellable,
+                           refresh_info_cb,
+                           sview);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_refresh (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  /* Restart the timeout so that a burst of changes only causes one
+     refresh */
+  if (priv->refresh_timeout)
+    g_source_remove (priv->refresh_timeout);
+
+  priv->refresh_timeout = g_timeout_add (GIT_SOURCE_VIEW_REFRESH_DELAY,
+                                         refresh_timeout_cb,
+                                         sview);
+}
+
+static void
+queue_reblame (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  priv->reblame_pending = TRUE;
+  queue_refresh (sview);
+}
+
+static void
+git_source_view_on_file_changed (GFileMonitor *monitor,
+                                 GFile *file,
+                                 GFile *other_file,
+                                 GFileMonitorEvent event_type,
+                                 GitSourceView *sview)
+{
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      queue_refresh (sview);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+git_source_view_on_index_changed (GFileMonitor *monitor,
+                                  GFile *file,
+                                  GFile *other_file,
+                                  GFileMonitorEvent event_type,
+                                  GitSourceView *sview)
+{
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      queue_reblame (sview);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/* Watches the index of the repo so that the working copy can be
+   blamed again after something like git reset or git stash */
+static void
+git_source_view_start_index_monitor (GitSourceView *sview, GFile *repo)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GFile *git_dir = git_find_git_dir (repo);
+  GFile *index = g_file_get_child (git_dir, "index");
+
+  /* Git writes a new index and renames it over the old one */
+  priv->index_monitor = g_file_monitor_file (index,
+                                             G_FILE_MONITOR_WATCH_MOVES,
+                                             NULL /* cancellable */,
+                                             NULL /* error */);
+
+  if (priv->index_monitor)
+    priv->index_changed_handler
+      = g_signal_connect (priv->index_monitor, "changed",
+                          G_CALLBACK (git_source_view_on_index_changed),
+                          sview);
+
+  g_object_unref (index);
+  g_object_unref (git_dir);
+}
+
+static void
+git_source_view_start_monitor (GitSourceView *sview, GFile *file)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  /* Editors that save by writing a new file and renaming it over the
+     old one would otherwise look like the file was deleted */
+  priv->monitor = g_file_monitor_file (file,
+                                       G_FILE_MONITOR_WATCH_MOVES,
+                                       NULL /* cancellable */,
+                                       NULL /* error */);
+
+  if (priv->monitor)
+    priv->monitor_changed_handler
+      = g_signal_connect (priv->monitor, "changed",
+                          G_CALLBACK (git_source_view_on_file_changed),
+                          sview);
+}
+
+static void
+git_source_view_on_completed (GitAnnotatedSource *source,
+                              const GError *error,
+                              GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  hide_progress_bar (sview);
+
+  if (error)
+    {
+      set_error_state (sview, error);
+
+      /* Let the user decide whether a big or binary file is worth
+         blaming */
+      if ((g_error_matches (error, GIT_ERROR, GIT_ERROR_TOO_LARGE)
+           || g_error_matches (error, GIT_ERROR, GIT_ERROR_BINARY))
+          && (git_annotated_source_get_guard_action (source)
+              != GIT_ANNOTATED_SOURCE_GUARD_REFUSE)
+          && priv->blame_anyway_button)
+        gtk_widget_set_visible (priv->blame_anyway_button, TRUE);
+    }
+  else
+    {
+      /* Use the loading source to paint with if the text wasn’t
+         already shown while the blame was running */
+      if (priv->paint_source != source)
+        git_source_view_set_paint_source (sview, source);
+
+      /* Changes to the working copy are applied to this blame */
+      if (priv->monitor)
+        priv->working_copy_blamed = TRUE;
+    }
+
+  git_source_view_unref_loading_source (sview);
+
+  if (priv->refresh_pending)
+    {
+      priv->refresh_pending = FALSE;
+      queue_refresh (sview);
+    }
+}
+
+static gchar *
+format_time_left (gint seconds)
+{
+  if (seconds < 120)
+    return g_strdup_printf (ngettext ("about %d second left",
+                                      "about %d seconds left",
+                                      seconds),
+                            seconds);
+  else
+    {
+      gint minutes = (seconds + 30) / 60;
+
+      return g_strdup_printf (ngettext ("about %d minute left",
+                                        "about %d minutes left",
+                                        minutes),
+                              minutes);
+    }
+}
+
+static void
+update_progress_bar (GitSourceView *sview,
+                     guint n_attributed_lines,
+                     guint n_lines)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (priv->progress_bar == NULL)
+    return;
+
+  GtkProgressBar *bar = GTK_PROGRESS_BAR (priv->progress_bar);
+
+  /* The total isn’t known until the text has loaded */
+  if (n_lines == 0)
+    {
+      gtk_progress_bar_set_text (bar, _("Blaming…"));
+      gtk_progress_bar_pulse (bar);
+      return;
+    }
+
+  gdouble fraction = MIN (n_attributed_lines / (gdouble) n_lines, 1.0);
+  gint64 now = g_get_monotonic_time ();
+
+  if (priv->progress_start_fraction < 0.0)
+    {
+      priv->progress_start_time = now;
+      priv->progress_start_fraction = fraction;
+    }
+
+  gtk_progress_bar_set_fraction (bar, fraction);
+
+  gchar *lines_text = g_strdup_printf (ngettext ("%u of %u line",
+                                                 "%u of %u lines",
+                                                 n_lines),
+                                       n_attributed_lines,
+                                       n_lines);
+  gdouble done = fraction - priv->progress_start_fraction;
+  gint64 elapsed = now - priv->progress_start_time;
+
+  /* Wait until there is something to go on before guessing */
+  if (done > 0.0 && elapsed >= G_USEC_PER_SEC)
+    {
+      gdouble left = elapsed * (1.0 - fraction) / done / G_USEC_PER_SEC;
+      gchar *left_text = format_time_left ((gint) (left + 0.5));
+      gchar *text = g_strconcat (lines_text, ", ", left_text, NULL);
+
+      gtk_progress_bar_set_text (bar, text);
+
+      g_free (text);
+      g_free (left_text);
+    }
+  else
+    gtk_progress_bar_set_text (bar, lines_text);
+
+  g_free (lines_text);
+}
+
+static void
+show_progress_bar (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  guint n_attributed_lines = 0, n_lines = 0;
+
+  if (priv->progress_bar == NULL)
+    return;
+
+  gtk_widget_set_visible (priv->progress_bar, TRUE);
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (priv->progress_bar), 0.0);
+
+  priv->progress_start_fraction = -1.0;
+
+  if (priv->load_source)
+    git_annotated_source_get_progress (priv->load_source,
+                                       &n_attributed_lines,
+                                       &n_lines);
+
+  update_progress_bar (sview, n_attributed_lines, n_lines);
+}
+
+static void
+git_source_view_on_progress (GitAnnotatedSource *source,
+                             guint n_attributed_lines,
+                             guint n_lines,
+                             GitSourceView *sview)
+{
+  update_progress_bar (sview, n_attributed_lines, n_lines);
+}
+
+static void
+git_source_view_on_text_changed (GitAnnotatedSource *source,
+                                 GitSourceView *sview)
+{
+  /* Show the text straight away and let the hash view fill in the
+     commits as the blame reaches them */
+  git_source_view_set_paint_source (sview, source);
+}
+
+static void
+git_source_view_set_loading_source (GitSourceView *sview,
+                                    GitAnnotatedSource *source)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  priv->load_source = source;
+  priv->loading_completed_handler
+    = g_signal_connect (source, "completed",
+                        G_CALLBACK (git_source_view_on_completed), sview);
+  priv->loading_text_changed_handler
+    = g_signal_connect (source, "text-changed",
+                        G_CALLBACK (git_source_view_on_text_changed), sview);
+  priv->loading_progress_handler
+    = g_signal_connect (source, "progress",
+                        G_CALLBACK (git_source_view_on_progress), sview);
+
+  if (git_annotated_source_get_text_loaded (source))
+    git_source_view_set_paint_source (sview, source);
+}
+
+/* Loads the blame for the file. If guarded is FALSE then it is
+   blamed even if it is too big or looks like a binary file. */
+static void
+git_source_view_load (GitSourceView *sview,
+                      GFile *file,
+                      const gchar *revision,
+                      gboolean guarded)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  GError *error = NULL;
+
+  /* If we're currently trying to load some source then cancel it */
+  git_source_view_unref_loading_source (sview);
+
+  priv->working_copy_blamed = FALSE;
+
+  g_free (priv->load_revision);
+  priv->load_revision = g_strdup (revision);
+  priv->load_guarded = guarded;
+
+  GitAnnotatedSource *source = NULL;
+
+  /* The cached source might be one that is still checking the file */
+  if (priv->cache && guarded)
+    source = git_source_cache_lookup (priv->cache, file, revision,
+                                      priv->refine);
+
+  if (source)
+    {
+      /* Another view may have already loaded the same source or it
+         might still be loading it. Either way we can share it. */
+      if (git_annotated_source_get_completed (source))
+        {
+          hide_progress_bar (sview);
+          git_source_view_set_paint_source (sview, source);
+          g_object_unref (source);
+        }
+      else
+        {
+          git_source_view_set_loading_source (sview, source);
+          show_progress_bar (sview);
+        }
+
+      return;
+    }
+
+  git_source_view_set_loading_source (sview, git_annotated_source_new ());
+
+  /* Most commits will end up being looked at in the commit dialog so
+     get their details in one go once the blame is finished */
+  git_annotated_source_set_prefetch_commits (priv->load_source, TRUE);
+  /* Show the recent changes quickly and then look further back and
+     follow lines that were moved or copied */
+  git_annotated_source_set_progressive (priv->load_source, priv->refine);
+  git_annotated_source_set_detect_copies (priv->load_source, priv->refine);
+
+  if (!guarded)
+    {
+      git_annotated_source_set_max_size (priv->load_source, 0);
+      git_annotated_source_set_check_binary (priv->load_source, FALSE);
+    }
+
+  if (git_annotated_source_fetch (priv->load_source,
+                                  file, revision,
+                                  &error))
+    {
+      if (priv->cache)
+        git_source_cache_add (priv->cache, file, revision, priv->refine,
+                              priv->load_source);
+
+      show_progress_bar (sview);
+    }
+  else
+    {
+      set_error_state (sview, error);
+      git_source_view_unref_loading_source (sview);
+
+      hide_progress_bar (sview);
+
+      g_error_free (error);
+    }
+}
+
+static void
+git_source_view_on_resolved (GitRefResolver *resolver,
+                             const GError *error,
+                             GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (error)
+    {
+      /* If something is already shown then it is better to keep
+         showing it than to replace it with an error. A repo without
+         any commits yet has no HEAD but the working copy can still be
+         shown. */
+      if (priv->resolved_hash == NULL && priv->revision)
+        {
+          hide_progress_bar (sview);
+          set_error_state (sview, error);
+        }
+
+      return;
+    }
+
+  const gchar *hash = git_ref_resolver_get_hash (resolver);
+
+  if (priv->revision == NULL)
+    {
+      /* The first time is only to find out where HEAD started. After
+         that a commit or checkout changes what the lines are blamed
+         on. */
+      if (priv->resolved_hash && strcmp (priv->resolved_hash, hash))
+        queue_reblame (sview);
+
+      g_free (priv->resolved_hash);
+      priv->resolved_hash = g_strdup (hash);
+
+      return;
+    }
+
+  if (priv->cache)
+    git_source_cache_set_resolved (priv->cache, priv->file,
+                                   priv->revision, hash);
+
+  /* Nothing to do if the revision hasn’t moved */
+  if (priv->resolved_hash && !strcmp (priv->resolved_hash, hash))
+    return;
+
+  g_free (priv->resolved_hash);
+  priv->resolved_hash = g_strdup (hash);
+
+  /* Blaming the hash rather than the symbolic name means the result
+     can be cached */
+  git_source_view_load (sview, priv->file, hash, TRUE);
+}
+
+static void
+git_source_view_on_repo_found (GObject *object,
+                               GAsyncResult *result,
+                               gpointer user_data)
+{
+  GitSourceView *sview = user_data;
+  GError *error = NULL;
+  GFile *repo = git_find_repo_finish (G_FILE (object), result, &error);
+
+  /* The view might have been destroyed if it was cancelled */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  g_clear_object (&priv->repo_cancellable);
+
+  if (repo)
+    {
+      if (priv->revision)
+        git_ref_resolver_start (priv->ref_resolver, repo, priv->revision,
+                                &error);
+      else
+        {
+          /* Failing to watch the working copy isn’t worth showing an
+             error for */
+          git_source_view_start_index_monitor (sview, repo);
+          git_ref_resolver_start (priv->ref_resolver, repo, "HEAD", NULL);
+        }
+
+      g_object_unref (repo);
+    }
+
+  if (error)
+    {
+      if (priv->revision)
+        {
+          hide_progress_bar (sview);
+          set_error_state (sview, error);
+        }
+
+      g_error_free (error);
+    }
+}
+
+/* Finds the repo of the file and starts resolving the revision, or
+   HEAD for the working copy */
+static void
+git_source_view_start_resolver (GitSourceView *sview, GFile *file)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (priv->ref_resolver == NULL)
+    {
+      priv->ref_resolver = git_ref_resolver_new ();
+      priv->resolved_handler
+        = g_signal_connect (priv->ref_resolver, "completed",
+                            G_CALLBACK (git_source_view_on_resolved),
+                            sview);
+    }
+
+  priv->repo_cancellable = g_cancellable_new ();
+
+  git_find_repo_async (file,
+                       priv->repo_cancellable,
+                       git_source_view_on_repo_found,
+                       sview);
+}
+
+/* Shows whatever the symbolic revision pointed to last time straight
+   away and then checks in the background whether it has moved */
+static void
+git_source_view_resolve (GitSourceView *sview,
+                         GFile *file,
+                         const gchar *revision)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+  const gchar *hash;
+
+  priv->revision = g_strdup (revision);
+
+  if (priv->cache
+      && (hash = git_source_cache_get_resolved (priv->cache,
+                                                file, revision)))
+    {
+      GitAnnotatedSource *source
+        = git_source_cache_lookup (priv->cache, file, hash, priv->refine);
+
+      if (source)
+        {
+          if (git_annotated_source_get_completed (source))
+            {
+              priv->resolved_hash = g_strdup (hash);
+              hide_progress_bar (sview);
+              git_source_view_set_paint_source (sview, source);
+            }
+
+          g_object_unref (source);
+        }
+    }
+
+  if (priv->resolved_hash == NULL)
+    show_progress_bar (sview);
+
+  git_source_view_start_resolver (sview, file);
+}
+
+void
+git_source_view_set_file (GitSourceView *sview,
+                          GFile *file,
+                          const gchar *revision)
+{
+  g_return_if_fail (GIT_IS_SOURCE_VIEW (sview));
+  g_return_if_fail (file != NULL);
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  /* If we're currently trying to load some source then cancel it */
+  git_source_view_unref_loading_source (sview);
+
+  git_source_view_stop_monitor (sview);
+  git_source_view_stop_resolver (sview);
+
+  g_object_ref (file);
+  if (priv->file)
+    g_object_unref (priv->file);
+  priv->file = file;
+
+  if (revision == NULL)
+    {
+      /* Only the working copy can change */
+      git_source_view_start_monitor (sview, file);
+      git_source_view_start_resolver (sview, file);
+    }
+  else if (!git_is_object_id (revision))
+    {
+      /* Branch names and the like can move */
+      git_source_view_resolve (sview, file, revision);
+      return;
+    }
+
+  git_source_view_load (sview, file, revision, TRUE);
+}
+
+static void
+git_source_view_blame_anyway (GitSourceView *sview)
+{
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (priv->file == NULL)
+    return;
+
+  gchar *revision = g_strdup (priv->load_revision);
+
+  git_source_view_load (sview, priv->file, revision, FALSE);
+
+  g_free (revision);
+}
+
+void
+git_source_view_set_cache (GitSourceView *sview,
+                           GitSourceCache *cache)
+{
+  g_return_if_fail (GIT_IS_SOURCE_VIEW (sview));
+  g_return_if_fail (cache == NULL || GIT_IS_SOURCE_CACHE (cache));
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (cache)
+    g_object_ref (cache);
+
+  if (priv->cache)
+    g_object_unref (priv->cache);
+
+  priv->cache = cache;
+}
+
+/* Sets whether the blame first looks at the recent history and then
+   refines it in the background, finishing with a pass that follows
+   lines that were moved or copied. The current file is blamed again
+   if it changes. */
+void
+git_source_view_set_refine (GitSourceView *sview,
+                            gboolean refine)
+{
+  g_return_if_fail (GIT_IS_SOURCE_VIEW (sview));
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  refine = !!refine;
+
+  if (priv->refine == refine)
+    return;
+
+  priv->refine = refine;
+
+  /* A symbolic revision that is still being resolved will be loaded
+     with the new setting when it is done */
+  if (priv->file == NULL || (priv->revision && priv->resolved_hash == NULL))
+    return;
+
+  gchar *revision = g_strdup (priv->load_revision);
+
+  git_source_view_load (sview, priv->file, revision, priv->load_guarded);
+
+  g_free (revision);
+}
+
+gboolean
+git_source_view_get_refine (GitSourceView *sview)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_VIEW (sview), FALSE);
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  return priv->refine;
+}
+
+/* Gets the range of lines covered by the selection, or just the line
+   with the cursor if nothing is selected. Line numbers count from 1.
+   Returns FALSE if no source is being shown. */
+gboolean
+git_source_view_get_selected_lines (GitSourceView *sview,
+                                    guint *start_line,
+                                    guint *end_line)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_VIEW (sview), FALSE);
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (priv->paint_source == NULL
+      || priv->text_view == NULL
+      || git_annotated_source_get_n_lines (priv->paint_source) == 0)
+    return FALSE;
+
+  GtkTextBuffer *buffer
+    = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->text_view));
+  guint n_lines = git_annotated_source_get_n_lines (priv->paint_source);
+  GtkTextIter start, end;
+
+  if (gtk_text_buffer_get_selection_bounds (buffer, &start, &end)
+      && gtk_text_iter_starts_line (&end)
+      && gtk_text_iter_get_line (&end) > gtk_text_iter_get_line (&start))
+    /* A selection of whole lines ends at the start of the next one */
+    gtk_text_iter_backward_char (&end);
+
+  *start_line = MIN (gtk_text_iter_get_line (&start) + 1, n_lines);
+  *end_line = MIN (gtk_text_iter_get_line (&end) + 1, n_lines);
+
+  return TRUE;
+}
+
+/* Hashes a line without its line ending so that the text from the
+   working copy matches the text from the object database even if a
+   filter converted the line endings */
+static guint64
+hash_line_text (const gchar *text, gsize length)
+{
+  if (length > 0 && text[length - 1] == '\n')
+    length--;
+  if (length > 0 && text[length - 1] == '\r')
+    length--;
+
+  return git_line_diff_hash (text, length);
+}
+
+/* Maps lines of the working copy that count from 1 to the same lines
+   in the given blob. Lines that were added are moved to the closest
+   line that is still there. */
+static void
+map_lines_to_blob (GitAnnotatedSource *source,
+                   GBytes *blob,
+                   guint *start_line,
+                   guint *end_line)
+{
+  const gchar *blob_text = g_bytes_get_data (blob, NULL);
+  guint n_lines = git_annotated_source_get_n_lines (source);
+  guint n_blob_lines, i;
+  guint *blob_starts = git_line_diff_split (blob_text,
+                                            g_bytes_get_size (blob),
+                                            &n_blob_lines);
+  guint64 *hashes = g_new (guint64, MAX (n_lines, 1));
+  guint64 *blob_hashes = g_new (guint64, MAX (n_blob_lines, 1));
+  GArray *matches;
+
+  for (i = 0; i < n_lines; i++)
+    {
+      const gchar *text = git_annotated_source_get_line (source, i)->text;
+
+      if (text == NULL)
+        text = "";
+
+      hashes[i] = hash_line_text (text, strlen (text));
+    }
+
+  for (i = 0; i < n_blob_lines; i++)
+    blob_hashes[i] = hash_line_text (blob_text + blob_starts[i],
+                                     blob_starts[i + 1] - blob_starts[i]);
+
+  matches = git_line_diff_ids (hashes, n_lines,
+                               blob_hashes, n_blob_lines,
+                               0 /* max_cost */);
+
+  *start_line = git_line_diff_map_line (matches, *start_line - 1,
+                                        n_blob_lines, NULL) + 1;
+  *end_line = git_line_diff_map_line (matches, *end_line - 1,
+                                      n_blob_lines, NULL) + 1;
+
+  *start_line = MIN (*start_line, n_blob_lines);
+  *end_line = CLAMP (*end_line, *start_line, n_blob_lines);
+
+  g_array_free (matches, TRUE);
+  g_free (blob_hashes);
+  g_free (hashes);
+  g_free (blob_starts);
+}
+
+/* Gets the selected lines as a range that can be passed to git log -L
+   along with the revision to start from. git log can’t look at the
+   working copy so in that case the lines are mapped to where they are
+   in the commit at HEAD. Returns FALSE if there are no lines to show
+   the history of, including when the file isn’t in HEAD. */
+gboolean
+git_source_view_get_history_range (GitSourceView *sview,
+                                   gchar **revision,
+                                   guint *start_line,
+                                   guint *end_line)
+{
+  g_return_val_if_fail (GIT_IS_SOURCE_VIEW (sview), FALSE);
+
+  GitSourceViewPrivate *priv = git_source_view_get_instance_private (sview);
+
+  if (!git_source_view_get_selected_lines (sview, start_line, end_line))
+    return FALSE;
+
+  if (priv->revision)
+    {
+      *revision = g_strdup (priv->revision);
+      return TRUE;
+    }
+
+  GFile *repo = git_annotated_source_get_repo (priv->paint_source);
+  GitOid commit, blob_oid;
+
+  if (repo == NULL
+      || priv->file == NULL
+      || priv->resolved_hash == NULL
+      || !git_oid_from_hex (&commit, priv->resolved_hash))
+    return FALSE;
+
+  gchar *path = g_file_get_relative_path (repo, priv->file);
+
+  if (path == NULL)
+    return FALSE;
+
+  GitObjectDb *db
+    = git_commit_bag_get_object_db (git_commit_bag_get_default (), repo);
+  GBytes *blob = NULL;
+
+  if (git_object_db_find_blob_at_path (db, &commit, path, &blob_oid, NULL))
+    blob = git_object_db_read_blob (db, &blob_oid, NULL);
+
+  g_free (path);
+
+  if (blob == NULL || g_bytes_get_size (blob) == 0)
+    {
+      if (blob)
+        g_bytes_unref (blob);
+      return FALSE;
+    }
+
+  map_lines_to_blob (priv->paint_source, blob, start_line, end_line);
+
+  g_bytes_unref (blob);
+
+  *revision = g_strdup (priv->resolved_hash);
+
+  return TRUE;
 }
@@ -20,6 +20,7 @@
 
 #include <gtk/gtk.h>
 #include "git-commit.h"
+#include "git-source-cache.h"
 
 G_BEGIN_DECLS
 
@@ -37,6 +38,9 @@ struct _GitSourceViewClass
 
   void (* commit_selected) (GitSourceView *source_view,
                             GitCommit *commit);
+  void (* blame_previous) (GitSourceView *source_view,
+                           GFile *file,
+                           GitCommit *commit);
 };
 
 GtkWidget *git_source_view_new (void);
@@ -45,6 +49,21 @@ void git_source_view_set_file (GitSourceView *sview,
                                GFile *file,
                                const gchar *revision);
 
+void git_source_view_set_cache (GitSourceView *sview,
+                                GitSourceCache *cache);
+
+void git_source_view_set_refine (GitSourceView *sview,
+                                 gboolean refine);
+gboolean git_source_view_get_refine (GitSourceView *sview);
+
+gboolean git_source_view_get_selected_lines (GitSourceView *sview,
+                                             guint *start_line,
+                                             guint *end_line);
+gboolean git_source_view_get_history_range (GitSourceView *sview,
+                                            gchar **revision,
+                                            guint *start_line,
+                                            guint *end_line);
+
 G_END_DECLS
 
 #endif /* __GIT_SOURCE_VIEW_H__ */
@@ -0,0 +1,239 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "git-commit-graph.h"
+#include "git-oid.h"
+#include "test-repo.h"
+
+static GitCommitGraph *
+open_graph (const gchar *repo)
+{
+  gchar *git_dir = g_build_filename (repo, ".git", NULL);
+  GFile *common_dir = g_file_new_for_path (git_dir);
+  GitCommitGraph *graph = git_commit_graph_new (common_dir);
+
+  g_object_unref (common_dir);
+  g_free (git_dir);
+
+  return graph;
+}
+
+/* Checks the parents of every commit against git rev-list. Returns
+   the number of commits that were found in the graph. */
+static guint
+check_parents (const gchar *repo)
+{
+  GitCommitGraph *graph = open_graph (repo);
+  gchar *list = test_repo_git (repo, "rev-list", "--all", "--parents", NULL);
+  gchar **lines = g_strsplit (list, "\n", -1);
+  GArray *parents = g_array_new (FALSE, FALSE, sizeof (GitOid));
+  guint n_found = 0;
+
+  for (guint i = 0; lines[i] && *lines[i]; i++)
+    {
+      gchar **hashes = g_strsplit (lines[i], " ", -1);
+      guint n_parents = g_strv_length (hashes) - 1;
+      GitOid oid;
+
+      g_assert_true (git_oid_from_hex (&oid, hashes[0]));
+
+      g_array_set_size (parents, 0);
+
+      if (git_commit_graph_get_parents (graph, &oid, parents))
+        {
+          g_assert_cmpuint (parents->len, ==, n_parents);
+
+          for (guint j = 0; j < n_parents; j++)
+            {
+              gchar hex[GIT_OID_MAX_HEX_LENGTH + 1];
+
+              git_oid_to_hex (&g_array_index (parents, GitOid, j), hex);
+              g_assert_cmpstr (hex, ==, hashes[j + 1]);
+            }
+
+          n_found++;
+        }
+      else
+        {
+          /* The parents are left alone if the commit isn’t found */
+          g_assert_cmpuint (parents->len, ==, 0);
+        }
+
+      g_strfreev (hashes);
+    }
+
+  g_array_free (parents, TRUE);
+  g_strfreev (lines);
+  g_free (list);
+  g_object_unref (graph);
+
+  return n_found;
+}
+
+static guint
+count_commits (const gchar *repo)
+{
+  gchar *count = test_repo_git (repo, "rev-list", "--all", "--count", NULL);
+  guint ret = atoi (count);
+
+  g_free (count);
+
+  return ret;
+}
+
+/* Makes history with a normal merge and an octopus merge. Commits
+   with more than two parents are stored differently in the graph. */
+static void
+make_merges (const gchar *repo, const gchar *prefix)
+{
+  gchar *base = g_strconcat (prefix, "-base", NULL);
+
+  g_free (test_repo_commit_file (repo, base, "base\n"));
+
+  for (guint i = 0; i < 4; i++)
+    {
+      gchar *branch = g_strdup_printf ("%s-%u", prefix, i);
+      gchar *path = g_strconcat (branch, ".txt", NULL);
+
+      g_free (test_repo_git (repo, "checkout", "--quiet", "-b", branch,
+                             NULL));
+      g_free (test_repo_commit_file (repo, path, branch));
+      g_free (test_repo_git (repo, "checkout", "--quiet", "-", NULL));
+
+      g_free (path);
+      g_free (branch);
+    }
+
+  gchar *b0 = g_strconcat (prefix, "-0", NULL);
+  gchar *b1 = g_strconcat (prefix, "-1", NULL);
+  gchar *b2 = g_strconcat (prefix, "-2", NULL);
+  gchar *b3 = g_strconcat (prefix, "-3", NULL);
+
+  g_free (test_repo_git (repo, "merge", "--quiet", "--no-ff",
+                         "-m", "Merge", b0, NULL));
+  g_free (test_repo_git (repo, "merge", "--quiet", "--no-ff",
+                         "-m", "Octopus", b1, b2, b3, NULL));
+
+  g_free (b3);
+  g_free (b2);
+  g_free (b1);
+  g_free (b0);
+  g_free (base);
+}
+
+static void
+test_parents (void)
+{
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  gchar *repo = test_repo_new ();
+
+  make_merges (repo, "first");
+
+  /* Without a graph nothing is found */
+  g_assert_cmpuint (check_parents (repo), ==, 0);
+
+  g_free (test_repo_git (repo, "commit-graph", "write", "--reachable",
+                         NULL));
+  g_assert_cmpuint (check_parents (repo), ==, count_commits (repo));
+
+  /* Commits made after the graph was written aren’t in it */
+  g_free (test_repo_commit_file (repo, "late.txt", "late\n"));
+  g_assert_cmpuint (check_parents (repo), ==, count_commits (repo) - 1);
+
+  test_repo_free (repo);
+}
+
+static void
+test_split (void)
+{
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  gchar *repo = test_repo_new ();
+
+  make_merges (repo, "first");
+  g_free (test_repo_git (repo, "commit-graph", "write", "--reachable",
+                         "--split", NULL));
+
+  /* The second layer has merges whose parents are in the first */
+  make_merges (repo, "second");
+  g_free (test_repo_git (repo, "commit-graph", "write", "--reachable",
+                         "--split=no-merge", NULL));
+
+  g_assert_cmpuint (check_parents (repo), ==, count_commits (repo));
+
+  test_repo_free (repo);
+}
+
+static void
+test_replaced (void)
+{
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  gchar *repo = test_repo_new ();
+
+  make_merges (repo, "first");
+  g_free (test_repo_git (repo, "commit-graph", "write", "--reachable",
+                         NULL));
+
+  /* git ignores the graph once the history is altered so the
+     parents that it has might be wrong */
+  g_free (test_repo_git (repo, "replace", "--graft", "HEAD", NULL));
+  g_assert_cmpuint (check_parents (repo), ==, 0);
+
+  /* Packing the replace ref mustn’t hide it */
+  g_free (test_repo_git (repo, "pack-refs", "--all", NULL));
+  g_assert_cmpuint (check_parents (repo), ==, 0);
+
+  g_free (test_repo_git (repo, "replace", "-d", "HEAD", NULL));
+  g_assert_cmpuint (check_parents (repo), ==, count_commits (repo));
+
+  test_repo_free (repo);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  test_repo_init ();
+
+  g_test_add_func ("/commit-graph/parents", test_parents);
+  g_test_add_func ("/commit-graph/split", test_split);
+  g_test_add_func ("/commit-graph/replaced", test_replaced);
+
+  return g_test_run ();
+}
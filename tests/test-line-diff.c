@@ -0,0 +1,261 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "git-line-diff.h"
+
+static void
+test_split (void)
+{
+  static const struct
+  {
+    const gchar *text;
+    guint n_lines;
+    guint starts[4];
+  } tests[] =
+    {
+      { "", 0, { 0 } },
+      { "a", 1, { 0, 1 } },
+      { "a\n", 1, { 0, 2 } },
+      { "a\nbc\n", 2, { 0, 2, 5 } },
+      { "a\n\nbc", 3, { 0, 2, 3, 5 } },
+    };
+
+  for (guint i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      guint n_lines;
+      guint *starts = git_line_diff_split (tests[i].text,
+                                           strlen (tests[i].text),
+                                           &n_lines);
+
+      g_assert_cmpuint (n_lines, ==, tests[i].n_lines);
+      g_assert_cmpmem (starts, (n_lines + 1) * sizeof (guint),
+                       tests[i].starts, (n_lines + 1) * sizeof (guint));
+
+      g_free (starts);
+    }
+}
+
+static void
+test_hash (void)
+{
+  gchar buf[80], copy[sizeof buf + 2];
+
+  for (guint i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  /* The hash mustn’t depend on where the text is in memory or on
+     anything past its end */
+  for (guint length = 0; length <= sizeof buf; length++)
+    {
+      guint64 hash = git_line_diff_hash (buf, length);
+
+      memcpy (copy + 1, buf, length);
+      copy[1 + length] = 'x';
+      g_assert_cmpuint (git_line_diff_hash (copy + 1, length), ==, hash);
+
+      if (length > 0)
+        {
+          g_assert_cmpuint (git_line_diff_hash (buf, length - 1), !=, hash);
+
+          copy[length] ^= 1;
+          g_assert_cmpuint (git_line_diff_hash (copy + 1, length), !=, hash);
+        }
+    }
+}
+
+/* Checks that the matches are in order, don’t overlap and only pair
+   up equal lines. Returns the number of matched lines. */
+static guint
+check_matches (GArray *matches,
+               const gchar * const *a, guint a_n,
+               const gchar * const *b, guint b_n)
+{
+  guint a_next = 0, b_next = 0, n_matched = 0;
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const GitLineDiffMatch *match
+        = &g_array_index (matches, GitLineDiffMatch, i);
+
+      g_assert_cmpuint (match->n_lines, >, 0);
+      g_assert_cmpuint (match->a_line, >=, a_next);
+      g_assert_cmpuint (match->b_line, >=, b_next);
+      g_assert_cmpuint (match->a_line + match->n_lines, <=, a_n);
+      g_assert_cmpuint (match->b_line + match->n_lines, <=, b_n);
+
+      for (guint j = 0; j < match->n_lines; j++)
+        g_assert_cmpstr (a[match->a_line + j], ==, b[match->b_line + j]);
+
+      a_next = match->a_line + match->n_lines;
+      b_next = match->b_line + match->n_lines;
+      n_matched += match->n_lines;
+    }
+
+  return n_matched;
+}
+
+static guint
+longest_common_subsequence (const gchar * const *a, guint a_n,
+                            const gchar * const *b, guint b_n)
+{
+  guint *lengths = g_new0 (guint, (a_n + 1) * (b_n + 1));
+  guint ret;
+
+  for (guint i = a_n; i-- > 0;)
+    for (guint j = b_n; j-- > 0;)
+      {
+        guint *l = lengths + i * (b_n + 1) + j;
+
+        if (!strcmp (a[i], b[j]))
+          *l = l[b_n + 2] + 1;
+        else
+          *l = MAX (l[b_n + 1], l[1]);
+      }
+
+  ret = lengths[0];
+
+  g_free (lengths);
+
+  return ret;
+}
+
+static gchar **
+random_lines (guint n_lines, guint n_symbols)
+{
+  gchar **lines = g_new (gchar *, n_lines + 1);
+
+  for (guint i = 0; i < n_lines; i++)
+    lines[i] = g_strdup_printf ("%c\n",
+                                'a' + g_test_rand_int_range (0, n_symbols));
+
+  lines[n_lines] = NULL;
+
+  return lines;
+}
+
+/* Compares random texts made from only a few different lines so that
+   there are lots of ways to match them up */
+static void
+test_random (void)
+{
+  for (guint iteration = 0; iteration < 2000; iteration++)
+    {
+      guint a_n = g_test_rand_int_range (0, 16);
+      guint b_n = g_test_rand_int_range (0, 16);
+      guint n_symbols = g_test_rand_int_range (1, 5);
+      gchar **a = random_lines (a_n, n_symbols);
+      gchar **b = random_lines (b_n, n_symbols);
+      const gchar * const *ca = (const gchar * const *) a;
+      const gchar * const *cb = (const gchar * const *) b;
+      guint lcs = longest_common_subsequence (ca, a_n, cb, b_n);
+      gchar *a_text = g_strjoinv ("", a);
+      gchar *b_text = g_strjoinv ("", b);
+      guint a_split_n, b_split_n;
+      guint *a_starts = git_line_diff_split (a_text, strlen (a_text),
+                                             &a_split_n);
+      guint *b_starts = git_line_diff_split (b_text, strlen (b_text),
+                                             &b_split_n);
+      GArray *matches;
+
+      g_assert_cmpuint (a_split_n, ==, a_n);
+      g_assert_cmpuint (b_split_n, ==, b_n);
+
+      /* Without a max_cost the diff is minimal */
+      matches = git_line_diff (a_text, a_starts, a_n,
+                               b_text, b_starts, b_n);
+      g_assert_cmpuint (check_matches (matches, ca, a_n, cb, b_n), ==, lcs);
+      g_array_free (matches, TRUE);
+
+      matches = git_line_diff_strings (ca, a_n, cb, b_n, 0);
+      g_assert_cmpuint (check_matches (matches, ca, a_n, cb, b_n), ==, lcs);
+      g_array_free (matches, TRUE);
+
+      /* With one it can give up early but the matches must still be
+         right */
+      matches = git_line_diff_strings (ca, a_n, cb, b_n, 2);
+      g_assert_cmpuint (check_matches (matches, ca, a_n, cb, b_n), <=, lcs);
+      g_array_free (matches, TRUE);
+
+      g_free (b_starts);
+      g_free (a_starts);
+      g_free (b_text);
+      g_free (a_text);
+      g_strfreev (b);
+      g_strfreev (a);
+    }
+}
+
+static void
+test_map_line (void)
+{
+  static const gchar * const a[] =
+    { "one", "two", "three", "four", "five" };
+  static const gchar * const b[] =
+    { "zero", "one", "2", "2.5", "three", "five" };
+  static const struct
+  {
+    guint line, mapped;
+    gboolean exact;
+  } tests[] =
+    {
+      { 0, 1, TRUE },
+      /* A changed line stays the same distance after the previous
+         unchanged one */
+      { 1, 2, FALSE },
+      { 2, 4, TRUE },
+      /* A removed line can’t go past the next unchanged one */
+      { 3, 5, FALSE },
+      { 4, 5, TRUE },
+      /* Lines past the end stay in the text */
+      { 10, 5, FALSE },
+    };
+  GArray *matches = git_line_diff_strings (a, G_N_ELEMENTS (a),
+                                           b, G_N_ELEMENTS (b),
+                                           0);
+
+  for (guint i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      gboolean exact;
+
+      g_assert_cmpuint (git_line_diff_map_line (matches,
+                                                tests[i].line,
+                                                G_N_ELEMENTS (b),
+                                                &exact),
+                        ==, tests[i].mapped);
+      g_assert_cmpint (exact, ==, tests[i].exact);
+    }
+
+  g_array_free (matches, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/line-diff/split", test_split);
+  g_test_add_func ("/line-diff/hash", test_hash);
+  g_test_add_func ("/line-diff/random", test_random);
+  g_test_add_func ("/line-diff/map-line", test_map_line);
+
+  return g_test_run ();
+}
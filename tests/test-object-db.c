@@ -0,0 +1,316 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "git-common.h"
+#include "git-object-db.h"
+#include "git-oid.h"
+#include "test-repo.h"
+
+/* Reads every object in the repo with GitObjectDb and checks that it
+   matches what git cat-file gives */
+static void
+check_all_objects (const gchar *repo)
+{
+  gchar *git_dir = g_build_filename (repo, ".git", NULL);
+  GFile *common_dir = g_file_new_for_path (git_dir);
+  GitObjectDb *db = git_object_db_new (common_dir);
+  GBytes *batch = test_repo_git_bytes (repo,
+                                       "cat-file",
+                                       "--batch-all-objects",
+                                       "--batch",
+                                       NULL);
+  gsize length;
+  const gchar *p = g_bytes_get_data (batch, &length);
+  const gchar *end = p + length;
+  guint n_objects = 0;
+
+  /* Each object is a line with its id, type and size followed by the
+     contents and a newline */
+  while (p < end)
+    {
+      const gchar *eol = memchr (p, '\n', end - p);
+      gchar *header, **parts;
+      GitObjectType type, expected_type;
+      GError *error = NULL;
+      guint64 size;
+      GitOid oid;
+      GBytes *data;
+
+      g_assert_nonnull (eol);
+      header = g_strndup (p, eol - p);
+      parts = g_strsplit (header, " ", 3);
+      g_assert_cmpuint (g_strv_length (parts), ==, 3);
+
+      g_assert_true (git_oid_from_hex (&oid, parts[0]));
+
+      if (!strcmp (parts[1], "commit"))
+        expected_type = GIT_OBJECT_TYPE_COMMIT;
+      else if (!strcmp (parts[1], "tree"))
+        expected_type = GIT_OBJECT_TYPE_TREE;
+      else if (!strcmp (parts[1], "blob"))
+        expected_type = GIT_OBJECT_TYPE_BLOB;
+      else
+        expected_type = GIT_OBJECT_TYPE_TAG;
+
+      size = g_ascii_strtoull (parts[2], NULL, 10);
+      p = eol + 1;
+      g_assert_cmpuint (end - p, >, size);
+
+      data = git_object_db_read (db, &oid, &type, &error);
+      g_assert_no_error (error);
+      g_assert_cmpint (type, ==, expected_type);
+      g_assert_cmpmem (g_bytes_get_data (data, NULL),
+                       g_bytes_get_size (data),
+                       p, size);
+
+      /* There is always a nul byte after the data */
+      g_assert_cmpint (((const gchar *) g_bytes_get_data (data, NULL))[size],
+                       ==,
+                       '\0');
+
+      p += size + 1;
+      n_objects++;
+
+      g_bytes_unref (data);
+      g_strfreev (parts);
+      g_free (header);
+    }
+
+  g_assert_cmpuint (n_objects, >, 0);
+
+  g_bytes_unref (batch);
+  g_object_unref (db);
+  g_object_unref (common_dir);
+  g_free (git_dir);
+}
+
+/* Makes some history with enough similar versions of a file that
+   packing it makes deltas */
+static void
+make_history (const gchar *repo, guint n_commits)
+{
+  GString *text = g_string_new (NULL);
+  guint i;
+
+  for (i = 0; i < n_commits; i++)
+    {
+      g_string_append_printf (text, "Line %u of a file that keeps growing\n",
+                              i);
+      g_free (test_repo_commit_file (repo, "file.txt", text->str));
+
+      if (i % 4 == 0)
+        {
+          gchar *other = g_strdup_printf ("Version %u\n", i);
+          g_free (test_repo_commit_file (repo, "dir/other.txt", other));
+          g_free (other);
+        }
+    }
+
+  g_string_free (text, TRUE);
+}
+
+static void
+test_cat_file (void)
+{
+  gchar *repo;
+
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  repo = test_repo_new ();
+
+  make_history (repo, 20);
+  g_free (test_repo_git (repo, "tag", "-a", "-m", "A tag", "v1", NULL));
+
+  /* Loose objects only */
+  check_all_objects (repo);
+
+  /* Packed with deltas plus some loose objects on top */
+  g_free (test_repo_git (repo, "gc", "--quiet", "--aggressive", NULL));
+  make_history (repo, 5);
+  check_all_objects (repo);
+
+  test_repo_free (repo);
+}
+
+static void
+test_alternates (void)
+{
+  gchar *repo, *clone_parent, *clone, *relative, *alternates;
+  GError *error = NULL;
+
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  repo = test_repo_new ();
+  make_history (repo, 10);
+  g_free (test_repo_git (repo, "gc", "--quiet", NULL));
+  make_history (repo, 3);
+
+  clone_parent = g_dir_make_tmp ("blame-browse-test-XXXXXX", &error);
+  g_assert_no_error (error);
+  clone = g_build_filename (clone_parent, "clone", NULL);
+
+  g_free (test_repo_git (clone_parent,
+                         "clone", "--quiet", "--shared", repo, clone,
+                         NULL));
+
+  /* Use a relative path to check that it is taken relative to the
+     objects directory */
+  relative = g_strdup_printf ("# A comment\n"
+                              "../../../../%s/.git/objects\n",
+                              strrchr (repo, G_DIR_SEPARATOR) + 1);
+  alternates = g_build_filename (clone, ".git", "objects",
+                                 "info", "alternates",
+                                 NULL);
+  g_file_set_contents (alternates, relative, -1, NULL);
+
+  g_free (test_repo_commit_file (clone, "new.txt", "Only in the clone\n"));
+
+  check_all_objects (clone);
+
+  g_free (alternates);
+  g_free (relative);
+  g_free (clone);
+  test_repo_free (clone_parent);
+  test_repo_free (repo);
+}
+
+/* Writes a loose object with the header given and a little data
+   after it */
+static void
+write_loose_object (const gchar *repo, const gchar *hex, const gchar *header)
+{
+  gchar *dirname = g_strdup_printf ("%s/.git/objects/%.2s", repo, hex);
+  gchar *filename = g_strdup_printf ("%s/%s", dirname, hex + 2);
+  gsize header_length = strlen (header) + 1;
+  gsize raw_length = header_length + 3;
+  guint8 *raw = g_malloc (raw_length);
+  uLongf compressed_length = compressBound (raw_length);
+  guint8 *compressed = g_malloc (compressed_length);
+
+  memcpy (raw, header, header_length);
+  memcpy (raw + header_length, "abc", 3);
+
+  g_assert_cmpint (compress (compressed, &compressed_length,
+                             raw, raw_length),
+                   ==,
+                   Z_OK);
+
+  g_mkdir_with_parents (dirname, 0755);
+  g_file_set_contents (filename,
+                       (const gchar *) compressed, compressed_length,
+                       NULL);
+
+  g_free (compressed);
+  g_free (raw);
+  g_free (filename);
+  g_free (dirname);
+}
+
+static void
+test_bad_loose_size (void)
+{
+  static const char * const headers[] =
+    {
+      /* The right size */
+      "blob 3",
+      /* Far more than the compressed data could hold */
+      "blob 99999999999",
+      "blob 18446744073709551615",
+      "blob -3",
+      "blob 3x",
+      "blob ",
+    };
+  gchar *repo, *git_dir;
+  GFile *common_dir;
+  GitObjectDb *db;
+  guint i;
+
+  if (!test_repo_have_git ())
+    {
+      g_test_skip ("git is not available");
+      return;
+    }
+
+  repo = test_repo_new ();
+  git_dir = g_build_filename (repo, ".git", NULL);
+  common_dir = g_file_new_for_path (git_dir);
+  db = git_object_db_new (common_dir);
+
+  for (i = 0; i < G_N_ELEMENTS (headers); i++)
+    {
+      gchar *hex = g_strdup_printf ("%040x", i + 1);
+      GError *error = NULL;
+      GitOid oid;
+      GBytes *data;
+
+      write_loose_object (repo, hex, headers[i]);
+
+      g_assert_true (git_oid_from_hex (&oid, hex));
+      data = git_object_db_read (db, &oid, NULL, &error);
+
+      if (i == 0)
+        {
+          g_assert_no_error (error);
+          g_assert_cmpmem (g_bytes_get_data (data, NULL),
+                           g_bytes_get_size (data),
+                           "abc", 3);
+          g_bytes_unref (data);
+        }
+      else
+        {
+          g_assert_null (data);
+          g_assert_error (error, GIT_ERROR, GIT_ERROR_PARSE_ERROR);
+          g_error_free (error);
+        }
+
+      g_free (hex);
+    }
+
+  g_object_unref (db);
+  g_object_unref (common_dir);
+  g_free (git_dir);
+  test_repo_free (repo);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  test_repo_init ();
+
+  g_test_add_func ("/object-db/cat-file", test_cat_file);
+  g_test_add_func ("/object-db/alternates", test_alternates);
+  g_test_add_func ("/object-db/bad-loose-size", test_bad_loose_size);
+
+  return g_test_run ();
+}
@@ -0,0 +1,125 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "git-oid.h"
+
+#define SHA1_HEX "0123456789abcdef0123456789ABCDEF01234567"
+#define SHA256_HEX "fedcba9876543210fedcba9876543210" \
+                   "fedcba9876543210fedcba9876543210"
+
+static void
+test_parse (void)
+{
+  GitOid oid;
+  gchar hex[GIT_OID_MAX_HEX_LENGTH + 1];
+
+  g_assert_cmpuint (git_oid_parse_hex (&oid, SHA1_HEX, 40), ==, 40);
+  g_assert_cmpuint (oid.len, ==, GIT_OID_SHA1_LENGTH);
+  g_assert_cmpuint (oid.id[0], ==, 0x01);
+  g_assert_cmpuint (oid.id[19], ==, 0x67);
+  git_oid_to_hex (&oid, hex);
+  g_assert_cmpstr (hex, ==, "0123456789abcdef0123456789abcdef01234567");
+
+  g_assert_cmpuint (git_oid_parse_hex (&oid, SHA256_HEX, 64), ==, 64);
+  g_assert_cmpuint (oid.len, ==, GIT_OID_SHA256_LENGTH);
+  git_oid_to_hex (&oid, hex);
+  g_assert_cmpstr (hex, ==, SHA256_HEX);
+
+  /* The id can be followed by anything that isn’t a hex digit */
+  g_assert_cmpuint (git_oid_parse_hex (&oid, SHA1_HEX " 1 2 3", 46),
+                    ==, 40);
+  g_assert_cmpuint (git_oid_parse_hex (&oid, SHA1_HEX "\n", 41), ==, 40);
+
+  /* Only the length given is looked at */
+  g_assert_cmpuint (git_oid_parse_hex (&oid, SHA256_HEX, 40), ==, 40);
+  g_assert_cmpuint (oid.len, ==, GIT_OID_SHA1_LENGTH);
+}
+
+static void
+test_parse_invalid (void)
+{
+  static const gchar * const invalid[] =
+    {
+      "",
+      "0123",
+      /* One digit short and one digit too many */
+      "0123456789abcdef0123456789abcdef0123456",
+      SHA1_HEX "8",
+      /* Between the two lengths */
+      SHA1_HEX "89ab",
+      SHA256_HEX "0",
+      "g123456789abcdef0123456789abcdef01234567",
+      "0123456789abcdef0123456789abcdef0123456g",
+      " 0123456789abcdef0123456789abcdef01234567",
+    };
+  GitOid oid;
+
+  for (guint i = 0; i < G_N_ELEMENTS (invalid); i++)
+    {
+      g_assert_cmpuint (git_oid_parse_hex (&oid,
+                                           invalid[i],
+                                           strlen (invalid[i])),
+                        ==, 0);
+      g_assert_false (git_oid_from_hex (&oid, invalid[i]));
+    }
+
+  /* from_hex needs the whole string to be the id */
+  g_assert_false (git_oid_from_hex (&oid, SHA1_HEX " "));
+  g_assert_true (git_oid_from_hex (&oid, SHA1_HEX));
+}
+
+static void
+test_compare (void)
+{
+  GitOid a, b, zero;
+
+  g_assert_true (git_oid_from_hex (&a, SHA1_HEX));
+  g_assert_true (git_oid_from_hex (&b, SHA1_HEX));
+  g_assert_true (git_oid_equal (&a, &b));
+  g_assert_cmpuint (git_oid_hash (&a), ==, git_oid_hash (&b));
+  g_assert_cmpuint (git_oid_hash (&a), ==, 0x01234567);
+
+  b.id[19] ^= 1;
+  g_assert_false (git_oid_equal (&a, &b));
+
+  /* Ids of different lengths are never equal even if one is a prefix
+     of the other */
+  g_assert_true (git_oid_from_hex (&b, SHA1_HEX "89abcdef0123456789abcdef"));
+  g_assert_false (git_oid_equal (&a, &b));
+
+  g_assert_false (git_oid_is_zero (&a));
+  g_assert_true (git_oid_from_hex (&zero,
+                                   "0000000000000000000000000000000000000000"));
+  g_assert_true (git_oid_is_zero (&zero));
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/oid/parse", test_parse);
+  g_test_add_func ("/oid/parse-invalid", test_parse_invalid);
+  g_test_add_func ("/oid/compare", test_compare);
+
+  return g_test_run ();
+}
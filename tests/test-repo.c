@@ -0,0 +1,205 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "test-repo.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* Makes git ignore the user’s configuration and gives the commits a
+   fixed identity and date so that they are the same on every run */
+void
+test_repo_init (void)
+{
+  g_unsetenv ("GIT_DIR");
+  g_unsetenv ("GIT_WORK_TREE");
+  g_unsetenv ("GIT_COMMON_DIR");
+  g_unsetenv ("GIT_OBJECT_DIRECTORY");
+  g_unsetenv ("GIT_ALTERNATE_OBJECT_DIRECTORIES");
+  g_setenv ("GIT_CONFIG_NOSYSTEM", "1", TRUE);
+  g_setenv ("GIT_CONFIG_GLOBAL", "/dev/null", TRUE);
+  g_setenv ("GIT_AUTHOR_NAME", "Test", TRUE);
+  g_setenv ("GIT_AUTHOR_EMAIL", "test@example.com", TRUE);
+  g_setenv ("GIT_AUTHOR_DATE", "1700000000 +0000", TRUE);
+  g_setenv ("GIT_COMMITTER_NAME", "Test", TRUE);
+  g_setenv ("GIT_COMMITTER_EMAIL", "test@example.com", TRUE);
+  g_setenv ("GIT_COMMITTER_DATE", "1700000000 +0000", TRUE);
+}
+
+gboolean
+test_repo_have_git (void)
+{
+  gchar *path = g_find_program_in_path ("git");
+  gboolean ret = path != NULL;
+
+  g_free (path);
+
+  return ret;
+}
+
+static GBytes *
+test_repo_git_valist (const gchar *repo, va_list ap)
+{
+  GPtrArray *argv = g_ptr_array_new ();
+  GSubprocessLauncher *launcher;
+  GSubprocess *subprocess;
+  GBytes *out = NULL, *err = NULL;
+  GError *error = NULL;
+  const gchar *arg;
+
+  g_ptr_array_add (argv, (gpointer) "git");
+  while ((arg = va_arg (ap, const gchar *)))
+    g_ptr_array_add (argv, (gpointer) arg);
+  g_ptr_array_add (argv, NULL);
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE
+                                        | G_SUBPROCESS_FLAGS_STDERR_PIPE);
+  g_subprocess_launcher_set_cwd (launcher, repo);
+  subprocess = g_subprocess_launcher_spawnv (launcher,
+                                             (const gchar * const *)
+                                             argv->pdata,
+                                             &error);
+  g_assert_no_error (error);
+
+  g_subprocess_communicate (subprocess, NULL, NULL, &out, &err, &error);
+  g_assert_no_error (error);
+
+  if (!g_subprocess_get_successful (subprocess))
+    g_error ("git %s failed: %.*s",
+             (const gchar *) argv->pdata[1],
+             (int) g_bytes_get_size (err),
+             (const gchar *) g_bytes_get_data (err, NULL));
+
+  g_bytes_unref (err);
+  g_object_unref (subprocess);
+  g_object_unref (launcher);
+  g_ptr_array_free (argv, TRUE);
+
+  return out;
+}
+
+/* Runs git in repo and returns what it printed. The test fails if git
+   does. */
+GBytes *
+test_repo_git_bytes (const gchar *repo, ...)
+{
+  GBytes *out;
+  va_list ap;
+
+  va_start (ap, repo);
+  out = test_repo_git_valist (repo, ap);
+  va_end (ap);
+
+  return out;
+}
+
+/* The same but for output that is text */
+gchar *
+test_repo_git (const gchar *repo, ...)
+{
+  GBytes *out;
+  va_list ap;
+
+  va_start (ap, repo);
+  out = test_repo_git_valist (repo, ap);
+  va_end (ap);
+
+  return g_strndup (g_bytes_get_data (out, NULL), g_bytes_get_size (out));
+}
+
+gchar *
+test_repo_new (void)
+{
+  GError *error = NULL;
+  gchar *repo = g_dir_make_tmp ("blame-browse-test-XXXXXX", &error);
+
+  g_assert_no_error (error);
+
+  g_free (test_repo_git (repo, "init", "--quiet", NULL));
+
+  return repo;
+}
+
+static void
+test_repo_remove_dir (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          gchar *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR)
+              && !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+            test_repo_remove_dir (child);
+          else
+            g_unlink (child);
+
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+void
+test_repo_free (gchar *repo)
+{
+  test_repo_remove_dir (repo);
+  g_free (repo);
+}
+
+void
+test_repo_write_file (const gchar *repo,
+                      const gchar *path,
+                      const gchar *contents)
+{
+  gchar *filename = g_build_filename (repo, path, NULL);
+  gchar *dirname = g_path_get_dirname (filename);
+  GError *error = NULL;
+
+  g_mkdir_with_parents (dirname, 0755);
+  g_file_set_contents (filename, contents, -1, &error);
+  g_assert_no_error (error);
+
+  g_free (dirname);
+  g_free (filename);
+}
+
+/* Writes the file, commits it and returns the hash of the commit */
+gchar *
+test_repo_commit_file (const gchar *repo,
+                       const gchar *path,
+                       const gchar *contents)
+{
+  test_repo_write_file (repo, path, contents);
+
+  g_free (test_repo_git (repo, "add", "--", path, NULL));
+  g_free (test_repo_git (repo,
+                         "commit", "--quiet", "-m", path,
+                         NULL));
+
+  return g_strchomp (test_repo_git (repo, "rev-parse", "HEAD", NULL));
+}
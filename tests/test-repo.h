@@ -0,0 +1,46 @@
+/* This file is part of blame-browse.
+ * Copyright (C) 2026  Neil Roberts  <bpeeluk@yahoo.co.uk>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_REPO_H__
+#define __TEST_REPO_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Helpers for tests that need a real repository. The repositories
+   are made with git in a temporary directory and the environment is
+   set up so that the user’s configuration can’t affect them. */
+
+void test_repo_init (void);
+gboolean test_repo_have_git (void);
+
+gchar *test_repo_new (void);
+void test_repo_free (gchar *repo);
+
+GBytes *test_repo_git_bytes (const gchar *repo, ...) G_GNUC_NULL_TERMINATED;
+gchar *test_repo_git (const gchar *repo, ...) G_GNUC_NULL_TERMINATED;
+void test_repo_write_file (const gchar *repo,
+                           const gchar *path,
+                           const gchar *contents);
+gchar *test_repo_commit_file (const gchar *repo,
+                              const gchar *path,
+                              const gchar *contents);
+
+G_END_DECLS
+
+#endif /* __TEST_REPO_H__ */